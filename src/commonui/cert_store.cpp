@@ -1,7 +1,18 @@
 #include "cert_store.h"
 
+#include <libfilezilla/hash.hpp>
 #include <libfilezilla/iputils.hpp>
 
+#include <string_view>
+
+size_t cert_store::cert_key_hash::operator()(cert_key const& key) const
+{
+	size_t h = std::hash<std::string_view>()(std::string_view(reinterpret_cast<char const*>(key.fingerprint.data()), key.fingerprint.size()));
+	h ^= std::hash<std::string>()(key.host) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	h ^= std::hash<unsigned int>()(key.port) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	return h;
+}
+
 bool cert_store::IsTrusted(fz::tls_session_info const& info)
 {
 	if (info.get_algorithm_warnings() != 0) {
@@ -34,69 +45,92 @@ bool cert_store::IsInsecure(std::string const& host, unsigned int port, bool per
 
 bool cert_store::HasCertificate(std::string const& host, unsigned int port)
 {
-	for (auto const& cert : data_[session].trusted_certs_) {
-		if (cert.host == host && cert.port == port) {
-			return true;
-		}
+	cert_key const key{host, port, {}};
+	if (data_[session].trusted_hosts_.count(key)) {
+		return true;
 	}
 
 	LoadTrustedCerts();
 
-	for (auto const& cert : data_[persistent].trusted_certs_) {
-		if (cert.host == host && cert.port == port) {
-			return true;
-		}
+	return data_[persistent].trusted_hosts_.count(key) != 0;
+}
+
+bool cert_store::DoIsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& fingerprint, data const& d, bool allowSans)
+{
+	if (d.trusted_index_.count({host, port, fingerprint})) {
+		return true;
+	}
+
+	if (allowSans && fz::get_address_type(host) == fz::address_type::unknown) {
+		return d.trusted_sans_.count({std::string(), port, fingerprint}) != 0;
 	}
 
 	return false;
 }
 
-bool cert_store::DoIsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& data, std::list<cert_store::t_certData> const& trustedCerts, bool allowSans)
+bool cert_store::IsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& data, bool permanentOnly, bool allowSans)
 {
-	if (!data.size()) {
+	if (data.empty()) {
 		return false;
 	}
 
-	bool const dnsname = fz::get_address_type(host) == fz::address_type::unknown;
+	auto const fingerprint = fz::sha256(data);
+	bool trusted = DoIsTrusted(host, port, fingerprint, data_[persistent], allowSans);
+	if (!trusted && !permanentOnly) {
+		trusted = DoIsTrusted(host, port, fingerprint, data_[session], allowSans);
+	}
 
-	for (auto const& cert : trustedCerts) {
-		if (port != cert.port) {
-			continue;
-		}
+	return trusted;
+}
 
-		if (cert.data != data) {
-			continue;
-		}
+bool cert_store::AddTrustedCert(data & d, t_certData && cert)
+{
+	cert.fingerprint = fz::sha256(cert.data);
 
-		if (host != cert.host) {
-			if (!dnsname || !allowSans || !cert.trustSans) {
-				continue;
-			}
-		}
+	cert_key key{cert.host, cert.port, cert.fingerprint};
+	if (d.trusted_index_.count(key)) {
+		return false;
+	}
 
-		return true;
+	auto it = d.trusted_certs_.emplace(d.trusted_certs_.end(), std::move(cert));
+	if (it->trustSans) {
+		++d.trusted_sans_[{std::string(), it->port, it->fingerprint}];
 	}
+	++d.trusted_hosts_[{it->host, it->port, {}}];
+	d.trusted_index_.emplace(std::move(key), it);
 
-	return false;
+	return true;
 }
 
-bool cert_store::IsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& data, bool permanentOnly, bool allowSans)
+void cert_store::RemoveTrustedCerts(data & d, std::string const& host, unsigned int port)
 {
-	bool trusted = DoIsTrusted(host, port, data, data_[persistent].trusted_certs_, allowSans);
-	if (!trusted && !permanentOnly) {
-		trusted = DoIsTrusted(host, port, data, data_[session].trusted_certs_, allowSans);
+	auto hosts = d.trusted_hosts_.find({host, port, {}});
+	if (hosts == d.trusted_hosts_.end()) {
+		return;
 	}
+	d.trusted_hosts_.erase(hosts);
 
-	return trusted;
+	for (auto it = d.trusted_certs_.begin(); it != d.trusted_certs_.end(); ) {
+		if (it->host != host || it->port != port) {
+			++it;
+			continue;
+		}
+
+		if (it->trustSans) {
+			auto sans = d.trusted_sans_.find({std::string(), port, it->fingerprint});
+			if (sans != d.trusted_sans_.end() && !--sans->second) {
+				d.trusted_sans_.erase(sans);
+			}
+		}
+		d.trusted_index_.erase({host, port, it->fingerprint});
+		it = d.trusted_certs_.erase(it);
+	}
 }
 
 void cert_store::SetInsecure(std::string const& host, unsigned int port, bool permanent)
 {
 	// A host can't be both trusted and insecure
-	data_[session].trusted_certs_.erase(
-		std::remove_if(data_[session].trusted_certs_.begin(), data_[session].trusted_certs_.end(), [&host, &port](t_certData const& cert) { return cert.host == host && cert.port == port; }),
-		data_[session].trusted_certs_.end()
-	);
+	RemoveTrustedCerts(data_[session], host, port);
 
 	if (!permanent) {
 		data_[session].insecure_hosts_.emplace(std::make_tuple(host, port));
@@ -108,10 +142,7 @@ void cert_store::SetInsecure(std::string const& host, unsigned int port, bool pe
 	}
 
 	// A host can't be both trusted and insecure
-	data_[persistent].trusted_certs_.erase(
-		std::remove_if(data_[persistent].trusted_certs_.begin(), data_[persistent].trusted_certs_.end(), [&host, &port](t_certData const& cert) { return cert.host == host && cert.port == port; }),
-		data_[persistent].trusted_certs_.end()
-	);
+	RemoveTrustedCerts(data_[persistent], host, port);
 
 	data_[persistent].insecure_hosts_.emplace(std::make_tuple(host, port));
 }
@@ -156,7 +187,7 @@ void cert_store::SetTrusted(fz::tls_session_info const& info, bool permanent, bo
 	data_[session].insecure_hosts_.erase(std::make_tuple(cert.host, cert.port));
 
 	if (!permanent) {
-		data_[session].trusted_certs_.emplace_back(std::move(cert));
+		AddTrustedCert(data_[session], std::move(cert));
 		return;
 	}
 
@@ -167,7 +198,7 @@ void cert_store::SetTrusted(fz::tls_session_info const& info, bool permanent, bo
 	// A host can't be both trusted and insecure
 	data_[persistent].insecure_hosts_.erase({cert.host, cert.port});
 
-	data_[persistent].trusted_certs_.emplace_back(std::move(cert));
+	AddTrustedCert(data_[persistent], std::move(cert));
 }
 
 bool cert_store::DoSetTrusted(t_certData const& cert, fz::x509_certificate const&)
@@ -206,6 +237,6 @@ void cert_store::SetSessionResumptionSupport(std::string const& host, unsigned s
 		return;
 	}
 
-	data_[persistent].ftp_tls_resumption_support_.emplace(std::make_tuple(host, port), secure);
+	data_[persistent].ftp_tls_resumption_support_[std::make_tuple(host, port)] = secure;
 	data_[session].ftp_tls_resumption_support_.erase({host, port});
 }
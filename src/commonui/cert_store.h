@@ -11,6 +11,7 @@
 #include <set>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 class FZCUI_PUBLIC_SYMBOL cert_store
@@ -34,6 +35,9 @@ protected:
 		bool trustSans{};
 		unsigned int port{};
 		std::vector<uint8_t> data;
+
+		// SHA-256 of the data, set by AddTrustedCert
+		std::vector<uint8_t> fingerprint;
 	};
 
 	virtual bool DoSetTrusted(t_certData const& cert, fz::x509_certificate const&);
@@ -43,20 +47,52 @@ protected:
 
 protected:
 	bool IsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& data, bool permanentOnly, bool allowSans);
-	bool DoIsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& data, std::list<t_certData> const& trustedCerts, bool allowSans);
 
 	enum : size_t {
 		persistent,
 		session
 	};
 
+	// Trusted certificates are indexed by host and port plus the SHA-256
+	// fingerprint of the certificate.
+	struct cert_key final {
+		std::string host;
+		unsigned int port{};
+		std::vector<uint8_t> fingerprint;
+
+		bool operator==(cert_key const& op) const {
+			return port == op.port && host == op.host && fingerprint == op.fingerprint;
+		}
+	};
+
+	struct cert_key_hash final {
+		size_t operator()(cert_key const& key) const;
+	};
+
 	struct data final {
 		std::list<t_certData> trusted_certs_;
+
+		// Into trusted_certs_
+		std::unordered_map<cert_key, std::list<t_certData>::iterator, cert_key_hash> trusted_index_;
+
+		// Certificates trusted for all their hostnames, keyed without host
+		std::unordered_map<cert_key, size_t, cert_key_hash> trusted_sans_;
+
+		// Certificates per host and port, keyed without fingerprint
+		std::unordered_map<cert_key, size_t, cert_key_hash> trusted_hosts_;
+
 		std::set<std::tuple<std::string, unsigned int>> insecure_hosts_;
 		std::map<std::tuple<std::string, unsigned short>, bool> ftp_tls_resumption_support_;
 	};
 
 	data data_[2];
+
+	// Returns false if the certificate already is trusted for the host
+	bool AddTrustedCert(data & d, t_certData && cert);
+	void RemoveTrustedCerts(data & d, std::string const& host, unsigned int port);
+
+private:
+	bool DoIsTrusted(std::string const& host, unsigned int port, std::vector<uint8_t> const& fingerprint, data const& d, bool allowSans);
 };
 
 #endif
@@ -8,7 +8,9 @@
 #include <sys/stat.h>
 #endif
 
+#include <algorithm>
 #include <array>
+#include <deque>
 
 std::array<std::wstring, 4> const matchTypeXmlNames =
 	{ L"All", L"Any", L"None", L"Not all" };
@@ -33,7 +35,7 @@ bool CFilterCondition::set(t_filterType t, std::wstring const& v, int c, bool ma
 				return false;
 			}
 			try {
-				auto flags = std::regex_constants::ECMAScript;
+				auto flags = std::regex_constants::ECMAScript | std::regex_constants::optimize;
 				if (!matchCase) {
 					flags |= std::regex_constants::icase;
 				}
@@ -164,188 +166,471 @@ static bool StringMatch(std::wstring const& subject, CFilterCondition const& con
 	return match;
 }
 
-bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
+// Evaluates conditions other than name and path.
+// Returns false if the condition does not apply to the file.
+static bool MetaMatch(CFilterCondition const& c, int64_t size, int attributes, fz::datetime const& date, bool& matched)
 {
-	if (dir && !filter.filterDirs) {
-		return false;
-	}
-	else if (!dir && !filter.filterFiles) {
-		return false;
-	}
+	matched = false;
 
-	for (auto const& condition : filter.filters) {
-		bool match = false;
-
-		switch (condition.type)
+	switch (c.type)
+	{
+	case filter_size:
+		if (size == -1) {
+			return false;
+		}
+		switch (c.condition)
 		{
-		case filter_name:
-			match = StringMatch(name, condition, filter.matchCase);
+		case 0:
+			if (size > c.value) {
+				matched = true;
+			}
 			break;
-		case filter_path:
-			match = StringMatch(path, condition, filter.matchCase);
+		case 1:
+			if (size == c.value) {
+				matched = true;
+			}
 			break;
-		case filter_size:
-			if (size == -1) {
-				continue;
+		case 2:
+			if (size != c.value) {
+				matched = true;
 			}
-			switch (condition.condition)
+			break;
+		case 3:
+			if (size < c.value) {
+				matched = true;
+			}
+			break;
+		}
+		break;
+	case filter_attributes:
+#ifndef FZ_WINDOWS
+		return false;
+#else
+		if (!attributes) {
+			return false;
+		}
+
+		{
+			int flag = 0;
+			switch (c.condition)
 			{
 			case 0:
-				if (size > condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_ARCHIVE;
 				break;
 			case 1:
-				if (size == condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_COMPRESSED;
 				break;
 			case 2:
-				if (size != condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_ENCRYPTED;
 				break;
 			case 3:
-				if (size < condition.value) {
-					match = true;
-				}
+				flag = FILE_ATTRIBUTE_HIDDEN;
+				break;
+			case 4:
+				flag = FILE_ATTRIBUTE_READONLY;
+				break;
+			case 5:
+				flag = FILE_ATTRIBUTE_SYSTEM;
 				break;
-			}
-			break;
-		case filter_attributes:
-#ifndef FZ_WINDOWS
-			continue;
-#else
-			if (!attributes) {
-				continue;
 			}
 
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = FILE_ATTRIBUTE_ARCHIVE;
-					break;
-				case 1:
-					flag = FILE_ATTRIBUTE_COMPRESSED;
-					break;
-				case 2:
-					flag = FILE_ATTRIBUTE_ENCRYPTED;
-					break;
-				case 3:
-					flag = FILE_ATTRIBUTE_HIDDEN;
-					break;
-				case 4:
-					flag = FILE_ATTRIBUTE_READONLY;
-					break;
-				case 5:
-					flag = FILE_ATTRIBUTE_SYSTEM;
-					break;
-				}
-
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
-				}
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == c.value) {
+				matched = true;
 			}
+		}
 #endif //FZ_WINDOWS
-			break;
-		case filter_permissions:
+		break;
+	case filter_permissions:
 #ifdef FZ_WINDOWS
-			continue;
+		return false;
 #else
-			if (attributes == -1) {
-				continue;
-			}
+		if (attributes == -1) {
+			return false;
+		}
 
+		{
+			int flag = 0;
+			switch (c.condition)
 			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = S_IRUSR;
-					break;
-				case 1:
-					flag = S_IWUSR;
-					break;
-				case 2:
-					flag = S_IXUSR;
-					break;
-				case 3:
-					flag = S_IRGRP;
-					break;
-				case 4:
-					flag = S_IWGRP;
-					break;
-				case 5:
-					flag = S_IXGRP;
-					break;
-				case 6:
-					flag = S_IROTH;
-					break;
-				case 7:
-					flag = S_IWOTH;
-					break;
-				case 8:
-					flag = S_IXOTH;
-					break;
-				}
+			case 0:
+				flag = S_IRUSR;
+				break;
+			case 1:
+				flag = S_IWUSR;
+				break;
+			case 2:
+				flag = S_IXUSR;
+				break;
+			case 3:
+				flag = S_IRGRP;
+				break;
+			case 4:
+				flag = S_IWGRP;
+				break;
+			case 5:
+				flag = S_IXGRP;
+				break;
+			case 6:
+				flag = S_IROTH;
+				break;
+			case 7:
+				flag = S_IWOTH;
+				break;
+			case 8:
+				flag = S_IXOTH;
+				break;
+			}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
-				}
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == c.value) {
+				matched = true;
 			}
+		}
 #endif //FZ_WINDOWS
-			break;
-		case filter_date:
-			if (!date.empty()) {
-				int cmp = date.compare(condition.date);
-				switch (condition.condition)
-				{
-				case 0: // Before
-					match = cmp < 0;
-					break;
-				case 1: // Equals
-					match = cmp == 0;
-					break;
-				case 2: // Not equals
-					match = cmp != 0;
-					break;
-				case 3: // After
-					match = cmp > 0;
-					break;
-				}
+		break;
+	case filter_date:
+		if (!date.empty()) {
+			int cmp = date.compare(c.date);
+			switch (c.condition)
+			{
+			case 0: // Before
+				matched = cmp < 0;
+				break;
+			case 1: // Equals
+				matched = cmp == 0;
+				break;
+			case 2: // Not equals
+				matched = cmp != 0;
+				break;
+			case 3: // After
+				matched = cmp > 0;
+				break;
 			}
-			break;
-		default:
-			break;
 		}
-		if (match) {
-			if (filter.matchType == CFilter::any) {
-				return true;
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+// Returns 1 if filtered, 0 if not, -1 if further conditions need to be checked
+static int ConditionResult(CFilter::t_matchType matchType, bool match)
+{
+	if (match) {
+		if (matchType == CFilter::any) {
+			return 1;
+		}
+		else if (matchType == CFilter::none) {
+			return 0;
+		}
+	}
+	else {
+		if (matchType == CFilter::all) {
+			return 0;
+		}
+		else if (matchType == CFilter::not_all) {
+			return 1;
+		}
+	}
+
+	return -1;
+}
+
+static bool FinalResult(CFilter::t_matchType matchType, bool empty)
+{
+	if (matchType == CFilter::not_all) {
+		return false;
+	}
+
+	if (matchType != CFilter::any || empty) {
+		return true;
+	}
+
+	return false;
+}
+
+bool filter_manager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
+{
+	if (dir && !filter.filterDirs) {
+		return false;
+	}
+	else if (!dir && !filter.filterFiles) {
+		return false;
+	}
+
+	for (auto const& condition : filter.filters) {
+		bool match = false;
+
+		if (condition.type == filter_name) {
+			match = StringMatch(name, condition, filter.matchCase);
+		}
+		else if (condition.type == filter_path) {
+			match = StringMatch(path, condition, filter.matchCase);
+		}
+		else if (!MetaMatch(condition, size, attributes, date, match)) {
+			continue;
+		}
+
+		int const result = ConditionResult(filter.matchType, match);
+		if (result != -1) {
+			return result == 1;
+		}
+	}
+
+	return FinalResult(filter.matchType, filter.filters.empty());
+}
+
+int compiled_filters::matcher::add(std::wstring const& pattern)
+{
+	if (lengths_.size() >= max_patterns || pattern.empty()) {
+		return -1;
+	}
+
+	if (nodes_.empty()) {
+		nodes_.emplace_back();
+	}
+
+	int const index = static_cast<int>(lengths_.size());
+	lengths_.push_back(pattern.size());
+
+	size_t n = 0;
+	for (auto const& c : pattern) {
+		auto & next = nodes_[n].next;
+		auto it = std::lower_bound(next.begin(), next.end(), c, [](auto const& lhs, wchar_t rhs) { return lhs.first < rhs; });
+		if (it != next.end() && it->first == c) {
+			n = it->second;
+		}
+		else {
+			size_t const created = nodes_.size();
+			next.emplace(it, c, created);
+			nodes_.emplace_back();
+			n = created;
+		}
+	}
+	nodes_[n].own |= uint64_t(1) << index;
+
+	return index;
+}
+
+size_t compiled_filters::matcher::child(size_t n, wchar_t c) const
+{
+	if (!n && static_cast<unsigned int>(c) < 128) {
+		return root_next_[c];
+	}
+
+	auto const& next = nodes_[n].next;
+	auto it = std::lower_bound(next.begin(), next.end(), c, [](auto const& lhs, wchar_t rhs) { return lhs.first < rhs; });
+	if (it != next.end() && it->first == c) {
+		return it->second;
+	}
+	return 0;
+}
+
+void compiled_filters::matcher::build()
+{
+	if (nodes_.empty()) {
+		return;
+	}
+
+	// Breadth-first, so that fail targets are complete before they are used
+	std::deque<size_t> queue;
+	nodes_[0].out = nodes_[0].own;
+	for (auto const& next : nodes_[0].next) {
+		if (static_cast<unsigned int>(next.first) < 128) {
+			root_next_[next.first] = next.second;
+		}
+		nodes_[next.second].fail = 0;
+		nodes_[next.second].out = nodes_[next.second].own;
+		queue.push_back(next.second);
+	}
+
+	while (!queue.empty()) {
+		size_t const n = queue.front();
+		queue.pop_front();
+
+		for (auto const& next : nodes_[n].next) {
+			size_t f = nodes_[n].fail;
+			size_t target = child(f, next.first);
+			while (!target && f) {
+				f = nodes_[f].fail;
+				target = child(f, next.first);
 			}
-			else if (filter.matchType == CFilter::none) {
-				return false;
+
+			auto & node = nodes_[next.second];
+			node.fail = target;
+			node.out = node.own | nodes_[target].out;
+			queue.push_back(next.second);
+		}
+	}
+}
+
+compiled_filters::matcher::result compiled_filters::matcher::match(std::wstring const& subject) const
+{
+	result r;
+	if (nodes_.empty()) {
+		return r;
+	}
+
+	// Prefixes are found by following the trie from the root only
+	size_t n = 0;
+	for (auto const& c : subject) {
+		n = child(n, c);
+		if (!n) {
+			break;
+		}
+		r.at_start |= nodes_[n].own;
+	}
+
+	n = 0;
+	for (auto const& c : subject) {
+		size_t next = child(n, c);
+		while (!next && n) {
+			n = nodes_[n].fail;
+			next = child(n, c);
+		}
+		n = next;
+		r.found |= nodes_[n].out;
+	}
+	r.at_end = nodes_[n].out;
+
+	return r;
+}
+
+struct compiled_filters::state final
+{
+	state(std::wstring const& name, std::wstring const& path)
+		: subjects{&name, &name, &path, &path}
+	{}
+
+	std::wstring const& subject(int type)
+	{
+		if (type == name_nocase || type == path_nocase) {
+			if (!lowered[type]) {
+				lowered[type] = true;
+				lower[type] = fz::str_tolower(*subjects[type]);
 			}
+			return lower[type];
 		}
-		else {
-			if (filter.matchType == CFilter::all) {
-				return false;
+		return *subjects[type];
+	}
+
+	std::wstring const* subjects[subject_count];
+	std::wstring lower[subject_count];
+	bool lowered[subject_count]{};
+
+	matcher::result results[subject_count];
+	bool matched[subject_count]{};
+};
+
+compiled_filters::compiled_filters(std::vector<CFilter> const& filters)
+{
+	filters_.reserve(filters.size());
+	for (auto const& in : filters) {
+		filter f;
+		f.matchType = in.matchType;
+		f.filterFiles = in.filterFiles;
+		f.filterDirs = in.filterDirs;
+
+		for (auto const& c : in.filters) {
+			condition out;
+			out.c = c;
+			if (c.type == filter_name || c.type == filter_path) {
+				out.subject = (c.type == filter_name) ? name_case : path_case;
+				if (!in.matchCase) {
+					++out.subject;
+				}
+				if (c.condition != 4) {
+					out.pattern = matchers_[out.subject].add(in.matchCase ? c.strValue : c.lowerValue);
+				}
 			}
-			else if (filter.matchType == CFilter::not_all) {
-				return true;
+			f.conditions.emplace_back(std::move(out));
+		}
+
+		// Cheapest first: Metadata, then plain string matches, regular expressions last.
+		// The match types do not depend on the order of conditions.
+		auto const cost = [](condition const& c) {
+			if (c.subject == -1) {
+				return 0;
 			}
+			return (c.c.condition == 4) ? 2 : 1;
+		};
+		std::stable_sort(f.conditions.begin(), f.conditions.end(), [&cost](condition const& lhs, condition const& rhs) { return cost(lhs) < cost(rhs); });
+
+		filters_.emplace_back(std::move(f));
+	}
+
+	for (auto & m : matchers_) {
+		m.build();
+	}
+}
+
+bool compiled_filters::match(condition const& c, state & s) const
+{
+	if (c.pattern == -1) {
+		// Regular expressions, and string conditions exceeding the capacity of the matcher
+		if (c.c.condition == 4) {
+			return c.c.pRegEx && std::regex_search(*s.subjects[c.subject], *c.c.pRegEx);
 		}
+		return StringMatch(*s.subjects[c.subject], c.c, c.subject == name_case || c.subject == path_case);
+	}
+
+	auto & r = s.results[c.subject];
+	if (!s.matched[c.subject]) {
+		s.matched[c.subject] = true;
+		r = matchers_[c.subject].match(s.subject(c.subject));
 	}
 
-	if (filter.matchType == CFilter::not_all) {
+	uint64_t const bit = uint64_t(1) << c.pattern;
+	switch (c.c.condition)
+	{
+	case 0:
+		return (r.found & bit) != 0;
+	case 1:
+		return (r.at_start & bit) && matchers_[c.subject].length(c.pattern) == s.subject(c.subject).size();
+	case 2:
+		return (r.at_start & bit) != 0;
+	case 3:
+		return (r.at_end & bit) != 0;
+	case 5:
+		return !(r.found & bit);
+	default:
 		return false;
 	}
+}
 
-	if (filter.matchType != CFilter::any || filter.filters.empty()) {
-		return true;
+bool compiled_filters::FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	state s(name, path);
+
+	for (auto const& f : filters_) {
+		if (dir ? !f.filterDirs : !f.filterFiles) {
+			continue;
+		}
+
+		int result = -1;
+		for (auto const& c : f.conditions) {
+			bool matched = false;
+			if (c.subject != -1) {
+				matched = match(c, s);
+			}
+			else if (!MetaMatch(c.c, size, attributes, date, matched)) {
+				continue;
+			}
+
+			result = ConditionResult(f.matchType, matched);
+			if (result != -1) {
+				break;
+			}
+		}
+		if (result == -1) {
+			result = FinalResult(f.matchType, f.conditions.empty()) ? 1 : 0;
+		}
+		if (result == 1) {
+			return true;
+		}
 	}
 
 	return false;
@@ -0,0 +1,231 @@
+#include "listing_comparison.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <iterator>
+
+namespace {
+// Like iswdigit, which only ever matches these
+bool is_digit(wchar_t c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Like towlower, but skips the call for ASCII characters no locale changes
+wchar_t fold_case(wchar_t c)
+{
+	if (c < 0x80 && (c < 'A' || c > 'Z')) {
+		return c;
+	}
+	return static_cast<wchar_t>(std::towlower(c));
+}
+}
+
+std::wstring make_sort_key(std::wstring_view const& name, NameSortMode mode)
+{
+	std::wstring key;
+	if (mode == NameSortMode::natural) {
+		// Numbers are stored as a marker, their length without leading zeros, and their digits.
+		// The marker is a digit itself, so numbers compare to other characters like digits do.
+		// Leading zeros only break ties at the very end.
+		size_t numbers{};
+		for (size_t i = 0; i < name.size(); ++i) {
+			if (is_digit(name[i]) && (!i || !is_digit(name[i - 1]))) {
+				++numbers;
+			}
+		}
+		key.reserve(name.size() + 1 + numbers * 3);
+
+		std::wstring zeros;
+		size_t i = 0;
+		while (i < name.size()) {
+			if (!is_digit(name[i])) {
+				key += fold_case(name[i++]);
+				continue;
+			}
+
+			size_t const start = i;
+			while (i < name.size() && is_digit(name[i])) {
+				++i;
+			}
+			size_t first = start;
+			while (first + 1 < i && name[first] == '0') {
+				++first;
+			}
+			key += '0';
+			key += static_cast<wchar_t>(std::min(i - first, size_t(0xffff)));
+			key.append(name.substr(first, i - first));
+			zeros += static_cast<wchar_t>(std::min(first - start, size_t(0xffff)));
+		}
+		key += L'\0';
+		key += zeros;
+	}
+	else {
+		// Case-folded name first, original name breaks ties
+		key.reserve(name.size() * 2 + 1);
+		for (auto const c : name) {
+			key += fold_case(c);
+		}
+		key += L'\0';
+		key += name;
+	}
+
+	return key;
+}
+
+listing_comparison::listing_comparison(int dirSortMode, NameSortMode nameSortMode, int comparisonMode, bool hideIdentical, fz::duration const& threshold)
+	: dirSortMode_(dirSortMode)
+	, nameSortMode_(nameSortMode)
+	, comparisonMode_(comparisonMode)
+	, hideIdentical_(hideIdentical)
+	, threshold_(threshold)
+{
+}
+
+void listing_comparison::prepare(std::vector<entry> & entries) const
+{
+	if (nameSortMode_ == NameSortMode::case_sensitive) {
+		// Plain names already are the keys
+		return;
+	}
+
+	for (auto & e : entries) {
+		e.key = make_sort_key(e.key, nameSortMode_);
+		if (!e.path_key.empty()) {
+			e.path_key = make_sort_key(e.path_key, nameSortMode_);
+		}
+	}
+}
+
+void listing_comparison::add(bool left, std::vector<entry> && entries)
+{
+	auto & pending = pending_[left ? 0 : 1];
+	auto & offset = offset_[left ? 0 : 1];
+
+	if (offset) {
+		pending.erase(pending.begin(), pending.begin() + offset);
+		offset = 0;
+	}
+	if (pending.empty()) {
+		pending = std::move(entries);
+	}
+	else {
+		pending.insert(pending.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+	}
+}
+
+int listing_comparison::compare_entries(entry const& left, entry const& right) const
+{
+	if (dirSortMode_ != 2) {
+		// Not inline
+		if (left.dir != right.dir) {
+			return left.dir ? -1 : 1;
+		}
+	}
+
+	int cmp = left.key.compare(right.key);
+	if (!cmp) {
+		cmp = left.path_key.compare(right.path_key);
+	}
+	return cmp;
+}
+
+void listing_comparison::compare_match(entry const& left, entry const& right, std::vector<unsigned char> & leftFlags, std::vector<unsigned char> & rightFlags) const
+{
+	unsigned char leftFlag = normal;
+	unsigned char rightFlag = normal;
+
+	if (!comparisonMode_) {
+		if (!left.dir && left.size != right.size) {
+			leftFlag = different;
+			rightFlag = different;
+		}
+	}
+	else if (!left.date.empty() && !right.date.empty()) {
+		fz::datetime leftDate = left.date;
+		fz::datetime rightDate = right.date;
+
+		int dateCmp = leftDate.compare(rightDate);
+		if (dateCmp < 0) {
+			leftDate += threshold_;
+		}
+		else if (dateCmp > 0) {
+			rightDate += threshold_;
+		}
+		int adjustedDateCmp = leftDate.compare(rightDate);
+		if (dateCmp && dateCmp == -adjustedDateCmp) {
+			dateCmp = 0;
+		}
+
+		if (dateCmp < 0) {
+			rightFlag = newer;
+		}
+		else if (dateCmp > 0) {
+			leftFlag = newer;
+		}
+	}
+	else if (!left.date.empty() || !right.date.empty()) {
+		// Only one side has a date, never consider that identical
+		leftFlags.push_back(leftFlag);
+		rightFlags.push_back(rightFlag);
+		return;
+	}
+
+	if (hideIdentical_ && leftFlag == normal && rightFlag == normal && !left.parent) {
+		leftFlag = 0;
+		rightFlag = 0;
+	}
+	leftFlags.push_back(leftFlag);
+	rightFlags.push_back(rightFlag);
+}
+
+void listing_comparison::compare(bool final, std::vector<unsigned char> & leftFlags, std::vector<unsigned char> & rightFlags)
+{
+	auto const& left = pending_[0];
+	auto const& right = pending_[1];
+	size_t & l = offset_[0];
+	size_t & r = offset_[1];
+
+	if (final) {
+		// Otherwise leave growing to push_back, reserving exactly on each chunk
+		// would reallocate every time.
+		size_t const rows = left.size() - l + right.size() - r;
+		leftFlags.reserve(leftFlags.size() + rows);
+		rightFlags.reserve(rightFlags.size() + rows);
+	}
+
+	while (l < left.size() && r < right.size()) {
+		int const cmp = compare_entries(left[l], right[r]);
+		if (!cmp) {
+			compare_match(left[l++], right[r++], leftFlags, rightFlags);
+		}
+		else if (cmp < 0) {
+			leftFlags.push_back(lonely);
+			rightFlags.push_back(fill);
+			++l;
+		}
+		else {
+			leftFlags.push_back(fill);
+			rightFlags.push_back(lonely);
+			++r;
+		}
+	}
+
+	if (!final) {
+		return;
+	}
+
+	for (; l < left.size(); ++l) {
+		leftFlags.push_back(lonely);
+		rightFlags.push_back(fill);
+	}
+	for (; r < right.size(); ++r) {
+		leftFlags.push_back(fill);
+		rightFlags.push_back(lonely);
+	}
+
+	pending_[0].clear();
+	pending_[1].clear();
+	l = 0;
+	r = 0;
+}
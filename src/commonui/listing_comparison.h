@@ -0,0 +1,88 @@
+#ifndef FILEZILLA_COMMONUI_LISTING_COMPARISON_HEADER
+#define FILEZILLA_COMMONUI_LISTING_COMPARISON_HEADER
+
+#include "visibility.h"
+
+#include <libfilezilla/time.hpp>
+
+#include <string>
+#include <vector>
+
+enum class NameSortMode
+{
+	case_insensitive,
+	case_sensitive,
+	natural
+};
+
+// Returns a key such that comparing keys of two names yields the same order as
+// CmpNoCase respectively, with numbers ordered by value, CmpNatural. Saves case
+// folding and parsing numbers on each comparison.
+// Not needed in case-sensitive mode, names are their own keys.
+std::wstring FZCUI_PUBLIC_SYMBOL make_sort_key(std::wstring_view const& name, NameSortMode mode);
+
+// Comparison core, independent of the views and thread-agnostic.
+//
+// Both sides are fed with entries already sorted the way the file lists sort
+// by name, the sort keys are precomputed so the merge itself does nothing but
+// plain key comparisons.
+//
+// Entries can be added in chunks, compare() emits the rows that can be decided
+// so far. This allows streaming the comparison of whole trees, one directory
+// after the other, without holding all of them at once.
+class FZCUI_PUBLIC_SYMBOL listing_comparison final
+{
+public:
+	// One flag per row and side. A zero flag is an identical entry that is
+	// hidden.
+	enum flags : unsigned char
+	{
+		normal = 1,
+		fill = 2,
+		different = 4,
+		newer = 8,
+		lonely = 16
+	};
+
+	struct entry final
+	{
+		std::wstring key; // Name, turned into the sort key by prepare()
+		std::wstring path_key; // Path, turned into the sort key by prepare()
+		int64_t size{-1};
+		fz::datetime date;
+		bool dir{};
+		bool parent{};
+	};
+
+	listing_comparison(int dirSortMode, NameSortMode nameSortMode, int comparisonMode, bool hideIdentical, fz::duration const& threshold);
+
+	// Replaces names and paths by their sort keys. Can be called for both sides
+	// in parallel.
+	void prepare(std::vector<entry> & entries) const;
+
+	// Appends prepared entries to one side. Each side has to be in sort order
+	// across all chunks.
+	void add(bool left, std::vector<entry> && entries);
+
+	// Merges both sides as far as possible, appending one flag per row for
+	// each. Entries that may still have a match in a later chunk of the other
+	// side are kept. If final is set, all remaining entries are emitted and
+	// the next add() starts a new listing.
+	void compare(bool final, std::vector<unsigned char> & leftFlags, std::vector<unsigned char> & rightFlags);
+
+private:
+	int compare_entries(entry const& left, entry const& right) const;
+	void compare_match(entry const& left, entry const& right, std::vector<unsigned char> & leftFlags, std::vector<unsigned char> & rightFlags) const;
+
+	int const dirSortMode_;
+	NameSortMode const nameSortMode_;
+	int const comparisonMode_;
+	bool const hideIdentical_;
+	fz::duration const threshold_;
+
+	// Entries not yet emitted, starting at offset_
+	std::vector<entry> pending_[2];
+	size_t offset_[2]{};
+};
+
+#endif
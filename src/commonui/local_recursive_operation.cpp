@@ -2,6 +2,18 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
+#include <thread>
+
+namespace {
+// Upper limit of directories enumerated in parallel
+size_t const max_workers = 8;
+
+// Pooled workers pause while this many listings wait for the GUI thread, keeping
+// memory bounded if enumerating is faster than queueing.
+size_t const max_pending_listings = 100;
+}
+
 local_recursive_operation::local_recursive_operation()
 {}
 
@@ -62,13 +74,33 @@ bool local_recursive_operation::do_start_recursive_operation(OperationMode mode,
 	m_operationMode = mode;
 
 	m_filters = filters;
+	compiled_filters_ = compiled_filters(m_filters.first);
 	m_ignoreLinks = ignore_links;
 
+	worker_count_ = 1;
 	if (pool_) {
-		thread_ = pool_->spawn([this] { thread_entry(); });
-		if (!thread_) {
-			m_operationMode = recursive_none;
-			return false;
+		worker_count_ = std::clamp(static_cast<size_t>(std::thread::hardware_concurrency()), size_t(1), max_workers);
+	}
+	work_queues_.assign(worker_count_, std::deque<local_recursion_root::new_dir>());
+	conds_ = std::make_unique<fz::condition[]>(worker_count_);
+	waiting_.assign(worker_count_, false);
+	busy_workers_ = 0;
+	finished_workers_ = 0;
+
+	if (pool_) {
+		for (size_t i = 0; i < worker_count_; ++i) {
+			threads_.emplace_back(pool_->spawn([this, i] { worker_entry(i); }));
+			if (!threads_.back()) {
+				threads_.pop_back();
+				if (threads_.empty()) {
+					m_operationMode = recursive_none;
+					return false;
+				}
+				// Make do with fewer workers
+				worker_count_ = threads_.size();
+				work_queues_.resize(worker_count_);
+				break;
+			}
 		}
 	}
 
@@ -89,35 +121,52 @@ void local_recursive_operation::StopRecursiveOperation()
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
 
+		wake_workers(l);
 	}
 
-	thread_.join();
+	join_threads();
 	m_listedDirectories.clear();
 }
 
-void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d)
+void local_recursive_operation::join_threads()
+{
+	{
+		// Workers might be waiting for the GUI to catch up, make them quit
+		fz::scoped_lock l(mutex_);
+		recursion_roots_.clear();
+		wake_workers(l);
+	}
+
+	for (auto & t : threads_) {
+		t.join();
+	}
+	threads_.clear();
+}
+
+void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, size_t worker)
 {
 	if (recursion_roots_.empty()) {
 		return;
 	}
 
-	auto& root = recursion_roots_.front();
-
-	// Queue for recursion
-	for (auto const& entry : d.dirs) {
+	// Queue for recursion. Reversed, the worker takes them from the back.
+	auto & queue = work_queues_[worker];
+	for (auto it = d.dirs.crbegin(); it != d.dirs.crend(); ++it) {
 		local_recursion_root::new_dir dir;
-		CLocalPath localSub = d.localPath;
-		localSub.AddSegment(entry.name);
+		dir.localPath = d.localPath;
+		dir.localPath.AddSegment(it->name);
 
-		CServerPath remoteSub = d.remotePath;
-		if (!remoteSub.empty()) {
+		dir.remotePath = d.remotePath;
+		if (!dir.remotePath.empty()) {
 			if (m_operationMode == recursive_transfer) {
 				// Non-flatten case
-				remoteSub.AddSegment(entry.name);
+				dir.remotePath.AddSegment(it->name);
 			}
 		}
-		root.add_dir_to_visit(localSub, remoteSub);
+		queue.emplace_back(std::move(dir));
 	}
+	// Something to steal for idle workers
+	wake_workers(l, d.dirs.size());
 
 	m_listedDirectories.emplace_back(std::move(d));
 
@@ -129,29 +178,106 @@ void local_recursive_operation::EnqueueEnumeratedListing(fz::scoped_lock& l, lis
 	}
 }
 
+bool local_recursive_operation::DequeueEnumeratedListing(listing& d)
+{
+	fz::scoped_lock l(mutex_);
+	if (m_listedDirectories.empty()) {
+		return false;
+	}
+
+	d = std::move(m_listedDirectories.front());
+	m_listedDirectories.pop_front();
+
+	if (m_listedDirectories.size() + 1 == max_pending_listings) {
+		wake_workers(l);
+	}
+
+	return true;
+}
+
+bool local_recursive_operation::take_dir(size_t worker, local_recursion_root::new_dir& dir)
+{
+	auto & own = work_queues_[worker];
+	if (!own.empty()) {
+		dir = std::move(own.back());
+		own.pop_back();
+		return true;
+	}
+
+	auto & root = recursion_roots_.front();
+	if (!root.m_dirsToVisit.empty()) {
+		dir = std::move(root.m_dirsToVisit.front());
+		root.m_dirsToVisit.pop_front();
+		return true;
+	}
+
+	for (size_t i = 1; i < work_queues_.size(); ++i) {
+		auto & other = work_queues_[(worker + i) % work_queues_.size()];
+		if (!other.empty()) {
+			dir = std::move(other.front());
+			other.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void local_recursive_operation::wait(fz::scoped_lock& l, size_t worker)
+{
+	waiting_[worker] = true;
+	conds_[worker].wait(l);
+}
+
+void local_recursive_operation::wake_workers(fz::scoped_lock& l, size_t count)
+{
+	for (size_t i = 0; i < waiting_.size() && count; ++i) {
+		if (waiting_[i]) {
+			waiting_[i] = false;
+			conds_[i].signal(l);
+			--count;
+		}
+	}
+}
+
 void local_recursive_operation::thread_entry()
 {
+	worker_entry(0);
+}
+
+void local_recursive_operation::worker_entry(size_t worker)
+{
+	bool last{};
 	{
 		fz::scoped_lock l(mutex_);
 
-		auto filters = m_filters.first;
-
 		while (!recursion_roots_.empty()) {
-			listing d;
+			if (pool_ && m_listedDirectories.size() >= max_pending_listings) {
+				// Woken up once the GUI has caught up
+				wait(l, worker);
+				continue;
+			}
 
-			{
-				auto& root = recursion_roots_.front();
-				if (root.m_dirsToVisit.empty()) {
+			local_recursion_root::new_dir dir;
+			if (!take_dir(worker, dir)) {
+				if (busy_workers_) {
+					// Other workers may still come across subdirectories
+					wait(l, worker);
+				}
+				else {
 					recursion_roots_.pop_front();
-					continue;
+
+					// Idle workers either get to work on the next root or finish
+					wake_workers(l);
 				}
+				continue;
+			}
 
-				auto const& dir = root.m_dirsToVisit.front();
-				d.localPath = dir.localPath;
-				d.remotePath = dir.remotePath;
+			listing d;
+			d.localPath = std::move(dir.localPath);
+			d.remotePath = std::move(dir.remotePath);
 
-				root.m_dirsToVisit.pop_front();
-			}
+			++busy_workers_;
 
 			// Do the slow part without holding mutex
 			l.unlock();
@@ -171,7 +297,7 @@ void local_recursive_operation::thread_entry()
 					}
 					entry.name = fz::to_wstring(name);
 
-					if (!filter_manager::FilenameFiltered(filters, entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
+					if (!compiled_filters_.FilenameFiltered(entry.name, d.localPath.GetPath(), t == fz::local_filesys::dir, entry.size, entry.attributes, entry.time)) {
 						if (t == fz::local_filesys::dir) {
 							d.dirs.emplace_back(std::move(entry));
 						}
@@ -193,7 +319,7 @@ void local_recursive_operation::thread_entry()
 								l.unlock();
 								break;
 							}
-							EnqueueEnumeratedListing(l, std::move(d));
+							EnqueueEnumeratedListing(l, std::move(d), worker);
 							l.unlock();
 							d = next;
 						}
@@ -202,19 +328,30 @@ void local_recursive_operation::thread_entry()
 			}
 
 			l.lock();
+			--busy_workers_;
+
 			// Check for cancellation
 			if (recursion_roots_.empty()) {
 				break;
 			}
 			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
-				EnqueueEnumeratedListing(l, std::move(d));
+				EnqueueEnumeratedListing(l, std::move(d), worker);
 			}
 		}
 
-		listing d;
-		m_listedDirectories.emplace_back(std::move(d));
+		// Last one out marks the end of the operation
+		if (++finished_workers_ >= worker_count_) {
+			listing d;
+			m_listedDirectories.emplace_back(std::move(d));
+			last = true;
+		}
+		else {
+			// Wake the waiting workers so that they notice being done as well
+			wake_workers(l);
+		}
 	}
 
-	on_listed_directory();
+	if (last) {
+		on_listed_directory();
+	}
 }
-
@@ -12,8 +12,10 @@
 #include <libfilezilla/time.hpp>
 
 #include <deque>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 class FZCUI_PUBLIC_SYMBOL local_recursion_root final
 {
@@ -81,7 +83,12 @@ protected:
 	virtual void on_listed_directory() = 0;
 
 protected:
-	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d);
+	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d, size_t worker);
+
+	// Takes the next enumerated listing for processing on the GUI side.
+	bool DequeueEnumeratedListing(listing& d);
+
+	void join_threads();
 
 	std::deque<local_recursion_root> recursion_roots_;
 
@@ -90,8 +97,30 @@ protected:
 
 	std::deque<listing> m_listedDirectories;
 	bool m_ignoreLinks{};
+	compiled_filters compiled_filters_;
+
+	std::vector<fz::async_task> threads_;
+
+private:
+	void worker_entry(size_t worker);
+	bool take_dir(size_t worker, local_recursion_root::new_dir& dir);
+
+	// Blocks the worker until another thread wakes it up
+	void wait(fz::scoped_lock& l, size_t worker);
+
+	// Wakes up to count waiting workers
+	void wake_workers(fz::scoped_lock& l, size_t count = size_t(-1));
+
+	// Each worker works depth-first on its own queue of subdirectories
+	// and steals the oldest entries of other workers once it runs dry.
+	std::vector<std::deque<local_recursion_root::new_dir>> work_queues_;
+	size_t worker_count_{1};
+	size_t busy_workers_{};
+	size_t finished_workers_{};
 
-	fz::async_task thread_;
+	// One per worker, a condition can only have a single waiter
+	std::unique_ptr<fz::condition[]> conds_;
+	std::vector<bool> waiting_;
 };
 
 #endif
@@ -105,6 +105,7 @@ fz::private_key login_manager::GetDecryptor(fz::public_key const& pub, bool * fo
 		auto priv = fz::private_key::from_password(pw, pub.salt_);
 		if (priv && priv.pubkey() == pub) {
 			decryptors_[pub] = priv;
+			on_decryptor_added(priv);
 			return priv;
 		}
 	}
@@ -115,6 +116,9 @@ fz::private_key login_manager::GetDecryptor(fz::public_key const& pub, bool * fo
 void login_manager::Remember(const fz::private_key &key, std::string_view const& pass)
 {
 	decryptors_[key.pubkey()] = key;
+	if (key) {
+		on_decryptor_added(key);
+	}
 
 	if (!pass.empty()) {
 		for (auto const& pw : decryptorPasswords_) {
@@ -36,6 +36,9 @@ protected:
 	virtual bool query_unprotect_site(Site&) { return false; }
 	virtual bool query_credentials(Site&, std::wstring const& /*challenge*/, bool /*canRemember*/) { return false; }
 
+	// Called whenever a new decryptor becomes known
+	virtual void on_decryptor_added(fz::private_key const&) {}
+
 	// Session password cache for Ask-type servers
 	struct t_passwordcache final
 	{
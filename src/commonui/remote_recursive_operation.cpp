@@ -5,6 +5,8 @@
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
 
+#include <algorithm>
+
 recursion_root::recursion_root(CServerPath const& start_dir, bool allow_parent)
 	: m_remoteStartDir(start_dir)
 	, m_allowParent(allow_parent)
@@ -72,6 +74,7 @@ void remote_recursive_operation::start_recursive_operation(OperationMode mode, A
 void remote_recursive_operation::do_start_recursive_operation(OperationMode, ActiveFilters const& filters)
 {
 	m_filters = filters;
+	compiled_filters_ = compiled_filters(m_filters.second);
 	NextOperation();
 }
 
@@ -93,6 +96,7 @@ bool remote_recursive_operation::NextOperation()
 			}
 
 			process_command(std::make_unique<CListCommand>(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : 0));
+			prefetch_listings();
 			return true;
 		}
 
@@ -105,6 +109,43 @@ bool remote_recursive_operation::NextOperation()
 	return false;
 }
 
+bool remote_recursive_operation::next_prefetch(CServerPath & parent, std::wstring & subdir)
+{
+	if (m_operationMode == recursive_none || recursion_roots_.empty()) {
+		return false;
+	}
+
+	auto & root = recursion_roots_.front();
+
+	// The front is being listed already. Don't look too far ahead either,
+	// on deep trees the directories further back get visited much later.
+	size_t const max_lookahead = 100;
+	size_t const end = std::min(root.m_dirsToVisit.size(), max_lookahead);
+	for (size_t i = 1; i < end; ++i) {
+		auto const& dir = root.m_dirsToVisit[i];
+		if (dir.link || !dir.doVisit || !dir.recurse) {
+			continue;
+		}
+
+		CServerPath path = dir.parent;
+		if (!dir.subdir.empty() && !path.ChangePath(dir.subdir)) {
+			continue;
+		}
+		if (root.m_visitedDirs.find(path) != root.m_visitedDirs.end()) {
+			continue;
+		}
+		if (!root.m_prefetchedDirs.insert(path).second) {
+			continue;
+		}
+
+		parent = dir.parent;
+		subdir = dir.subdir;
+		return true;
+	}
+
+	return false;
+}
+
 bool remote_recursive_operation::BelowRecursionRoot(CServerPath const& path, recursion_root::new_dir &dir)
 {
 	if (!dir.start_dir.empty()) {
@@ -149,7 +190,7 @@ void remote_recursive_operation::process_entries(recursion_root& root, CDirector
 				continue;
 			}
 		}
-		else if (filter_manager::FilenameFiltered(m_filters.second, entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
+		else if (compiled_filters_.FilenameFiltered(entry.name, remotePath, entry.is_dir(), entry.size, 0, entry.time)) {
 			continue;
 		}
 
@@ -12,8 +12,8 @@
 
 #include <deque>
 #include <memory>
-#include <set>
 #include <string>
+#include <unordered_set>
 
 class ChmodData;
 
@@ -56,7 +56,8 @@ private:
 	};
 
 	CServerPath m_remoteStartDir;
-	std::set<CServerPath> m_visitedDirs;
+	std::unordered_set<CServerPath> m_visitedDirs;
+	std::unordered_set<CServerPath> m_prefetchedDirs;
 	std::deque<new_dir> m_dirsToVisit;
 	bool m_allowParent{};
 };
@@ -100,6 +101,15 @@ protected:
 	// called after looping through directory (non-recursively) to allow status updates et al.
 	virtual void handle_dir_listing_end() = 0;
 
+	// called whenever the operation is about to list the next directory. Derived classes
+	// can use next_prefetch() to list upcoming directories on additional connections
+	// so that the listings are already cached once the operation gets to them.
+	virtual void prefetch_listings() {}
+
+	// Hands out the next directory queued for visiting that has neither been visited
+	// nor handed out before. Visiting order is unaffected.
+	bool next_prefetch(CServerPath & parent, std::wstring & subdir);
+
 	// Call this when engine indicates that link was tried to be listed as directory but is not one
 	void LinkIsNotDir(Site const& site);
 
@@ -118,6 +128,8 @@ protected:
 
 	std::deque<recursion_root> recursion_roots_;
 
+	compiled_filters compiled_filters_;
+
 	// Needed for recursive_chmod
 	std::unique_ptr<ChmodData> chmodData_;
 };
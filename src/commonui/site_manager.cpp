@@ -2,9 +2,117 @@
 #include "fz_paths.h"
 #include "ipcmutex.h"
 
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/translate.hpp>
 
 #include <cstring>
+#include <map>
+
+namespace {
+// Name of a Server, Folder or Bookmark element
+std::wstring GetElementName(pugi::xml_node node)
+{
+	std::wstring name = GetTextElement_Trimmed(node, "Name");
+	if (name.empty()) {
+		name = GetTextElement_Trimmed(node);
+	}
+	return name;
+}
+
+// A parsed site manager file with an index from site paths to elements.
+// Stays valid as long as size and modification time of the file are
+// unchanged, so repeated lookups neither read nor parse the file.
+class site_index final
+{
+public:
+	// Reloads the file if it has changed
+	bool update(std::wstring const& fileName);
+
+	pugi::xml_node find(std::vector<std::wstring> const& segments) const;
+
+private:
+	void add(pugi::xml_node node, std::vector<std::wstring> & segments);
+
+	CXmlFile file_;
+	bool valid_{};
+	int64_t size_{-1};
+	fz::datetime mtime_;
+
+	std::map<std::vector<std::wstring>, pugi::xml_node> index_;
+};
+
+bool site_index::update(std::wstring const& fileName)
+{
+	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
+	// to the same file or one is reading while the other one writes.
+	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+
+	bool is_link{};
+	int64_t size{-1};
+	fz::datetime mtime;
+	bool const exists = fz::local_filesys::get_file_info(fz::to_native(fileName), is_link, &size, &mtime, nullptr) == fz::local_filesys::file;
+	if (valid_ && exists && size == size_ && mtime == mtime_ && !mtime.empty()) {
+		return true;
+	}
+
+	valid_ = false;
+	index_.clear();
+
+	file_.SetFileName(fileName);
+	auto document = file_.Load();
+	if (!document) {
+		return false;
+	}
+
+	std::vector<std::wstring> segments;
+	add(document.child("Servers"), segments);
+
+	valid_ = exists;
+	size_ = size;
+	mtime_ = mtime;
+
+	return true;
+}
+
+void site_index::add(pugi::xml_node node, std::vector<std::wstring> & segments)
+{
+	for (auto child = node.first_child(); child; child = child.next_sibling()) {
+		if (strcmp(child.name(), "Server") && strcmp(child.name(), "Folder") && strcmp(child.name(), "Bookmark")) {
+			continue;
+		}
+
+		std::wstring name = GetElementName(child);
+		if (name.empty()) {
+			continue;
+		}
+
+		segments.push_back(std::move(name));
+
+		// Like walking the tree, only the first of several equally named
+		// siblings is reachable.
+		if (index_.emplace(segments, child).second && strcmp(child.name(), "Bookmark")) {
+			add(child, segments);
+		}
+
+		segments.pop_back();
+	}
+}
+
+pugi::xml_node site_index::find(std::vector<std::wstring> const& segments) const
+{
+	auto it = index_.find(segments);
+	if (it == index_.cend()) {
+		return pugi::xml_node();
+	}
+	return it->second;
+}
+
+fz::mutex site_index_mutex;
+
+// By file name
+std::map<std::wstring, site_index> site_indexes;
+}
 
 bool site_manager::Load(std::wstring const& settings_file, CSiteManagerXmlHandler& handler, std::wstring& error)
 {
@@ -272,13 +380,9 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 
 	sitePath = sitePath.substr(1);
 
-	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
-	// to the same file or one is reading while the other one writes.
-	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
-
-	CXmlFile file;
+	std::wstring fileName;
 	if (c == '0') {
-		file.SetFileName(paths.settings_file(L"sitemanager"));
+		fileName = paths.settings_file(L"sitemanager");
 	}
 	else {
 		CLocalPath const defaultsDir = paths.defaults_path;
@@ -286,18 +390,14 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 			error = fz::translate("Site does not exist.");
 			return ret;
 		}
-		file.SetFileName(defaultsDir.GetPath() + L"fzdefaults.xml");
+		fileName = defaultsDir.GetPath() + L"fzdefaults.xml";
 	}
 
-	auto document = file.Load();
-	if (!document) {
-		error = fz::translate("Error loading xml file");
-		return ret;
-	}
+	fz::scoped_lock lock(site_index_mutex);
 
-	auto element = document.child("Servers");
-	if (!element) {
-		error = fz::translate("Site does not exist.");
+	auto & index = site_indexes[fileName];
+	if (!index.update(fileName)) {
+		error = fz::translate("Error loading xml file");
 		return ret;
 	}
 
@@ -307,7 +407,7 @@ std::pair<std::unique_ptr<Site>, Bookmark> site_manager::GetSiteByPath(app_paths
 		return ret;
 	}
 
-	auto child = GetElementByPath(element, segments);
+	auto child = index.find(segments);
 	if (!child) {
 		error = fz::translate("Site does not exist.");
 		return ret;
@@ -350,10 +450,7 @@ pugi::xml_node site_manager::GetElementByPath(pugi::xml_node node, std::vector<s
 				continue;
 			}
 
-			std::wstring name = GetTextElement_Trimmed(child, "Name");
-			if (name.empty()) {
-				name = GetTextElement_Trimmed(child);
-			}
+			std::wstring name = GetElementName(child);
 			if (name.empty()) {
 				continue;
 			}
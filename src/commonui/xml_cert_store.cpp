@@ -2,18 +2,50 @@
 
 #include "ipcmutex.h"
 
+#include <libfilezilla/file.hpp>
+
+namespace {
+// Once the journal holds this many records, it gets merged into the XML file
+size_t const max_journal_records = 100;
+
+std::wstring GetJournalName(std::wstring file)
+{
+	if (file.size() > 4 && file.compare(file.size() - 4, 4, L".xml") == 0) {
+		file.resize(file.size() - 4);
+	}
+	return file + L".journal";
+}
+}
+
 xml_cert_store::xml_cert_store(std::wstring const& file)
 	: m_xmlFile(file)
+	, journal_file_(GetJournalName(file))
 {
 }
 
 void xml_cert_store::LoadTrustedCerts()
 {
 	CReentrantInterProcessMutexLocker mutex(MUTEX_TRUSTEDCERTS);
-	if (!m_xmlFile.Modified()) {
-		return;
+	if (m_xmlFile.Modified()) {
+		LoadXml();
+	}
+
+	if (!ReplayJournal()) {
+		// Another instance has merged the journal into the XML file
+		LoadXml();
+		ReplayJournal();
 	}
 
+	if (journal_records_ >= max_journal_records && AllowedToSave()) {
+		Compact();
+	}
+}
+
+void xml_cert_store::LoadXml()
+{
+	journal_offset_ = 0;
+	journal_records_ = 0;
+
 	auto root = m_xmlFile.Load();
 	if (!root) {
 		return;
@@ -56,13 +88,7 @@ void xml_cert_store::LoadTrustedCerts()
 			data.trustSans = GetTextElementBool(cert, "TrustSANs");
 
 			// Weed out duplicates
-			if (IsTrusted(data.host, data.port, data.data, true, false)) {
-				return false;
-			}
-
-			data_[persistent].trusted_certs_.emplace_back(std::move(data));
-
-			return true;
+			return AddTrustedCert(data_[persistent], std::move(data));
 		};
 
 		auto cert = element.child("Certificate");
@@ -87,11 +113,9 @@ void xml_cert_store::LoadTrustedCerts()
 				return false;
 			}
 
-			for (auto const& cert : data_[persistent].trusted_certs_) {
-				// A host can't be both trusted and insecure
-				if (cert.host == host && cert.port == port) {
-					return false;
-				}
+			// A host can't be both trusted and insecure
+			if (data_[persistent].trusted_hosts_.count({host, port, {}})) {
+				return false;
 			}
 
 			data_[persistent].insecure_hosts_.emplace(std::make_tuple(host, port));
@@ -121,11 +145,9 @@ void xml_cert_store::LoadTrustedCerts()
 				return false;
 			}
 
-			for (auto const& cert : data_[persistent].trusted_certs_) {
-				// A host can't be both trusted and insecure
-				if (cert.host == host && cert.port == port) {
-					return false;
-				}
+			// A host can't be both trusted and insecure
+			if (data_[persistent].trusted_hosts_.count({host, port, {}})) {
+				return false;
 			}
 
 			data_[persistent].ftp_tls_resumption_support_.emplace(std::make_tuple(host, port), node.text().as_bool());
@@ -149,6 +171,174 @@ void xml_cert_store::LoadTrustedCerts()
 	}
 }
 
+bool xml_cert_store::ReplayJournal()
+{
+	int64_t size{};
+	std::string buffer;
+	{
+		fz::file journal(fz::to_native(journal_file_), fz::file::reading, fz::file::existing);
+		if (!journal.opened()) {
+			return journal_offset_ == 0;
+		}
+
+		size = journal.size();
+		if (size < journal_offset_) {
+			return false;
+		}
+		if (size == journal_offset_ || journal.seek(journal_offset_, fz::file::begin) != journal_offset_) {
+			return true;
+		}
+
+		buffer.resize(static_cast<size_t>(size - journal_offset_));
+		size_t read{};
+		while (read < buffer.size()) {
+			int64_t r = journal.read(&buffer[read], static_cast<int64_t>(buffer.size() - read));
+			if (r <= 0) {
+				break;
+			}
+			read += static_cast<size_t>(r);
+		}
+		buffer.resize(read);
+	}
+
+	auto root = m_xmlFile.GetElement();
+
+	size_t pos{};
+	for (size_t nl = buffer.find('\n'); nl != std::string::npos; nl = buffer.find('\n', pos)) {
+		ApplyJournalRecord(root, buffer.substr(pos, nl - pos));
+		++journal_records_;
+		pos = nl + 1;
+	}
+	journal_offset_ += static_cast<int64_t>(pos);
+
+	if (journal_offset_ < size && AllowedToSave()) {
+		// Drop the partial record of an interrupted write, so that the next
+		// record does not get appended to it.
+		fz::file journal(fz::to_native(journal_file_), fz::file::writing, fz::file::existing);
+		if (journal.opened() && journal.seek(journal_offset_, fz::file::begin) == journal_offset_) {
+			journal.truncate();
+		}
+	}
+
+	return true;
+}
+
+void xml_cert_store::ApplyJournalRecord(pugi::xml_node& root, std::string const& record)
+{
+	auto const tokens = fz::strtok(record, " ");
+	if (tokens.size() < 3) {
+		return;
+	}
+
+	auto const decodedHost = fz::hex_decode(tokens[1]);
+	std::string const host(decodedHost.cbegin(), decodedHost.cend());
+	unsigned int const port = fz::to_integral<unsigned int>(tokens[2]);
+	if (host.empty() || port < 1 || port > 65535) {
+		return;
+	}
+
+	auto & d = data_[persistent];
+	if (tokens[0] == "trust" && tokens.size() == 7) {
+		t_certData cert;
+		cert.host = host;
+		cert.port = port;
+		cert.trustSans = tokens[3] == "1";
+		cert.data = fz::hex_decode(tokens[6]);
+
+		int64_t const now = fz::datetime::now().get_time_t();
+		int64_t const activationTime = fz::to_integral<int64_t>(tokens[4]);
+		int64_t const expirationTime = fz::to_integral<int64_t>(tokens[5]);
+		if (cert.data.empty() || !activationTime || activationTime > now || !expirationTime || expirationTime < now) {
+			return;
+		}
+
+		if (IsTrusted(host, port, cert.data, true, false)) {
+			return;
+		}
+
+		if (root) {
+			SetTrustedInXml(root, cert, activationTime, expirationTime);
+		}
+		d.insecure_hosts_.erase(std::make_tuple(host, port));
+		AddTrustedCert(d, std::move(cert));
+	}
+	else if (tokens[0] == "insecure" && tokens.size() == 3) {
+		if (d.insecure_hosts_.count(std::make_tuple(host, port))) {
+			return;
+		}
+
+		if (root) {
+			SetInsecureToXml(root, host, port);
+		}
+		RemoveTrustedCerts(d, host, port);
+		d.insecure_hosts_.emplace(std::make_tuple(host, port));
+	}
+	else if (tokens[0] == "resumption" && tokens.size() == 4) {
+		bool const secure = tokens[3] == "1";
+		if (root) {
+			SetSessionResumptionSupportInXml(root, host, static_cast<unsigned short>(port), secure);
+		}
+		d.ftp_tls_resumption_support_[std::make_tuple(host, static_cast<unsigned short>(port))] = secure;
+	}
+}
+
+bool xml_cert_store::AppendToJournal(std::string const& record)
+{
+	fz::file journal(fz::to_native(journal_file_), fz::file::writing, fz::file::existing);
+	if (!journal.opened()) {
+		return false;
+	}
+
+	// Anything not yet replayed would get lost on the next load
+	int64_t const end = journal.seek(0, fz::file::end);
+	if (end != journal_offset_) {
+		return false;
+	}
+
+	std::string const line = record + "\n";
+	int64_t const size = static_cast<int64_t>(line.size());
+	if (journal.write(line.c_str(), size) != size || !journal.fsync()) {
+		if (journal.seek(end, fz::file::begin) == end) {
+			journal.truncate();
+		}
+		return false;
+	}
+
+	journal_offset_ = end + size;
+	++journal_records_;
+
+	return true;
+}
+
+void xml_cert_store::Persist(std::string const& record)
+{
+	// Until the XML file exists, it needs to be written in full
+	if (!m_xmlFile.Modified() && AppendToJournal(record)) {
+		if (journal_records_ >= max_journal_records) {
+			Compact();
+		}
+		return;
+	}
+
+	if (!Compact()) {
+		SavingFileFailed(m_xmlFile.GetFileName(), m_xmlFile.GetError());
+	}
+}
+
+bool xml_cert_store::Compact()
+{
+	if (!m_xmlFile.GetElement() || !m_xmlFile.Save()) {
+		return false;
+	}
+
+	// Everything in the journal is part of the XML file now
+	fz::remove_file(fz::to_native(journal_file_));
+	journal_offset_ = 0;
+	journal_records_ = 0;
+
+	return true;
+}
+
 void xml_cert_store::SetInsecureToXml(pugi::xml_node& root, std::string const& host, unsigned int port)
 {
 	auto certs = root.child("TrustedCerts");
@@ -191,9 +381,7 @@ bool xml_cert_store::DoSetInsecure(std::string const& host, unsigned int port)
 		auto root = m_xmlFile.GetElement();
 		if (root) {
 			SetInsecureToXml(root, host, port);
-			if (!m_xmlFile.Save()) {
-				SavingFileFailed(m_xmlFile.GetFileName(), m_xmlFile.GetError());
-			}
+			Persist(fz::sprintf("insecure %s %d", fz::hex_encode<std::string>(host), port));
 		}
 	}
 
@@ -201,7 +389,7 @@ bool xml_cert_store::DoSetInsecure(std::string const& host, unsigned int port)
 }
 
 
-void xml_cert_store::SetTrustedInXml(pugi::xml_node& root, t_certData const& cert, fz::x509_certificate const& certificate)
+void xml_cert_store::SetTrustedInXml(pugi::xml_node& root, t_certData const& cert, int64_t activationTime, int64_t expirationTime)
 {
 	auto certs = root.child("TrustedCerts");
 	if (!certs) {
@@ -210,8 +398,8 @@ void xml_cert_store::SetTrustedInXml(pugi::xml_node& root, t_certData const& cer
 
 	auto xCert = certs.append_child("Certificate");
 	AddTextElementUtf8(xCert, "Data", fz::hex_encode<std::string>(cert.data));
-	AddTextElement(xCert, "ActivationTime", static_cast<int64_t>(certificate.get_activation_time().get_time_t()));
-	AddTextElement(xCert, "ExpirationTime", static_cast<int64_t>(certificate.get_expiration_time().get_time_t()));
+	AddTextElement(xCert, "ActivationTime", activationTime);
+	AddTextElement(xCert, "ExpirationTime", expirationTime);
 	AddTextElement(xCert, "Host", cert.host);
 	AddTextElement(xCert, "Port", cert.port);
 	AddTextElement(xCert, "TrustSANs", cert.trustSans ? L"1" : L"0");
@@ -245,10 +433,11 @@ bool xml_cert_store::DoSetTrusted(t_certData const& cert, fz::x509_certificate c
 	if (AllowedToSave()) {
 		auto root = m_xmlFile.GetElement();
 		if (root) {
-			SetTrustedInXml(root, cert, certificate);
-			if (!m_xmlFile.Save()) {
-				SavingFileFailed(m_xmlFile.GetFileName(), m_xmlFile.GetError());
-			}
+			int64_t const activationTime = certificate.get_activation_time().get_time_t();
+			int64_t const expirationTime = certificate.get_expiration_time().get_time_t();
+			SetTrustedInXml(root, cert, activationTime, expirationTime);
+			Persist(fz::sprintf("trust %s %d %d %d %d %s", fz::hex_encode<std::string>(cert.host), cert.port, cert.trustSans ? 1 : 0,
+				activationTime, expirationTime, fz::hex_encode<std::string>(cert.data)));
 		}
 	}
 
@@ -289,9 +478,7 @@ bool xml_cert_store::DoSetSessionResumptionSupport(std::string const& host, unsi
 		auto root = m_xmlFile.GetElement();
 		if (root) {
 			SetSessionResumptionSupportInXml(root, host, port, secure);
-			if (!m_xmlFile.Save()) {
-				SavingFileFailed(m_xmlFile.GetFileName(), m_xmlFile.GetError());
-			}
+			Persist(fz::sprintf("resumption %s %d %d", fz::hex_encode<std::string>(host), port, secure ? 1 : 0));
 		}
 	}
 
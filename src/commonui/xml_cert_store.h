@@ -20,14 +20,30 @@ protected:
 	virtual void LoadTrustedCerts() override;
 
 	void SetInsecureToXml(pugi::xml_node& root, std::string const& host, unsigned int port);
-	void SetTrustedInXml(pugi::xml_node& root, t_certData const& cert, fz::x509_certificate const& certificate);
+	void SetTrustedInXml(pugi::xml_node& root, t_certData const& cert, int64_t activationTime, int64_t expirationTime);
 	void SetSessionResumptionSupportInXml(pugi::xml_node& root, std::string const& host, unsigned short port, bool secure);
 
 	virtual void SavingFileFailed(std::wstring const& /*file*/, std::wstring const& /*msg*/) {}
 	virtual bool AllowedToSave() const { return true; }
 
 private:
+	void LoadXml();
+
+	// Changes are appended to a journal next to the XML file, which gets
+	// merged back into the XML file once it has grown long enough.
+	bool ReplayJournal();
+	void ApplyJournalRecord(pugi::xml_node& root, std::string const& record);
+	bool AppendToJournal(std::string const& record);
+	void Persist(std::string const& record);
+	bool Compact();
+
 	CXmlFile m_xmlFile;
+
+	std::wstring journal_file_;
+
+	// Number of bytes and records of the journal reflected in data_
+	int64_t journal_offset_{};
+	size_t journal_records_{};
 };
 
 #endif
@@ -2,6 +2,7 @@
 
 void activity_logger::record(_direction direction, uint64_t amount)
 {
+	totals_[direction].fetch_add(amount, std::memory_order_relaxed);
 	if (!amounts_[direction].fetch_add(amount)) {
 		fz::scoped_lock l(mtx_);
 		if (waiting_) {
@@ -5,17 +5,21 @@
 #include "engineprivate.h"
 #include "lookup.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "proxy.h"
 #include "servercapabilities.h"
+#include "trace.h"
 
 #include "../include/local_path.h"
 #include "../include/engine_options.h"
 #include "../include/sizeformatting_base.h"
+#include "../include/tls_session_cache.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/iputils.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/rate_limited_layer.hpp>
+#include <libfilezilla/tls_layer.hpp>
 
 #include <string.h>
 
@@ -65,6 +69,22 @@ Command CControlSocket::GetCurrentCommandId() const
 	return Command::none;
 }
 
+void CControlSocket::LogTransferTelemetry()
+{
+	CTransferTelemetry const t = engine_.transfer_telemetry_.Get();
+
+	std::wstring occupancy;
+	for (size_t i = 0; i < CTransferTelemetry::occupancy_buckets; ++i) {
+		occupancy += fz::sprintf(L" %d:%d", i, t.occupancy[i]);
+	}
+
+	log(logmsg::debug_info, L"Transfer took %d ms, waited for disk %d ms, network %d ms, peer %d ms. %d bytes in %d disk calls taking %d ms, %d network calls. Buffers ready:%s",
+		t.duration.get_milliseconds(), t.wait[CTransferTelemetry::disk].get_milliseconds(), t.wait[CTransferTelemetry::network].get_milliseconds(), t.wait[CTransferTelemetry::peer].get_milliseconds(),
+		t.bytes, t.disk_calls, t.disk_io.get_milliseconds(), t.network_calls, occupancy);
+
+	engine_.AddNotification(std::make_unique<CTransferTelemetryNotification>(t));
+}
+
 void CControlSocket::LogTransferResultMessage(int nErrorCode, CFileTransferOpData *pData)
 {
 	bool tmp{};
@@ -162,6 +182,10 @@ int CControlSocket::ResetOperation(int nErrorCode)
 		prefix = _("Critical error:") + L" ";
 	}
 
+	if (oldOperation && (nErrorCode & FZ_REPLY_ERROR) == FZ_REPLY_ERROR && (nErrorCode & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
+		engine_.metrics_.error(currentServer_.GetProtocol());
+	}
+
 	if (oldOperation) {
 		const Command commandId = oldOperation->opId;
 		switch (commandId)
@@ -198,6 +222,7 @@ int CControlSocket::ResetOperation(int nErrorCode)
 		case Command::transfer:
 			{
 				auto & data = static_cast<CFileTransferOpData &>(*oldOperation);
+				record_trace(engine_.GetEngineId(), trace_event::transfer_end, nErrorCode);
 				if (!data.download() && data.transferInitiated_) {
 					if (!currentServer_) {
 						log(logmsg::debug_warning, L"currentServer_ is empty");
@@ -207,6 +232,9 @@ int CControlSocket::ResetOperation(int nErrorCode)
 					}
 				}
 				LogTransferResultMessage(nErrorCode, &data);
+				if (data.transferInitiated_) {
+					LogTransferTelemetry();
+				}
 			}
 			break;
 		default:
@@ -374,6 +402,12 @@ int CControlSocket::CheckOverwriteFile()
 	data.localFileTime_ = data.download() ? data.writer_factory_.mtime() : data.reader_factory_.mtime();
 
 	if (data.download()) {
+		if (data.writer_factory_.range_end() != writer_factory::npos) {
+			// Ranges of a segmented download write into a preallocated file
+			// and always continue where they left off.
+			data.resume_ = true;
+			return FZ_REPLY_OK;
+		}
 		if (data.localFileSize_ == aio_base::nosize && data.localFileTime_.empty()) {
 			return FZ_REPLY_OK;
 		}
@@ -934,6 +968,34 @@ void CRealControlSocket::ResetSocket()
 	send_buffer_.clear();
 }
 
+std::vector<uint8_t> CRealControlSocket::GetCachedTlsSession(std::wstring const& host, unsigned int port)
+{
+	auto session = engine_.GetContext().GetTlsSessionCache().lookup(fz::str_tolower_ascii(fz::to_utf8(host)), static_cast<unsigned short>(port));
+	if (!session.empty()) {
+		log(logmsg::debug_info, L"Trying to resume TLS session of an earlier connection");
+	}
+	return session;
+}
+
+void CRealControlSocket::CacheTlsSession(fz::tls_layer const& tls, std::wstring const& host, unsigned int port)
+{
+	auto & cache = engine_.GetContext().GetTlsSessionCache();
+	auto const key = fz::str_tolower_ascii(fz::to_utf8(host));
+
+	switch (tls.get_state()) {
+	case fz::socket_state::none:
+		break;
+	case fz::socket_state::connecting:
+	case fz::socket_state::failed:
+		// The session might be the reason the handshake failed
+		cache.remove(key, static_cast<unsigned short>(port));
+		break;
+	default:
+		cache.store(key, static_cast<unsigned short>(port), tls.get_session_parameters());
+		break;
+	}
+}
+
 bool CControlSocket::SetFileExistsAction(CFileExistsNotification *pFileExistsNotification)
 {
 	if (!pFileExistsNotification) {
@@ -1016,6 +1078,29 @@ bool CControlSocket::SetFileExistsAction(CFileExistsNotification *pFileExistsNot
 			ResetOperation(FZ_REPLY_OK);
 		}
 		break;
+	case CFileExistsNotification::overwriteIfDifferent:
+		if (pFileExistsNotification->localSize < 0 || pFileExistsNotification->remoteSize < 0) {
+			SendNextCommand();
+		}
+		else if (CanCompareChecksums()) {
+			// A grown local file may still share its start with the remote file,
+			// in which case only the remainder needs to be uploaded.
+			if (pFileExistsNotification->localSize == pFileExistsNotification->remoteSize ||
+				(!data.download() && pFileExistsNotification->localSize > pFileExistsNotification->remoteSize))
+			{
+				data.compareChecksum_ = true;
+			}
+			SendNextCommand();
+		}
+		else if (pFileExistsNotification->localSize != pFileExistsNotification->remoteSize) {
+			SendNextCommand();
+		}
+		else {
+			log(logmsg::debug_info, L"Server does not support checksums, comparing size and modification time instead");
+			pFileExistsNotification->overwriteAction = CFileExistsNotification::overwriteSizeOrNewer;
+			return SetFileExistsAction(pFileExistsNotification);
+		}
+		break;
 	case CFileExistsNotification::resume:
 		if (data.download() && data.localFileSize_ != aio_base::nosize) {
 			data.resume_ = true;
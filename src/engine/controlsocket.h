@@ -131,6 +131,9 @@ public:
 	bool tryAbsolutePath_{};
 	bool resume_{};
 
+	// Skip the transfer if source and target have the same checksum
+	bool compareChecksum_{};
+
 	transfer_flags flags_;
 
 	// Set to true when sending the command which
@@ -220,6 +223,9 @@ public:
 	void CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification);
 	bool SetFileExistsAction(CFileExistsNotification *pFileExistsNotification);
 
+	// Whether file contents can be compared through server-side checksums
+	virtual bool CanCompareChecksums() const { return false; }
+
 	CServer const& GetCurrentServer() const;
 
 	// Conversion function which convert between local and server charset.
@@ -286,6 +292,7 @@ protected:
 	virtual void UpdateCache(COpData const& data, CServerPath const& serverPath, std::wstring const& remoteFile, int64_t fileSize);
 
 	void LogTransferResultMessage(int nErrorCode, CFileTransferOpData *pData);
+	void LogTransferTelemetry();
 
 	// Called by ResetOperation if there's a queued operation
 	int ParseSubcommandResult(int prevResult, std::unique_ptr<COpData> && previousOperation);
@@ -331,6 +338,7 @@ class CProxySocket;
 
 namespace fz {
 class rate_limited_layer;
+class tls_layer;
 }
 
 class CRealControlSocket : public CControlSocket
@@ -358,6 +366,14 @@ protected:
 
 	virtual void SetSocketBufferSizes() {};
 
+	// Session of an earlier connection to the same server, shared by all
+	// engines of the context
+	std::vector<uint8_t> GetCachedTlsSession(std::wstring const& host, unsigned int port);
+
+	// Remembers the session of an established connection, or forgets the
+	// cached one if the connection did not get established.
+	void CacheTlsSession(fz::tls_layer const& tls, std::wstring const& host, unsigned int port);
+
 	int Send(unsigned char const* buffer, unsigned int len);
 	int Send(char const* buffer, unsigned int len) {
 		return Send(reinterpret_cast<unsigned char const*>(buffer), len);
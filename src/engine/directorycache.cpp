@@ -1,113 +1,114 @@
 #include "filezilla.h"
 #include "directorycache.h"
 
+#include <algorithm>
 #include <assert.h>
 
+namespace {
+bool over_limit(int64_t entries, int64_t files)
+{
+	return entries > 50000 ||
+		(files > 1000000 && entries > 1000) ||
+		(files > 5000000 && entries > 100);
+}
+}
+
 CDirectoryCache::CDirectoryCache()
 {
 }
 
 CDirectoryCache::~CDirectoryCache()
 {
-	for (auto & serverEntry : m_serverList) {
-		for (auto & cacheEntry : serverEntry.cacheList) {
-#ifndef NDEBUG
-			m_totalFileCount -= cacheEntry.listing.size();
-#endif
-			tLruList::iterator* lruIt = (tLruList::iterator*)cacheEntry.lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
-			}
-		}
-	}
-#ifndef NDEBUG
-	assert(m_totalFileCount == 0);
-#endif
 }
 
 void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	// Prepared before locking, from then on the listing is only read
+	auto snapshot = std::make_shared<CDirectoryListing>(listing);
+	snapshot->BuildFindMaps();
 
-	tServerIter sit = CreateServerEntry(server);
-	assert(sit != m_serverList.end());
+	{
+		std::unique_lock<std::shared_mutex> lock;
+		tServerEntry serverEntry = CreateServerEntry(server, lock);
 
-	m_totalFileCount += listing.size();
+		m_totalFileCount += listing.size();
 
-	tCacheIter cit;
-	bool unused;
-	if (Lookup(cit, sit, listing.path, true, unused)) {
-		auto & entry = const_cast<CCacheEntry&>(*cit);
+		auto [iter, inserted] = serverEntry->cacheList.try_emplace(listing.path);
+		auto & entry = iter->second;
+		if (inserted) {
+			++m_totalEntryCount;
+		}
+		else {
+			m_totalFileCount -= entry.listing->size();
+		}
+		entry.listing = std::move(snapshot);
 		entry.modificationTime = fz::monotonic_clock::now();
-
-		m_totalFileCount -= cit->listing.size();
-		entry.listing = listing;
-
-		return;
+		Touch(entry);
 	}
 
-	cit = sit->cacheList.emplace_hint(cit, listing);
-
-	UpdateLru(sit, cit);
-
-	Prune();
+	if (NeedsPruning()) {
+		Prune();
+	}
 }
 
 bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server, const CServerPath &path, bool allowUnsureEntries, bool& is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	auto snapshot = Lookup(server, path, allowUnsureEntries, is_outdated);
+	if (!snapshot) {
 		return false;
 	}
 
-	tCacheIter iter;
-	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated)) {
-		listing = iter->listing;
-		return true;
-	}
-
-	return false;
+	listing = *snapshot;
+	return true;
 }
 
-bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
+std::shared_ptr<CDirectoryListing const> CDirectoryCache::Lookup(CServer const& server, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
 {
-	CCacheEntry dummy;
-	dummy.listing.path = path;
-	cacheIter = sit->cacheList.lower_bound(dummy);
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (serverEntry) {
+		std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
+
+		auto iter = Lookup(*serverEntry, path, allowUnsureEntries, is_outdated);
+		if (iter != serverEntry->cacheList.end()) {
+			++hits_;
+			return iter->second.listing;
+		}
+	}
 
-	if (cacheIter != sit->cacheList.end()) {
-		CCacheEntry const& entry = *cacheIter;
+	++misses_;
+	return nullptr;
+}
 
-		if (entry.listing.path == path) {
-			UpdateLru(sit, cacheIter);
+CDirectoryCache::tCacheIter CDirectoryCache::Lookup(CServerEntry & serverEntry, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
+{
+	auto iter = serverEntry.cacheList.find(path);
+	if (iter == serverEntry.cacheList.end()) {
+		return iter;
+	}
 
-			if (!allowUnsureEntries && entry.listing.get_unsure_flags()) {
-				return false;
-			}
+	CCacheEntry const& entry = iter->second;
+	Touch(entry);
 
-			is_outdated = (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
-			return true;
-		}
+	if (!allowUnsureEntries && entry.listing->get_unsure_flags()) {
+		return serverEntry.cacheList.end();
 	}
 
-	return false;
+	is_outdated = (fz::monotonic_clock::now() - entry.listing->m_firstListTime) > fz::duration::from_milliseconds(ttl_.load(std::memory_order_relaxed));
+	return iter;
 }
 
 bool CDirectoryCache::DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return false;
 	}
 
-	tCacheIter iter;
-	if (Lookup(iter, sit, path, true, is_outdated)) {
-		hasUnsureEntries = iter->listing.get_unsure_flags();
+	std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
+
+	auto iter = Lookup(*serverEntry, path, true, is_outdated);
+	if (iter != serverEntry->cacheList.end()) {
+		hasUnsureEntries = iter->second.listing->get_unsure_flags();
 		return true;
 	}
 
@@ -119,17 +120,21 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 	LookupResults results{};
 	CDirentry entry;
 
-	fz::scoped_lock lock(mutex_);
+	tListing listing;
+	bool outdated{};
+	{
+		tServerEntry serverEntry = GetServerEntry(server);
+		if (!serverEntry) {
+			return {results, entry};
+		}
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		return {results, entry};
-	}
+		std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
 
-	tCacheIter iter;
-	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
-		return {results, entry};
+		auto iter = Lookup(*serverEntry, path, true, outdated);
+		if (iter == serverEntry->cacheList.end()) {
+			return {results, entry};
+		}
+		listing = iter->second.listing;
 	}
 
 	if (outdated) {
@@ -141,18 +146,15 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 
 	results |= LookupResults::direxists;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
-
-	size_t i = listing.FindFile_CmpCase(filename);
+	size_t i = listing->FindFile_CmpCase(filename);
 	if (i != std::string::npos) {
-		entry = listing[i];
+		entry = (*listing)[i];
 		results |= LookupResults::found | LookupResults::matchedcase;
 	}
 	else if (server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive)) {
-		i = listing.FindFile_CmpNoCase(filename);
+		i = listing->FindFile_CmpNoCase(filename);
 		if (i != std::string::npos) {
-			entry = listing[i];
+			entry = (*listing)[i];
 			results |= LookupResults::found;
 		}
 	}
@@ -164,17 +166,21 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 {
 	std::vector<std::tuple<LookupResults, CDirentry>> ret;
 
-	fz::scoped_lock lock(mutex_);
+	tListing listing;
+	bool outdated{};
+	{
+		tServerEntry serverEntry = GetServerEntry(server);
+		if (!serverEntry) {
+			return ret;
+		}
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		return ret;
-	}
+		std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
 
-	tCacheIter iter;
-	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
-		return ret;
+		auto iter = Lookup(*serverEntry, path, true, outdated);
+		if (iter == serverEntry->cacheList.end()) {
+			return ret;
+		}
+		listing = iter->second.listing;
 	}
 
 	LookupResults results{};
@@ -188,23 +194,20 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 
 	results |= LookupResults::direxists;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
-
 	ret.reserve(filenames.size());
 
 	for (auto const& filename : filenames) {
 		CDirentry entry;
 		LookupResults fileresults = results;
-		size_t i = listing.FindFile_CmpCase(filename);
+		size_t i = listing->FindFile_CmpCase(filename);
 		if (i != std::string::npos) {
-			entry = listing[i];
+			entry = (*listing)[i];
 			fileresults |= LookupResults::found | LookupResults::matchedcase;
 		}
 		else if (server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive)) {
-			i = listing.FindFile_CmpNoCase(filename);
+			i = listing->FindFile_CmpNoCase(filename);
 			if (i != std::string::npos) {
-				entry = listing[i];
+				entry = (*listing)[i];
 				fileresults |= LookupResults::found;
 			}
 		}
@@ -216,34 +219,35 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 
 bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServerPath const& path, std::wstring const& filename, bool &dirDidExist, bool &matchedCase)
 {
-	fz::scoped_lock lock(mutex_);
+	dirDidExist = false;
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		dirDidExist = false;
-		return false;
-	}
+	tListing listing;
+	{
+		tServerEntry serverEntry = GetServerEntry(server);
+		if (!serverEntry) {
+			return false;
+		}
 
-	tCacheIter iter;
-	bool unused;
-	if (!Lookup(iter, sit, path, true, unused)) {
-		dirDidExist = false;
-		return false;
+		std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
+
+		bool unused;
+		auto iter = Lookup(*serverEntry, path, true, unused);
+		if (iter == serverEntry->cacheList.end()) {
+			return false;
+		}
+		listing = iter->second.listing;
 	}
 	dirDidExist = true;
 
-	const CCacheEntry &cacheEntry = *iter;
-	const CDirectoryListing &listing = cacheEntry.listing;
-
-	size_t i = listing.FindFile_CmpCase(filename);
+	size_t i = listing->FindFile_CmpCase(filename);
 	if (i != std::string::npos) {
-		entry = listing[i];
+		entry = (*listing)[i];
 		matchedCase = true;
 		return true;
 	}
-	i = listing.FindFile_CmpNoCase(filename);
+	i = listing->FindFile_CmpNoCase(filename);
 	if (i != std::string::npos) {
-		entry = listing[i];
+		entry = (*listing)[i];
 		matchedCase = false;
 		return true;
 	}
@@ -253,60 +257,57 @@ bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServe
 
 bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return false;
 	}
 
+	std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+
 	bool const cmpCase = server.GetCaseSensitivity() == CaseSensitivity::yes;
 	bool dir{};
 
-	auto const now = fz::monotonic_clock::now();
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-
+	for (auto & [entryPath, entry] : serverEntry->cacheList) {
 		if (cmpCase) {
-			if (path != entry.listing.path) {
+			if (path != entryPath) {
 				continue;
 			}
 		}
 		else {
-			if (path.CmpNoCase(entry.listing.path)) {
+			if (path.CmpNoCase(entryPath)) {
 				continue;
 			}
 		}
 
-		UpdateLru(sit, iter);
+		Touch(entry);
 
-		for (unsigned int i = 0; i < entry.listing.size(); i++) {
+		auto & listing = Modify(entry);
+		for (unsigned int i = 0; i < listing.size(); i++) {
 			bool same;
 			if (cmpCase) {
-				same = filename == entry.listing[i].name;
+				same = filename == listing[i].name;
 			}
 			else {
-				same = !fz::stricmp(filename, entry.listing[i].name);
+				same = !fz::stricmp(filename, listing[i].name);
 			}
 			if (same) {
-				if (entry.listing[i].is_dir()) {
+				if (listing[i].is_dir()) {
 					dir = true;
 				}
-				entry.listing.get(i).flags |= CDirentry::flag_unsure;
+				listing.get(i).flags |= CDirentry::flag_unsure;
 			}
 		}
-		entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
-		entry.modificationTime = now;
+		listing.m_flags |= CDirectoryListing::unsure_unknown;
+		Publish(entry);
 	}
 
 	if (dir) {
 		CServerPath child = path;
 		if (child.ChangePath(filename)) {
-			for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-				auto & entry = const_cast<CCacheEntry&>(*iter);
-				if (path.IsParentOf(entry.listing.path, !cmpCase, true)) {
-					entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
-					entry.modificationTime = now;
+			for (auto & [entryPath, entry] : serverEntry->cacheList) {
+				if (path.IsParentOf(entryPath, !cmpCase, true)) {
+					Modify(entry).m_flags |= CDirectoryListing::unsure_unknown;
+					Publish(entry);
 				}
 			}
 		}
@@ -317,29 +318,34 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 
 bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return false;
 	}
 
+	std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+	return DoUpdateFile(*serverEntry, path, filename, mayCreate, type, size, ownerGroup);
+}
+
+bool CDirectoryCache::DoUpdateFile(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
+{
 	bool updated = false;
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (path.CmpNoCase(entry.listing.path)) {
+	for (auto & [entryPath, entry] : serverEntry.cacheList) {
+		if (path.CmpNoCase(entryPath)) {
 			continue;
 		}
 
-		UpdateLru(sit, iter);
+		Touch(entry);
+
+		auto & listing = Modify(entry);
 
 		bool matchCase = false;
 		size_t i;
-		for (i = 0; i < entry.listing.size(); ++i) {
-			if (!fz::stricmp(filename, entry.listing[i].name)) {
-				entry.listing.get(i).flags |= CDirentry::flag_unsure;
-				if (entry.listing[i].name == filename) {
+		for (i = 0; i < listing.size(); ++i) {
+			if (!fz::stricmp(filename, listing[i].name)) {
+				listing.get(i).flags |= CDirentry::flag_unsure;
+				if (listing[i].name == filename) {
 					matchCase = true;
 					break;
 				}
@@ -347,15 +353,15 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 		}
 
 		if (matchCase) {
-			Filetype old_type = entry.listing[i].is_dir() ? dir : file;
+			Filetype old_type = listing[i].is_dir() ? dir : file;
 			if (type != old_type) {
-				entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
+				listing.m_flags |= CDirectoryListing::unsure_invalid;
 			}
 			else if (type == dir) {
-				entry.listing.m_flags |= CDirectoryListing::unsure_dir_changed;
+				listing.m_flags |= CDirectoryListing::unsure_dir_changed;
 			}
 			else {
-				entry.listing.m_flags |= CDirectoryListing::unsure_file_changed;
+				listing.m_flags |= CDirectoryListing::unsure_file_changed;
 			}
 		}
 		else if (type != unknown && mayCreate) {
@@ -373,23 +379,23 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 			}
 			switch (type) {
 			case dir:
-				entry.listing.m_flags |= CDirectoryListing::unsure_dir_added | CDirectoryListing::listing_has_dirs;
+				listing.m_flags |= CDirectoryListing::unsure_dir_added | CDirectoryListing::listing_has_dirs;
 				break;
 			case file:
-				entry.listing.m_flags |= CDirectoryListing::unsure_file_added;
+				listing.m_flags |= CDirectoryListing::unsure_file_added;
 				break;
 			default:
-				entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
+				listing.m_flags |= CDirectoryListing::unsure_invalid;
 				break;
 			}
-			entry.listing.Append(std::move(direntry));
+			listing.Append(std::move(direntry));
 
 			++m_totalFileCount;
 		}
 		else {
-			entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
+			listing.m_flags |= CDirectoryListing::unsure_unknown;
 		}
-		entry.modificationTime = fz::monotonic_clock::now();
+		Publish(entry);
 
 		updated = true;
 	}
@@ -399,91 +405,94 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 
 bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return false;
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		if (path.CmpNoCase(entry.listing.path)) {
+	std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+	DoRemoveFile(*serverEntry, path, filename);
+
+	return true;
+}
+
+void CDirectoryCache::DoRemoveFile(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename)
+{
+	for (auto & [entryPath, entry] : serverEntry.cacheList) {
+		if (path.CmpNoCase(entryPath)) {
 			continue;
 		}
 
-		UpdateLru(sit, iter);
+		Touch(entry);
+
+		auto & listing = Modify(entry);
 
 		bool matchCase = false;
-		for (size_t i = 0; i < entry.listing.size(); ++i) {
-			if (entry.listing[i].name == filename) {
+		for (size_t i = 0; i < listing.size(); ++i) {
+			if (listing[i].name == filename) {
 				matchCase = true;
 			}
 		}
 
 		if (matchCase) {
 			size_t i;
-			for (i = 0; i < entry.listing.size(); ++i) {
-				if (entry.listing[i].name == filename) {
+			for (i = 0; i < listing.size(); ++i) {
+				if (listing[i].name == filename) {
 					break;
 				}
 			}
-			assert(i != entry.listing.size());
+			assert(i != listing.size());
 
-			entry.listing.RemoveEntry(i); // This does set m_hasUnsureEntries
+			listing.RemoveEntry(i); // This does set m_hasUnsureEntries
 			--m_totalFileCount;
 		}
 		else {
-			for (size_t i = 0; i < entry.listing.size(); ++i) {
-				if (!fz::stricmp(filename, entry.listing[i].name)) {
-					entry.listing.get(i).flags |= CDirentry::flag_unsure;
+			for (size_t i = 0; i < listing.size(); ++i) {
+				if (!fz::stricmp(filename, listing[i].name)) {
+					listing.get(i).flags |= CDirentry::flag_unsure;
 				}
 			}
-			entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
+			listing.m_flags |= CDirectoryListing::unsure_invalid;
 		}
-		entry.modificationTime = fz::monotonic_clock::now();
+		Publish(entry);
 	}
-
-	return true;
 }
 
 void CDirectoryCache::InvalidateServer(CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
-
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (!iter->server.SameContent(server)) {
-			continue;
-		}
+	tServerEntry serverEntry;
+	{
+		std::unique_lock<std::shared_mutex> lock(mutex_);
 
-		for (tCacheIter cit = iter->cacheList.begin(); cit != iter->cacheList.end(); ++cit) {
-			tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
+		for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
+			if ((*iter)->server.SameContent(server)) {
+				serverEntry = std::move(*iter);
+				m_serverList.erase(iter);
+				break;
 			}
-
-			m_totalFileCount -= cit->listing.size();
 		}
+	}
 
-		m_serverList.erase(iter);
-		break;
+	if (serverEntry) {
+		std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+		Clear(*serverEntry);
+		serverEntry->removed = true;
 	}
 }
 
 bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return false;
 	}
 
-	tCacheIter iter;
+	std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
+
 	bool unused;
-	if (Lookup(iter, sit, path, true, unused)) {
-		time = iter->modificationTime;
+	auto iter = Lookup(*serverEntry, path, true, unused);
+	if (iter != serverEntry->cacheList.end()) {
+		time = iter->second.modificationTime;
 		return true;
 	}
 
@@ -492,96 +501,99 @@ bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& se
 
 void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const&)
 {
-	fz::scoped_lock lock(mutex_);
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
+		return;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+	DoRemoveDir(*serverEntry, path, filename);
+}
 
+void CDirectoryCache::DoRemoveDir(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename)
+{
 	// TODO: This is not 100% foolproof and may not work properly
 	// Perhaps just throw away the complete cache?
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		return;
-	}
-
 	CServerPath absolutePath = path;
 	if (!absolutePath.AddSegment(filename)) {
 		absolutePath.clear();
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ) {
-		auto & entry = const_cast<CCacheEntry&>(*iter);
-		// Delete exact matches and subdirs
-		if (!absolutePath.empty() && (entry.listing.path == absolutePath || absolutePath.IsParentOf(entry.listing.path, true))) {
-			m_totalFileCount -= entry.listing.size();
-			tLruList::iterator* lruIt = (tLruList::iterator*)iter->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
+	if (!absolutePath.empty()) {
+		for (auto iter = serverEntry.cacheList.begin(); iter != serverEntry.cacheList.end(); ) {
+			// Delete exact matches and subdirs
+			if (iter->first == absolutePath || absolutePath.IsParentOf(iter->first, true)) {
+				Erase(serverEntry, iter++);
+			}
+			else {
+				++iter;
 			}
-			sit->cacheList.erase(iter++);
-		}
-		else {
-			++iter;
 		}
 	}
 
-	RemoveFile(server, path, filename);
+	DoRemoveFile(serverEntry, path, filename);
 }
 
 void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return;
 	}
 
-	tCacheIter iter;
-	bool is_outdated = false;
-	bool found = Lookup(iter, sit, pathFrom, true, is_outdated);
-	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
-		if (pathFrom == pathTo) {
-			RemoveFile(server, pathFrom, fileTo);
-			size_t i;
-			for (i = 0; i < listing.size(); ++i) {
-				if (listing[i].name == fileFrom) {
-					break;
-				}
-			}
-			if (i != listing.size()) {
-				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					RemoveDir(server, pathFrom, fileTo, CServerPath());
-					UpdateFile(server, pathFrom, fileTo, true, dir);
+	{
+		std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+
+		bool is_outdated = false;
+		auto iter = Lookup(*serverEntry, pathFrom, true, is_outdated);
+		if (iter != serverEntry->cacheList.end()) {
+			// Modifications replace the listing, always look at the current one.
+			auto & entry = iter->second;
+			auto const find = [&]() {
+				size_t i;
+				for (i = 0; i < entry.listing->size(); ++i) {
+					if ((*entry.listing)[i].name == fileFrom) {
+						break;
+					}
 				}
-				else {
-					listing.get(i).name = fileTo;
-					listing.get(i).flags |= CDirentry::flag_unsure;
-					listing.m_flags |= CDirectoryListing::unsure_unknown;
-					listing.ClearFindMap();
+				return i;
+			};
+
+			if (pathFrom == pathTo) {
+				DoRemoveFile(*serverEntry, pathFrom, fileTo);
+				size_t i = find();
+				if (i != entry.listing->size()) {
+					if ((*entry.listing)[i].is_dir()) {
+						DoRemoveDir(*serverEntry, pathFrom, fileFrom);
+						DoRemoveDir(*serverEntry, pathFrom, fileTo);
+						DoUpdateFile(*serverEntry, pathFrom, fileTo, true, dir);
+					}
+					else {
+						auto & listing = Modify(entry);
+						listing.get(i).name = fileTo;
+						listing.get(i).flags |= CDirentry::flag_unsure;
+						listing.m_flags |= CDirectoryListing::unsure_unknown;
+						listing.ClearFindMap();
+						Publish(entry);
+					}
 				}
+				return;
 			}
-			return;
-		}
-		else {
-			size_t i;
-			for (i = 0; i < listing.size(); ++i) {
-				if (listing[i].name == fileFrom) {
-					break;
-				}
-			}
-			if (i != listing.size()) {
-				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					UpdateFile(server, pathTo, fileTo, true, dir);
-				}
-				else {
-					RemoveFile(server, pathFrom, fileFrom);
-					UpdateFile(server, pathTo, fileTo, true, file);
+			else {
+				size_t i = find();
+				if (i != entry.listing->size()) {
+					if ((*entry.listing)[i].is_dir()) {
+						DoRemoveDir(*serverEntry, pathFrom, fileFrom);
+						DoUpdateFile(*serverEntry, pathTo, fileTo, true, dir);
+					}
+					else {
+						DoRemoveFile(*serverEntry, pathFrom, fileFrom);
+						DoUpdateFile(*serverEntry, pathTo, fileTo, true, file);
+					}
 				}
+				return;
 			}
-			return;
 		}
 	}
 
@@ -591,30 +603,33 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 
 void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const& path, std::wstring const& filename, std::wstring& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
-
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
+	tServerEntry serverEntry = GetServerEntry(server);
+	if (!serverEntry) {
 		return;
 	}
 
-	tCacheIter iter;
-	bool is_outdated = false;
-	bool found = Lookup(iter, sit, path, true, is_outdated);
-	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
-		size_t i;
-		for (i = 0; i < listing.size(); ++i) {
-			if (listing[i].name == filename) {
-				break;
+	{
+		std::unique_lock<std::shared_mutex> lock(serverEntry->mutex);
+
+		bool is_outdated = false;
+		auto iter = Lookup(*serverEntry, path, true, is_outdated);
+		if (iter != serverEntry->cacheList.end()) {
+			auto & entry = iter->second;
+			size_t i;
+			for (i = 0; i < entry.listing->size(); ++i) {
+				if ((*entry.listing)[i].name == filename) {
+					break;
+				}
 			}
-		}
-		if (i != listing.size()) {
-			if (!listing[i].is_dir()) {
-				listing.get(i).ownerGroup.get() = ownerGroup;
-				listing.ClearFindMap();
+			if (i != entry.listing->size()) {
+				if (!(*entry.listing)[i].is_dir()) {
+					auto & listing = Modify(entry);
+					listing.get(i).ownerGroup.get() = ownerGroup;
+					listing.ClearFindMap();
+					Publish(entry);
+				}
+				return;
 			}
-			return;
 		}
 	}
 
@@ -622,76 +637,178 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 	InvalidateServer(server);
 }
 
-
-CDirectoryCache::tServerIter CDirectoryCache::CreateServerEntry(CServer const& server)
+CDirectoryCache::tServerEntry CDirectoryCache::CreateServerEntry(CServer const& server, std::unique_lock<std::shared_mutex> & lock)
 {
-	for (tServerIter iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
-			return iter;
+	while (true) {
+		tServerEntry serverEntry = GetServerEntry(server);
+		if (!serverEntry) {
+			std::unique_lock<std::shared_mutex> listLock(mutex_);
+			for (auto const& entry : m_serverList) {
+				if (entry->server.SameContent(server)) {
+					serverEntry = entry;
+					break;
+				}
+			}
+			if (!serverEntry) {
+				serverEntry = std::make_shared<CServerEntry>(server);
+				m_serverList.push_back(serverEntry);
+			}
+		}
+
+		lock = std::unique_lock<std::shared_mutex>(serverEntry->mutex);
+		if (!serverEntry->removed) {
+			return serverEntry;
 		}
-	}
-	m_serverList.emplace_back(server);
 
-	return --m_serverList.end();
+		// Got removed in the meantime, try again
+		lock.unlock();
+	}
 }
 
-CDirectoryCache::tServerIter CDirectoryCache::GetServerEntry(CServer const& server)
+CDirectoryCache::tServerEntry CDirectoryCache::GetServerEntry(CServer const& server)
 {
-	tServerIter iter;
-	for (iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
-			break;
+	std::shared_lock<std::shared_mutex> lock(mutex_);
+
+	for (auto const& entry : m_serverList) {
+		if (entry->server.SameContent(server)) {
+			return entry;
 		}
 	}
 
-	return iter;
+	return nullptr;
 }
 
-void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
+CDirectoryListing& CDirectoryCache::Modify(CCacheEntry & entry)
 {
-	tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-	if (lruIt) {
-		m_leastRecentlyUsedList.splice(m_leastRecentlyUsedList.end(), m_leastRecentlyUsedList, *lruIt);
-		**lruIt = std::make_pair(sit, cit);
-	}
-	else {
-		auto & entry = const_cast<CCacheEntry&>(*cit);
-		entry.lruIt = (void*)new tLruList::iterator(m_leastRecentlyUsedList.emplace(m_leastRecentlyUsedList.end(), sit, cit));
+	// Whoever got the listing through a lookup keeps seeing it unchanged.
+	// The copy is cheap, it shares the entries until they get changed.
+	auto listing = std::make_shared<CDirectoryListing>(*entry.listing);
+	entry.listing = listing;
+
+	return *listing;
+}
+
+void CDirectoryCache::Publish(CCacheEntry & entry)
+{
+	entry.listing->BuildFindMaps();
+	entry.modificationTime = fz::monotonic_clock::now();
+}
+
+void CDirectoryCache::Erase(CServerEntry & serverEntry, tCacheIter const& iter)
+{
+	m_totalFileCount -= iter->second.listing->size();
+	--m_totalEntryCount;
+	serverEntry.cacheList.erase(iter);
+}
+
+void CDirectoryCache::Clear(CServerEntry & serverEntry)
+{
+	for (auto const& entry : serverEntry.cacheList) {
+		m_totalFileCount -= entry.second.listing->size();
 	}
+	m_totalEntryCount -= serverEntry.cacheList.size();
+	serverEntry.cacheList.clear();
+}
+
+void CDirectoryCache::Touch(CCacheEntry const& entry)
+{
+	entry.lastUse.store(++lruClock_, std::memory_order_relaxed);
+}
+
+bool CDirectoryCache::NeedsPruning() const
+{
+	return over_limit(m_totalEntryCount.load(std::memory_order_relaxed), m_totalFileCount.load(std::memory_order_relaxed));
 }
 
 void CDirectoryCache::Prune()
 {
-	while ((m_leastRecentlyUsedList.size() > 50000) ||
-		(m_totalFileCount > 1000000 && m_leastRecentlyUsedList.size() > 1000) ||
-		(m_totalFileCount > 5000000 && m_leastRecentlyUsedList.size() > 100))
-	{
-		tFullEntryPosition pos = m_leastRecentlyUsedList.front();
-		tLruList::iterator* lruIt = (tLruList::iterator*)pos.second->lruIt;
-		delete lruIt;
+	fz::scoped_lock pruneLock(prune_mutex_);
+	if (!NeedsPruning()) {
+		// Someone else was faster
+		return;
+	}
 
-		m_totalFileCount -= pos.second->listing.size();
+	std::vector<tServerEntry> servers;
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex_);
+		servers = m_serverList;
+	}
 
-		pos.first->cacheList.erase(pos.second);
-		if (pos.first->cacheList.empty()) {
-			m_serverList.erase(pos.first);
+	struct candidate final
+	{
+		uint64_t lastUse;
+		size_t files;
+		CServerEntry* serverEntry;
+		CServerPath path;
+	};
+
+	std::vector<candidate> candidates;
+	for (auto const& serverEntry : servers) {
+		std::shared_lock<std::shared_mutex> lock(serverEntry->mutex);
+		for (auto const& [path, entry] : serverEntry->cacheList) {
+			candidates.push_back({entry.lastUse.load(std::memory_order_relaxed), entry.listing->size(), serverEntry.get(), path});
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](candidate const& lhs, candidate const& rhs) { return lhs.lastUse < rhs.lastUse; });
+
+	// Go a bit below the limits, so that not every following Store
+	// has to prune again.
+	int64_t entries = m_totalEntryCount;
+	int64_t files = m_totalFileCount;
+	int64_t const entrySlack = entries / 16;
+	int64_t const fileSlack = files / 16;
+
+	size_t count{};
+	while (count < candidates.size() && over_limit(entries + entrySlack, files + fileSlack)) {
+		--entries;
+		files -= candidates[count].files;
+		++count;
+	}
+	candidates.resize(count);
+
+	std::stable_sort(candidates.begin(), candidates.end(), [](candidate const& lhs, candidate const& rhs) { return lhs.serverEntry < rhs.serverEntry; });
+	for (auto it = candidates.cbegin(); it != candidates.cend(); ) {
+		auto & serverEntry = *it->serverEntry;
+		std::unique_lock<std::shared_mutex> lock(serverEntry.mutex);
+		for (; it != candidates.cend() && it->serverEntry == &serverEntry; ++it) {
+			auto iter = serverEntry.cacheList.find(it->path);
+
+			// Keep entries used since
+			if (iter != serverEntry.cacheList.end() && iter->second.lastUse.load(std::memory_order_relaxed) == it->lastUse) {
+				Erase(serverEntry, iter);
+			}
 		}
+	}
 
-		m_leastRecentlyUsedList.pop_front();
+	std::unique_lock<std::shared_mutex> lock(mutex_);
+	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ) {
+		auto & serverEntry = **iter;
+		std::unique_lock<std::shared_mutex> serverLock(serverEntry.mutex, std::try_to_lock);
+		if (serverLock && serverEntry.cacheList.empty()) {
+			serverEntry.removed = true;
+			iter = m_serverList.erase(iter);
+		}
+		else {
+			++iter;
+		}
 	}
 }
 
 void CDirectoryCache::SetTtl(fz::duration const& ttl)
 {
-	fz::scoped_lock lock(mutex_);
-
+	fz::duration value = ttl;
 	if (ttl < fz::duration::from_seconds(30)) {
-		ttl_ = fz::duration::from_seconds(30);
+		value = fz::duration::from_seconds(30);
 	}
 	else if (ttl > fz::duration::from_days(1)) {
-		ttl_ = fz::duration::from_days(1);
-	}
-	else {
-		ttl_ = ttl;
+		value = fz::duration::from_days(1);
 	}
+
+	ttl_ = value.get_milliseconds();
+}
+
+void CDirectoryCache::GetStatistics(uint64_t & hits, uint64_t & misses) const
+{
+	hits = hits_.load(std::memory_order_relaxed);
+	misses = misses_.load(std::memory_order_relaxed);
 }
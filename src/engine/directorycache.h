@@ -12,14 +12,21 @@ multiple entries in a cache directory using a case insensitive search
 On other operations, the directory is marked as unsure. It may still be valid,
 but for some operations the engine/interface prefers to retrieve a clean
 version.
+
+The cache is shared by all engines. Each server has its own lock, lookups
+only take it shared and hand out the cached listings themselves. These are
+never modified once stored, changes replace them with an updated copy.
 */
 
 #include "../include/directorylisting.h"
 
 #include <libfilezilla/mutex.hpp>
 
-#include <list>
-#include <set>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 
 enum class LookupFlags
 {
@@ -90,6 +97,11 @@ public:
 	void Store(CDirectoryListing const& listing, CServer const& server);
 	bool GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path);
 	bool Lookup(CDirectoryListing &listing, CServer const&server, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
+
+	// Returns the cached listing itself rather than a copy. It never changes,
+	// updates to the cache replace it. Null if not found.
+	std::shared_ptr<CDirectoryListing const> Lookup(CServer const&server, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
+
 	bool DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated);
 	bool LookupFile(CDirentry &entry, CServer const& server, CServerPath const& path, std::wstring const& filename, bool &dirDidExist, bool &matchedCase);
 	bool InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename);
@@ -102,70 +114,87 @@ public:
 
 	void SetTtl(fz::duration const& ttl);
 
+	// Outcome of the listing lookups so far
+	void GetStatistics(uint64_t & hits, uint64_t & misses) const;
+
 protected:
 
+	typedef std::shared_ptr<CDirectoryListing const> tListing;
+
 	class CCacheEntry final
 	{
 	public:
 		CCacheEntry() = default;
-		CCacheEntry(CCacheEntry const& entry) = default;
-		CCacheEntry(CCacheEntry && entry) noexcept = default;
-
-		explicit CCacheEntry(CDirectoryListing const& l)
-			: listing(l)
-			, modificationTime(fz::monotonic_clock::now())
-		{}
 
-		CDirectoryListing listing;
+		tListing listing;
 		fz::monotonic_clock modificationTime;
 
-		CCacheEntry& operator=(CCacheEntry const& a) = default;
-		CCacheEntry& operator=(CCacheEntry && a) noexcept = default;
-
-		void* lruIt{}; // void* to break cyclic declaration dependency
-
-		bool operator<(CCacheEntry const& op) const noexcept {
-			return listing.path < op.listing.path;
-		}
+		// Stamp of the last access for the LRU. Gets updated by lookups
+		// holding only the shared lock.
+		mutable std::atomic<uint64_t> lastUse{};
 	};
 
+	// The cached listings of a server with their own lock, so that engines
+	// connected to different servers do not contend with each other.
 	class CServerEntry final
 	{
 	public:
-		CServerEntry() {}
 		explicit CServerEntry(CServer const& s)
 			: server(s)
 		{}
 
-		CServer server;
-		std::set<CCacheEntry> cacheList;
+		CServer const server;
+
+		std::shared_mutex mutex;
+		std::unordered_map<CServerPath, CCacheEntry> cacheList;
+
+		// Set once removed from the server list, under the exclusive lock
+		bool removed{};
 	};
 
-	typedef std::list<CServerEntry>::iterator tServerIter;
+	typedef std::shared_ptr<CServerEntry> tServerEntry;
+	typedef std::unordered_map<CServerPath, CCacheEntry>::iterator tCacheIter;
 
-	tServerIter CreateServerEntry(const CServer& server);
-	tServerIter GetServerEntry(const CServer& server);
+	tServerEntry GetServerEntry(CServer const& server);
 
-	typedef std::set<CCacheEntry>::iterator tCacheIter;
-	typedef std::set<CCacheEntry>::const_iterator tCacheConstIter;
+	// Returns the entry with exclusive lock held
+	tServerEntry CreateServerEntry(CServer const& server, std::unique_lock<std::shared_mutex> & lock);
 
-	bool Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
+	tCacheIter Lookup(CServerEntry & serverEntry, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
 
-	fz::mutex mutex_;
+	// Replaces the listing of the entry with a copy to modify
+	CDirectoryListing& Modify(CCacheEntry & entry);
 
-	std::list<CServerEntry> m_serverList;
+	// Call once done changing the listing returned by Modify
+	void Publish(CCacheEntry & entry);
 
-	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
+	// The following need the exclusive lock of the server entry
+	bool DoUpdateFile(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size = -1, std::wstring const& ownerGroup = std::wstring{});
+	void DoRemoveFile(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename);
+	void DoRemoveDir(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& filename);
+	void Erase(CServerEntry & serverEntry, tCacheIter const& iter);
+	void Clear(CServerEntry & serverEntry);
 
+	void Touch(CCacheEntry const& entry);
+
+	bool NeedsPruning() const;
 	void Prune();
 
-	typedef std::pair<tServerIter, tCacheIter> tFullEntryPosition;
-	typedef std::list<tFullEntryPosition> tLruList;
-	tLruList m_leastRecentlyUsedList;
+	// Only guards the server list, never held while waiting for the lock of
+	// a server entry.
+	std::shared_mutex mutex_;
+	std::vector<tServerEntry> m_serverList;
+
+	fz::mutex prune_mutex_;
+
+	std::atomic<uint64_t> lruClock_{};
+	std::atomic<int64_t> m_totalEntryCount{};
+	std::atomic<int64_t> m_totalFileCount{};
 
-	int64_t m_totalFileCount{};
+	std::atomic<int64_t> ttl_{fz::duration::from_seconds(600).get_milliseconds()};
 
-	fz::duration ttl_{fz::duration::from_seconds(600)};
+	std::atomic<uint64_t> hits_{};
+	std::atomic<uint64_t> misses_{};
 };
 
 #endif
@@ -208,6 +208,23 @@ void CDirectoryListing::ClearFindMap()
 	m_searchmap_nocase.clear();
 }
 
+void CDirectoryListing::BuildFindMaps() const
+{
+	if (!m_entries || m_entries->empty()) {
+		return;
+	}
+
+	auto & searchmap_case = m_searchmap_case.get();
+	for (size_t i = searchmap_case.size(); i < m_entries->size(); ++i) {
+		searchmap_case.emplace((*m_entries)[i]->name, i);
+	}
+
+	auto & searchmap_nocase = m_searchmap_nocase.get();
+	for (size_t i = searchmap_nocase.size(); i < m_entries->size(); ++i) {
+		searchmap_nocase.emplace(fz::str_tolower((*m_entries)[i]->name), i);
+	}
+}
+
 void CDirectoryListing::Append(CDirentry&& entry)
 {
 	m_entries.get().emplace_back(entry);
@@ -3,11 +3,15 @@
 #include "../include/activity_logger.h"
 #include "../include/engine_context.h"
 #include "../include/engine_options.h"
+#include "../include/file_hash.h"
+#include "../include/tls_session_cache.h"
 
 #include "directorycache.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
+#include "trace.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/rate_limiter.hpp>
@@ -104,14 +108,19 @@ public:
 	COptionsBase& options_;
 	fz::thread_pool pool_;
 	fz::event_loop loop_{pool_};
+	CLogFileWriter log_file_writer_{pool_};
+	trace_writer trace_writer_{options_, pool_};
 	fz::rate_limit_manager rate_limit_mgr_;
 	fz::rate_limiter rate_limiter_;
 	option_change_handler option_change_handler_{options_, loop_, rate_limit_mgr_, rate_limiter_};
 	CDirectoryCache directory_cache_;
 	CPathCache path_cache_;
+	local_hash_cache local_hash_cache_;
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
+	tls_session_cache tls_session_cache_;
 	activity_logger activity_logger_;
+	engine_metrics metrics_{options_, pool_, directory_cache_, path_cache_, activity_logger_};
 };
 
 CFileZillaEngineContext::CFileZillaEngineContext(COptionsBase & options, CustomEncodingConverterBase const& customEncodingConverter)
@@ -150,6 +159,11 @@ CPathCache& CFileZillaEngineContext::GetPathCache()
 	return impl_->path_cache_;
 }
 
+local_hash_cache& CFileZillaEngineContext::GetLocalHashCache()
+{
+	return impl_->local_hash_cache_;
+}
+
 OpLockManager& CFileZillaEngineContext::GetOpLockManager()
 {
 	return impl_->opLockManager_;
@@ -160,7 +174,22 @@ fz::tls_system_trust_store& CFileZillaEngineContext::GetTlsSystemTrustStore()
 	return impl_->tlsSystemTrustStore_;
 }
 
+CLogFileWriter& CFileZillaEngineContext::GetLogFileWriter()
+{
+	return impl_->log_file_writer_;
+}
+
+tls_session_cache& CFileZillaEngineContext::GetTlsSessionCache()
+{
+	return impl_->tls_session_cache_;
+}
+
 activity_logger& CFileZillaEngineContext::GetActivityLogger()
 {
 	return impl_->activity_logger_;
-}
\ No newline at end of file
+}
+
+engine_metrics& CFileZillaEngineContext::GetMetrics()
+{
+	return impl_->metrics_;
+}
@@ -67,6 +67,7 @@ unsigned int register_engine_options()
 		{ "FTP Proxy login sequence", L"", option_flags::normal },
 		{ "SFTP keyfiles", L"", option_flags::platform },
 		{ "SFTP compression", false, option_flags::normal },
+		{ "SFTP archive transfers", false, option_flags::normal },
 		{ "Proxy type", 0, option_flags::normal, 0, 3 },
 		{ "Proxy host", L"", option_flags::normal },
 		{ "Proxy port", 0, option_flags::normal, 1, 65535 },
@@ -75,11 +76,15 @@ unsigned int register_engine_options()
 		{ "Logging file", L"", option_flags::platform },
 		{ "Logging filesize limit", 10, option_flags::normal, 0, 2000 },
 		{ "Logging show detailed logs", false, option_flags::internal },
+		{ "Trace file", L"", option_flags::platform },
+		{ "Metrics socket", L"", option_flags::platform },
 		{ "Size format", 0, option_flags::normal, 0, 4 },
 		{ "Size thousands separator", true, option_flags::normal },
 		{ "Size decimal places", 1, option_flags::numeric_clamp, 0, 3 },
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
-		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 }
+		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
+		{ "HTTP pipelining", false, option_flags::normal },
+		{ "HTTP idle connections", 4, option_flags::numeric_clamp, 0, 16 }
 	});
 	return value;
 }
@@ -5,12 +5,15 @@
 #include "ftp/ftpcontrolsocket.h"
 #include "http/httpcontrolsocket.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "pathcache.h"
 #include "sftp/sftpcontrolsocket.h"
+#include "trace.h"
 #if ENABLE_STORJ
 #include "storj/storjcontrolsocket.h"
 #endif
 
+#include "../include/aio.h"
 #include "../include/engine_options.h"
 
 #include <libfilezilla/event_loop.hpp>
@@ -40,6 +43,7 @@ CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& contex
 	, transfer_status_(*this)
 	, opLockManager_(context.GetOpLockManager())
 	, activity_logger_(context.GetActivityLogger())
+	, metrics_(context.GetMetrics())
 	, notification_cb_(notification_cb)
 	, m_engine_id(get_next_engine_id())
 	, options_(context.GetOptions())
@@ -56,6 +60,8 @@ CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& contex
 		m_engineList.push_back(this);
 	}
 
+	metrics_.engine_added();
+
 	logger_ = std::make_unique<CLogging>(*this);
 
 	{
@@ -103,7 +109,9 @@ CFileZillaEnginePrivate::~CFileZillaEnginePrivate()
 	m_maySendNotificationEvent = false;
 
 	controlSocket_.reset();
-	currentCommand_.reset();
+	ClearCurrentCommand();
+
+	metrics_.engine_removed();
 
 	// Delete notification list
 	for (auto & notification : m_NotificationList) {
@@ -251,6 +259,7 @@ int CFileZillaEnginePrivate::ResetOperation(int nErrorCode)
 							delay = fz::duration::from_seconds(1);
 						}
 						logger_->log(logmsg::status, _("Waiting to retry..."));
+						metrics_.reconnect();
 						stop_timer(m_retryTimer);
 						m_retryTimer = add_timer(delay, true);
 						return FZ_REPLY_WOULDBLOCK;
@@ -261,7 +270,7 @@ int CFileZillaEnginePrivate::ResetOperation(int nErrorCode)
 
 		AddNotification(std::make_unique<COperationNotification>(nErrorCode, currentCommand_->GetId()));
 
-		currentCommand_.reset();
+		ClearCurrentCommand();
 	}
 
 	if (nErrorCode != FZ_REPLY_OK) {
@@ -341,16 +350,15 @@ int CFileZillaEnginePrivate::List(CListCommand const& command)
 				}
 			}
 			if (!path.empty()) {
-				CDirectoryListing listing;
 				bool is_outdated = false;
-				bool found = directory_cache_.Lookup(listing, server, path, true, is_outdated);
-				if (found && !is_outdated) {
-					if (listing.get_unsure_flags()) {
+				auto const listing = directory_cache_.Lookup(server, path, true, is_outdated);
+				if (listing && !is_outdated) {
+					if (listing->get_unsure_flags()) {
 						flags |= LIST_FLAG_REFRESH;
 					}
 					else {
 						if (!avoid) {
-							AddNotification(std::make_unique<CDirectoryListingNotification>(listing.path, true));
+							AddNotification(std::make_unique<CDirectoryListingNotification>(listing->path, true));
 						}
 						return FZ_REPLY_OK;
 					}
@@ -368,6 +376,8 @@ int CFileZillaEnginePrivate::List(CListCommand const& command)
 
 int CFileZillaEnginePrivate::FileTransfer(CFileTransferCommand const& command)
 {
+	record_trace(GetEngineId(), trace_event::transfer_start, command.Download() ? 1 : 0);
+	transfer_telemetry_.Reset();
 	controlSocket_->FileTransfer(command);
 	return FZ_REPLY_CONTINUE;
 }
@@ -589,6 +599,14 @@ void CFileZillaEnginePrivate::operator()(fz::event_base const& ev)
 		);
 }
 
+void CFileZillaEnginePrivate::ClearCurrentCommand()
+{
+	if (currentCommand_) {
+		metrics_.command_finished(currentCommand_->GetId());
+		currentCommand_.reset();
+	}
+}
+
 int CFileZillaEnginePrivate::CheckCommandPreconditions(CCommand const& command, bool checkBusy)
 {
 	if (checkBusy && IsBusy()) {
@@ -691,7 +709,7 @@ void CFileZillaEnginePrivate::DoCancel()
 	if (m_retryTimer) {
 		controlSocket_.reset();
 
-		currentCommand_.reset();
+		ClearCurrentCommand();
 
 		stop_timer(m_retryTimer);
 		m_retryTimer = 0;
@@ -749,6 +767,7 @@ int CFileZillaEnginePrivate::Execute(CCommand const& command)
 	}
 
 	currentCommand_.reset(command.Clone());
+	metrics_.command_started(command.GetId());
 	send_event<CCommandEvent>();
 
 	return FZ_REPLY_WOULDBLOCK;
@@ -848,6 +867,66 @@ fz::logger_interface& CFileZillaEnginePrivate::GetLogger()
 }
 
 
+static_assert(CTransferTelemetry::occupancy_buckets == aio_base::buffer_count + 1, "Need one bucket per possible number of ready buffers");
+
+void CTransferTelemetryManager::Reset()
+{
+	start_ = fz::monotonic_clock::now();
+	for (auto & w : wait_) {
+		w = 0;
+	}
+	disk_io_ = 0;
+	disk_calls_ = 0;
+	network_calls_ = 0;
+	bytes_ = 0;
+	for (auto & o : occupancy_) {
+		o = 0;
+	}
+}
+
+void CTransferTelemetryManager::AddWait(CTransferTelemetry::stage stage, fz::duration const& d)
+{
+	wait_[stage] += d.get_microseconds();
+}
+
+void CTransferTelemetryManager::AddDiskIO(fz::duration const& d, int64_t bytes)
+{
+	disk_io_ += d.get_microseconds();
+	++disk_calls_;
+	if (bytes > 0) {
+		bytes_ += bytes;
+	}
+}
+
+void CTransferTelemetryManager::AddNetworkCalls(uint64_t count)
+{
+	network_calls_ += count;
+}
+
+void CTransferTelemetryManager::SampleOccupancy(size_t ready)
+{
+	if (ready < CTransferTelemetry::occupancy_buckets) {
+		++occupancy_[ready];
+	}
+}
+
+CTransferTelemetry CTransferTelemetryManager::Get() const
+{
+	CTransferTelemetry ret;
+	ret.duration = fz::monotonic_clock::now() - start_;
+	for (size_t i = 0; i < CTransferTelemetry::stage_count; ++i) {
+		ret.wait[i] = fz::duration::from_microseconds(wait_[i]);
+	}
+	ret.disk_io = fz::duration::from_microseconds(disk_io_);
+	ret.disk_calls = disk_calls_;
+	ret.network_calls = network_calls_;
+	ret.bytes = bytes_;
+	for (size_t i = 0; i < CTransferTelemetry::occupancy_buckets; ++i) {
+		ret.occupancy[i] = occupancy_[i];
+	}
+	return ret;
+}
+
 CTransferStatusManager::CTransferStatusManager(CFileZillaEnginePrivate& engine)
 	: engine_(engine)
 {
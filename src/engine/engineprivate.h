@@ -16,6 +16,7 @@
 
 class CControlSocket;
 class CLogging;
+class engine_metrics;
 class OpLockManager;
 
 enum EngineNotificationType
@@ -55,6 +56,36 @@ protected:
 	CFileZillaEnginePrivate& engine_;
 };
 
+// Collects CTransferTelemetry of the current transfer. Gets updated from the
+// threads of the readers and writers as well.
+class CTransferTelemetryManager final
+{
+public:
+	CTransferTelemetryManager() = default;
+
+	CTransferTelemetryManager(CTransferTelemetryManager const&) = delete;
+	CTransferTelemetryManager& operator=(CTransferTelemetryManager const&) = delete;
+
+	void Reset();
+
+	void AddWait(CTransferTelemetry::stage stage, fz::duration const& d);
+	void AddDiskIO(fz::duration const& d, int64_t bytes);
+	void AddNetworkCalls(uint64_t count);
+	void SampleOccupancy(size_t ready);
+
+	CTransferTelemetry Get() const;
+
+protected:
+	fz::monotonic_clock start_{fz::monotonic_clock::now()};
+
+	std::atomic<int64_t> wait_[CTransferTelemetry::stage_count]{};
+	std::atomic<int64_t> disk_io_{};
+	std::atomic<uint64_t> disk_calls_{};
+	std::atomic<uint64_t> network_calls_{};
+	std::atomic<int64_t> bytes_{};
+	std::atomic<uint64_t> occupancy_[CTransferTelemetry::occupancy_buckets]{};
+};
+
 class CFileZillaEnginePrivate final : public fz::event_handler
 {
 public:
@@ -102,6 +133,7 @@ public:
 	unsigned int GetEngineId() const { return m_engine_id; }
 
 	CTransferStatusManager transfer_status_;
+	CTransferTelemetryManager transfer_telemetry_;
 
 	CustomEncodingConverterBase const& GetEncodingConverter() const { return encoding_converter_; }
 
@@ -110,6 +142,8 @@ public:
 	fz::logger_interface& GetLogger();
 	activity_logger& activity_logger_;
 
+	engine_metrics& metrics_;
+
 protected:
 	void OnOptionsChanged(watched_options const& options);
 
@@ -119,6 +153,7 @@ protected:
 	bool ShouldQueueLogsFromOptions() const;
 
 	int CheckCommandPreconditions(CCommand const& command, bool checkBusy);
+	void ClearCurrentCommand();
 
 
 	bool CheckAsyncRequestReplyPreconditions(std::unique_ptr<CAsyncRequestNotification> const& reply);
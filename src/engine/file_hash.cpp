@@ -0,0 +1,345 @@
+#include "filezilla.h"
+
+#include "../include/file_hash.h"
+
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/hash.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace {
+class crc32_accumulator final
+{
+public:
+	crc32_accumulator()
+	{
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+			}
+			table_[i] = c;
+		}
+	}
+
+	void update(unsigned char const* data, size_t len)
+	{
+		for (size_t i = 0; i < len; ++i) {
+			crc_ = table_[(crc_ ^ data[i]) & 0xff] ^ (crc_ >> 8);
+		}
+	}
+
+	std::vector<uint8_t> digest() const
+	{
+		uint32_t const crc = crc_ ^ 0xffffffffu;
+		return { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16), static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) };
+	}
+
+private:
+	uint32_t table_[256];
+	uint32_t crc_{0xffffffffu};
+};
+}
+
+std::wstring file_hash_algorithm_name(file_hash_algorithm alg)
+{
+	switch (alg) {
+	case file_hash_algorithm::crc32:
+		return L"CRC32";
+	case file_hash_algorithm::md5:
+		return L"MD5";
+	case file_hash_algorithm::sha1:
+		return L"SHA-1";
+	case file_hash_algorithm::sha256:
+		return L"SHA-256";
+	case file_hash_algorithm::sha512:
+		return L"SHA-512";
+	default:
+		return std::wstring();
+	}
+}
+
+file_hash_algorithm file_hash_algorithm_from_name(std::wstring_view const& name)
+{
+	for (auto alg : { file_hash_algorithm::crc32, file_hash_algorithm::md5, file_hash_algorithm::sha1, file_hash_algorithm::sha256, file_hash_algorithm::sha512 }) {
+		if (fz::equal_insensitive_ascii(name, file_hash_algorithm_name(alg))) {
+			return alg;
+		}
+	}
+	return file_hash_algorithm::none;
+}
+
+size_t file_hash_length(file_hash_algorithm alg)
+{
+	switch (alg) {
+	case file_hash_algorithm::crc32:
+		return 8;
+	case file_hash_algorithm::md5:
+		return 32;
+	case file_hash_algorithm::sha1:
+		return 40;
+	case file_hash_algorithm::sha256:
+		return 64;
+	case file_hash_algorithm::sha512:
+		return 128;
+	default:
+		return 0;
+	}
+}
+
+namespace {
+class hasher final
+{
+public:
+	explicit hasher(file_hash_algorithm alg)
+		: alg_(alg)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		switch (alg_) {
+		case file_hash_algorithm::crc32:
+			crc_ = std::make_unique<crc32_accumulator>();
+			break;
+		case file_hash_algorithm::md5:
+			acc_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::md5);
+			break;
+		case file_hash_algorithm::sha1:
+			acc_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha1);
+			break;
+		case file_hash_algorithm::sha256:
+			acc_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha256);
+			break;
+		default:
+			acc_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha512);
+			break;
+		}
+	}
+
+	void update(unsigned char const* data, size_t len)
+	{
+		if (crc_) {
+			crc_->update(data, len);
+		}
+		else {
+			acc_->update(data, len);
+		}
+	}
+
+	std::string digest()
+	{
+		return fz::hex_encode<std::string>(crc_ ? crc_->digest() : acc_->digest());
+	}
+
+private:
+	file_hash_algorithm const alg_;
+	std::unique_ptr<crc32_accumulator> crc_;
+	std::unique_ptr<fz::hash_accumulator> acc_;
+};
+
+size_t const buffer_size = 256 * 1024;
+}
+
+std::string hash_local_file(std::wstring const& file, file_hash_algorithm alg, std::atomic<bool> const* abort)
+{
+	if (alg == file_hash_algorithm::none) {
+		return std::string();
+	}
+
+	fz::file f(fz::to_native(file), fz::file::reading, fz::file::existing);
+	if (!f.opened()) {
+		return std::string();
+	}
+
+	hasher h(alg);
+	auto buffer = std::make_unique<unsigned char[]>(buffer_size);
+	while (true) {
+		if (abort && *abort) {
+			return std::string();
+		}
+
+		int64_t read = f.read(buffer.get(), buffer_size);
+		if (read < 0) {
+			return std::string();
+		}
+		if (!read) {
+			break;
+		}
+		h.update(buffer.get(), static_cast<size_t>(read));
+	}
+
+	return h.digest();
+}
+
+bool hash_local_file_chunks(std::wstring const& file, file_hash_algorithm alg, int64_t chunk_size, int64_t total
+	, std::function<bool(std::string && hash)> const& on_chunk, std::atomic<bool> const* abort)
+{
+	if (alg == file_hash_algorithm::none || chunk_size <= 0 || total < 0) {
+		return false;
+	}
+
+	fz::file f(fz::to_native(file), fz::file::reading, fz::file::existing);
+	if (!f.opened()) {
+		return false;
+	}
+
+	hasher h(alg);
+	auto buffer = std::make_unique<unsigned char[]>(buffer_size);
+
+	int64_t chunk_left = std::min(chunk_size, total);
+	int64_t left = total;
+	while (left > 0) {
+		if (abort && *abort) {
+			return false;
+		}
+
+		int64_t const read = f.read(buffer.get(), static_cast<int64_t>(std::min(static_cast<int64_t>(buffer_size), chunk_left)));
+		if (read <= 0) {
+			// Error or file shorter than expected
+			return false;
+		}
+		h.update(buffer.get(), static_cast<size_t>(read));
+		chunk_left -= read;
+		left -= read;
+
+		if (!chunk_left) {
+			if (!on_chunk(h.digest())) {
+				return true;
+			}
+			h.reset();
+			chunk_left = std::min(chunk_size, left);
+		}
+	}
+
+	return true;
+}
+
+namespace {
+int64_t const min_delta_chunk_size = 1024 * 1024;
+int64_t const max_delta_chunks = 64;
+}
+
+file_hash_chunks::file_hash_chunks(int64_t size)
+{
+	if (size <= 0) {
+		return;
+	}
+
+	size_ = size;
+	chunk_size_ = std::max(min_delta_chunk_size, (size + max_delta_chunks - 1) / max_delta_chunks);
+	count_ = (size + chunk_size_ - 1) / chunk_size_;
+}
+
+int64_t delta_upload_offset(int64_t common, int64_t remote_size, bool rest_stream)
+{
+	if (common <= 0 || common > remote_size) {
+		return -1;
+	}
+	if (common != remote_size && !rest_stream) {
+		return -1;
+	}
+	return common;
+}
+
+int64_t common_prefix(file_hash_chunks const& chunks, std::vector<std::string> const& local_hashes, std::function<std::string(int64_t chunk)> const& remote_hash)
+{
+	int64_t chunk = 0;
+	for (; chunk < chunks.count() && chunk < static_cast<int64_t>(local_hashes.size()); ++chunk) {
+		auto const& local = local_hashes[static_cast<size_t>(chunk)];
+		if (local.empty() || local != remote_hash(chunk)) {
+			break;
+		}
+	}
+	return chunks.covered(chunk);
+}
+
+local_hash_cache::local_hash_cache(size_t max_entries)
+	: max_entries_(max_entries)
+{
+}
+
+void local_hash_cache::set_store(local_hash_store* store)
+{
+	fz::scoped_lock l(store_mtx_);
+	store_ = store;
+}
+
+std::string local_hash_cache::lookup(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime)
+{
+	{
+		fz::scoped_lock l(mtx_);
+
+		auto it = entries_.find(key_type(file, alg));
+		if (it != entries_.end()) {
+			if (it->second.size == size && it->second.mtime == mtime && !mtime.empty()) {
+				lru_.splice(lru_.begin(), lru_, it->second.lru);
+				return it->second.hash;
+			}
+
+			lru_.erase(it->second.lru);
+			entries_.erase(it);
+		}
+	}
+
+	std::string hash;
+	{
+		fz::scoped_lock l(store_mtx_);
+		if (store_ && !mtime.empty()) {
+			hash = store_->lookup(file, alg, size, mtime);
+		}
+	}
+	if (!hash.empty()) {
+		insert(file, alg, size, mtime, hash);
+	}
+	return hash;
+}
+
+void local_hash_cache::store(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash)
+{
+	if (hash.empty() || mtime.empty()) {
+		return;
+	}
+
+	insert(file, alg, size, mtime, hash);
+
+	fz::scoped_lock l(store_mtx_);
+	if (store_) {
+		store_->store(file, alg, size, mtime, hash);
+	}
+}
+
+void local_hash_cache::insert(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash)
+{
+	fz::scoped_lock l(mtx_);
+
+	key_type key(file, alg);
+	auto it = entries_.find(key);
+	if (it != entries_.end()) {
+		lru_.splice(lru_.begin(), lru_, it->second.lru);
+	}
+	else {
+		if (entries_.size() >= max_entries_ && !lru_.empty()) {
+			entries_.erase(lru_.back());
+			lru_.pop_back();
+		}
+		lru_.push_front(key);
+		it = entries_.emplace(std::move(key), entry()).first;
+		it->second.lru = lru_.begin();
+	}
+
+	it->second.size = size;
+	it->second.mtime = mtime;
+	it->second.hash = hash;
+}
+
+void local_hash_cache::clear()
+{
+	fz::scoped_lock l(mtx_);
+	entries_.clear();
+	lru_.clear();
+}
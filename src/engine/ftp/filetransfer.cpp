@@ -1,6 +1,7 @@
 #include "../filezilla.h"
 
 #include "filetransfer.h"
+#include "hash.h"
 #include "transfersocket.h"
 
 #include "../directorycache.h"
@@ -53,6 +54,26 @@ int CFtpFileTransferOpData::Send()
 		break;
 	case filetransfer_resumetest:
 	case filetransfer_transfer:
+		if (compareChecksum_) {
+			compareChecksum_ = false;
+			checksumNextState_ = opState;
+			opState = filetransfer_waitchecksum;
+			if (!download() && binary && remoteFileSize_ > 0 && localFileSize_ != aio_base::nosize &&
+				remoteFileSize_ <= static_cast<int64_t>(localFileSize_) && CFtpDeltaOpData::Supported(currentServer_))
+			{
+				controlSocket_.Push(std::make_unique<CFtpDeltaOpData>(controlSocket_, remotePath_, remoteFile_, !tryAbsolutePath_
+					, localName_, remoteFileSize_));
+			}
+			else if (remoteFileSize_ >= 0 && localFileSize_ != aio_base::nosize && remoteFileSize_ == static_cast<int64_t>(localFileSize_)) {
+				controlSocket_.Push(std::make_unique<CFtpHashOpData>(controlSocket_, remotePath_, remoteFile_, !tryAbsolutePath_
+					, localName_, static_cast<int64_t>(localFileSize_), localFileTime_));
+			}
+			else {
+				opState = checksumNextState_;
+			}
+			return FZ_REPLY_CONTINUE;
+		}
+
 		if (controlSocket_.m_pTransferSocket) {
 			log(logmsg::debug_verbose, L"m_pTransferSocket != 0");
 			controlSocket_.m_pTransferSocket.reset();
@@ -80,10 +101,23 @@ int CFtpFileTransferOpData::Send()
 					localFileSize_ = 0;
 				}
 
-				engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				uint64_t const range_end = writer_factory_.range_end();
+				if (range_end != writer_factory::npos) {
+					if (static_cast<uint64_t>(resumeOffset) >= range_end) {
+						log(logmsg::debug_info, L"Range has already been downloaded completely.");
+						return FZ_REPLY_OK;
+					}
+					engine_.transfer_status_.Init(static_cast<int64_t>(range_end), resumeOffset, false);
+				}
+				else {
+					engine_.transfer_status_.Init(remoteFileSize_, resumeOffset, false);
+				}
 			}
 			else {
-				if (resume_) {
+				if (deltaOffset_ >= 0) {
+					resumeOffset = deltaOffset_;
+				}
+				else if (resume_) {
 					if (remoteFileSize_ > 0) {
 						resumeOffset = remoteFileSize_;
 
@@ -114,7 +148,13 @@ int CFtpFileTransferOpData::Send()
 				if (!writer) {
 					return FZ_REPLY_CRITICALERROR;
 				}
-				if (engine_.GetOptions().get_int(OPTION_PREALLOCATE_SPACE)) {
+				uint64_t const range_end = writer_factory_.range_end();
+				if (range_end != writer_factory::npos) {
+					// Server sends everything from the restart offset onwards, the
+					// transfer socket closes the data connection at the end of the range.
+					controlSocket_.m_pTransferSocket->set_range(range_end - static_cast<uint64_t>(resumeOffset));
+				}
+				else if (engine_.GetOptions().get_int(OPTION_PREALLOCATE_SPACE)) {
 					if (remoteFileSize_ != aio_base::nosize && remoteFileSize_ > resumeOffset) {
 						if (writer->preallocate(static_cast<uint64_t>(remoteFileSize_ - resumeOffset)) != aio_result::ok) {
 							return FZ_REPLY_ERROR;
@@ -135,7 +175,7 @@ int CFtpFileTransferOpData::Send()
 		if (download()) {
 			cmd = L"RETR ";
 		}
-		else if (resume_ && resumeOffset != 0) {
+		else if ((resume_ || deltaOffset_ >= 0) && resumeOffset != 0) {
 			if (CServerCapabilities::GetCapability(currentServer_, rest_stream) == yes) {
 				cmd = L"STOR "; // In this case REST gets sent since resume offset was set earlier
 			}
@@ -299,7 +339,7 @@ int CFtpFileTransferOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
-int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
+int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const& previousOperation)
 {
 	if (opState == filetransfer_waitcwd) {
 		if (prevResult == FZ_REPLY_OK) {
@@ -426,7 +466,7 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 					return FZ_REPLY_CONTINUE;
 				}
 			}
-			else if (download() && !remoteFileTime_.empty()) {
+			else if (download() && !remoteFileTime_.empty() && writer_factory_.range_end() == writer_factory::npos) {
 				if (!writer_factory_.set_mtime(remoteFileTime_)) {
 					log(logmsg::debug_warning, L"Could not set modification time");
 				}
@@ -459,6 +499,35 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 
 		opState = filetransfer_transfer;
 	}
+	else if (opState == filetransfer_waitchecksum) {
+		opState = checksumNextState_;
+		if (prevResult == FZ_REPLY_OK && previousOperation.opId == PrivCommand::hash &&
+			static_cast<CFtpHashOpData const&>(previousOperation).identical_)
+		{
+			if (download()) {
+				log(logmsg::status, _("Skipping download of %s, checksums match"), remotePath_.FormatFilename(remoteFile_));
+			}
+			else {
+				log(logmsg::status, _("Skipping upload of %s, checksums match"), localName_);
+			}
+			return FZ_REPLY_OK;
+		}
+		else if (prevResult == FZ_REPLY_OK && previousOperation.opId == PrivCommand::delta) {
+			int64_t const common = static_cast<CFtpDeltaOpData const&>(previousOperation).commonPrefix_;
+			if (common == remoteFileSize_ && localFileSize_ == static_cast<uint64_t>(remoteFileSize_)) {
+				log(logmsg::status, _("Skipping upload of %s, checksums match"), localName_);
+				return FZ_REPLY_OK;
+			}
+
+			deltaOffset_ = delta_upload_offset(common, remoteFileSize_, CServerCapabilities::GetCapability(currentServer_, rest_stream) == yes);
+			if (deltaOffset_ >= 0) {
+				log(logmsg::status, _("First %d bytes of %s are unchanged, uploading the remainder"), deltaOffset_, localName_);
+			}
+		}
+		else if (prevResult != FZ_REPLY_OK) {
+			log(logmsg::status, _("Checksums could not be compared, transferring file"));
+		}
+	}
 
 	return FZ_REPLY_CONTINUE;
 }
@@ -14,7 +14,8 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_waitchecksum
 };
 
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
@@ -29,6 +30,13 @@ public:
 	int TestResumeCapability();
 
 	bool fileDidExist_{true};
+
+	// State to continue with after comparing checksums
+	int checksumNextState_{};
+
+	// Offset to upload from if the start of the remote file is known to be
+	// identical to the local file.
+	int64_t deltaOffset_{-1};
 };
 
 #endif
@@ -5,6 +5,7 @@
 #include "delete.h"
 #include "filetransfer.h"
 #include "ftpcontrolsocket.h"
+#include "hash.h"
 #include "list.h"
 #include "logon.h"
 #include "mkd.h"
@@ -17,6 +18,7 @@
 #include "../directorycache.h"
 #include "../directorylistingparser.h"
 #include "../engineprivate.h"
+#include "../metrics.h"
 #include "../pathcache.h"
 #include "../proxy.h"
 #include "../servercapabilities.h"
@@ -178,6 +180,7 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_lastHashAlgorithm = file_hash_algorithm::none;
 	m_sentRestartOffset = false;
 	m_protectDataChannel = false;
 
@@ -190,7 +193,8 @@ void CFtpControlSocket::OnConnect()
 			tls_layer_ = std::make_unique<fz::tls_layer>(event_loop_, this, *active_layer_, &engine_.GetContext().GetTlsSystemTrustStore(), logger_);
 			active_layer_ = tls_layer_.get();
 
-			if (!tls_layer_->client_handshake(this)) {
+			engine_.metrics_.tls_handshake();
+			if (!tls_layer_->client_handshake(this, GetCachedTlsSession(currentServer_.GetHost(), currentServer_.GetPort()))) {
 				DoClose();
 			}
 
@@ -198,10 +202,12 @@ void CFtpControlSocket::OnConnect()
 		}
 		else {
 			log(logmsg::status, _("TLS connection established, waiting for welcome message..."));
+			CacheTlsSession(*tls_layer_, currentServer_.GetHost(), currentServer_.GetPort());
 		}
 	}
 	else if ((currentServer_.GetProtocol() == FTPES || currentServer_.GetProtocol() == FTP) && tls_layer_) {
 		log(logmsg::status, _("TLS connection established."));
+		CacheTlsSession(*tls_layer_, currentServer_.GetHost(), currentServer_.GetPort());
 		SendNextCommand();
 		return;
 	}
@@ -438,6 +444,9 @@ void CFtpControlSocket::TransferEnd()
 	if (data.pOldData->transferEndReason == TransferEndReason::successful) {
 		data.pOldData->transferEndReason = reason;
 	}
+	if (reason == TransferEndReason::successful && m_pTransferSocket->range_complete()) {
+		data.pOldData->rangeComplete = true;
+	}
 
 	if (reason == TransferEndReason::failed_tls_resumption) {
 		log(logmsg::error, _("TLS session resumption on data connection failed. Closing control connection to start over."));
@@ -598,6 +607,11 @@ void CFtpControlSocket::Chmod(CChmodCommand const& command)
 	Push(std::make_unique<CFtpChmodOpData>(*this, command));
 }
 
+bool CFtpControlSocket::CanCompareChecksums() const
+{
+	return CFtpHashOpData::Supported(currentServer_);
+}
+
 int CFtpControlSocket::GetExternalIPAddress(std::string& address)
 {
 	// Local IP should work. Only a complete moron would use IPv6
@@ -799,7 +813,11 @@ void CFtpControlSocket::operator()(fz::event_base const& ev)
 void CFtpControlSocket::ResetSocket()
 {
 	receiveBuffer_.clear();
-	tls_layer_.reset();
+	if (tls_layer_) {
+		// By now the server has had the chance to send its session tickets
+		CacheTlsSession(*tls_layer_, currentServer_.GetHost(), currentServer_.GetPort());
+		tls_layer_.reset();
+	}
 	m_pendingReplies = 0;
 	m_repliesToSkip = 0;
 	m_Response.clear();
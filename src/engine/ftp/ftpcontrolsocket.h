@@ -5,11 +5,15 @@
 #include "../controlsocket.h"
 #include "../rtt.h"
 
+#include "../../include/file_hash.h"
+
 #include <regex>
 
 namespace PrivCommand {
 auto const cwd = Command::private1;
 auto const rawtransfer = Command::private2;
+auto const hash = Command::private3;
+auto const delta = Command::private4;
 }
 
 class CExternalIPResolver;
@@ -65,6 +69,7 @@ protected:
 	virtual void Mkdir(CServerPath const& path) override;
 	virtual void Rename(CRenameCommand const& command) override;
 	virtual void Chmod(CChmodCommand const& command) override;
+	virtual bool CanCompareChecksums() const override;
 	void Transfer(std::wstring const& cmd, CFtpTransferOpData* oldData);
 
 	void TransferEnd();
@@ -115,6 +120,9 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// Algorithm last selected through OPTS HASH on this connection
+	file_hash_algorithm m_lastHashAlgorithm{};
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
@@ -134,7 +142,9 @@ protected:
 	friend class CFtpChangeDirOpData;
 	friend class CFtpChmodOpData;
 	friend class CFtpDeleteOpData;
+	friend class CFtpDeltaOpData;
 	friend class CFtpFileTransferOpData;
+	friend class CFtpHashOpData;
 	friend class CFtpListOpData;
 	friend class CFtpLogonOpData;
 	friend class CFtpMkdirOpData;
@@ -155,6 +165,9 @@ public:
 	TransferEndReason transferEndReason{TransferEndReason::successful};
 	bool tranferCommandSent{};
 
+	// Set if the data connection got closed after receiving the requested range
+	bool rangeComplete{};
+
 	int64_t resumeOffset{};
 	bool binary{true};
 };
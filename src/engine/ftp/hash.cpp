@@ -0,0 +1,468 @@
+#include "../filezilla.h"
+
+#include "hash.h"
+#include "../engineprivate.h"
+#include "../servercapabilities.h"
+
+enum hashStates
+{
+	hash_init,
+	hash_opts,
+	hash_hash,
+	hash_waitlocal
+};
+
+namespace {
+// In order of preference
+file_hash_algorithm const preferred_algorithms[] = {
+	file_hash_algorithm::sha256,
+	file_hash_algorithm::sha512,
+	file_hash_algorithm::sha1,
+	file_hash_algorithm::md5,
+	file_hash_algorithm::crc32
+};
+
+capabilityNames x_command_capability(file_hash_algorithm alg)
+{
+	switch (alg) {
+	case file_hash_algorithm::crc32:
+		return xcrc_command;
+	case file_hash_algorithm::md5:
+		return xmd5_command;
+	case file_hash_algorithm::sha1:
+		return xsha1_command;
+	case file_hash_algorithm::sha256:
+		return xsha256_command;
+	default:
+		return xsha512_command;
+	}
+}
+
+std::wstring x_command(file_hash_algorithm alg)
+{
+	switch (alg) {
+	case file_hash_algorithm::crc32:
+		return L"XCRC";
+	case file_hash_algorithm::md5:
+		return L"XMD5";
+	case file_hash_algorithm::sha1:
+		return L"XSHA1";
+	case file_hash_algorithm::sha256:
+		return L"XSHA256";
+	default:
+		return L"XSHA512";
+	}
+}
+
+// Picks algorithm and command. needOpts is set if the algorithm first
+// needs to be selected through OPTS HASH.
+file_hash_algorithm choose(CServer const& server, std::wstring & command, bool & needOpts)
+{
+	std::wstring algorithms;
+	if (CServerCapabilities::GetCapability(server, hash_command, &algorithms) == yes) {
+		bool supported[6]{};
+		bool current[6]{};
+		for (auto const& token : fz::strtok_view(algorithms, L";")) {
+			bool const selected = !token.empty() && token.back() == '*';
+			auto const alg = file_hash_algorithm_from_name(selected ? token.substr(0, token.size() - 1) : token);
+			supported[static_cast<int>(alg)] = true;
+			current[static_cast<int>(alg)] = selected;
+		}
+
+		for (auto const alg : preferred_algorithms) {
+			if (supported[static_cast<int>(alg)]) {
+				command = L"HASH";
+				needOpts = !current[static_cast<int>(alg)];
+				return alg;
+			}
+		}
+	}
+
+	for (auto const alg : preferred_algorithms) {
+		if (CServerCapabilities::GetCapability(server, x_command_capability(alg)) == yes) {
+			command = x_command(alg);
+			needOpts = false;
+			return alg;
+		}
+	}
+
+	return file_hash_algorithm::none;
+}
+
+// The digest is the first token of the reply that has the right length and
+// is made up of hex digits only.
+std::string parse_hash(std::wstring const& reply, file_hash_algorithm alg)
+{
+	size_t const len = file_hash_length(alg);
+	if (reply.size() < 4) {
+		return std::string();
+	}
+
+	for (auto const& token : fz::strtok_view(std::wstring_view(reply).substr(4), L" ")) {
+		if (token.size() != len) {
+			continue;
+		}
+
+		std::string hash;
+		hash.reserve(len);
+		for (auto const c : token) {
+			if (c >= '0' && c <= '9') {
+				hash += static_cast<char>(c);
+			}
+			else if (c >= 'a' && c <= 'f') {
+				hash += static_cast<char>(c);
+			}
+			else if (c >= 'A' && c <= 'F') {
+				hash += static_cast<char>(c - 'A' + 'a');
+			}
+			else {
+				break;
+			}
+		}
+		if (hash.size() == len) {
+			return hash;
+		}
+	}
+
+	return std::string();
+}
+}
+
+CFtpHashOpData::CFtpHashOpData(CFtpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, bool omitPath
+	, std::wstring const& localFile, int64_t localSize, fz::datetime const& localTime)
+	: COpData(PrivCommand::hash, L"CFtpHashOpData")
+	, CFtpOpData(controlSocket)
+	, fz::event_handler(controlSocket.event_loop_)
+	, path_(path)
+	, file_(file)
+	, omitPath_(omitPath)
+	, localFile_(localFile)
+	, localSize_(localSize)
+	, localTime_(localTime)
+{
+}
+
+CFtpHashOpData::~CFtpHashOpData()
+{
+	abort_ = true;
+	if (task_) {
+		task_.join();
+	}
+	remove_handler();
+}
+
+bool CFtpHashOpData::Supported(CServer const& server)
+{
+	std::wstring command;
+	bool needOpts{};
+	return choose(server, command, needOpts) != file_hash_algorithm::none;
+}
+
+int CFtpHashOpData::Send()
+{
+	switch (opState)
+	{
+	case hash_init:
+		alg_ = choose(currentServer_, command_, needOpts_);
+		if (alg_ == file_hash_algorithm::none) {
+			return FZ_REPLY_NOTSUPPORTED;
+		}
+		if (controlSocket_.m_lastHashAlgorithm != file_hash_algorithm::none) {
+			// Already selected on this connection, FEAT only reflects the initial choice
+			needOpts_ = command_ == L"HASH" && controlSocket_.m_lastHashAlgorithm != alg_;
+		}
+
+		log(logmsg::status, _("Comparing %s checksums of '%s'"), file_hash_algorithm_name(alg_), path_.FormatFilename(file_));
+
+		localHash_ = engine_.GetContext().GetLocalHashCache().lookup(localFile_, alg_, localSize_, localTime_);
+		if (!localHash_.empty()) {
+			localDone_ = true;
+		}
+		else {
+			// Let the local file be hashed while the server is busy doing the same
+			task_ = engine_.GetThreadPool().spawn([this]() {
+				localHash_ = hash_local_file(localFile_, alg_, &abort_);
+				send_event<CFtpLocalHashEvent>();
+			});
+			if (!task_) {
+				log(logmsg::debug_warning, L"Could not spawn hashing task");
+				return FZ_REPLY_ERROR;
+			}
+		}
+
+		opState = needOpts_ ? hash_opts : hash_hash;
+		return FZ_REPLY_CONTINUE;
+	case hash_opts:
+		return controlSocket_.SendCommand(L"OPTS HASH " + file_hash_algorithm_name(alg_));
+	case hash_hash:
+		return controlSocket_.SendCommand(command_ + L" " + path_.FormatFilename(file_, omitPath_));
+	case hash_waitlocal:
+		if (!localDone_) {
+			return FZ_REPLY_WOULDBLOCK;
+		}
+		if (localHash_.empty()) {
+			log(logmsg::error, _("Could not compute checksum of local file %s"), localFile_);
+			return FZ_REPLY_ERROR;
+		}
+
+		identical_ = localHash_ == remoteHash_;
+		log(logmsg::debug_info, L"Local checksum %s, remote checksum %s", localHash_, remoteHash_);
+		return FZ_REPLY_OK;
+	}
+
+	log(logmsg::debug_warning, L"Unknown op state: %d", opState);
+	return FZ_REPLY_INTERNALERROR;
+}
+
+int CFtpHashOpData::ParseResponse()
+{
+	int const code = controlSocket_.GetReplyCode();
+	if (code != 2) {
+		return FZ_REPLY_ERROR;
+	}
+
+	if (opState == hash_opts) {
+		controlSocket_.m_lastHashAlgorithm = alg_;
+		opState = hash_hash;
+		return FZ_REPLY_CONTINUE;
+	}
+	else if (opState != hash_hash) {
+		log(logmsg::debug_warning, L"Unknown op state: %d", opState);
+		return FZ_REPLY_INTERNALERROR;
+	}
+
+	remoteHash_ = parse_hash(controlSocket_.m_Response, alg_);
+	if (remoteHash_.empty()) {
+		log(logmsg::debug_warning, L"Could not find checksum in reply");
+		return FZ_REPLY_ERROR;
+	}
+
+	opState = hash_waitlocal;
+	return FZ_REPLY_CONTINUE;
+}
+
+void CFtpHashOpData::operator()(fz::event_base const& ev)
+{
+	if (ev.derived_type() != CFtpLocalHashEvent::type()) {
+		return;
+	}
+
+	task_.join();
+	task_ = fz::async_task();
+	localDone_ = true;
+	engine_.GetContext().GetLocalHashCache().store(localFile_, alg_, localSize_, localTime_, localHash_);
+
+	if (opState == hash_waitlocal) {
+		controlSocket_.SendNextCommand();
+	}
+}
+
+enum deltaStates
+{
+	delta_init,
+	delta_opts,
+	delta_rang,
+	delta_hash,
+	delta_waitlocal,
+	delta_reset
+};
+
+namespace {
+file_hash_algorithm choose_ranged(CServer const& server, bool & needOpts)
+{
+	if (CServerCapabilities::GetCapability(server, rang_command) != yes) {
+		return file_hash_algorithm::none;
+	}
+
+	// Only HASH honors the range
+	std::wstring command;
+	auto const alg = choose(server, command, needOpts);
+	if (command != L"HASH") {
+		return file_hash_algorithm::none;
+	}
+	return alg;
+}
+}
+
+CFtpDeltaOpData::CFtpDeltaOpData(CFtpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, bool omitPath
+	, std::wstring const& localFile, int64_t remoteSize)
+	: COpData(PrivCommand::delta, L"CFtpDeltaOpData")
+	, CFtpOpData(controlSocket)
+	, fz::event_handler(controlSocket.event_loop_)
+	, path_(path)
+	, file_(file)
+	, omitPath_(omitPath)
+	, localFile_(localFile)
+	, remoteSize_(remoteSize)
+	, chunks_(remoteSize)
+{
+}
+
+CFtpDeltaOpData::~CFtpDeltaOpData()
+{
+	abort_ = true;
+	if (task_) {
+		task_.join();
+	}
+	remove_handler();
+}
+
+bool CFtpDeltaOpData::Supported(CServer const& server)
+{
+	bool needOpts{};
+	return choose_ranged(server, needOpts) != file_hash_algorithm::none;
+}
+
+int CFtpDeltaOpData::Send()
+{
+	switch (opState)
+	{
+	case delta_init:
+		if (remoteSize_ <= 0) {
+			return FZ_REPLY_INTERNALERROR;
+		}
+
+		alg_ = choose_ranged(currentServer_, needOpts_);
+		if (alg_ == file_hash_algorithm::none) {
+			return FZ_REPLY_NOTSUPPORTED;
+		}
+		if (controlSocket_.m_lastHashAlgorithm != file_hash_algorithm::none) {
+			// Already selected on this connection, FEAT only reflects the initial choice
+			needOpts_ = controlSocket_.m_lastHashAlgorithm != alg_;
+		}
+
+		log(logmsg::status, _("Comparing %s checksums of '%s' in %d parts"), file_hash_algorithm_name(alg_), path_.FormatFilename(file_), chunks_.count());
+
+		task_ = engine_.GetThreadPool().spawn([this]() {
+			auto const on_chunk = [this](std::string && hash) {
+				{
+					fz::scoped_lock l(mtx_);
+					localHashes_.emplace_back(std::move(hash));
+				}
+				send_event<CFtpLocalHashEvent>();
+				return !abort_;
+			};
+			hash_local_file_chunks(localFile_, alg_, chunks_.chunk_size(), chunks_.size(), on_chunk, &abort_);
+
+			{
+				fz::scoped_lock l(mtx_);
+				localDone_ = true;
+			}
+			send_event<CFtpLocalHashEvent>();
+		});
+		if (!task_) {
+			log(logmsg::debug_warning, L"Could not spawn hashing task");
+			return FZ_REPLY_ERROR;
+		}
+
+		opState = needOpts_ ? delta_opts : delta_rang;
+		return FZ_REPLY_CONTINUE;
+	case delta_opts:
+		return controlSocket_.SendCommand(L"OPTS HASH " + file_hash_algorithm_name(alg_));
+	case delta_rang:
+		return controlSocket_.SendCommand(fz::sprintf(L"RANG %d %d", chunks_.first(chunk_), chunks_.last(chunk_)));
+	case delta_hash:
+		return controlSocket_.SendCommand(L"HASH " + path_.FormatFilename(file_, omitPath_));
+	case delta_waitlocal:
+	{
+		std::string localHash;
+		{
+			fz::scoped_lock l(mtx_);
+			if (static_cast<int64_t>(localHashes_.size()) > chunk_) {
+				localHash = localHashes_[chunk_];
+				commonPrefix_ = common_prefix(chunks_, localHashes_, [this](int64_t chunk) {
+					return chunk < static_cast<int64_t>(remoteHashes_.size()) ? remoteHashes_[chunk] : std::string();
+				});
+			}
+			else if (!localDone_) {
+				return FZ_REPLY_WOULDBLOCK;
+			}
+		}
+		if (localHash.empty()) {
+			log(logmsg::error, _("Could not compute checksum of local file %s"), localFile_);
+			return Reset(true);
+		}
+
+		if (commonPrefix_ < chunks_.covered(chunk_ + 1)) {
+			log(logmsg::debug_info, L"Part %d differs, local checksum %s, remote checksum %s", chunk_, localHash, remoteHashes_.back());
+			return Reset(false);
+		}
+
+		++chunk_;
+		if (chunk_ >= chunks_.count()) {
+			return Reset(false);
+		}
+		opState = delta_rang;
+		return FZ_REPLY_CONTINUE;
+	}
+	case delta_reset:
+		// An empty range restores hashing of entire files
+		return controlSocket_.SendCommand(L"RANG 1 0");
+	}
+
+	log(logmsg::debug_warning, L"Unknown op state: %d", opState);
+	return FZ_REPLY_INTERNALERROR;
+}
+
+int CFtpDeltaOpData::ParseResponse()
+{
+	int const code = controlSocket_.GetReplyCode();
+
+	switch (opState) {
+	case delta_opts:
+		if (code != 2) {
+			return FZ_REPLY_ERROR;
+		}
+		controlSocket_.m_lastHashAlgorithm = alg_;
+		opState = delta_rang;
+		return FZ_REPLY_CONTINUE;
+	case delta_rang:
+		if (code != 2 && code != 3) {
+			// Nothing to undo as the range did not get set
+			return FZ_REPLY_ERROR;
+		}
+		opState = delta_hash;
+		return FZ_REPLY_CONTINUE;
+	case delta_hash:
+	{
+		if (code != 2) {
+			return Reset(true);
+		}
+		auto hash = parse_hash(controlSocket_.m_Response, alg_);
+		if (hash.empty()) {
+			log(logmsg::debug_warning, L"Could not find checksum in reply");
+			return Reset(true);
+		}
+		remoteHashes_.emplace_back(std::move(hash));
+		opState = delta_waitlocal;
+		return FZ_REPLY_CONTINUE;
+	}
+	case delta_reset:
+		if (code != 2 && code != 3) {
+			return FZ_REPLY_ERROR;
+		}
+		return failed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
+	default:
+		log(logmsg::debug_warning, L"Unknown op state: %d", opState);
+		return FZ_REPLY_INTERNALERROR;
+	}
+}
+
+int CFtpDeltaOpData::Reset(bool failed)
+{
+	failed_ = failed;
+	abort_ = true;
+	opState = delta_reset;
+	return FZ_REPLY_CONTINUE;
+}
+
+void CFtpDeltaOpData::operator()(fz::event_base const& ev)
+{
+	if (ev.derived_type() != CFtpLocalHashEvent::type()) {
+		return;
+	}
+
+	if (opState == delta_waitlocal) {
+		controlSocket_.SendNextCommand();
+	}
+}
@@ -0,0 +1,109 @@
+#ifndef FILEZILLA_ENGINE_FTP_HASH_HEADER
+#define FILEZILLA_ENGINE_FTP_HASH_HEADER
+
+#include "ftpcontrolsocket.h"
+
+#include "../../include/file_hash.h"
+
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <vector>
+
+struct ftp_local_hash_event_type;
+typedef fz::simple_event<ftp_local_hash_event_type> CFtpLocalHashEvent;
+
+// Compares the checksum of a remote file with the one of a local file.
+// The server is asked through HASH or one of the X* checksum commands
+// while the local file gets hashed on the thread pool.
+class CFtpHashOpData final : public COpData, public CFtpOpData, public fz::event_handler
+{
+public:
+	CFtpHashOpData(CFtpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, bool omitPath
+		, std::wstring const& localFile, int64_t localSize, fz::datetime const& localTime);
+	virtual ~CFtpHashOpData();
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+	// Whether the server supports any of the checksum commands
+	static bool Supported(CServer const& server);
+
+	// Set if the operation succeeded and both files have the same checksum
+	bool identical_{};
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+
+	CServerPath const path_;
+	std::wstring const file_;
+	bool const omitPath_;
+
+	std::wstring const localFile_;
+	int64_t const localSize_;
+	fz::datetime const localTime_;
+
+	file_hash_algorithm alg_{};
+	std::wstring command_;
+	bool needOpts_{};
+
+	std::string remoteHash_;
+	std::string localHash_;
+	bool localDone_{};
+
+	std::atomic<bool> abort_{};
+	fz::async_task task_;
+};
+
+// Finds how much of the start of a local file is identical to the remote
+// file. The remote file is hashed chunk by chunk by restricting HASH through
+// RANG, stopping at the first chunk that differs from the local file.
+class CFtpDeltaOpData final : public COpData, public CFtpOpData, public fz::event_handler
+{
+public:
+	CFtpDeltaOpData(CFtpControlSocket & controlSocket, CServerPath const& path, std::wstring const& file, bool omitPath
+		, std::wstring const& localFile, int64_t remoteSize);
+	virtual ~CFtpDeltaOpData();
+
+	virtual int Send() override;
+	virtual int ParseResponse() override;
+
+	// Whether the server supports hashing byte ranges through HASH and RANG
+	static bool Supported(CServer const& server);
+
+	// Number of leading bytes both files have in common, a multiple of the
+	// chunk size unless it covers the entire remote file.
+	int64_t commonPrefix_{};
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+
+	int Reset(bool failed);
+
+	CServerPath const path_;
+	std::wstring const file_;
+	bool const omitPath_;
+
+	std::wstring const localFile_;
+	int64_t const remoteSize_;
+	file_hash_chunks const chunks_;
+
+	file_hash_algorithm alg_{};
+	bool needOpts_{};
+
+	int64_t chunk_{};
+
+	// One per chunk compared so far
+	std::vector<std::string> remoteHashes_;
+	bool failed_{};
+
+	// Filled by the hashing task
+	fz::mutex mtx_;
+	std::vector<std::string> localHashes_;
+	bool localDone_{};
+
+	std::atomic<bool> abort_{};
+	fz::async_task task_;
+};
+
+#endif
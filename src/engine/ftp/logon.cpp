@@ -1,6 +1,7 @@
 #include "../filezilla.h"
 
 #include "logon.h"
+#include "../metrics.h"
 #include "../proxy.h"
 #include "../servercapabilities.h"
 
@@ -275,7 +276,8 @@ int CFtpLogonOpData::ParseResponse()
 			controlSocket_.tls_layer_ = std::make_unique<fz::tls_layer>(controlSocket_.event_loop_, &controlSocket_, *controlSocket_.active_layer_, &engine_.GetContext().GetTlsSystemTrustStore(), controlSocket_.logger_);
 			controlSocket_.active_layer_ = controlSocket_.tls_layer_.get();
 
-			if (!controlSocket_.tls_layer_->client_handshake(&controlSocket_)) {
+			engine_.metrics_.tls_handshake();
+			if (!controlSocket_.tls_layer_->client_handshake(&controlSocket_, controlSocket_.GetCachedTlsSession(currentServer_.GetHost(), currentServer_.GetPort()))) {
 				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
 			}
 
@@ -848,4 +850,25 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 	else if (HasFeature(up, L"EPSV")) {
 		CServerCapabilities::SetCapability(currentServer_, epsv_command, yes);
 	}
+	else if (HasFeature(up, L"HASH")) {
+		CServerCapabilities::SetCapability(currentServer_, hash_command, yes, line.size() > 5 ? line.substr(5) : std::wstring());
+	}
+	else if (HasFeature(up, L"XCRC")) {
+		CServerCapabilities::SetCapability(currentServer_, xcrc_command, yes);
+	}
+	else if (HasFeature(up, L"XMD5")) {
+		CServerCapabilities::SetCapability(currentServer_, xmd5_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA1")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha1_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA256")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha256_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA512")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha512_command, yes);
+	}
+	else if (HasFeature(up, L"RANG STREAM")) {
+		CServerCapabilities::SetCapability(currentServer_, rang_command, yes);
+	}
 }
@@ -265,6 +265,11 @@ int CFtpRawTransferOpData::ParseResponse()
 		break;
 	case rawtransfer_waittransfer:
 		if (code != 2 && code != 3) {
+			if (pOldData->rangeComplete && pOldData->transferEndReason == TransferEndReason::successful) {
+				// We closed the data connection ourselves, the server merely reports the aborted transfer.
+				log(logmsg::debug_info, L"Ignoring error reply, requested range has been received.");
+				return FZ_REPLY_OK;
+			}
 			if (pOldData->transferEndReason == TransferEndReason::successful) {
 				pOldData->transferEndReason = TransferEndReason::transfer_command_failure;
 			}
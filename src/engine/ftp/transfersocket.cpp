@@ -2,8 +2,10 @@
 #include "../activity_logger_layer.h"
 #include "../directorylistingparser.h"
 #include "../engineprivate.h"
+#include "../metrics.h"
 #include "../proxy.h"
 #include "../servercapabilities.h"
+#include "../trace.h"
 
 #include "ftpcontrolsocket.h"
 #include "transfersocket.h"
@@ -379,6 +381,7 @@ void CTransferSocket::OnConnect()
 {
 	controlSocket_.SetAlive();
 	controlSocket_.log(logmsg::debug_verbose, L"CTransferSocket::OnConnect");
+	record_trace(engine_.GetEngineId(), trace_event::socket_connected);
 
 	if (!socket_) {
 		controlSocket_.log(logmsg::debug_verbose, L"CTransferSocket::OnConnect called without socket");
@@ -471,19 +474,32 @@ void CTransferSocket::OnReceive()
 			return;
 		}
 		else if (m_transferMode == TransferMode::download) {
+			AddNetworkWait();
+
 			int error;
 			int numread;
+			int64_t received{};
+			int calls{};
 
 			// Only do a certain number of iterations in one go to keep the event loop going.
 			// Otherwise this behaves like a livelock on very large files written to a very fast
 			// SSD downloaded from a very fast server.
 			for (int i = 0; i < 100; ++i) {
+				if (!range_remaining_) {
+					FinalizeWrite();
+					return;
+				}
+
 				if (!CheckGetNextWriteBuffer()) {
 					return;
 				}
 
 				size_t to_read = buffer_.capacity() - buffer_.size();
+				if (range_remaining_ < to_read) {
+					to_read = static_cast<size_t>(range_remaining_);
+				}
 				numread = active_layer_->read(buffer_.get(to_read), static_cast<unsigned int>(to_read), error);
+				++calls;
 				if (numread <= 0) {
 					break;
 				}
@@ -495,10 +511,21 @@ void CTransferSocket::OnReceive()
 				}
 
 				buffer_.add(static_cast<size_t>(numread));
+				received += numread;
+				if (range_remaining_ != aio_base::nosize) {
+					range_remaining_ -= static_cast<uint64_t>(numread);
+				}
+			}
+			if (received) {
+				record_trace(engine_.GetEngineId(), trace_event::socket_receive, received);
 			}
+			engine_.transfer_telemetry_.AddNetworkCalls(calls);
 
 			if (numread < 0) {
-				if (error != EAGAIN) {
+				if (error == EAGAIN) {
+					network_wait_start_ = fz::monotonic_clock::now();
+				}
+				else {
 					controlSocket_.log(logmsg::error, L"Could not read from transfer socket: %s", fz::socket_error_description(error));
 					TransferEnd(TransferEndReason::transfer_failure);
 				}
@@ -586,8 +613,12 @@ void CTransferSocket::OnSend()
 		return;
 	}
 
+	AddNetworkWait();
+
 	int error;
 	int written;
+	int64_t sent{};
+	int calls{};
 
 	// Only do a certain number of iterations in one go to keep the event loop going.
 	// Otherwise this behaves like a livelock on very large files read from a very fast
@@ -598,6 +629,7 @@ void CTransferSocket::OnSend()
 		}
 
 		written = active_layer_->write(buffer_.get(), static_cast<int>(buffer_.size()), error);
+		++calls;
 		if (written <= 0) {
 			break;
 		}
@@ -611,10 +643,17 @@ void CTransferSocket::OnSend()
 		engine_.transfer_status_.Update(written);
 
 		buffer_.consume(written);
+		sent += written;
+	}
+	if (sent) {
+		record_trace(engine_.GetEngineId(), trace_event::socket_send, sent);
 	}
+	engine_.transfer_telemetry_.AddNetworkCalls(calls);
 
 	if (written < 0) {
 		if (error == EAGAIN) {
+			record_trace(engine_.GetEngineId(), trace_event::socket_send_blocked);
+			network_wait_start_ = fz::monotonic_clock::now();
 			if (!m_madeProgress) {
 				controlSocket_.log(logmsg::debug_debug, L"First EAGAIN in CTransferSocket::OnSend()");
 				m_madeProgress = 1;
@@ -631,6 +670,14 @@ void CTransferSocket::OnSend()
 	}
 }
 
+void CTransferSocket::AddNetworkWait()
+{
+	if (network_wait_start_) {
+		engine_.transfer_telemetry_.AddWait(CTransferTelemetry::network, fz::monotonic_clock::now() - network_wait_start_);
+		network_wait_start_ = fz::monotonic_clock();
+	}
+}
+
 void CTransferSocket::OnSocketError(int error)
 {
 	controlSocket_.log(logmsg::debug_verbose, L"CTransferSocket::OnSocketError(%d)", error);
@@ -719,6 +766,7 @@ bool CTransferSocket::InitLayers(bool active)
 		tls_layer_ = std::make_unique<fz::tls_layer>(controlSocket_.event_loop_, nullptr, *active_layer_, nullptr, controlSocket_.logger_);
 		active_layer_ = tls_layer_.get();
 
+		engine_.metrics_.tls_handshake();
 		if (!tls_layer_->client_handshake(controlSocket_.tls_layer_->get_raw_certificate(), controlSocket_.tls_layer_->get_session_parameters(), controlSocket_.tls_layer_->peer_host())) {
 			return false;
 		}
@@ -756,10 +804,16 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 		return;
 	}
 	m_transferEndReason = reason;
+	record_trace(engine_.GetEngineId(), trace_event::socket_transfer_end, static_cast<int64_t>(reason));
 
 	if (reason != TransferEndReason::successful) {
 		ResetSocket();
 	}
+	else if (range_complete()) {
+		// The server is still sending data past the end of the range
+		controlSocket_.log(logmsg::debug_verbose, L"Requested range received, closing data connection");
+		ResetSocket();
+	}
 	else {
 		active_layer_->shutdown();
 	}
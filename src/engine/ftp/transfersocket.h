@@ -39,6 +39,11 @@ public:
 	void set_reader(std::unique_ptr<reader_base> && reader, bool ascii);
 	void set_writer(std::unique_ptr<writer_base> && writer, bool ascii);
 
+	// Limits a download to the given number of bytes. Once received, the
+	// data connection gets closed without waiting for the server.
+	void set_range(uint64_t length) { range_remaining_ = length; }
+	bool range_complete() const { return range_remaining_ == 0; }
+
 	void ContinueWithoutSesssionResumption();
 
 protected:
@@ -98,10 +103,15 @@ protected:
 	// On uploads, 1 after first WSAE_WOULDBLOCK
 	int m_madeProgress{};
 
+	// Set while the socket would block, for the transfer telemetry
+	fz::monotonic_clock network_wait_start_;
+	void AddNetworkWait();
+
 	std::unique_ptr<reader_base> reader_;
 	std::unique_ptr<writer_base> writer_;
 	fz::nonowning_buffer buffer_;
 	size_t resumetest_{};
+	uint64_t range_remaining_{aio_base::nosize};
 
 	fz::buffer line_ending_buffer_;
 };
@@ -2,6 +2,8 @@
 
 #include "filetransfer.h"
 
+#include "../servercapabilities.h"
+
 #include <libfilezilla/local_filesys.hpp>
 
 #include <assert.h>
@@ -10,6 +12,7 @@
 enum filetransferStates
 {
 	filetransfer_init = 0,
+	filetransfer_head,
 	filetransfer_transfer,
 	filetransfer_waittransfer
 };
@@ -65,10 +68,42 @@ int CHttpFileTransferOpData::Send()
 			if (res != FZ_REPLY_OK) {
 				return res;
 			}
+
+			if (writer_factory_.range_end() != writer_factory::npos &&
+				CServerCapabilities::GetCapability(currentServer_, range_requests) == unknown)
+			{
+				opState = filetransfer_head;
+			}
 		}
 		return FZ_REPLY_CONTINUE;
+	case filetransfer_head:
+		// Find out whether the server supports ranges before requesting one
+		rr_.request_.verb_ = "HEAD";
+		rr_.response_.on_header_ = [this](auto const&) { return this->OnHeader(); };
+
+		opState = filetransfer_waittransfer;
+		controlSocket_.Request(make_simple_rr(&rr_));
+		return FZ_REPLY_CONTINUE;
 	case filetransfer_transfer:
-		if (resume_) {
+		if (writer_factory_.range_end() != writer_factory::npos) {
+			uint64_t const range_end = writer_factory_.range_end();
+			if (CServerCapabilities::GetCapability(currentServer_, range_requests) == no) {
+				// Without ranges, the transfer of the first segment downloads the whole file
+				if (writer_factory_.range_start() != 0) {
+					log(logmsg::status, _("Server does not support byte ranges, the file gets downloaded by the transfer of its first segment."));
+					return FZ_REPLY_OK;
+				}
+				rr_.request_.headers_.erase("Range");
+			}
+			else if (static_cast<uint64_t>(localFileSize_) >= range_end) {
+				log(logmsg::debug_info, L"Range has already been downloaded completely.");
+				return FZ_REPLY_OK;
+			}
+			else {
+				rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", localFileSize_, range_end - 1);
+			}
+		}
+		else if (resume_) {
 			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-", localFileSize_);
 		}
 
@@ -88,12 +123,20 @@ int CHttpFileTransferOpData::OnHeader()
 {
 	log(logmsg::debug_verbose, L"CHttpFileTransferOpData::OnHeader");
 
-	if (rr_.response_.code_ == 416 && resume_) {
+	bool const range = writer_factory_.range_end() != writer_factory::npos;
+	if (rr_.response_.code_ == 416 && resume_ && !range) {
 		resume_ = false;
 		opState = filetransfer_transfer;
 		return FZ_REPLY_ERROR;
 	}
 
+	if (rr_.request_.verb_ == "HEAD" && rr_.response_.code_ >= 400) {
+		// Not every server allows HEAD, just try the range request
+		rr_.request_.verb_ = "GET";
+		opState = filetransfer_transfer;
+		return FZ_REPLY_OK;
+	}
+
 	if (rr_.response_.code_ < 200 || rr_.response_.code_ >= 400) {
 		return FZ_REPLY_ERROR;
 	}
@@ -136,10 +179,29 @@ int CHttpFileTransferOpData::OnHeader()
 
 		rr_.request_.uri_ = location;
 
+		opState = (rr_.request_.verb_ == "HEAD") ? filetransfer_head : filetransfer_transfer;
+		return FZ_REPLY_OK;
+	}
+
+	if (rr_.request_.verb_ == "HEAD") {
+		auto const accept = fz::str_tolower_ascii(rr_.response_.get_header("Accept-Ranges"));
+		if (accept == "bytes") {
+			CServerCapabilities::SetCapability(currentServer_, range_requests, yes);
+		}
+		else if (accept == "none") {
+			CServerCapabilities::SetCapability(currentServer_, range_requests, no);
+		}
+		// Otherwise the reply to the actual range request tells
+
+		rr_.request_.verb_ = "GET";
 		opState = filetransfer_transfer;
 		return FZ_REPLY_OK;
 	}
 
+	if (range) {
+		return OnRangeHeader();
+	}
+
 	// Check if the server disallowed resume
 	if (resume_ && rr_.response_.code_ != 206) {
 		resume_ = false;
@@ -168,9 +230,57 @@ int CHttpFileTransferOpData::OnHeader()
 	return FZ_REPLY_CONTINUE;
 }
 
+int CHttpFileTransferOpData::OnRangeHeader()
+{
+	uint64_t const start = static_cast<uint64_t>(localFileSize_);
+	int64_t total = static_cast<int64_t>(writer_factory_.range_end());
+
+	if (rr_.response_.code_ == 206) {
+		// Content-Range: bytes first-last/complete-length
+		auto const content_range = rr_.response_.get_header("Content-Range");
+		auto const tokens = fz::strtok_view(content_range, " -/");
+		if (tokens.size() < 3 || tokens[0] != "bytes" || fz::to_integral<uint64_t>(tokens[1], aio_base::nosize) != start) {
+			log(logmsg::error, _("Malformed response header: %s"), _("Invalid Content-Range"));
+			return FZ_REPLY_ERROR;
+		}
+		CServerCapabilities::SetCapability(currentServer_, range_requests, yes);
+	}
+	else {
+		// Server ignored the range and is sending the whole file. Drop the
+		// segmentation: the transfer of the first segment writes the rest of
+		// the file, the other segments finish without reading the body.
+		CServerCapabilities::SetCapability(currentServer_, range_requests, no);
+		if (writer_factory_.range_start() != 0) {
+			log(logmsg::status, _("Server does not support byte ranges, the file gets downloaded by the transfer of its first segment."));
+			rr_.response_.limit_ = 0;
+			return FZ_REPLY_CONTINUE;
+		}
+
+		log(logmsg::status, _("Server does not support byte ranges, downloading the whole file in this transfer."));
+		if (!writer_factory_.extend_range()) {
+			return FZ_REPLY_INTERNALERROR;
+		}
+		rr_.response_.skip_ = start;
+		total = fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1);
+	}
+
+	auto writer = writer_factory_.open(start, engine_, &controlSocket_, aio_base::shm_flag_none);
+	if (!writer) {
+		return FZ_REPLY_CRITICALERROR;
+	}
+	rr_.response_.writer_ = std::move(writer);
+
+	if (engine_.transfer_status_.empty()) {
+		engine_.transfer_status_.Init(total, static_cast<int64_t>(start), false);
+		engine_.transfer_status_.SetStartTime();
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
 int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 {
-	if (opState == filetransfer_transfer) {
+	if (opState == filetransfer_transfer || opState == filetransfer_head) {
 		return FZ_REPLY_CONTINUE;
 	}
 
@@ -19,6 +19,7 @@ public:
 
 private:
 	int OnHeader();
+	int OnRangeHeader();
 
 	HttpRequestResponse rr_;
 
@@ -8,15 +8,21 @@
 
 #include "../../include/engine_options.h"
 
+#include "../activity_logger_layer.h"
 #include "../controlsocket.h"
 #include "../engineprivate.h"
+#include "../metrics.h"
+#include "../proxy.h"
 
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/iputils.hpp>
 #include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/rate_limited_layer.hpp>
 #include <libfilezilla/tls_layer.hpp>
 #include <libfilezilla/uri.hpp>
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 
@@ -64,6 +70,8 @@ int HttpResponse::reset()
 	code_ = 0;
 	headers_.clear();
 	body_.clear();
+	skip_ = 0;
+	limit_ = aio_base::nosize;
 
 	return FZ_REPLY_CONTINUE;
 }
@@ -130,10 +138,16 @@ CHttpControlSocket::CHttpControlSocket(CFileZillaEnginePrivate & engine)
 {
 }
 
+namespace {
+// Most servers close idle connections on their own after a few seconds to a minute
+fz::duration const idle_connection_timeout = fz::duration::from_seconds(30);
+}
+
 CHttpControlSocket::~CHttpControlSocket()
 {
 	remove_handler();
 	DoClose();
+	idle_connections_.clear();
 }
 
 bool CHttpControlSocket::SetAsyncRequestReply(CAsyncRequestNotification *pNotification)
@@ -197,7 +211,11 @@ void CHttpControlSocket::OnReceive()
 		return;
 	}
 
-	int res = static_cast<CHttpRequestOpData&>(*operations_.back()).OnReceive(false);
+	auto & data = static_cast<CHttpRequestOpData&>(*operations_.back());
+	int res = data.OnReceive(false);
+	if ((res & FZ_REPLY_DISCONNECTED) && data.RetryOnReusedConnection()) {
+		res = FZ_REPLY_CONTINUE;
+	}
 	if (res == FZ_REPLY_CONTINUE) {
 		SendNextCommand();
 	}
@@ -224,12 +242,14 @@ void CHttpControlSocket::OnConnect()
 			tls_layer_ = std::make_unique<fz::tls_layer>(event_loop_, this, *active_layer_, &engine_.GetContext().GetTlsSystemTrustStore(), logger_);
 			active_layer_ = tls_layer_.get();
 
-			if (!tls_layer_->client_handshake(&data)) {
+			engine_.metrics_.tls_handshake();
+			if (!tls_layer_->client_handshake(&data, GetCachedTlsSession(data.host_, data.port_))) {
 				DoClose();
 			}
 		}
 		else {
 			log(logmsg::status, _("TLS connection established, sending HTTP request"));
+			CacheTlsSession(*tls_layer_, data.host_, data.port_);
 			ResetOperation(FZ_REPLY_OK);
 		}
 	}
@@ -299,6 +319,12 @@ int CHttpControlSocket::InternalConnect(std::wstring const& host, unsigned short
 		if (!allowDisconnect) {
 			return FZ_REPLY_WOULDBLOCK;
 		}
+		ParkConnection();
+	}
+
+	if (RestoreConnection(host, port, tls)) {
+		log(logmsg::debug_verbose, L"Reusing an idle connection");
+		return FZ_REPLY_OK;
 	}
 
 	ResetSocket();
@@ -320,17 +346,95 @@ void CHttpControlSocket::OnSocketError(int error)
 		return;
 	}
 
+	if (operations_.back()->opId == PrivCommand::http_request) {
+		auto & data = static_cast<CHttpRequestOpData&>(*operations_.back());
+		if (data.RetryOnReusedConnection()) {
+			SendNextCommand();
+			return;
+		}
+	}
+
 	log(logmsg::error, _("Disconnected from server: %s"), fz::socket_error_description(error));
 	ResetOperation(FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED);
 }
 
+void CHttpControlSocket::ParkConnection()
+{
+	size_t const max = static_cast<size_t>(engine_.GetOptions().get_int(OPTION_HTTP_IDLE_CONNECTIONS));
+	if (!max || !active_layer_ || !send_buffer_.empty() || active_layer_->get_state() != fz::socket_state::connected) {
+		ResetSocket();
+		return;
+	}
+
+	log(logmsg::debug_verbose, L"Keeping idle connection to %s:%d", connected_host_, connected_port_);
+
+	if (idle_connections_.size() >= max) {
+		idle_connections_.erase(idle_connections_.begin());
+	}
+
+	// No events until the connection gets used again
+	active_layer_->set_event_handler(nullptr);
+
+	idle_connection c;
+	c.host_ = connected_host_;
+	c.port_ = connected_port_;
+	c.tls_ = connected_tls_;
+	c.since_ = fz::monotonic_clock::now();
+	c.socket_ = std::move(socket_);
+	c.activity_logger_layer_ = std::move(activity_logger_layer_);
+	c.ratelimit_layer_ = std::move(ratelimit_layer_);
+	c.proxy_layer_ = std::move(proxy_layer_);
+	c.tls_layer_ = std::move(tls_layer_);
+	c.active_layer_ = active_layer_;
+	idle_connections_.push_back(std::move(c));
+
+	ResetSocket();
+}
+
+bool CHttpControlSocket::RestoreConnection(std::wstring const& host, unsigned short port, bool tls)
+{
+	auto const now = fz::monotonic_clock::now();
+
+	idle_connections_.erase(std::remove_if(idle_connections_.begin(), idle_connections_.end(), [&now](idle_connection const& c) {
+		return now - c.since_ >= idle_connection_timeout;
+	}), idle_connections_.end());
+
+	auto found = std::find_if(idle_connections_.begin(), idle_connections_.end(), [&](idle_connection const& c) {
+		return c.host_ == host && c.port_ == port && c.tls_ == tls;
+	});
+	if (found == idle_connections_.end()) {
+		return false;
+	}
+
+	ResetSocket();
+
+	socket_ = std::move(found->socket_);
+	activity_logger_layer_ = std::move(found->activity_logger_layer_);
+	ratelimit_layer_ = std::move(found->ratelimit_layer_);
+	proxy_layer_ = std::move(found->proxy_layer_);
+	tls_layer_ = std::move(found->tls_layer_);
+	active_layer_ = found->active_layer_;
+	connected_host_ = host;
+	connected_port_ = port;
+	connected_tls_ = tls;
+	idle_connections_.erase(found);
+
+	// Picks up anything that happened while idle, e.g. the server closing the connection
+	active_layer_->set_event_handler(this);
+
+	return true;
+}
+
 void CHttpControlSocket::ResetSocket()
 {
 	log(logmsg::debug_verbose, L"CHttpControlSocket::ResetSocket()");
 
 	active_layer_ = nullptr;
 
-	tls_layer_.reset();
+	if (tls_layer_) {
+		CacheTlsSession(*tls_layer_, connected_host_, connected_port_);
+		tls_layer_.reset();
+	}
 
 	CRealControlSocket::ResetSocket();
 }
@@ -338,6 +442,7 @@ void CHttpControlSocket::ResetSocket()
 int CHttpControlSocket::Disconnect()
 {
 	DoClose();
+	idle_connections_.clear();
 	return FZ_REPLY_OK;
 }
 
@@ -78,6 +78,13 @@ public:
 
 	uint64_t update_content_length();
 
+	// Requests that can safely be repeated if the connection got closed
+	// before a response was received.
+	bool idempotent() const
+	{
+		return verb_ == "GET" || verb_ == "HEAD" || verb_ == "OPTIONS" || verb_ == "PUT" || verb_ == "DELETE";
+	}
+
 	virtual int reset();
 };
 
@@ -126,6 +133,15 @@ public:
 	// Holds error body and success body if there is no writer.
 	fz::buffer body_;
 
+	// Number of leading bytes of a successful body that are dropped
+	// instead of being passed to the writer.
+	uint64_t skip_{};
+
+	// Once this many bytes following the skipped ones have been passed to
+	// the writer, the rest of the body is not read and the connection gets
+	// closed.
+	uint64_t limit_{aio_base::nosize};
+
 	bool success() const {
 		return code_ >= 200 && code_ < 300;
 	}
@@ -211,6 +227,13 @@ protected:
 	int InternalConnect(std::wstring const& host, unsigned short port, bool tls, bool allowDisconnect);
 	virtual int Disconnect() override;
 
+	// Moves the current connection into the idle pool, or closes it if it
+	// cannot be kept.
+	void ParkConnection();
+
+	// Makes an idle connection to the given host the current one
+	bool RestoreConnection(std::wstring const& host, unsigned short port, bool tls);
+
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) override;
 
 	std::unique_ptr<fz::tls_layer> tls_layer_;
@@ -234,6 +257,24 @@ private:
 	unsigned short connected_port_{};
 	bool connected_tls_{};
 
+	// Kept-alive connections to hosts other than the current one.
+	// Members are in layering order so that they get destroyed top-down.
+	struct idle_connection final
+	{
+		std::wstring host_;
+		unsigned short port_{};
+		bool tls_{};
+		fz::monotonic_clock since_;
+
+		std::unique_ptr<fz::socket> socket_;
+		std::unique_ptr<activity_logger_layer> activity_logger_layer_;
+		std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
+		std::unique_ptr<CProxySocket> proxy_layer_;
+		std::unique_ptr<fz::tls_layer> tls_layer_;
+		fz::socket_layer* active_layer_{};
+	};
+	std::vector<idle_connection> idle_connections_;
+
 	static RequestThrottler throttler_;
 };
 
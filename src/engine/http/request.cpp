@@ -2,6 +2,8 @@
 
 #include "request.h"
 
+#include "../../include/engine_options.h"
+
 #include <libfilezilla/encode.hpp>
 
 #include <string.h>
@@ -53,10 +55,14 @@ void CHttpRequestOpData::AddRequest(std::shared_ptr<HttpRequestResponseInterface
 	if (!(opState & request_send_mask)) {
 		bool wait = false;
 		if (!requests_.empty()) {
-			if (!requests_.back() && !read_state_.keep_alive_) {
+			if (!requests_.back()) {
+				// Body of a response nobody is interested in is still being received
+				wait = true;
+			}
+			else if (!(requests_.back()->request().keep_alive() || requests_.back()->response().keep_alive())) {
 				wait = true;
 			}
-			else if (requests_.back() && !(requests_.back()->request().keep_alive() || requests_.back()->response().keep_alive())) {
+			else if (!CanPipeline(requests_.back()->request(), rr->request())) {
 				wait = true;
 			}
 		}
@@ -123,11 +129,7 @@ int CHttpRequestOpData::Send()
 			host_header += fz::to_string(req.uri_.port_);
 		}
 		req.headers_["Host"] = host_header;
-		auto pos = req.headers_.find("Connection");
-		if (pos == req.headers_.end()) {
-			// TODO: consider making keep-alive the default
-			req.headers_["Connection"] = "close";
-		}
+		// No Connection header: HTTP/1.1 connections are persistent by default
 		req.headers_["User-Agent"] = fz::replaced_substrings(PACKAGE_STRING, " ", "/");
 
 		opState &= ~request_init;
@@ -158,6 +160,9 @@ int CHttpRequestOpData::Send()
 		auto const& uri = req.uri_;
 		int res = controlSocket_.InternalConnect(fz::to_wstring_from_utf8(uri.host_), uri.port_, uri.scheme_ == "https", !send_pos_);
 		if (res == FZ_REPLY_OK) {
+			if (!send_pos_) {
+				reused_connection_ = true;
+			}
 			opState &= ~request_wait_connect;
 			opState |= request_send;
 			res = FZ_REPLY_CONTINUE;
@@ -223,6 +228,10 @@ int CHttpRequestOpData::Send()
 							opState |= request_send_wait_for_read;
 							log(logmsg::debug_info, L"Request did not ask for keep-alive. Waiting for response to finish before sending next request a new connection.");
 						}
+						else if (!CanPipeline(req, requests_[send_pos_]->request())) {
+							opState |= request_send_wait_for_read;
+							log(logmsg::debug_verbose, L"Waiting for response to finish before sending next request.");
+						}
 						else {
 							opState |= request_init;
 						}
@@ -306,6 +315,10 @@ int CHttpRequestOpData::Send()
 					opState |= request_send_wait_for_read;
 					log(logmsg::debug_info, L"Request did not ask for keep-alive. Waiting for response to finish before sending next request a new connection.");
 				}
+				else if (!CanPipeline(req, requests_[send_pos_]->request())) {
+					opState |= request_send_wait_for_read;
+					log(logmsg::debug_verbose, L"Waiting for response to finish before sending next request.");
+				}
 				else {
 					opState |= request_init;
 				}
@@ -323,6 +336,44 @@ int CHttpRequestOpData::Send()
 	return FZ_REPLY_INTERNALERROR;
 }
 
+bool CHttpRequestOpData::CanPipeline(HttpRequest const& prev, HttpRequest const& next) const
+{
+	if (!engine_.GetOptions().get_int(OPTION_HTTP_PIPELINING)) {
+		return false;
+	}
+
+	// Only plain GET and HEAD requests, anything else may depend on the
+	// outcome of the previous request.
+	auto const pipelinable = [](HttpRequest const& req) {
+		return !req.body_ && (req.verb_ == "GET" || req.verb_ == "HEAD");
+	};
+	return pipelinable(prev) && pipelinable(next);
+}
+
+bool CHttpRequestOpData::RetryOnReusedConnection()
+{
+	if (!reused_connection_) {
+		return false;
+	}
+	reused_connection_ = false;
+
+	for (size_t i = 0; i < send_pos_ && i < requests_.size(); ++i) {
+		if (!requests_[i] || !requests_[i]->request().idempotent()) {
+			return false;
+		}
+	}
+
+	log(logmsg::debug_info, L"Kept-alive connection got closed by the server, retrying on a new connection.");
+
+	controlSocket_.ResetSocket();
+	recv_buffer_.clear();
+	read_state_ = read_state();
+	send_pos_ = 0;
+	opState = request_init | request_reading;
+
+	return true;
+}
+
 int CHttpRequestOpData::SubcommandResult(int, COpData const&)
 {
 	if (opState & request_wait_connect) {
@@ -448,6 +499,7 @@ int CHttpRequestOpData::OnReceive(bool repeatedProcessing)
 			else if (read) {
 				recv_buffer_.add(static_cast<size_t>(read));
 				controlSocket_.SetAlive();
+				reused_connection_ = false;
 			}
 
 			read_state_.eof_ = read == 0;
@@ -512,6 +564,11 @@ int CHttpRequestOpData::OnReceive(bool repeatedProcessing)
 					opState = request_init | request_reading;
 					return FZ_REPLY_CONTINUE;
 				}
+
+				if (!send_pos_ && (opState & request_send_wait_for_read)) {
+					// Next request wasn't pipelined, send it now on the same connection
+					return FZ_REPLY_CONTINUE;
+				}
 			}
 			else if (res != FZ_REPLY_CONTINUE) {
 				return res;
@@ -738,6 +795,13 @@ int CHttpRequestOpData::ProcessCompleteHeader()
 	}
 
 	if (res == FZ_REPLY_CONTINUE) {
+		if (!response.limit_ && read_state_.responseContentLength_) {
+			// Not interested in any of the body
+			log(logmsg::debug_verbose, L"Not reading response body, closing connection");
+			read_state_.keep_alive_ = false;
+			read_state_.done_ = true;
+			return FinalizeResponseBody();
+		}
 		if (!read_state_.responseContentLength_) {
 			read_state_.done_ = true;
 			return FinalizeResponseBody();
@@ -856,6 +920,18 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, size_t & remaining)
 		if (!(response.flags_ & HttpResponse::flag_ignore_body)) {
 			if (response.success()) {
 				if (response.writer_) {
+					if (response.skip_) {
+						size_t s = (response.skip_ < remaining) ? static_cast<size_t>(response.skip_) : remaining;
+						response.skip_ -= s;
+						data += s;
+						remaining -= s;
+					}
+					size_t excess{};
+					if (response.limit_ < remaining) {
+						excess = remaining - static_cast<size_t>(response.limit_);
+						remaining = static_cast<size_t>(response.limit_);
+					}
+					size_t const limited = remaining;
 					while (remaining) {
 						if (read_state_.writer_buffer_.size() >= read_state_.writer_buffer_.capacity()) {
 							auto r = response.writer_->get_write_buffer(read_state_.writer_buffer_);
@@ -876,6 +952,19 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, size_t & remaining)
 						data += s;
 						remaining -= s;
 					}
+					if (response.limit_ != aio_base::nosize) {
+						response.limit_ -= limited - remaining;
+						if (!response.limit_) {
+							// Not interested in the rest of the body
+							log(logmsg::debug_verbose, L"Got all needed data, closing connection");
+							remaining = 0;
+							read_state_.keep_alive_ = false;
+							read_state_.done_ = true;
+						}
+						else {
+							remaining += excess;
+						}
+					}
 				}
 				else {
 					if (response.body_.size() < 1024*1024*16) {
@@ -901,7 +990,7 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, size_t & remaining)
 
 	read_state_.receivedData_ += initial - remaining;
 
-	if (res == FZ_REPLY_CONTINUE && read_state_.receivedData_ == read_state_.responseContentLength_) {
+	if (res == FZ_REPLY_CONTINUE && (read_state_.done_ || read_state_.receivedData_ == read_state_.responseContentLength_)) {
 		read_state_.done_ = true;
 		res = FinalizeResponseBody();
 	}
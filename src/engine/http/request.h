@@ -36,6 +36,11 @@ public:
 
 	int OnReceive(bool repeatedProcessing);
 
+	// If a kept-alive connection got closed before anything was received on it,
+	// starts over on a new connection. Returns false if the requests cannot be
+	// safely repeated.
+	bool RetryOnReusedConnection();
+
 private:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnReaderReady(reader_base * r);
@@ -49,10 +54,16 @@ private:
 	int ProcessData(unsigned char* data, size_t & len);
 	int FinalizeResponseBody();
 
+	// Whether next can be sent before the response to prev has been received
+	bool CanPipeline(HttpRequest const& prev, HttpRequest const& next) const;
+
 	std::deque<std::shared_ptr<HttpRequestResponseInterface>> requests_;
 
 	size_t send_pos_{};
 
+	// Set while nothing has been received yet on a connection that was already open
+	bool reused_connection_{};
+
 
 	enum transferEncodings
 	{
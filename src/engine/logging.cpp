@@ -6,6 +6,9 @@
 
 #include <libfilezilla/util.hpp>
 
+#include <algorithm>
+
+#include <assert.h>
 #include <errno.h>
 
 #ifndef FZ_WINDOWS
@@ -14,320 +17,587 @@
 #include <fcntl.h>
 #endif
 
-bool CLogging::m_logfile_initialized = false;
+namespace {
+// Messages of a single engine that can be queued before it has to wait
+size_t const ring_capacity = 4096;
+
+// Flushing at least this often, even if the rings are not filling up
+fz::duration const flush_interval = fz::duration::from_milliseconds(100);
+
+// Once this much has been formatted it is written out, even if there is more
+size_t const max_batch_size = 256 * 1024;
+
 #ifdef FZ_WINDOWS
-HANDLE CLogging::m_log_fd = INVALID_HANDLE_VALUE;
+char const eol[] = "\r\n";
 #else
-int CLogging::m_log_fd = -1;
+char const eol[] = "\n";
 #endif
-std::string CLogging::m_prefixes[sizeof(logmsg::type) * 8];
-unsigned int CLogging::m_pid;
-int CLogging::m_max_size;
-fz::native_string CLogging::m_file;
-
-int CLogging::m_refcount = 0;
-fz::mutex CLogging::mutex_(false);
-
+}
 
-class CLoggingOptionsChanged final : public fz::event_handler
+log_ring::log_ring(unsigned int engine_id, size_t capacity)
+	: engine_id_(engine_id)
+	, mask_(capacity - 1)
 {
-public:
-	CLoggingOptionsChanged(CLogging& logger, COptionsBase& options, fz::event_loop& loop)
-		: fz::event_handler(loop)
-		, logger_(logger)
-		, options_(options)
-	{
-		logger_.UpdateLogLevel(options_);
-		options_.watch(OPTION_LOGGING_DEBUGLEVEL, this);
-		options_.watch(OPTION_LOGGING_RAWLISTING, this);
+	assert(capacity && !(capacity & (capacity - 1)));
+	slots_ = std::make_unique<slot[]>(capacity);
+	for (size_t i = 0; i < capacity; ++i) {
+		slots_[i].seq.store(i, std::memory_order_relaxed);
 	}
+}
 
-	virtual ~CLoggingOptionsChanged()
-	{
-		options_.unwatch_all(this);
-		remove_handler();
+bool log_ring::push(logmsg::type t, std::wstring const& msg, fz::datetime const& time)
+{
+	size_t pos = head_.load(std::memory_order_relaxed);
+	slot* s;
+	while (true) {
+		s = &slots_[pos & mask_];
+		size_t const seq = s->seq.load(std::memory_order_acquire);
+		auto const diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (!diff) {
+			if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// Slot not yet consumed, full
+			return false;
+		}
+		else {
+			pos = head_.load(std::memory_order_relaxed);
+		}
 	}
 
-	virtual void operator()(const fz::event_base&)
-	{
-		 // In worker thread
-		logger_.UpdateLogLevel(options_);
-	}
+	s->type = t;
+	s->time = time;
+	s->msg = msg;
+	s->seq.store(pos + 1, std::memory_order_release);
 
-	CLogging & logger_;
-	COptionsBase& options_;
-};
+	return true;
+}
 
-CLogging::CLogging(CFileZillaEnginePrivate & engine)
-	: engine_(engine)
+size_t log_ring::size() const
 {
-	{
-		fz::scoped_lock l(mutex_);
-		++m_refcount;
-	}
-	UpdateLogLevel(engine.GetOptions());
-	optionChangeHandler_ = std::make_unique<CLoggingOptionsChanged>(*this, engine_.GetOptions(), engine.event_loop_);
+	size_t const tail = tail_.load(std::memory_order_relaxed);
+	size_t const head = head_.load(std::memory_order_relaxed);
+	return head - tail;
 }
 
-CLogging::~CLogging()
+
+CLogFileWriter::CLogFileWriter(fz::thread_pool & pool)
+	: pool_(pool)
 {
-	fz::scoped_lock l(mutex_);
-	--m_refcount;
+}
 
-	if (!m_refcount) {
-#ifdef FZ_WINDOWS
-		if (m_log_fd != INVALID_HANDLE_VALUE) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-		}
-#else
-		if (m_log_fd != -1) {
-			close(m_log_fd);
-			m_log_fd = -1;
-		}
-#endif
-		m_logfile_initialized = false;
+CLogFileWriter::~CLogFileWriter()
+{
+	{
+		fz::scoped_lock l(wakeup_mutex_);
+		quit_ = true;
+		cond_.signal(l);
 	}
+	thread_.join();
+
+	fz::scoped_lock l(mutex_);
+	flush();
+	close();
 }
 
-bool CLogging::InitLogFile(fz::scoped_lock& l)
+bool CLogFileWriter::init(COptionsBase & options, std::wstring & error)
 {
-	if (m_logfile_initialized) {
-		return true;
+	int state = state_.load(std::memory_order_acquire);
+	if (state) {
+		return state == 1;
 	}
 
-	m_logfile_initialized = true;
+	fz::scoped_lock l(mutex_);
+	state = state_.load(std::memory_order_relaxed);
+	if (state) {
+		return state == 1;
+	}
+	state_ = 2;
 
-	m_file = fz::to_native(engine_.GetOptions().get_string(OPTION_LOGGING_FILE));
-	if (m_file.empty()) {
+	file_ = fz::to_native(options.get_string(OPTION_LOGGING_FILE));
+	if (file_.empty()) {
 		return false;
 	}
 
 #ifdef FZ_WINDOWS
-	m_log_fd = CreateFile(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
+	fd_ = CreateFile(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fd_ == INVALID_HANDLE_VALUE) {
 		DWORD err = GetLastError();
 #else
-	m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-	if (m_log_fd == -1) {
+	fd_ = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ == -1) {
 		int err = errno;
 #endif
-		l.unlock(); //Avoid recursion
-		log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
+		error = fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
 		return false;
 	}
 
-	m_prefixes[fz::bitscan_reverse(logmsg::status)] = fz::to_utf8(_("Status:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::error)] = fz::to_utf8(_("Error:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::command)] = fz::to_utf8(_("Command:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::reply)] = fz::to_utf8(_("Response:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)] = fz::to_utf8(_("Trace:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_info)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_verbose)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_debug)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(_("Listing:"));
+	prefixes_[fz::bitscan_reverse(logmsg::status)] = fz::to_utf8(_("Status:"));
+	prefixes_[fz::bitscan_reverse(logmsg::error)] = fz::to_utf8(_("Error:"));
+	prefixes_[fz::bitscan_reverse(logmsg::command)] = fz::to_utf8(_("Command:"));
+	prefixes_[fz::bitscan_reverse(logmsg::reply)] = fz::to_utf8(_("Response:"));
+	prefixes_[fz::bitscan_reverse(logmsg::debug_warning)] = fz::to_utf8(_("Trace:"));
+	prefixes_[fz::bitscan_reverse(logmsg::debug_info)] = prefixes_[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(logmsg::debug_verbose)] = prefixes_[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(logmsg::debug_debug)] = prefixes_[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes_[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(_("Listing:"));
 
 #if FZ_WINDOWS
-	m_pid = static_cast<unsigned int>(GetCurrentProcessId());
+	pid_ = fz::to_string(static_cast<unsigned int>(GetCurrentProcessId()));
 #else
-	m_pid = static_cast<unsigned int>(getpid());
+	pid_ = fz::to_string(static_cast<unsigned int>(getpid()));
 #endif
 
-	m_max_size = engine_.GetOptions().get_int(OPTION_LOGGING_FILE_SIZELIMIT);
-	if (m_max_size < 0) {
-		m_max_size = 0;
+	max_size_ = options.get_int(OPTION_LOGGING_FILE_SIZELIMIT);
+	if (max_size_ < 0) {
+		max_size_ = 0;
+	}
+	else if (max_size_ > 2000) {
+		max_size_ = 2000;
 	}
-	else if (m_max_size > 2000) {
-		m_max_size = 2000;
+	max_size_ *= 1024 * 1024;
+
+	if (!thread_) {
+		thread_ = pool_.spawn([this]() { entry(); });
+		if (!thread_) {
+			close();
+			error = _("Could not spawn log file writer thread");
+			return false;
+		}
 	}
-	m_max_size *= 1024 * 1024;
 
+	buffer_.reserve(max_batch_size + 64 * 1024);
+
+	state_.store(1, std::memory_order_release);
+
+	// The thread might be waiting without a timeout
+	wakeup();
 	return true;
 }
 
-void CLogging::LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now)
+void CLogFileWriter::add(log_ring & ring)
 {
 	fz::scoped_lock l(mutex_);
+	rings_.push_back(&ring);
+}
 
-	if (!m_logfile_initialized) {
-		if (!InitLogFile(l)) {
-			return;
+void CLogFileWriter::remove(log_ring & ring)
+{
+	fz::scoped_lock l(mutex_);
+	flush();
+
+	auto it = std::find(rings_.begin(), rings_.end(), &ring);
+	if (it != rings_.end()) {
+		rings_.erase(it);
+	}
+
+	if (rings_.empty()) {
+		// Like the file name, the size limit only gets picked up when reopening the file
+		close();
+		state_ = 0;
+	}
+}
+
+void CLogFileWriter::wakeup()
+{
+	if (wakeup_pending_.exchange(true)) {
+		return;
+	}
+
+	fz::scoped_lock l(wakeup_mutex_);
+	cond_.signal(l);
+}
+
+std::wstring CLogFileWriter::take_error()
+{
+	fz::scoped_lock l(mutex_);
+	error_pending_ = false;
+	return std::move(error_);
+}
+
+void CLogFileWriter::entry()
+{
+	bool quit{};
+	while (!quit) {
+		{
+			fz::scoped_lock l(wakeup_mutex_);
+			if (!quit_) {
+				if (state_.load(std::memory_order_relaxed) == 1) {
+					cond_.wait(l, flush_interval);
+				}
+				else {
+					cond_.wait(l);
+				}
+			}
+			wakeup_pending_ = false;
+			quit = quit_;
 		}
+
+		fz::scoped_lock l(mutex_);
+		flush();
 	}
+}
+
+void CLogFileWriter::flush()
+{
+	bool const open = state_.load(std::memory_order_relaxed) == 1;
+
+	for (auto * ring : rings_) {
+		if (open) {
+			uint64_t const dropped = ring->dropped_.exchange(0);
+			if (dropped) {
+				append_dropped(dropped, ring->engine_id_);
+			}
+		}
+
+		size_t tail = ring->tail_.load(std::memory_order_relaxed);
+		while (true) {
+			auto & s = ring->slots_[tail & ring->mask_];
+			if (s.seq.load(std::memory_order_acquire) != tail + 1) {
+				break;
+			}
+
+			// Without a file, the messages are discarded to keep the ring from filling up
+			if (open) {
+				append(s, ring->engine_id_);
+			}
+			s.seq.store(tail + ring->mask_ + 1, std::memory_order_release);
+			ring->tail_.store(++tail, std::memory_order_release);
+
+			if (buffer_.size() >= max_batch_size) {
+				write();
+			}
+		}
+	}
+
+	if (!buffer_.empty()) {
+		write();
+	}
+}
+
+void CLogFileWriter::append(log_ring::slot const& s, unsigned int engine_id)
+{
+	// Consecutive messages are very likely from within the same second
+	time_t const t = s.time.get_time_t();
+	if (t != last_time_) {
+		last_time_ = t;
+		last_time_formatted_ = s.time.format("%Y-%m-%d %H:%M:%S", fz::datetime::local);
+	}
+
+	buffer_ += last_time_formatted_;
+	buffer_ += ' ';
+	buffer_ += pid_;
+	buffer_ += ' ';
+	buffer_ += fz::to_string(engine_id);
+	buffer_ += ' ';
+	buffer_ += prefixes_[fz::bitscan_reverse(s.type)];
+	buffer_ += ' ';
+	buffer_ += fz::to_utf8(s.msg);
+	buffer_ += eol;
+}
+
+void CLogFileWriter::append_dropped(uint64_t dropped, unsigned int engine_id)
+{
+	buffer_ += fz::datetime::now().format("%Y-%m-%d %H:%M:%S", fz::datetime::local);
+	buffer_ += ' ';
+	buffer_ += pid_;
+	buffer_ += ' ';
+	buffer_ += fz::to_string(engine_id);
+	buffer_ += ' ';
+	buffer_ += prefixes_[fz::bitscan_reverse(logmsg::debug_warning)];
+	buffer_ += fz::sprintf(" %u messages could not be logged in time and got dropped", dropped);
+	buffer_ += eol;
+}
+
+void CLogFileWriter::write()
+{
+	std::string_view data(buffer_);
+
 #ifdef FZ_WINDOWS
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
+	if (fd_ == INVALID_HANDLE_VALUE) {
+		buffer_.clear();
 		return;
 	}
 #else
-	if (m_log_fd == -1) {
+	if (fd_ == -1) {
+		buffer_.clear();
 		return;
 	}
 #endif
 
-	std::string const out = fz::sprintf("%s %u %u %s %s"
+	if (max_size_) {
+		std::wstring error;
+		if (!rotate(error)) {
+			buffer_.clear();
+			close();
+			state_ = 2;
+			set_error(std::move(error));
+			return;
+		}
+	}
+
 #ifdef FZ_WINDOWS
-		"\r\n",
+	while (!data.empty()) {
+		DWORD const len = static_cast<DWORD>(std::min(data.size(), size_t(1024 * 1024 * 1024)));
+		DWORD written{};
+		BOOL res = WriteFile(fd_, data.data(), len, &written, nullptr);
+		if (!res || !written) {
+			DWORD err = GetLastError();
 #else
-		"\n",
+	while (!data.empty()) {
+		ssize_t written = ::write(fd_, data.data(), data.size());
+		if (written == -1 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			int err = errno;
 #endif
-		now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), m_pid, engine_.GetEngineId(), m_prefixes[fz::bitscan_reverse(nMessageType)], fz::to_utf8(msg));
+			buffer_.clear();
+			close();
+			state_ = 2;
+			set_error(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+			return;
+		}
+		data = data.substr(static_cast<size_t>(written));
+	}
+
+	buffer_.clear();
+}
 
+bool CLogFileWriter::rotate(std::wstring & error)
+{
 #ifdef FZ_WINDOWS
-	if (m_max_size) {
-		LARGE_INTEGER size;
-		if (!GetFileSizeEx(m_log_fd, &size) || size.QuadPart > m_max_size) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-
-			// m_log_fd might no longer be the original file.
-			// Recheck on a new handle. Proteced with a mutex against other processes
-			HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
-			if (!hMutex) {
-				DWORD err = GetLastError();
-				l.unlock();
-				log(logmsg::error, _("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
-				return;
-			}
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(fd_, &size) && size.QuadPart <= max_size_) {
+		return true;
+	}
 
-			HANDLE hFile = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-			if (hFile == INVALID_HANDLE_VALUE) {
-				DWORD err = GetLastError();
+	CloseHandle(fd_);
+	fd_ = INVALID_HANDLE_VALUE;
 
-				// Oh dear..
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
+	// fd_ might no longer be the original file.
+	// Recheck on a new handle. Proteced with a mutex against other processes
+	HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
+	if (!hMutex) {
+		DWORD err = GetLastError();
+		error = fz::sprintf(_("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
+		return false;
+	}
 
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
+	HANDLE hFile = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		DWORD err = GetLastError();
 
-			DWORD err{};
-			if (GetFileSizeEx(hFile, &size) && size.QuadPart > m_max_size) {
-				CloseHandle(hFile);
-
-				// MoveFileEx can fail if trying to access a deleted file for which another process still has
-				// a handle. Move it far away first.
-				// Todo: Handle the case in which logdir and tmpdir are on different volumes.
-				// (Why is everthing so needlessly complex on MSW?)
-
-				wchar_t tempDir[MAX_PATH + 1];
-				DWORD res = GetTempPath(MAX_PATH, tempDir);
-				if (res && res <= MAX_PATH) {
-					tempDir[MAX_PATH] = 0;
-
-					wchar_t tempFile[MAX_PATH + 1];
-					res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
-					if (res) {
-						tempFile[MAX_PATH] = 0;
-						MoveFileExW((m_file + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
-						DeleteFileW(tempFile);
-					}
-				}
-				MoveFileExW(m_file.c_str(), (m_file + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
-				m_log_fd = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-				if (m_log_fd == INVALID_HANDLE_VALUE) {
-					// If this function would return bool, I'd return FILE_NOT_FOUND here.
-					err = GetLastError();
-				}
-			}
-			else {
-				m_log_fd = hFile;
-			}
+		// Oh dear..
+		ReleaseMutex(hMutex);
+		CloseHandle(hMutex);
 
-			if (hMutex) {
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
-			}
+		error = fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		return false;
+	}
 
-			if (err) {
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
+	DWORD err{};
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > max_size_) {
+		CloseHandle(hFile);
+
+		// MoveFileEx can fail if trying to access a deleted file for which another process still has
+		// a handle. Move it far away first.
+		// Todo: Handle the case in which logdir and tmpdir are on different volumes.
+		// (Why is everthing so needlessly complex on MSW?)
+
+		wchar_t tempDir[MAX_PATH + 1];
+		DWORD res = GetTempPath(MAX_PATH, tempDir);
+		if (res && res <= MAX_PATH) {
+			tempDir[MAX_PATH] = 0;
+
+			wchar_t tempFile[MAX_PATH + 1];
+			res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
+			if (res) {
+				tempFile[MAX_PATH] = 0;
+				MoveFileExW((file_ + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
+				DeleteFileW(tempFile);
 			}
 		}
+		MoveFileExW(file_.c_str(), (file_ + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
+		fd_ = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fd_ == INVALID_HANDLE_VALUE) {
+			// If this function would return bool, I'd return FILE_NOT_FOUND here.
+			err = GetLastError();
+		}
 	}
-	DWORD len = static_cast<DWORD>(out.size());
-	DWORD written;
-	BOOL res = WriteFile(m_log_fd, out.c_str(), len, &written, nullptr);
-	if (!res || written != len) {
-		DWORD err = GetLastError();
-		CloseHandle(m_log_fd);
-		m_log_fd = INVALID_HANDLE_VALUE;
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
+	else {
+		fd_ = hFile;
+	}
+
+	ReleaseMutex(hMutex);
+	CloseHandle(hMutex);
+
+	if (err) {
+		error = fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		return false;
 	}
 #else
-	if (m_max_size) {
-		struct stat buf;
-		int rc = fstat(m_log_fd, &buf);
-		while (!rc && buf.st_size > m_max_size) {
-			struct flock lock = {};
-			lock.l_type = F_WRLCK;
-			lock.l_whence = SEEK_SET;
-			lock.l_start = 0;
-			lock.l_len = 1;
-
-			// Retry through signals
-			while ((rc = fcntl(m_log_fd, F_SETLKW, &lock)) == -1 && errno == EINTR);
-
-			// Ignore any other failures
-			int fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (fd == -1) {
-				int err = errno;
-
-				close(m_log_fd);
-				m_log_fd = -1;
-
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-			struct stat buf2;
-			rc = fstat(fd, &buf2);
-
-			// Different files
-			if (!rc && buf.st_ino != buf2.st_ino) {
-				close(m_log_fd); // Releases the lock
-				m_log_fd = fd;
-				buf = buf2;
-				continue;
-			}
+	struct stat buf;
+	int rc = fstat(fd_, &buf);
+	while (!rc && buf.st_size > max_size_) {
+		struct flock lock = {};
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 1;
+
+		// Retry through signals
+		while ((rc = fcntl(fd_, F_SETLKW, &lock)) == -1 && errno == EINTR);
+
+		// Ignore any other failures
+		int fd = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1) {
+			int err = errno;
+			error = fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+			return false;
+		}
+		struct stat buf2;
+		rc = fstat(fd, &buf2);
+
+		// Different files
+		if (!rc && buf.st_ino != buf2.st_ino) {
+			::close(fd_); // Releases the lock
+			fd_ = fd;
+			buf = buf2;
+			continue;
+		}
 
-			// The file is indeed the log file and we are holding a lock on it.
+		// The file is indeed the log file and we are holding a lock on it.
 
-			// Rename it
-			rc = rename(m_file.c_str(), (m_file + ".1").c_str());
-			close(m_log_fd);
-			close(fd);
+		// Rename it
+		rc = rename(file_.c_str(), (file_ + ".1").c_str());
+		::close(fd_);
+		::close(fd);
 
-			// Get the new file
-			m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (m_log_fd == -1) {
-				int err = errno;
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
+		// Get the new file
+		fd_ = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd_ == -1) {
+			int err = errno;
+			error = fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+			return false;
+		}
 
-			if (!rc) {
-				// Rename didn't fail
-				rc = fstat(m_log_fd, &buf);
-			}
+		if (!rc) {
+			// Rename didn't fail
+			rc = fstat(fd_, &buf);
 		}
 	}
-	size_t written = write(m_log_fd, out.c_str(), out.size());
-	if (written != out.size()) {
-		int err = errno;
-		close(m_log_fd);
-		m_log_fd = -1;
+#endif
 
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
+	return true;
+}
+
+void CLogFileWriter::close()
+{
+#ifdef FZ_WINDOWS
+	if (fd_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (fd_ != -1) {
+		::close(fd_);
+		fd_ = -1;
 	}
 #endif
 }
 
+void CLogFileWriter::set_error(std::wstring && error)
+{
+	error_ = std::move(error);
+	error_pending_ = true;
+}
+
+
+class CLoggingOptionsChanged final : public fz::event_handler
+{
+public:
+	CLoggingOptionsChanged(CLogging& logger, COptionsBase& options, fz::event_loop& loop)
+		: fz::event_handler(loop)
+		, logger_(logger)
+		, options_(options)
+	{
+		logger_.UpdateLogLevel(options_);
+		options_.watch(OPTION_LOGGING_DEBUGLEVEL, this);
+		options_.watch(OPTION_LOGGING_RAWLISTING, this);
+	}
+
+	virtual ~CLoggingOptionsChanged()
+	{
+		options_.unwatch_all(this);
+		remove_handler();
+	}
+
+	virtual void operator()(const fz::event_base&)
+	{
+		 // In worker thread
+		logger_.UpdateLogLevel(options_);
+	}
+
+	CLogging & logger_;
+	COptionsBase& options_;
+};
+
+CLogging::CLogging(CFileZillaEnginePrivate & engine)
+	: engine_(engine)
+	, writer_(engine.GetContext().GetLogFileWriter())
+	, ring_(engine.GetEngineId(), ring_capacity)
+{
+	writer_.add(ring_);
+	UpdateLogLevel(engine.GetOptions());
+	optionChangeHandler_ = std::make_unique<CLoggingOptionsChanged>(*this, engine_.GetOptions(), engine.event_loop_);
+}
+
+CLogging::~CLogging()
+{
+	writer_.remove(ring_);
+}
+
+void CLogging::LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now)
+{
+	if (writer_.error_pending_) {
+		std::wstring error = writer_.take_error();
+		if (!error.empty()) {
+			log(logmsg::error, error);
+		}
+	}
+
+	std::wstring error;
+	if (!writer_.init(engine_.GetOptions(), error)) {
+		if (!error.empty()) {
+			log(logmsg::error, error);
+		}
+		return;
+	}
+
+	if (ring_.push(nMessageType, msg, now)) {
+		if (ring_.size() >= ring_.capacity() / 2) {
+			writer_.wakeup();
+		}
+		return;
+	}
+
+	// The writer cannot keep up. Debug output is dropped right away, everything
+	// else may wait a little for the writer to catch up before getting dropped.
+	if (!(nMessageType & (logmsg::debug_warning | logmsg::debug_info | logmsg::debug_verbose | logmsg::debug_debug | logmsg::listing))) {
+		for (int i = 0; i < 50; ++i) {
+			writer_.wakeup();
+			fz::sleep(fz::duration::from_milliseconds(2));
+			if (ring_.push(nMessageType, msg, now)) {
+				return;
+			}
+		}
+	}
+	++ring_.dropped_;
+}
+
 void CLogging::UpdateLogLevel(COptionsBase & options)
 {
 	logmsg::type enabled{};
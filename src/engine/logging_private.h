@@ -2,12 +2,134 @@
 #define FILEZILLA_ENGINE_LOGGING_PRIVATE_HEADER
 
 #include "engineprivate.h"
+#include "trace.h"
 #include <libfilezilla/format.hpp>
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
 #include <utility>
+#include <vector>
 
 class CLoggingOptionsChanged;
 
+// Messages of a single engine waiting to be written to the log file.
+//
+// Bounded lock-free queue, any thread of the engine can push, only the
+// log file writer pops. Slots are reused, so after warming up pushing a
+// message usually does not allocate.
+class log_ring final
+{
+public:
+	log_ring(unsigned int engine_id, size_t capacity);
+
+	log_ring(log_ring const&) = delete;
+	log_ring& operator=(log_ring const&) = delete;
+
+	// Returns false if the ring is full
+	bool push(logmsg::type t, std::wstring const& msg, fz::datetime const& time);
+
+	// Approximate number of queued messages
+	size_t size() const;
+	size_t capacity() const { return mask_ + 1; }
+
+	unsigned int const engine_id_;
+
+	// Messages lost because the ring stayed full
+	std::atomic<uint64_t> dropped_{};
+
+private:
+	friend class CLogFileWriter;
+
+	struct slot final
+	{
+		std::atomic<size_t> seq{};
+		logmsg::type type{};
+		fz::datetime time;
+		std::wstring msg;
+	};
+
+	std::unique_ptr<slot[]> slots_;
+	size_t const mask_;
+
+	alignas(64) std::atomic<size_t> head_{};
+	alignas(64) std::atomic<size_t> tail_{};
+};
+
+// Writes the messages of all engines of a context to the log file.
+//
+// A background thread drains the rings of the engines and writes them in
+// large batches. Size-based rotation is also handled by that thread, so
+// logging a message never touches the file.
+class CLogFileWriter final
+{
+public:
+	explicit CLogFileWriter(fz::thread_pool & pool);
+	~CLogFileWriter();
+
+	CLogFileWriter(CLogFileWriter const&) = delete;
+	CLogFileWriter& operator=(CLogFileWriter const&) = delete;
+
+	// Opens the log file on first use. Returns false if there is no log
+	// file, error is set if it could not be opened.
+	bool init(COptionsBase & options, std::wstring & error);
+
+	// Rings get flushed when they are removed. After the last ring is
+	// gone the log file gets closed.
+	void add(log_ring & ring);
+	void remove(log_ring & ring);
+
+	// Tells the background thread to flush early
+	void wakeup();
+
+	// Write errors are reported to the next engine logging something
+	std::atomic<bool> error_pending_{};
+	std::wstring take_error();
+
+private:
+	void entry();
+	void flush();
+	void append(log_ring::slot const& s, unsigned int engine_id);
+	void append_dropped(uint64_t dropped, unsigned int engine_id);
+	void write();
+	bool rotate(std::wstring & error);
+	void close();
+	void set_error(std::wstring && error);
+
+	fz::thread_pool & pool_;
+	fz::async_task thread_;
+
+	// Only held for waking up the background thread, never during I/O
+	fz::mutex wakeup_mutex_{false};
+	fz::condition cond_;
+	bool quit_{};
+	std::atomic<bool> wakeup_pending_{};
+
+	// 0 uninitialized, 1 open, 2 no log file or failed to open
+	std::atomic<int> state_{};
+
+	// Everything below is protected by mutex_
+	fz::mutex mutex_{false};
+
+#ifdef FZ_WINDOWS
+	HANDLE fd_{INVALID_HANDLE_VALUE};
+#else
+	int fd_{-1};
+#endif
+	fz::native_string file_;
+	int64_t max_size_{};
+	std::string pid_;
+	std::string prefixes_[sizeof(logmsg::type) * 8];
+
+	std::vector<log_ring*> rings_;
+
+	std::string buffer_;
+	time_t last_time_{-1};
+	std::string last_time_formatted_;
+
+	std::wstring error_;
+};
+
 class CLogging : public fz::logger_interface
 {
 public:
@@ -18,6 +140,7 @@ public:
 	CLogging& operator=(CLogging const&) = delete;
 
 	virtual void do_log(logmsg::type t, std::wstring&& msg) override final {
+		record_trace(engine_.GetEngineId(), trace_event::log, t, static_cast<int64_t>(msg.size()));
 		auto now = fz::datetime::now();
 		LogToFile(t, msg, now);
 		engine_.AddLogNotification(std::make_unique<CLogmsgNotification>(t, msg, now));
@@ -28,23 +151,10 @@ public:
 private:
 	CFileZillaEnginePrivate & engine_;
 
-	bool InitLogFile(fz::scoped_lock& l);
 	void LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now);
 
-	static bool m_logfile_initialized;
-#ifdef FZ_WINDOWS
-	static HANDLE m_log_fd;
-#else
-	static int m_log_fd;
-#endif
-	static std::string m_prefixes[sizeof(logmsg::type) * 8];
-	static unsigned int m_pid;
-	static int m_max_size;
-	static fz::native_string m_file;
-
-	static int m_refcount;
-
-	static fz::mutex mutex_;
+	CLogFileWriter & writer_;
+	log_ring ring_;
 
 	std::unique_ptr<CLoggingOptionsChanged> optionChangeHandler_;
 };
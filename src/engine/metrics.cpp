@@ -0,0 +1,309 @@
+#include "filezilla.h"
+
+#include "metrics.h"
+
+#include "../include/activity_logger.h"
+#include "../include/engine_options.h"
+
+#include "directorycache.h"
+#include "pathcache.h"
+
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+#include <string.h>
+
+namespace {
+// How long to wait for a client to send its request
+int const request_timeout = 500;
+
+void append_metric(std::string & out, char const* name, char const* type, char const* help, uint64_t value)
+{
+	out += fz::sprintf("# HELP %s %s\n# TYPE %s %s\n%s %d\n", name, help, name, type, name, value);
+}
+
+uint64_t load_gauge(std::atomic<int64_t> const& v)
+{
+	auto const value = v.load(std::memory_order_relaxed);
+	return value > 0 ? static_cast<uint64_t>(value) : 0;
+}
+}
+
+engine_metrics::engine_metrics(COptionsBase & options, fz::thread_pool & pool, CDirectoryCache & directory_cache, CPathCache & path_cache, activity_logger & activity)
+	: directory_cache_(directory_cache)
+	, path_cache_(path_cache)
+	, activity_(activity)
+	, pool_(pool)
+{
+#ifndef FZ_WINDOWS
+	path_ = fz::to_utf8(options.get_string(OPTION_METRICS_SOCKET));
+	if (path_.empty()) {
+		return;
+	}
+
+	// Only the owner may connect. The socket is bound inside a private
+	// directory, restricted and then moved into place, so that there is no
+	// window in which others could connect.
+	std::string dir = path_ + ".XXXXXX";
+
+	sockaddr_un addr{};
+	if (dir.size() + 2 >= sizeof(addr.sun_path)) {
+		path_.clear();
+		return;
+	}
+
+	listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd_ == -1) {
+		path_.clear();
+		return;
+	}
+	fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+	if (!mkdtemp(dir.data())) {
+		close(listen_fd_);
+		listen_fd_ = -1;
+		path_.clear();
+		return;
+	}
+
+	addr.sun_family = AF_UNIX;
+	std::string const bound = dir + "/s";
+	memcpy(addr.sun_path, bound.c_str(), bound.size() + 1);
+
+	// Remove a stale socket of a previous instance
+	struct stat buf;
+	if (!lstat(path_.c_str(), &buf) && S_ISSOCK(buf.st_mode)) {
+		unlink(path_.c_str());
+	}
+
+	// Unlike rename, link does not replace an existing file
+	bool ok = !bind(listen_fd_, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+	ok = ok && !chmod(bound.c_str(), S_IRUSR | S_IWUSR);
+	ok = ok && !link(bound.c_str(), path_.c_str());
+	unlink(bound.c_str());
+	rmdir(dir.c_str());
+
+	if (!ok || listen(listen_fd_, 8)) {
+		if (ok) {
+			unlink(path_.c_str());
+		}
+		close(listen_fd_);
+		listen_fd_ = -1;
+		path_.clear();
+		return;
+	}
+
+	if (pipe(quit_pipe_) == -1) {
+		quit_pipe_[0] = -1;
+		quit_pipe_[1] = -1;
+	}
+	else {
+		fcntl(quit_pipe_[0], F_SETFD, FD_CLOEXEC);
+		fcntl(quit_pipe_[1], F_SETFD, FD_CLOEXEC);
+		thread_ = pool_.spawn([this]() { entry(); });
+	}
+	if (!thread_) {
+		close(listen_fd_);
+		listen_fd_ = -1;
+		unlink(path_.c_str());
+		path_.clear();
+	}
+#else
+	(void)options;
+#endif
+}
+
+engine_metrics::~engine_metrics()
+{
+#ifndef FZ_WINDOWS
+	if (thread_) {
+		char const c{};
+		while (write(quit_pipe_[1], &c, 1) == -1 && errno == EINTR) {
+		}
+		thread_.join();
+	}
+	for (int fd : quit_pipe_) {
+		if (fd != -1) {
+			close(fd);
+		}
+	}
+	if (listen_fd_ != -1) {
+		close(listen_fd_);
+		unlink(path_.c_str());
+	}
+#endif
+}
+
+void engine_metrics::command_started(Command id)
+{
+	commands_.fetch_add(1, std::memory_order_relaxed);
+	if (id == Command::transfer) {
+		transfers_.fetch_add(1, std::memory_order_relaxed);
+		transfers_total_.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void engine_metrics::command_finished(Command id)
+{
+	commands_.fetch_sub(1, std::memory_order_relaxed);
+	if (id == Command::transfer) {
+		transfers_.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void engine_metrics::error(ServerProtocol protocol)
+{
+	if (protocol >= UNKNOWN && protocol <= MAX_VALUE) {
+		errors_[protocol + 1].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+std::string engine_metrics::format() const
+{
+	std::string out;
+
+	append_metric(out, "filezilla_received_bytes_total", "counter", "Bytes received on all connections.", activity_.total(activity_logger::recv));
+	append_metric(out, "filezilla_sent_bytes_total", "counter", "Bytes sent on all connections.", activity_.total(activity_logger::send));
+
+	append_metric(out, "filezilla_engines", "gauge", "Number of engines.", load_gauge(engines_));
+	append_metric(out, "filezilla_commands_active", "gauge", "Engines busy with a command, i.e. the depth of the queue being processed.", load_gauge(commands_));
+	append_metric(out, "filezilla_transfers_active", "gauge", "Transfers in progress.", load_gauge(transfers_));
+	append_metric(out, "filezilla_transfers_total", "counter", "Transfers started.", transfers_total_.load(std::memory_order_relaxed));
+
+	uint64_t hits{};
+	uint64_t misses{};
+	directory_cache_.GetStatistics(hits, misses);
+	append_metric(out, "filezilla_directory_cache_hits_total", "counter", "Directory listings found in the cache.", hits);
+	append_metric(out, "filezilla_directory_cache_misses_total", "counter", "Directory listings not found in the cache.", misses);
+
+	path_cache_.GetStatistics(hits, misses);
+	append_metric(out, "filezilla_path_cache_hits_total", "counter", "Resolved directory changes found in the path cache.", hits);
+	append_metric(out, "filezilla_path_cache_misses_total", "counter", "Directory changes not found in the path cache.", misses);
+
+	append_metric(out, "filezilla_reconnects_total", "counter", "Connection attempts retried after a failure.", reconnects_.load(std::memory_order_relaxed));
+	append_metric(out, "filezilla_tls_handshakes_total", "counter", "TLS handshakes started on control and data connections.", tls_handshakes_.load(std::memory_order_relaxed));
+
+	out += "# HELP filezilla_errors_total Failed commands by protocol.\n# TYPE filezilla_errors_total counter\n";
+	for (int i = UNKNOWN; i <= MAX_VALUE; ++i) {
+		auto const protocol = static_cast<ServerProtocol>(i);
+		std::string name = (protocol == UNKNOWN) ? std::string("unknown") : fz::to_utf8(CServer::GetPrefixFromProtocol(protocol));
+		if (name.empty()) {
+			name = fz::to_string(i);
+		}
+		out += fz::sprintf("filezilla_errors_total{protocol=\"%s\"} %d\n", name, errors_[i + 1].load(std::memory_order_relaxed));
+	}
+
+	return out;
+}
+
+#ifndef FZ_WINDOWS
+void engine_metrics::entry()
+{
+	while (true) {
+		pollfd fds[2]{};
+		fds[0].fd = quit_pipe_[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = listen_fd_;
+		fds[1].events = POLLIN;
+
+		int res = poll(fds, 2, -1);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if (fds[0].revents) {
+			return;
+		}
+		if (fds[1].revents & POLLIN) {
+			int fd = accept(listen_fd_, nullptr, nullptr);
+			if (fd != -1) {
+				fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+				int const one = 1;
+				setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+				serve(fd);
+				close(fd);
+			}
+		}
+	}
+}
+
+void engine_metrics::serve(int fd)
+{
+	// Read what the client sends until the end of the request headers, or
+	// until it closes its side or sends nothing for a while.
+	std::string request;
+	while (request.size() < 8192 && request.find("\r\n\r\n") == std::string::npos) {
+		pollfd pfd{};
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		int res = poll(&pfd, 1, request_timeout);
+		if (res == -1 && errno == EINTR) {
+			continue;
+		}
+		if (res <= 0) {
+			break;
+		}
+
+		char buf[1024];
+		ssize_t r = read(fd, buf, sizeof(buf));
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			break;
+		}
+		request.append(buf, static_cast<size_t>(r));
+	}
+
+	std::string out;
+	if (request.empty()) {
+		out = format();
+	}
+	else if (!request.compare(0, 4, "GET ")) {
+		std::string const body = format();
+		out = fz::sprintf("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", body.size());
+		out += body;
+	}
+	else {
+		out = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	}
+
+	char const* p = out.c_str();
+	size_t left = out.size();
+	while (left) {
+		ssize_t w = send(fd, p, left, MSG_NOSIGNAL);
+		if (w == -1 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			break;
+		}
+		p += w;
+		left -= static_cast<size_t>(w);
+	}
+}
+#else
+void engine_metrics::entry()
+{
+}
+
+void engine_metrics::serve(int)
+{
+}
+#endif
@@ -0,0 +1,70 @@
+#ifndef FILEZILLA_ENGINE_METRICS_HEADER
+#define FILEZILLA_ENGINE_METRICS_HEADER
+
+#include "../include/commands.h"
+#include "../include/server.h"
+
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <string>
+
+class activity_logger;
+class CDirectoryCache;
+class COptionsBase;
+class CPathCache;
+
+// Counters for all engines of a context.
+//
+// Updating a counter is a single relaxed atomic operation. If OPTION_METRICS_SOCKET
+// is set, a background thread serves a snapshot in the Prometheus text
+// format to every client connecting to that local socket. Clients may
+// send a HTTP request, e.g. curl --unix-socket, or nothing at all.
+class engine_metrics final
+{
+public:
+	engine_metrics(COptionsBase & options, fz::thread_pool & pool, CDirectoryCache & directory_cache, CPathCache & path_cache, activity_logger & activity);
+	~engine_metrics();
+
+	engine_metrics(engine_metrics const&) = delete;
+	engine_metrics& operator=(engine_metrics const&) = delete;
+
+	void engine_added() { engines_.fetch_add(1, std::memory_order_relaxed); }
+	void engine_removed() { engines_.fetch_sub(1, std::memory_order_relaxed); }
+
+	void command_started(Command id);
+	void command_finished(Command id);
+
+	void reconnect() { reconnects_.fetch_add(1, std::memory_order_relaxed); }
+	void tls_handshake() { tls_handshakes_.fetch_add(1, std::memory_order_relaxed); }
+	void error(ServerProtocol protocol);
+
+	std::string format() const;
+
+private:
+	void entry();
+	void serve(int fd);
+
+	CDirectoryCache & directory_cache_;
+	CPathCache & path_cache_;
+	activity_logger & activity_;
+
+	std::atomic<int64_t> engines_{};
+	std::atomic<int64_t> commands_{};
+	std::atomic<int64_t> transfers_{};
+	std::atomic<uint64_t> transfers_total_{};
+	std::atomic<uint64_t> reconnects_{};
+	std::atomic<uint64_t> tls_handshakes_{};
+	std::atomic<uint64_t> errors_[MAX_VALUE + 2]{};
+
+	fz::thread_pool & pool_;
+	fz::async_task thread_;
+
+	std::string path_;
+	int listen_fd_{-1};
+
+	// Written to by the destructor to stop the background thread
+	int quit_pipe_[2]{-1, -1};
+};
+
+#endif
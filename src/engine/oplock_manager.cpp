@@ -2,6 +2,7 @@
 
 #include "controlsocket.h"
 #include "oplock_manager.h"
+#include "trace.h"
 
 #include <assert.h>
 
@@ -93,6 +94,7 @@ OpLock OpLockManager::Lock(CControlSocket * socket, locking_reason reason, CServ
 	}
 
 	sli.locks_.push_back(info);
+	record_trace(socket->GetEngine().GetEngineId(), trace_event::oplock_lock, static_cast<int64_t>(reason), info.waiting ? 1 : 0);
 
 	return OpLock(this, socket_index, sli.locks_.size() - 1);
 }
@@ -108,6 +110,9 @@ void OpLockManager::Unlock(OpLock & lock)
 	auto & sli = socket_locks_[lock.socket_];
 
 	was_waiting = sli.locks_[lock.lock_].waiting;
+	if (sli.control_socket_) {
+		record_trace(sli.control_socket_->GetEngine().GetEngineId(), trace_event::oplock_unlock, static_cast<int64_t>(sli.locks_[lock.lock_].reason));
+	}
 
 	if (lock.lock_ + 1 == sli.locks_.size()) {
 		sli.locks_.pop_back();
@@ -158,8 +163,9 @@ bool OpLockManager::ObtainWaiting(CControlSocket * socket)
 	for (auto & sli : socket_locks_) {
 		if (sli.control_socket_ == socket) {
 			for (auto & lock : sli.locks_) {
-				if (lock.waiting) {
-					obtained |= ObtainWaiting(sli, lock);
+				if (lock.waiting && ObtainWaiting(sli, lock)) {
+					record_trace(socket->GetEngine().GetEngineId(), trace_event::oplock_obtained, static_cast<int64_t>(lock.reason));
+					obtained = true;
 				}
 			}
 		}
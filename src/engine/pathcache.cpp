@@ -1,6 +1,7 @@
 #include "filezilla.h"
 #include "pathcache.h"
 
+#include <algorithm>
 #include <assert.h>
 
 CPathCache::CPathCache()
@@ -17,62 +18,68 @@ void CPathCache::Store(CServer const& server, CServerPath const& target, CServer
 
 	assert(!target.empty() && !source.empty());
 
-	tCacheIterator iter = m_cache.find(server);
-	if (iter == m_cache.cend()) {
-		iter = m_cache.emplace(std::make_pair(server, tServerCache())).first;
-	}
-	tServerCache &serverCache = iter->second;
+	CServerCache &serverCache = m_cache[server];
 
 	CSourcePath sourcePath;
 
 	sourcePath.source = source;
 	sourcePath.subdir = subdir;
 
-	serverCache[sourcePath] = target;
+	auto res = serverCache.entries.emplace(std::move(sourcePath), target);
+	tEntryRef entry = &*res.first;
+	if (res.second) {
+		Index(serverCache, source, entry);
+	}
+	else if (res.first->second != target) {
+		Unindex(serverCache, res.first->second, entry);
+		res.first->second = target;
+	}
+	else {
+		return;
+	}
+	Index(serverCache, target, entry);
 }
 
 CServerPath CPathCache::Lookup(CServer const& server, CServerPath const& source, std::wstring const& subdir)
 {
 	fz::scoped_lock lock(mutex_);
 
-	const tCacheConstIterator iter = m_cache.find(server);
-	if (iter == m_cache.end()) {
-		return CServerPath();
-	}
+	CServerPath result;
 
-	CServerPath result = Lookup(iter->second, source, subdir);
+	const auto iter = m_cache.find(server);
+	if (iter != m_cache.end()) {
+		result = Lookup(iter->second, source, subdir);
+	}
 
-#ifndef NDEBUG
 	if (result.empty()) {
-		m_misses++;
+		++misses_;
 	}
 	else {
-		m_hits++;
+		++hits_;
 	}
-#endif
 
 	return result;
 }
 
-CServerPath CPathCache::Lookup(tServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir)
+CServerPath CPathCache::Lookup(CServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir)
 {
 	CSourcePath sourcePath;
 	sourcePath.source = source;
 	sourcePath.subdir = subdir;
 
-	tServerCacheConstIterator serverIter = serverCache.find(sourcePath);
-	if (serverIter == serverCache.end()) {
+	auto const iter = serverCache.entries.find(sourcePath);
+	if (iter == serverCache.entries.end()) {
 		return CServerPath();
 	}
 
-	return serverIter->second;
+	return iter->second;
 }
 
 void CPathCache::InvalidateServer(CServer const& server)
 {
 	fz::scoped_lock lock(mutex_);
 
-	tCacheIterator iter = m_cache.find(server);
+	auto iter = m_cache.find(server);
 	if (iter == m_cache.end()) {
 		return;
 	}
@@ -84,13 +91,13 @@ void CPathCache::InvalidatePath(CServer const& server, CServerPath const& path,
 {
 	fz::scoped_lock lock(mutex_);
 
-	tCacheIterator iter = m_cache.find(server);
+	auto iter = m_cache.find(server);
 	if (iter != m_cache.end()) {
 		InvalidatePath(iter->second, path, subdir);
 	}
 }
 
-void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir)
+void CPathCache::InvalidatePath(CServerCache & serverCache, CServerPath const& path, std::wstring const& subdir)
 {
 	CSourcePath sourcePath;
 
@@ -98,10 +105,10 @@ void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& p
 	sourcePath.subdir = subdir;
 
 	CServerPath target;
-	tServerCacheIterator serverIter = serverCache.find(sourcePath);
-	if (serverIter != serverCache.end()) {
-		target = serverIter->second;
-		serverCache.erase(serverIter);
+	auto iter = serverCache.entries.find(sourcePath);
+	if (iter != serverCache.entries.end()) {
+		target = iter->second;
+		Remove(serverCache, iter);
 	}
 
 	if (target.empty() && !subdir.empty()) {
@@ -111,20 +118,104 @@ void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& p
 		}
 	}
 
-	if (!target.empty()) {
-		// Unfortunately O(n), don't know of a faster way.
-		for (serverIter = serverCache.begin(); serverIter != serverCache.end(); ) {
-			if (serverIter->second == target || target.IsParentOf(serverIter->second, false)) {
-				serverCache.erase(serverIter++);
-			}
-			else if (serverIter->first.source == target || target.IsParentOf(serverIter->first.source, false)) {
-				serverCache.erase(serverIter++);
-			}
-			else {
-				++serverIter;
+	if (target.empty()) {
+		return;
+	}
+
+	// Collect all entries with source or target at or below the target
+	std::vector<tEntryRef> entries;
+	std::vector<CIndexNode const*> nodes;
+
+	auto const node = serverCache.index.find(target);
+	if (node != serverCache.index.end()) {
+		nodes.push_back(&node->second);
+	}
+	while (!nodes.empty()) {
+		CIndexNode const* n = nodes.back();
+		nodes.pop_back();
+
+		entries.insert(entries.end(), n->entries.cbegin(), n->entries.cend());
+		for (auto const& child : n->children) {
+			auto const it = serverCache.index.find(child);
+			if (it != serverCache.index.end()) {
+				nodes.push_back(&it->second);
 			}
 		}
 	}
+
+	// Entries with both source and target below the path are listed twice
+	std::sort(entries.begin(), entries.end());
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+	std::vector<CSourcePath> keys;
+	keys.reserve(entries.size());
+	for (auto const& entry : entries) {
+		keys.push_back(entry->first);
+	}
+	for (auto const& key : keys) {
+		iter = serverCache.entries.find(key);
+		if (iter != serverCache.entries.end()) {
+			Remove(serverCache, iter);
+		}
+	}
+}
+
+void CPathCache::Index(CServerCache & serverCache, CServerPath const& path, tEntryRef entry)
+{
+	auto res = serverCache.index.try_emplace(path);
+	res.first->second.entries.push_back(entry);
+
+	// Link new nodes to their parents, up to the first ancestor already in
+	// the index.
+	CServerPath child = path;
+	while (res.second) {
+		CServerPath parent = child.GetParent();
+		if (parent.empty()) {
+			break;
+		}
+		res = serverCache.index.try_emplace(parent);
+		res.first->second.children.insert(std::move(child));
+		child = std::move(parent);
+	}
+}
+
+void CPathCache::Unindex(CServerCache & serverCache, CServerPath const& path, tEntryRef entry)
+{
+	auto iter = serverCache.index.find(path);
+	if (iter == serverCache.index.end()) {
+		return;
+	}
+
+	auto & entries = iter->second.entries;
+	auto it = std::find(entries.begin(), entries.end(), entry);
+	if (it != entries.end()) {
+		entries.erase(it);
+	}
+
+	// Remove nodes no longer leading to any entry
+	CServerPath current = path;
+	while (iter->second.entries.empty() && iter->second.children.empty()) {
+		serverCache.index.erase(iter);
+
+		CServerPath parent = current.GetParent();
+		if (parent.empty()) {
+			break;
+		}
+		iter = serverCache.index.find(parent);
+		if (iter == serverCache.index.end()) {
+			break;
+		}
+		iter->second.children.erase(current);
+		current = std::move(parent);
+	}
+}
+
+void CPathCache::Remove(CServerCache & serverCache, tEntries::iterator it)
+{
+	tEntryRef entry = &*it;
+	Unindex(serverCache, it->first.source, entry);
+	Unindex(serverCache, it->second, entry);
+	serverCache.entries.erase(it);
 }
 
 void CPathCache::Clear()
@@ -132,3 +223,21 @@ void CPathCache::Clear()
 	fz::scoped_lock lock(mutex_);
 	m_cache.clear();
 }
+
+void CPathCache::GetStatistics(uint64_t & hits, uint64_t & misses) const
+{
+	hits = hits_.load(std::memory_order_relaxed);
+	misses = misses_.load(std::memory_order_relaxed);
+}
+
+size_t CPathCache::GetIndexSize(CServer const& server)
+{
+	fz::scoped_lock lock(mutex_);
+
+	auto const iter = m_cache.find(server);
+	if (iter == m_cache.end()) {
+		return 0;
+	}
+
+	return iter->second.index.size();
+}
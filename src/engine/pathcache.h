@@ -6,7 +6,13 @@
 
 #include <libfilezilla/mutex.hpp>
 
-class CPathCache final
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class FZC_PUBLIC_SYMBOL CPathCache final
 {
 public:
 	CPathCache();
@@ -28,6 +34,11 @@ public:
 
 	void Clear();
 
+	void GetStatistics(uint64_t & hits, uint64_t & misses) const;
+
+	// Number of nodes in the reverse index of the server, for testing
+	size_t GetIndexSize(CServer const& server);
+
 protected:
 	class CSourcePath
 	{
@@ -35,29 +46,55 @@ protected:
 		CServerPath source;
 		std::wstring subdir;
 
-		bool operator<(CSourcePath const& op) const
+		bool operator==(CSourcePath const& op) const
+		{
+			return source == op.source && subdir == op.subdir;
+		}
+	};
+
+	struct source_path_hash final
+	{
+		size_t operator()(CSourcePath const& path) const
 		{
-			return std::tie(subdir, source) < std::tie(op.subdir, op.source);
+			return std::hash<CServerPath>()(path.source) ^ (std::hash<std::wstring>()(path.subdir) << 1);
 		}
 	};
 
+	typedef std::unordered_map<CSourcePath, CServerPath, source_path_hash> tEntries;
+	typedef tEntries::value_type const* tEntryRef;
+
+	// Reverse index from paths to the entries using them as source or
+	// target. It also contains the ancestors of these paths, so that the
+	// entries below a path can be found without looking at all entries.
+	class CIndexNode final
+	{
+	public:
+		std::vector<tEntryRef> entries;
+		std::unordered_set<CServerPath> children;
+	};
+
+	class CServerCache final
+	{
+	public:
+		tEntries entries;
+		std::unordered_map<CServerPath, CIndexNode> index;
+	};
+
 	fz::mutex mutex_;
 
-	typedef std::map<CSourcePath, CServerPath> tServerCache;
-	typedef tServerCache::iterator tServerCacheIterator;
-	typedef tServerCache::const_iterator tServerCacheConstIterator;
-	typedef std::map<CServer, tServerCache> tCache;
+	// Few servers per context, they only need to be ordered
+	typedef std::map<CServer, CServerCache> tCache;
 	tCache m_cache;
-	typedef tCache::iterator tCacheIterator;
-	typedef tCache::const_iterator tCacheConstIterator;
 
-	CServerPath Lookup(tServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir);
-	void InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir = std::wstring());
+	CServerPath Lookup(CServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir);
+	void InvalidatePath(CServerCache & serverCache, CServerPath const& path, std::wstring const& subdir = std::wstring());
 
-#ifndef NDEBUG
-	int m_hits{};
-	int m_misses{};
-#endif
+	void Index(CServerCache & serverCache, CServerPath const& path, tEntryRef entry);
+	void Unindex(CServerCache & serverCache, CServerPath const& path, tEntryRef entry);
+	void Remove(CServerCache & serverCache, tEntries::iterator it);
+
+	std::atomic<uint64_t> hits_{};
+	std::atomic<uint64_t> misses_{};
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "../include/reader.h"
 
 #include "engineprivate.h"
+#include "trace.h"
 
 #include <libfilezilla/buffer.hpp>
 #include <libfilezilla/local_filesys.hpp>
@@ -166,11 +167,15 @@ read_result reader_base::read()
 		--ready_count_;
 	}
 	if (ready_count_) {
+		engine_.transfer_telemetry_.SampleOccupancy(ready_count_);
 		called_read_ = true;
 		processing_ = true;
 		return {aio_result::ok, buffers_[ready_pos_]};
 	}
 	else {
+		record_trace(engine_.GetEngineId(), trace_event::reader_wait);
+		engine_.transfer_telemetry_.SampleOccupancy(0);
+		wait_start_ = fz::monotonic_clock::now();
 		handler_waiting_ = true;
 		processing_ = false;
 		return {aio_result::wait, fz::nonowning_buffer()};
@@ -329,7 +334,9 @@ void file_reader::entry()
 	fz::scoped_lock l(mtx_);
 	while (!quit_ && !error_) {
 		if (ready_count_ >= buffers_.size()) {
+			fz::monotonic_clock const start = fz::monotonic_clock::now();
 			cond_.wait(l);
+			engine_.transfer_telemetry_.AddWait(CTransferTelemetry::peer, fz::monotonic_clock::now() - start);
 			continue;
 		}
 
@@ -343,7 +350,11 @@ void file_reader::entry()
 		int64_t read{};
 		if (to_read) {
 			l.unlock();
+			fz::monotonic_clock const start = fz::monotonic_clock::now();
 			read = file_.read(b.get(to_read), to_read);
+			fz::duration const d = fz::monotonic_clock::now() - start;
+			engine_.transfer_telemetry_.AddDiskIO(d, read);
+			record_trace(engine_.GetEngineId(), trace_event::reader_read, read, trace_duration(d));
 			l.lock();
 
 			if (quit_) {
@@ -364,6 +375,8 @@ void file_reader::entry()
 
 		if (handler_waiting_) {
 			handler_waiting_ = false;
+			record_trace(engine_.GetEngineId(), trace_event::reader_ready);
+			engine_.transfer_telemetry_.AddWait(CTransferTelemetry::disk, fz::monotonic_clock::now() - wait_start_);
 			if (handler_) {
 				handler_->send_event<read_ready_event>(this);
 			}
@@ -611,6 +611,13 @@ bool CServer::ProtocolHasFeature(ServerProtocol const protocol, ProtocolFeature
 		break;
 	case ProtocolFeature::Security:
 		return protocol != HTTP && protocol != INSECURE_FTP && protocol != INSECURE_WEBDAV;
+	case ProtocolFeature::SegmentedDownload:
+		if (protocol == SFTP || protocol == FTP || protocol == FTPS || protocol == FTPES || protocol == INSECURE_FTP ||
+			protocol == HTTP || protocol == HTTPS)
+		{
+			return true;
+		}
+		break;
 	}
 	return false;
 }
@@ -35,6 +35,16 @@ enum capabilityNames
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
 
+	// Checksum commands. The option of hash_command holds the algorithms
+	// listed in FEAT, the one currently selected is marked with an asterisk.
+	hash_command,
+	xcrc_command,
+	xmd5_command,
+	xsha1_command,
+	xsha256_command,
+	xsha512_command,
+	rang_command, // RANG STREAM, restricts HASH to a byte range
+
 	// Server timezone offset. If using FTP, LIST details are unspecified and
 	// can return different times than the UTC based times using the MLST or
 	// MDTM commands.
@@ -46,7 +56,10 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// HTTP-protocol specific
+	range_requests // Server honours byte ranges in the Range header
 };
 
 class CCapabilities final
@@ -1,6 +1,10 @@
 #include "filezilla.h"
 #include "../include/serverpath.h"
 
+#include <libfilezilla/mutex.hpp>
+
+#include <unordered_map>
+
 #define FTP_MVS_DOUBLE_QUOTE (wchar_t)0xDC
 
 struct CServerTypeTraits
@@ -30,17 +34,149 @@ static const CServerTypeTraits traits[SERVERTYPE_MAX] = {
 	{ L"/\\", false,    0,    0,    false, 0, 0,   true,  false } // DOS with forwardslashes
 };
 
-bool CServerPathData::operator==(CServerPathData const& cmp) const
+namespace {
+size_t combine_hash(size_t h, size_t v)
 {
-	if (m_prefix != cmp.m_prefix) {
-		return false;
+	return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
+
+struct node_key final
+{
+	size_t hash;
+	CServerPathData const* parent;
+
+	// The segment, or the prefix on roots
+	std::wstring name;
+
+	bool operator==(node_key const& op) const
+	{
+		return parent == op.parent && name == op.name;
 	}
+};
 
-	if (m_segments != cmp.m_segments) {
-		return false;
+struct node_key_hash final
+{
+	size_t operator()(node_key const& key) const
+	{
+		return key.hash;
 	}
+};
 
-	return true;
+struct node_entry final
+{
+	CServerPathData const* node{};
+	std::weak_ptr<CServerPathData const> ref;
+};
+
+// The trie is sharded so that threads building paths at the same time do
+// not all contend on the same mutex.
+size_t const shard_count = 64;
+
+struct shard final
+{
+	fz::mutex mtx_{false};
+	std::unordered_map<node_key, node_entry, node_key_hash> nodes_;
+};
+
+shard* shards()
+{
+	// Intentionally leaked, paths in static storage may outlive it otherwise.
+	static shard* s = new shard[shard_count];
+	return s;
+}
+
+// The nodes of a path in order from the first to the last segment. Refers
+// to the segments in the trie instead of copying them, only unusually deep
+// paths need an allocation.
+class segment_nodes final
+{
+public:
+	explicit segment_nodes(CServerPathData const* data)
+		: size_(data ? data->m_depth : 0)
+	{
+		if (size_ > fixed_size) {
+			heap_ = std::make_unique<CServerPathData const*[]>(size_);
+			nodes_ = heap_.get();
+		}
+		for (size_t i = size_; i; data = data->m_parent.get()) {
+			nodes_[--i] = data;
+		}
+	}
+
+	segment_nodes(segment_nodes const&) = delete;
+	segment_nodes& operator=(segment_nodes const&) = delete;
+
+	bool empty() const { return !size_; }
+	size_t size() const { return size_; }
+
+	std::wstring const& operator[](size_t i) const { return nodes_[i]->m_segment; }
+
+private:
+	static size_t const fixed_size = 32;
+
+	size_t const size_;
+	CServerPathData const* fixed_[fixed_size];
+	std::unique_ptr<CServerPathData const*[]> heap_;
+	CServerPathData const** nodes_{fixed_};
+};
+
+node_key make_key(CServerPathData const* parent, std::wstring const& name)
+{
+	size_t const h = combine_hash(parent ? parent->m_hash : 0, std::hash<std::wstring>()(name));
+	return node_key{h, parent, name};
+}
+
+void release(CServerPathData const* data)
+{
+	{
+		auto const key = make_key(data->m_parent.get(), data->m_parent ? data->m_segment : (data->m_prefix ? *data->m_prefix : std::wstring()));
+		auto & s = shards()[key.hash % shard_count];
+
+		fz::scoped_lock l(s.mtx_);
+		auto it = s.nodes_.find(key);
+
+		// A new node might already have taken the place of this one.
+		if (it != s.nodes_.end() && it->second.node == data) {
+			s.nodes_.erase(it);
+		}
+	}
+
+	delete data;
+}
+
+// Returns the child of the parent with the given segment, or, without
+// parent, the root for the given prefix.
+std::shared_ptr<CServerPathData const> intern(std::shared_ptr<CServerPathData const> const& parent, std::wstring const& name)
+{
+	auto key = make_key(parent.get(), name);
+	auto & s = shards()[key.hash % shard_count];
+
+	fz::scoped_lock l(s.mtx_);
+	auto & entry = s.nodes_[key];
+	auto node = entry.ref.lock();
+	if (!node) {
+		auto data = new CServerPathData;
+		data->m_hash = key.hash;
+		if (parent) {
+			data->m_parent = parent;
+			data->m_root = parent->m_root;
+			data->m_segment = name;
+			data->m_depth = parent->m_depth + 1;
+		}
+		else {
+			data->m_root = data;
+			if (!name.empty()) {
+				data->m_prefix = fz::sparse_optional<std::wstring>(name);
+			}
+		}
+
+		node = std::shared_ptr<CServerPathData const>(data, &release);
+		entry.node = data;
+		entry.ref = node;
+	}
+
+	return node;
+}
 }
 
 CServerPath::CServerPath()
@@ -69,7 +205,7 @@ CServerPath::CServerPath(std::wstring const& path, ServerType type)
 
 void CServerPath::clear()
 {
-	m_data.clear();
+	m_data.reset();
 }
 
 bool CServerPath::SetPath(std::wstring newPath)
@@ -120,7 +256,7 @@ bool CServerPath::SetPath(std::wstring &newPath, bool isFile)
 		}
 	}
 
-	m_data.clear();
+	m_data.reset();
 
 	if (!ChangePath(path, isFile)) {
 		return false;
@@ -151,26 +287,27 @@ std::wstring CServerPath::GetPath() const
 
 	std::wstring path;
 
-	auto const& data = *m_data;
+	auto const& prefix = GetPrefix();
+	segment_nodes const segments(m_data.get());
 
-	if (!traits[m_type].prefixmode && data.m_prefix) {
-		path = *data.m_prefix;
+	if (!traits[m_type].prefixmode && prefix) {
+		path = *prefix;
 	}
 
 	if (traits[m_type].left_enclosure != 0) {
 		path += traits[m_type].left_enclosure;
 	}
-	if (data.m_segments.empty() && (!traits[m_type].has_root || !data.m_prefix || traits[m_type].separator_after_prefix)) {
+	if (segments.empty() && (!traits[m_type].has_root || !prefix || traits[m_type].separator_after_prefix)) {
 		path += traits[m_type].separators[0];
 	}
 
-	for (auto iter = data.m_segments.cbegin(); iter != data.m_segments.cend(); ++iter) {
-		std::wstring const& segment = *iter;
-		if (iter != data.m_segments.cbegin()) {
+	for (size_t i = 0; i < segments.size(); ++i) {
+		std::wstring const& segment = segments[i];
+		if (i) {
 			path += traits[m_type].separators[0];
 		}
 		else if (traits[m_type].has_root) {
-			if (!data.m_prefix || traits[m_type].separator_after_prefix) {
+			if (!prefix || traits[m_type].separator_after_prefix) {
 				path += traits[m_type].separators[0];
 			}
 		}
@@ -185,8 +322,8 @@ std::wstring CServerPath::GetPath() const
 		}
 	}
 
-	if (traits[m_type].prefixmode && data.m_prefix) {
-		path += *data.m_prefix;
+	if (traits[m_type].prefixmode && prefix) {
+		path += *prefix;
 	}
 
 	if (traits[m_type].right_enclosure != 0) {
@@ -195,7 +332,7 @@ std::wstring CServerPath::GetPath() const
 
 	// DOS is strange.
 	// C: is current working dir on drive C, C:\ the drive root.
-	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && data.m_segments.size() == 1) {
+	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && segments.size() == 1) {
 		path += traits[m_type].separators[0];
 	}
 
@@ -209,10 +346,10 @@ bool CServerPath::HasParent() const
 	}
 
 	if (!traits[m_type].has_root) {
-		return m_data->m_segments.size() > 1;
+		return m_data->m_depth > 1;
 	}
 
-	return !m_data->m_segments.empty();
+	return m_data->m_depth != 0;
 }
 
 CServerPath CServerPath::GetParent() const
@@ -227,13 +364,13 @@ CServerPath& CServerPath::MakeParent()
 	if (empty() || !HasParent()) {
 		clear();
 	}
+	else if (m_type == MVS && (!GetPrefix() || *GetPrefix() != L".")) {
+		auto segments = GetSegments();
+		segments.pop_back();
+		Assign(fz::sparse_optional<std::wstring>(L"."), segments);
+	}
 	else {
-		CServerPathData& data = m_data.get();
-		data.m_segments.pop_back();
-
-		if (m_type == MVS) {
-			data.m_prefix = fz::sparse_optional<std::wstring>(L".");
-		}
+		m_data = m_data->m_parent;
 	}
 
 	return *this;
@@ -245,13 +382,14 @@ std::wstring CServerPath::GetFirstSegment() const
 		return std::wstring();
 	}
 
-	CServerPathData const& data = *m_data;
-	if (!data.m_segments.empty()) {
-		return data.m_segments.front();
-	}
-	else {
+	CServerPathData const* data = m_data.get();
+	if (!data->m_depth) {
 		return std::wstring();
 	}
+	while (data->m_depth > 1) {
+		data = data->m_parent.get();
+	}
+	return data->m_segment;
 }
 
 std::wstring CServerPath::GetLastSegment() const
@@ -260,13 +398,7 @@ std::wstring CServerPath::GetLastSegment() const
 		return std::wstring();
 	}
 
-	CServerPathData const& data = *m_data;
-	if (!data.m_segments.empty()) {
-		return data.m_segments.back();
-	}
-	else {
-		return std::wstring();
-	}
+	return m_data->m_segment;
 }
 
 // libc sprintf can be so slow at times...
@@ -300,10 +432,11 @@ std::wstring CServerPath::GetSafePath() const
 	size_t len = 5 // Type and 2x' ' and terminating 0
 		+ INTLENGTH; // Max length of prefix
 
-	auto const& data = *m_data;
-	len += data.m_prefix ? data.m_prefix->size() : 0;
-	for (auto const& segment : data.m_segments) {
-		len += segment.size() + 2 + INTLENGTH;
+	auto const& prefix = GetPrefix();
+	segment_nodes const segments(m_data.get());
+	len += prefix ? prefix->size() : 0;
+	for (size_t i = 0; i < segments.size(); ++i) {
+		len += segments[i].size() + 2 + INTLENGTH;
 	}
 
 	std::wstring safepath;
@@ -313,15 +446,16 @@ std::wstring CServerPath::GetSafePath() const
 
 	t = fast_sprint_number(t, m_type);
 	*(t++) = ' ';
-	t = fast_sprint_number(t, data.m_prefix ? data.m_prefix->size() : 0);
+	t = fast_sprint_number(t, prefix ? prefix->size() : 0);
 
-	if (data.m_prefix) {
+	if (prefix) {
 		*(t++) = ' ';
-		tstrcpy(t, data.m_prefix->c_str());
-		t += data.m_prefix->size();
+		tstrcpy(t, prefix->c_str());
+		t += prefix->size();
 	}
 
-	for (auto const& segment : data.m_segments) {
+	for (size_t i = 0; i < segments.size(); ++i) {
+		std::wstring const& segment = segments[i];
 		*(t++) = ' ';
 		t = fast_sprint_number(t, segment.size());
 		*(t++) = ' ';
@@ -346,9 +480,8 @@ bool CServerPath::SetSafePath(std::wstring const& path)
 
 bool CServerPath::DoSetSafePath(std::wstring const& path)
 {
-	CServerPathData& data = m_data.get();
-	data.m_prefix.clear();
-	data.m_segments.clear();
+	fz::sparse_optional<std::wstring> prefix;
+	tSegmentList segments;
 
 	// Optimized for speed, avoid expensive wxString functions
 	// Before the optimization this function was responsible for
@@ -396,6 +529,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		}
 		else {
 			// Is root directory, like / on unix like systems.
+			Assign(prefix, segments);
 			return true;
 		}
 	}
@@ -406,7 +540,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		return false;
 	}
 	if (prefix_len) {
-		data.m_prefix = fz::sparse_optional<std::wstring>(new std::wstring(p, p + prefix_len));
+		prefix = fz::sparse_optional<std::wstring>(new std::wstring(p, p + prefix_len));
 		p += prefix_len + 1;
 	}
 
@@ -434,11 +568,12 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		if (segment_len > end - p) {
 			return false;
 		}
-		data.m_segments.emplace_back(p, p + segment_len);
+		segments.emplace_back(p, p + segment_len);
 
 		p += segment_len + 1;
 	}
 
+	Assign(prefix, segments);
 	return true;
 }
 
@@ -472,55 +607,62 @@ bool CServerPath::IsSubdirOf(CServerPath const& path, bool cmpNoCase, bool allow
 		return false;
 	}
 	
-	auto const& ld = *m_data;
-	auto const& rd = *path.m_data;
+	auto const& lp = GetPrefix();
+	auto const& rp = path.GetPrefix();
 	if (traits[m_type].prefixmode != 1) {
 		if (cmpNoCase ) {
-			if (ld.m_prefix && !rd.m_prefix) {
+			if (lp && !rp) {
 				return false;
 			}
-			else if (!ld.m_prefix && rd.m_prefix) {
+			else if (!lp && rp) {
 				return false;
 			}
-			else if (ld.m_prefix && rd.m_prefix && fz::stricmp(*ld.m_prefix, *rd.m_prefix)) {
+			else if (lp && rp && fz::stricmp(*lp, *rp)) {
 				return false;
 			}
 		}
-		if (!cmpNoCase && ld.m_prefix != rd.m_prefix) {
+		if (!cmpNoCase && lp != rp) {
 			return false;
 		}
 	}
 
 	// On MVS, dirs like 'FOO.BAR' without trailing dot cannot have
 	// subdirectories
-	if (traits[m_type].prefixmode == 1 && !rd.m_prefix) {
+	if (traits[m_type].prefixmode == 1 && !rp) {
 		return false;
 	}
 
-	auto iter1 = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
-	while (iter1 != ld.m_segments.cend()) {
-		if (iter2 == rd.m_segments.cend()) {
-			return true;
-		}
+	size_t const depth = path.m_data->m_depth;
+	if (m_data->m_depth < depth || (m_data->m_depth == depth && !allowEqual)) {
+		return false;
+	}
+
+	CServerPathData const* l = m_data.get();
+	while (l->m_depth > depth) {
+		l = l->m_parent.get();
+	}
+
+	CServerPathData const* r = path.m_data.get();
+	if (l == r) {
+		return true;
+	}
+	if (!cmpNoCase && l->m_root == r->m_root) {
+		return false;
+	}
+
+	// Differing case or MVS prefixes
+	for (; l->m_depth; l = l->m_parent.get(), r = r->m_parent.get()) {
 		if (cmpNoCase) {
-			if (fz::stricmp(*iter1, *iter2)) {
+			if (fz::stricmp(l->m_segment, r->m_segment)) {
 				return false;
 			}
 		}
-		else if (*iter1 != *iter2) {
+		else if (l->m_segment != r->m_segment) {
 			return false;
 		}
-
-		++iter1;
-		++iter2;
 	}
 
-	if (allowEqual && iter2 == rd.m_segments.cend()) {
-		return true;
-	}
-
-	return false;
+	return true;
 }
 
 bool CServerPath::IsParentOf(CServerPath const& path, bool cmpNoCase, bool allowEqual) const
@@ -559,7 +701,13 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	}
 
 	bool const was_empty = empty();
-	CServerPathData& data = m_data.get();
+
+	fz::sparse_optional<std::wstring> prefix;
+	tSegmentList segments;
+	if (!was_empty) {
+		prefix = GetPrefix();
+		segments = GetSegments();
+	}
 
 	switch (m_type)
 	{
@@ -598,17 +746,17 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				dir = dir.substr(0, pos2);
 
 				if (pos1) {
-					data.m_prefix = fz::sparse_optional<std::wstring>(dir.substr(0, pos1));
+					prefix = fz::sparse_optional<std::wstring>(dir.substr(0, pos1));
 				}
 				dir = dir.substr(pos1 + 1);
 
-				data.m_segments.clear();
+				segments.clear();
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
-			if (data.m_segments.empty() && was_empty) {
+			if (segments.empty() && was_empty) {
 				return false;
 			}
 		}
@@ -627,16 +775,16 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 			}
 
 			if (is_absolute) {
-				data.m_segments.clear();
+				segments.clear();
 			}
 			else if (IsSeparator(dir[0])) {
 				// Drive-relative path
-				if (data.m_segments.empty()) {
+				if (segments.empty()) {
 					return false;
 				}
-				std::wstring first = data.m_segments.front();
-				data.m_segments.clear();
-				data.m_segments.push_back(first);
+				std::wstring first = segments.front();
+				segments.clear();
+				segments.push_back(first);
 				dir = dir.substr(1);
 			}
 			// else: Any other relative path
@@ -645,10 +793,10 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
-			if (data.m_segments.empty() && was_empty) {
+			if (segments.empty() && was_empty) {
 				return false;
 			}
 		}
@@ -684,7 +832,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 
 			dir = dir.substr(1, dir.size() - 2);
 
-			data.m_segments.clear();
+			segments.clear();
 		}
 		else if (dir.back() == traits[m_type].right_enclosure) {
 			return false;
@@ -707,14 +855,14 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 			file = dir.substr(pos + 1);
 			dir = dir.substr(0, pos);
 
-			if (!was_empty && !data.m_prefix && !dir.empty()) {
+			if (!was_empty && !prefix && !dir.empty()) {
 				return false;
 			}
 
-			data.m_prefix.clear();
+			prefix.clear();
 		}
 		else {
-			if (!was_empty && !data.m_prefix) {
+			if (!was_empty && !prefix) {
 				if (dir.find('.') != std::wstring::npos || !isFile) {
 					return false;
 				}
@@ -724,33 +872,33 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				if (!ExtractFile(dir, file)) {
 					return false;
 				}
-				data.m_prefix = fz::sparse_optional<std::wstring>(L".");
+				prefix = fz::sparse_optional<std::wstring>(L".");
 			}
 			else if (!dir.empty() && dir.back() == '.') {
-				data.m_prefix = fz::sparse_optional<std::wstring>(L".");
+				prefix = fz::sparse_optional<std::wstring>(L".");
 			}
 			else {
-				data.m_prefix.clear();
+				prefix.clear();
 			}
 		}
 
-		if (!Segmentize(dir, data.m_segments)) {
+		if (!Segmentize(dir, segments)) {
 			return false;
 		}
 		break;
 	case HPNONSTOP:
 		if (dir[0] == '\\') {
-			data.m_segments.clear();
+			segments.clear();
 		}
 
 		if (isFile && !ExtractFile(dir, file)) {
 			return false;
 		}
 
-		if (!Segmentize(dir, data.m_segments)) {
+		if (!Segmentize(dir, segments)) {
 			return false;
 		}
-		if (data.m_segments.empty() && was_empty) {
+		if (segments.empty() && was_empty) {
 			return false;
 		}
 
@@ -767,17 +915,17 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				if (colon2 == std::wstring::npos || colon2 == 1) {
 					return false;
 				}
-				data.m_prefix = fz::sparse_optional<std::wstring>(dir.substr(0, colon2 + 1));
+				prefix = fz::sparse_optional<std::wstring>(dir.substr(0, colon2 + 1));
 				dir = dir.substr(colon2 + 1);
 
-				data.m_segments.clear();
+				segments.clear();
 			}
 
 			if (isFile && !ExtractFile(dir, file)) {
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
@@ -785,14 +933,14 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	case CYGWIN:
 		{
 			if (IsSeparator(dir[0])) {
-				data.m_segments.clear();
-				data.m_prefix.clear();
+				segments.clear();
+				prefix.clear();
 			}
 			else if (was_empty) {
 				return false;
 			}
 			if (dir[0] == '/' && dir[1] == '/') {
-				data.m_prefix = fz::sparse_optional<std::wstring>(std::wstring(1, traits[m_type].separators[0]));
+				prefix = fz::sparse_optional<std::wstring>(std::wstring(1, traits[m_type].separators[0]));
 				dir = dir.substr(1);
 			}
 
@@ -800,7 +948,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
@@ -808,7 +956,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	default:
 		{
 			if (IsSeparator(dir[0])) {
-				data.m_segments.clear();
+				segments.clear();
 			}
 			else if (was_empty) {
 				return false;
@@ -818,17 +966,19 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
 		break;
 	}
 
-	if (!traits[m_type].has_root && data.m_segments.empty()) {
+	if (!traits[m_type].has_root && segments.empty()) {
 		return false;
 	}
 
+	Assign(prefix, segments);
+
 	if (isFile) {
 		if (traits[m_type].has_dots) {
 			if (file == L".." || file == L".") {
@@ -870,14 +1020,14 @@ bool CServerPath::operator<(CServerPath const& op) const
 		return false;
 	}
 
-	auto const& ld = *m_data;
-	auto const& rd = *op.m_data;
+	auto const& lp = GetPrefix();
+	auto const& rp = op.GetPrefix();
 
-	if (ld.m_prefix || rd.m_prefix) {
-		if (ld.m_prefix < rd.m_prefix) {
+	if (lp || rp) {
+		if (lp < rp) {
 			return true;
 		}
-		else if (rd.m_prefix < ld.m_prefix) {
+		else if (rp < lp) {
 			return false;
 		}
 	}
@@ -889,22 +1039,25 @@ bool CServerPath::operator<(CServerPath const& op) const
 		return true;
 	}
 
-	tConstSegmentIter iter1, iter2;
-	for (iter1 = ld.m_segments.cbegin(), iter2 = rd.m_segments.cbegin(); iter1 != ld.m_segments.cend(); ++iter1, ++iter2) {
-		if (iter2 == rd.m_segments.cend()) {
-			return false;
-		}
-
-		const int cmp = std::wcscmp(iter1->c_str(), iter2->c_str());
-		if (cmp < 0) {
-			return true;
-		}
-		if (cmp > 0) {
-			return false;
-		}
+	// Same prefix, so both are in the same tree. Compare the first segments
+	// in which they differ, below their deepest common ancestor.
+	CServerPathData const* l = m_data.get();
+	CServerPathData const* r = op.m_data.get();
+	while (l->m_depth > r->m_depth) {
+		l = l->m_parent.get();
+	}
+	while (r->m_depth > l->m_depth) {
+		r = r->m_parent.get();
+	}
+	if (l == r) {
+		return m_data->m_depth < op.m_data->m_depth;
+	}
+	while (l->m_parent != r->m_parent) {
+		l = l->m_parent.get();
+		r = r->m_parent.get();
 	}
 
-	return iter2 != rd.m_segments.cend();
+	return l->m_segment.compare(r->m_segment) < 0;
 }
 
 std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omitPath) const
@@ -913,7 +1066,7 @@ std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omit
 		return filename;
 	}
 
-	if (omitPath && (!traits[m_type].prefixmode || (m_data->m_prefix && *m_data->m_prefix == L"."))) {
+	if (omitPath && (!traits[m_type].prefixmode || (GetPrefix() && *GetPrefix() == L"."))) {
 		return filename;
 	}
 
@@ -924,7 +1077,7 @@ std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omit
 
 	switch (m_type) {
 		case VXWORKS:
-			if (!result.empty() && !IsSeparator(result.back()) && !m_data->m_segments.empty()) {
+			if (!result.empty() && !IsSeparator(result.back()) && m_data->m_depth) {
 				result += traits[m_type].separators[0];
 			}
 			break;
@@ -938,7 +1091,7 @@ std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omit
 			break;
 	}
 
-	if (traits[m_type].prefixmode == 1 && !m_data->m_prefix) {
+	if (traits[m_type].prefixmode == 1 && !GetPrefix()) {
 		result += L"(" + filename + L")";
 	}
 	else {
@@ -961,26 +1114,29 @@ int CServerPath::CmpNoCase(CServerPath const& op) const
 		return 0;
 	}
 
-	auto const& ld = *m_data;
-	auto const& rd = *op.m_data;
-
-	if (ld.m_prefix != rd.m_prefix) {
+	if (GetPrefix() != op.GetPrefix()) {
 		return 1;
 	}
 	else if (m_type != op.m_type) {
 		return 1;
 	}
 
-	if (ld.m_segments.size() > rd.m_segments.size()) {
+	if (m_data->m_depth > op.m_data->m_depth) {
 		return 1;
 	}
-	else if (ld.m_segments.size() < rd.m_segments.size()) {
+	else if (m_data->m_depth < op.m_data->m_depth) {
 		return -1;
 	}
 
-	auto iter = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
-	while (iter != ld.m_segments.cend()) {
+	if (m_data == op.m_data) {
+		return 0;
+	}
+
+	auto const ls = GetSegments();
+	auto const rs = op.GetSegments();
+	auto iter = ls.cbegin();
+	auto iter2 = rs.cbegin();
+	while (iter != ls.cend()) {
 		int res = fz::stricmp(*(iter++), *(iter2++));
 		if (res) {
 			return res;
@@ -997,7 +1153,7 @@ bool CServerPath::AddSegment(std::wstring const& segment)
 	}
 
 	// TODO: Check for invalid characters
-	m_data.get().m_segments.push_back(segment);
+	m_data = intern(m_data, segment);
 
 	return true;
 }
@@ -1012,11 +1168,11 @@ CServerPath CServerPath::GetCommonParent(CServerPath const& path) const
 		return CServerPath();
 	}
 
-	auto const& ld = *m_data;
-	auto const& rd = *path.m_data;
+	auto const& lp = GetPrefix();
+	auto const& rp = path.GetPrefix();
 
 	if (m_type != path.m_type ||
-		(!traits[m_type].prefixmode && ld.m_prefix != rd.m_prefix))
+		(!traits[m_type].prefixmode && lp != rp))
 	{
 		return CServerPath();
 	}
@@ -1038,44 +1194,49 @@ CServerPath CServerPath::GetCommonParent(CServerPath const& path) const
 		}
 	}
 
+	auto const ls = GetSegments();
+	auto const rs = path.GetSegments();
+
 	CServerPath parent;
 	parent.m_type = m_type;
 
-	CServerPathData& parentData = parent.m_data.get();
+	fz::sparse_optional<std::wstring> prefix;
+	tSegmentList segments;
 
-	auto last = ld.m_segments.cend();
-	auto last2 = rd.m_segments.cend();
+	auto last = ls.cend();
+	auto last2 = rs.cend();
 	if (traits[m_type].prefixmode == 1) {
-		if (!ld.m_prefix) {
+		if (!lp) {
 			--last;
 		}
-		if (!rd.m_prefix) {
+		if (!rp) {
 			--last2;
 		}
-		parentData.m_prefix = GetParent().m_data->m_prefix;
+		prefix = GetParent().GetPrefix();
 	}
 	else {
-		parentData.m_prefix = ld.m_prefix;
+		prefix = lp;
 	}
 
-	auto iter = ld.m_segments.cbegin();
-	auto iter2 = rd.m_segments.cbegin();
+	auto iter = ls.cbegin();
+	auto iter2 = rs.cbegin();
 	while (iter != last && iter2 != last2) {
 		if (*iter != *iter2) {
-			if (!traits[m_type].has_root && parentData.m_segments.empty()) {
+			if (!traits[m_type].has_root && segments.empty()) {
 				return CServerPath();
 			}
 			else {
-				return parent;
+				break;
 			}
 		}
 
-		parentData.m_segments.push_back(*iter);
+		segments.push_back(*iter);
 
 		++iter;
 		++iter2;
 	}
 
+	parent.Assign(prefix, segments);
 	return parent;
 }
 
@@ -1182,7 +1343,39 @@ bool CServerPath::ExtractFile(std::wstring& dir, std::wstring& file)
 
 size_t CServerPath::SegmentCount() const
 {
-	return empty() ? 0 : m_data->m_segments.size();
+	return empty() ? 0 : m_data->m_depth;
+}
+
+size_t CServerPath::hash() const
+{
+	return empty() ? 0 : combine_hash(m_data->m_hash, static_cast<size_t>(m_type));
+}
+
+CServerPath::tSegmentList CServerPath::GetSegments() const
+{
+	tSegmentList segments;
+	if (m_data) {
+		segments.resize(m_data->m_depth);
+		for (CServerPathData const* data = m_data.get(); data->m_depth; data = data->m_parent.get()) {
+			segments[data->m_depth - 1] = data->m_segment;
+		}
+	}
+	return segments;
+}
+
+fz::sparse_optional<std::wstring> const& CServerPath::GetPrefix() const
+{
+	static fz::sparse_optional<std::wstring> const none;
+	return m_data ? m_data->m_root->m_prefix : none;
+}
+
+void CServerPath::Assign(fz::sparse_optional<std::wstring> const& prefix, tSegmentList const& segments)
+{
+	auto data = intern(nullptr, prefix ? *prefix : std::wstring());
+	for (auto const& segment : segments) {
+		data = intern(data, segment);
+	}
+	m_data = std::move(data);
 }
 
 bool CServerPath::IsSeparator(wchar_t c) const
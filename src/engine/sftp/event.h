@@ -5,7 +5,7 @@
 
 #include <string>
 
-#define FZSFTP_PROTOCOL_VERSION 10
+#define FZSFTP_PROTOCOL_VERSION 11
 
 enum class sftpEvent {
 	Unknown = -1,
@@ -39,6 +39,7 @@ enum class sftpEvent {
 	io_open,
 	io_nextbuf,
 	io_finalize,
+	io_member,
 
 	count
 };
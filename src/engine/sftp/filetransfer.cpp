@@ -4,6 +4,7 @@
 #include "filetransfer.h"
 
 #include "../../include/engine_options.h"
+#include "../../include/local_path.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/process.hpp>
@@ -20,6 +21,35 @@ enum filetransferStates
 	filetransfer_chmtime
 };
 
+namespace {
+// Maps the path of an archive member to a path below the local root directory.
+// Returns an empty string for names that would end up outside of it.
+std::wstring ArchiveLocalPath(std::wstring const& root, std::wstring const& member)
+{
+	std::wstring ret = root;
+	bool empty = true;
+	for (auto const& segment : fz::strtok(member, L"/")) {
+		if (segment == L".") {
+			continue;
+		}
+		if (segment == L"..") {
+			return std::wstring();
+		}
+#ifdef FZ_WINDOWS
+		if (segment.find_first_of(L"\\:*?\"<>|") != std::wstring::npos) {
+			return std::wstring();
+		}
+#endif
+		if (ret.empty() || ret.back() != CLocalPath::path_separator) {
+			ret += CLocalPath::path_separator;
+		}
+		ret += segment;
+		empty = false;
+	}
+	return empty ? std::wstring() : ret;
+}
+}
+
 CSftpFileTransferOpData::~CSftpFileTransferOpData()
 {
 	remove_handler();
@@ -28,6 +58,10 @@ CSftpFileTransferOpData::~CSftpFileTransferOpData()
 
 int CSftpFileTransferOpData::Send()
 {
+	if (archive() && (opState == filetransfer_init || opState == filetransfer_transfer)) {
+		return SendArchive();
+	}
+
 	if (opState == filetransfer_init) {
 		if (download()) {
 			std::wstring filename = remotePath_.FormatFilename(remoteFile_);
@@ -59,8 +93,14 @@ int CSftpFileTransferOpData::Send()
 			cmd = "re";
 			logstr = L"re";
 		}
+		uint64_t const range_end = download() ? writer_factory_.range_end() : writer_factory::npos;
 		if (download()) {
-			engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			if (range_end != writer_factory::npos) {
+				engine_.transfer_status_.Init(static_cast<int64_t>(range_end), localFileSize_, false);
+			}
+			else {
+				engine_.transfer_status_.Init(remoteFileSize_, resume_ ? localFileSize_ : 0, false);
+			}
 			cmd += "get ";
 			logstr += L"get ";
 			
@@ -75,6 +115,12 @@ int CSftpFileTransferOpData::Send()
 			std::wstring localFile = controlSocket_.QuoteFilename(localName_);
 			cmd += fz::to_utf8(localFile);
 			logstr += localFile;
+
+			if (range_end != writer_factory::npos) {
+				// fzsftp stops reading at the end of the range
+				cmd += fz::sprintf(" %u", range_end);
+				logstr += fz::sprintf(L" %u", range_end);
+			}
 		}
 		else {
 			engine_.transfer_status_.Init(localFileSize_, resume_ ? remoteFileSize_ : 0, false);
@@ -125,13 +171,54 @@ int CSftpFileTransferOpData::Send()
 	return FZ_REPLY_INTERNALERROR;
 }
 
+int CSftpFileTransferOpData::SendArchive()
+{
+	if (remotePath_.GetType() == DEFAULT) {
+		remotePath_.SetType(currentServer_.GetType());
+	}
+
+	// The directory is transferred as a whole, there is nothing to look up
+	// and existing files get overwritten.
+	std::wstring const remoteDir = remotePath_.FormatFilename(remoteFile_);
+	if (download()) {
+		log(logmsg::status, _("Starting download of directory %s as archive"), remoteDir);
+		fz::mkdir(fz::to_native(localName_), true);
+	}
+	else {
+		log(logmsg::status, _("Starting upload of directory %s as archive"), localName_);
+		archiveDirs_.assign(1, std::wstring());
+	}
+
+	std::wstring const quoted = controlSocket_.QuoteFilename(remoteDir);
+	std::string const remote = controlSocket_.ConvToServer(quoted);
+	if (remote.empty()) {
+		log(logmsg::error, _("Could not convert command to server encoding"));
+		return FZ_REPLY_ERROR;
+	}
+
+	std::string const cmd = download() ? "gettar " : "puttar ";
+
+	opState = filetransfer_transfer;
+	engine_.transfer_status_.Init(-1, 0, false);
+	engine_.transfer_status_.SetStartTime();
+	transferInitiated_ = true;
+	controlSocket_.SetWait(true);
+
+	controlSocket_.log_raw(logmsg::command, fz::to_wstring(cmd) + quoted);
+	return controlSocket_.AddToStream(cmd + remote + "\r\n");
+}
+
 int CSftpFileTransferOpData::ParseResponse()
 {
-	if (opState == filetransfer_transfer) {
+	if (opState == filetransfer_transfer && archive()) {
+		FinishMember();
+		return controlSocket_.result_;
+	}
+	else if (opState == filetransfer_transfer) {
 		writer_.reset();
 		if (controlSocket_.result_ == FZ_REPLY_OK && engine_.GetOptions().get_int(OPTION_PRESERVE_TIMESTAMPS)) {
 			if (download()) {
-				if (!remoteFileTime_.empty()) {
+				if (!remoteFileTime_.empty() && writer_factory_.range_end() == writer_factory::npos) {
 					if (!writer_factory_.set_mtime(remoteFileTime_)) {
 						log(logmsg::debug_warning, L"Could not set modification time");
 					}
@@ -319,7 +406,20 @@ void CSftpFileTransferOpData::OnOpenRequested(uint64_t offset)
 	aio_base::shm_flag shm = controlSocket_.shm_fd_;
 #endif
 	decltype(std::declval<aio_base>().shared_memory_info()) info;
-	if (download()) {
+	if (archive()) {
+		if (download()) {
+			writer_ = memberWriter_.open(0, engine_, this, shm);
+		}
+		else {
+			reader_ = memberReader_.open(offset, engine_, this, shm, memberSize_);
+		}
+		if (!writer_ && !reader_) {
+			controlSocket_.AddToStream("--\n");
+			return;
+		}
+		info = writer_ ? writer_->shared_memory_info() : reader_->shared_memory_info();
+	}
+	else if (download()) {
 		if (resume_) {
 			offset = writer_factory_.size();
 			if (offset == aio_base::nosize) {
@@ -428,6 +528,149 @@ void CSftpFileTransferOpData::OnSizeRequested()
 	}
 }
 
+void CSftpFileTransferOpData::OnMemberRequested(std::wstring const& request)
+{
+	if (!archive()) {
+		controlSocket_.AddToStream("--\n");
+		return;
+	}
+
+	FinishMember();
+
+	if (download()) {
+		OnDownloadMember(request);
+	}
+	else {
+		OnNextUploadMember();
+	}
+}
+
+void CSftpFileTransferOpData::OnDownloadMember(std::wstring const& request)
+{
+	// <d|f> <mtime> <path>
+	size_t const pos = request.find(' ', 2);
+	if (request.size() < 4 || (request[0] != 'd' && request[0] != 'f') || request[1] != ' ' || pos == std::wstring::npos) {
+		log(logmsg::debug_warning, L"Malformed archive member announcement");
+		controlSocket_.AddToStream("--\n");
+		return;
+	}
+
+	std::wstring const member = request.substr(pos + 1);
+	std::wstring const local = ArchiveLocalPath(localName_, member);
+	if (local.empty()) {
+		log(logmsg::error, _("Skipping archive member with invalid name %s"), member);
+		controlSocket_.AddToStream("-0\n");
+		return;
+	}
+
+	if (request[0] == 'd') {
+		fz::native_string last_created;
+		if (!fz::mkdir(fz::to_native(local), true, false, &last_created)) {
+			log(logmsg::error, _("Could not create local directory %s"), local);
+			controlSocket_.AddToStream("--\n");
+			return;
+		}
+		if (!last_created.empty()) {
+			auto n = std::make_unique<CLocalDirCreatedNotification>();
+			if (n->dir.SetPath(fz::to_wstring(last_created))) {
+				engine_.AddNotification(std::move(n));
+			}
+		}
+	}
+	else {
+		memberWriter_ = std::make_unique<file_writer_factory>(local, flags_ & transfer_flags::fsync);
+		auto const seconds = fz::to_integral<int64_t>(request.substr(2, pos - 2));
+		if (seconds > 0) {
+			memberTime_ = fz::datetime(static_cast<time_t>(seconds), fz::datetime::seconds);
+		}
+		log(logmsg::debug_info, L"Receiving %s", local);
+	}
+	controlSocket_.AddToStream("-1\n");
+}
+
+void CSftpFileTransferOpData::OnNextUploadMember()
+{
+	// Breadth-first walk of the local tree, replies with one of
+	// -0 once done, -1 <size> <mtime> <path> for directories and
+	// -2 <size> <mtime> <path> for files.
+	while (true) {
+		if (!archiveListing_) {
+			if (archiveDirs_.empty()) {
+				controlSocket_.AddToStream("-0\n");
+				return;
+			}
+			archiveDir_ = std::move(archiveDirs_.front());
+			archiveDirs_.pop_front();
+
+			std::wstring const local = archiveDir_.empty() ? localName_ : ArchiveLocalPath(localName_, archiveDir_);
+			if (!archiveFs_.begin_find_files(fz::to_native(local), false)) {
+				log(logmsg::error, _("Could not list local directory %s"), local);
+				controlSocket_.AddToStream("--\n");
+				return;
+			}
+			archiveListing_ = true;
+		}
+
+		fz::native_string name;
+		bool isLink{};
+		fz::local_filesys::type t{};
+		int64_t size{};
+		fz::datetime time;
+		if (!archiveFs_.get_next_file(name, isLink, t, &size, &time, nullptr)) {
+			archiveFs_.end_find_files();
+			archiveListing_ = false;
+			continue;
+		}
+
+		std::wstring const wname = fz::to_wstring(name);
+		if (wname.empty()) {
+			continue;
+		}
+		std::wstring const member = archiveDir_.empty() ? wname : (archiveDir_ + L"/" + wname);
+		if (t == fz::local_filesys::dir && isLink) {
+			log(logmsg::status, _("Skipping symbolic link %s"), member);
+			continue;
+		}
+		if (t != fz::local_filesys::dir && t != fz::local_filesys::file) {
+			continue;
+		}
+
+		std::string const remote = controlSocket_.ConvToServer(member);
+		if (remote.empty() || member.find_first_of(L"\r\n") != std::wstring::npos) {
+			log(logmsg::error, _("Skipping %s, its name cannot be sent to the server"), member);
+			continue;
+		}
+
+		int64_t const seconds = time.empty() ? 0 : static_cast<int64_t>(time.get_time_t());
+		if (t == fz::local_filesys::dir) {
+			archiveDirs_.push_back(member);
+			controlSocket_.AddToStream(fz::sprintf("-1 0 %d ", seconds) + remote + "\n");
+		}
+		else {
+			memberReader_ = std::make_unique<file_reader_factory>(ArchiveLocalPath(localName_, member));
+			memberSize_ = static_cast<uint64_t>(std::max(int64_t(0), size));
+			log(logmsg::debug_info, L"Sending %s", member);
+			controlSocket_.AddToStream(fz::sprintf("-2 %d %d ", memberSize_, seconds) + remote + "\n");
+		}
+		return;
+	}
+}
+
+void CSftpFileTransferOpData::FinishMember()
+{
+	bool const finalized = writer_ && finalizing_;
+	writer_.reset();
+	reader_.reset();
+	finalizing_ = false;
+
+	if (finalized && !memberTime_.empty() && engine_.GetOptions().get_int(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (!memberWriter_.set_mtime(memberTime_)) {
+			log(logmsg::debug_warning, L"Could not set modification time");
+		}
+	}
+	memberTime_ = fz::datetime();
+}
+
 void CSftpFileTransferOpData::operator()(fz::event_base const& ev)
 {
 	fz::dispatch<read_ready_event, write_ready_event>(ev, this,
@@ -3,6 +3,10 @@
 
 #include "sftpcontrolsocket.h"
 
+#include <libfilezilla/local_filesys.hpp>
+
+#include <deque>
+
 class CSftpFileTransferOpData final : public CFileTransferOpData, public CSftpOpData, public fz::event_handler
 {
 public:
@@ -19,6 +23,12 @@ public:
 	void OnNextBufferRequested(uint64_t processed);
 	void OnFinalizeRequested(uint64_t lastWrite);
 
+	// Archive transfers: fzsftp announces each member it extracts,
+	// or asks for the next member to add to the archive.
+	void OnMemberRequested(std::wstring const& request);
+
+	bool archive() const { return flags_ & sftp_transfer_flags::archive; }
+
 	virtual int Send() override;
 	virtual int ParseResponse() override;
 	virtual int SubcommandResult(int, COpData const&) override;
@@ -28,12 +38,31 @@ private:
 	void OnReaderEvent(reader_base*);
 	void OnWriterEvent(writer_base*);
 
+	int SendArchive();
+	void OnDownloadMember(std::wstring const& request);
+	void OnNextUploadMember();
+
+	// Closes the reader or writer of the previous archive member
+	void FinishMember();
+
 	std::unique_ptr<reader_base> reader_;
 	std::unique_ptr<writer_base> writer_;
 	bool finalizing_{};
 
 	uint8_t const* base_address_{};
 	fz::nonowning_buffer buffer_;
+
+	// The archive member currently being transferred
+	writer_factory_holder memberWriter_;
+	reader_factory_holder memberReader_;
+	uint64_t memberSize_{};
+	fz::datetime memberTime_;
+
+	// Directories, relative to the local root, still to be added to an uploaded archive
+	std::deque<std::wstring> archiveDirs_;
+	std::wstring archiveDir_;
+	fz::local_filesys archiveFs_;
+	bool archiveListing_{};
 };
 
 #endif
@@ -163,6 +163,7 @@ void CSftpInputThread::processEvent(sftpEvent eventType, std::wstring & error)
 	case sftpEvent::io_open:
 	case sftpEvent::io_finalize:
 	case sftpEvent::io_nextbuf:
+	case sftpEvent::io_member:
 		lines = 1;
 		break;
 	case sftpEvent::AskHostkey:
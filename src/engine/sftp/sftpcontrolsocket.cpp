@@ -285,6 +285,12 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 			data.OnFinalizeRequested(fz::to_integral<uint64_t>(message.text[0]));
 		}
 		break;
+	case sftpEvent::io_member:
+		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
+			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
+			data.OnMemberRequested(message.text[0]);
+		}
+		break;
 	default:
 		log(logmsg::debug_warning, L"Message type %d not handled", message.type);
 		break;
@@ -510,6 +516,19 @@ void CSftpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 	Push(std::make_unique<CSftpFileTransferOpData>(*this, cmd));
 }
 
+void CSftpControlSocket::UpdateCache(COpData const& data, CServerPath const& serverPath, std::wstring const& remoteFile, int64_t fileSize)
+{
+	if (!(static_cast<CFileTransferOpData const&>(data).flags_ & sftp_transfer_flags::archive)) {
+		CControlSocket::UpdateCache(data, serverPath, remoteFile, fileSize);
+		return;
+	}
+
+	// Anything below the uploaded directory may have changed
+	engine_.GetDirectoryCache().RemoveDir(currentServer_, serverPath, remoteFile, CServerPath());
+	engine_.GetDirectoryCache().UpdateFile(currentServer_, serverPath, remoteFile, true, CDirectoryCache::dir);
+	SendDirectoryListingNotification(serverPath, false);
+}
+
 int CSftpControlSocket::DoClose(int nErrorCode)
 {
 	remove_bucket();
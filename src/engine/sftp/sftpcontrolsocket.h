@@ -42,6 +42,7 @@ protected:
 	std::wstring QuoteFilename(std::wstring const& filename);
 
 	virtual int DoClose(int nErrorCode = FZ_REPLY_DISCONNECTED | FZ_REPLY_ERROR) override;
+	virtual void UpdateCache(COpData const& data, CServerPath const& serverPath, std::wstring const& remoteFile, int64_t fileSize) override;
 
 	void ProcessReply(int result, std::wstring const& reply);
 
@@ -0,0 +1,99 @@
+#include "filezilla.h"
+
+#include "../include/tls_session_cache.h"
+
+tls_session_cache::tls_session_cache(size_t max_entries)
+	: max_entries_(max_entries)
+{
+}
+
+void tls_session_cache::set_store(tls_session_store* store)
+{
+	fz::scoped_lock l(store_mtx_);
+	store_ = store;
+}
+
+std::vector<uint8_t> tls_session_cache::lookup(std::string const& host, unsigned short port)
+{
+	{
+		fz::scoped_lock l(mtx_);
+
+		auto it = entries_.find(key_type(host, port));
+		if (it != entries_.end()) {
+			if (fz::monotonic_clock::now() - it->second.time < max_age()) {
+				lru_.splice(lru_.begin(), lru_, it->second.lru);
+				return it->second.session;
+			}
+
+			lru_.erase(it->second.lru);
+			entries_.erase(it);
+		}
+	}
+
+	std::vector<uint8_t> session;
+	{
+		fz::scoped_lock l(store_mtx_);
+		if (store_) {
+			session = store_->lookup(host, port);
+		}
+	}
+	if (!session.empty()) {
+		insert(host, port, session);
+	}
+	return session;
+}
+
+void tls_session_cache::store(std::string const& host, unsigned short port, std::vector<uint8_t> const& session)
+{
+	if (session.empty()) {
+		return;
+	}
+
+	insert(host, port, session);
+
+	fz::scoped_lock l(store_mtx_);
+	if (store_) {
+		store_->store(host, port, session);
+	}
+}
+
+void tls_session_cache::remove(std::string const& host, unsigned short port)
+{
+	{
+		fz::scoped_lock l(mtx_);
+
+		auto it = entries_.find(key_type(host, port));
+		if (it != entries_.end()) {
+			lru_.erase(it->second.lru);
+			entries_.erase(it);
+		}
+	}
+
+	fz::scoped_lock l(store_mtx_);
+	if (store_) {
+		store_->remove(host, port);
+	}
+}
+
+void tls_session_cache::insert(std::string const& host, unsigned short port, std::vector<uint8_t> const& session)
+{
+	fz::scoped_lock l(mtx_);
+
+	key_type key(host, port);
+	auto it = entries_.find(key);
+	if (it != entries_.end()) {
+		lru_.splice(lru_.begin(), lru_, it->second.lru);
+	}
+	else {
+		if (entries_.size() >= max_entries_ && !lru_.empty()) {
+			entries_.erase(lru_.back());
+			lru_.pop_back();
+		}
+		lru_.push_front(key);
+		it = entries_.emplace(std::move(key), entry()).first;
+		it->second.lru = lru_.begin();
+	}
+
+	it->second.time = fz::monotonic_clock::now();
+	it->second.session = session;
+}
@@ -0,0 +1,236 @@
+#include "filezilla.h"
+
+#include "trace.h"
+
+#include "../include/engine_options.h"
+
+#include <libfilezilla/local_filesys.hpp>
+
+#include <string.h>
+
+#include <cstdio>
+#include <thread>
+
+namespace trace_detail {
+std::atomic<trace_writer*> writer{};
+std::atomic<int> users{};
+}
+
+namespace {
+size_t const ring_capacity = 64 * 1024;
+
+fz::duration const flush_interval = fz::duration::from_milliseconds(250);
+
+// Records written with a single call
+size_t const batch_size = 4096;
+
+bool rename_file(fz::native_string const& source, fz::native_string const& dest)
+{
+#ifdef FZ_WINDOWS
+	return MoveFileExW(source.c_str(), dest.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(source.c_str(), dest.c_str()) == 0;
+#endif
+}
+}
+
+trace_writer::trace_writer(COptionsBase & options, fz::thread_pool & pool)
+	: mask_(ring_capacity - 1)
+	, pool_(pool)
+{
+	file_name_ = fz::to_native(options.get_string(OPTION_TRACE_FILE));
+	if (file_name_.empty()) {
+		return;
+	}
+
+	max_size_ = options.get_int(OPTION_LOGGING_FILE_SIZELIMIT);
+	if (max_size_ < 0) {
+		max_size_ = 0;
+	}
+	else if (max_size_ > 2000) {
+		max_size_ = 2000;
+	}
+	max_size_ *= 1024 * 1024;
+
+	// Keep the trace of the previous session
+	if (fz::local_filesys::get_size(file_name_) > 0) {
+		rename_file(file_name_, file_name_ + fzT(".1"));
+	}
+
+	if (!open()) {
+		return;
+	}
+
+	slots_ = std::make_unique<slot[]>(ring_capacity);
+	for (size_t i = 0; i < ring_capacity; ++i) {
+		slots_[i].seq.store(i, std::memory_order_relaxed);
+	}
+	batch_ = std::make_unique<trace_record[]>(batch_size);
+
+	thread_ = pool_.spawn([this]() { entry(); });
+	if (!thread_) {
+		file_.close();
+		return;
+	}
+
+	trace_detail::writer.store(this, std::memory_order_release);
+}
+
+trace_writer::~trace_writer()
+{
+	if (!thread_) {
+		return;
+	}
+
+	trace_writer* self = this;
+	trace_detail::writer.compare_exchange_strong(self, nullptr);
+
+	// Wait for those that got the pointer before it was cleared
+	while (trace_detail::users.load()) {
+		std::this_thread::yield();
+	}
+
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+
+	flush();
+}
+
+void trace_writer::add(unsigned int engine_id, trace_event event, int64_t arg0, int64_t arg1)
+{
+	auto const now = fz::monotonic_clock::now();
+
+	size_t pos = head_.load(std::memory_order_relaxed);
+	slot* s;
+	while (true) {
+		s = &slots_[pos & mask_];
+		size_t const seq = s->seq.load(std::memory_order_acquire);
+		auto const diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (!diff) {
+			if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			++dropped_;
+			return;
+		}
+		else {
+			pos = head_.load(std::memory_order_relaxed);
+		}
+	}
+
+	auto & r = s->record;
+	r.time = static_cast<uint64_t>((now - start_).get_microseconds());
+	r.engine_id = engine_id;
+	r.event = static_cast<uint16_t>(event);
+	r.reserved = 0;
+	r.args[0] = arg0;
+	r.args[1] = arg1;
+	s->seq.store(pos + 1, std::memory_order_release);
+
+	if (pos - tail_.load(std::memory_order_relaxed) >= ring_capacity / 2 && !wakeup_pending_.exchange(true)) {
+		fz::scoped_lock l(mutex_);
+		cond_.signal(l);
+	}
+}
+
+void trace_writer::entry()
+{
+	bool quit{};
+	while (!quit) {
+		{
+			fz::scoped_lock l(mutex_);
+			if (!quit_) {
+				cond_.wait(l, flush_interval);
+			}
+			wakeup_pending_ = false;
+			quit = quit_;
+		}
+
+		flush();
+	}
+}
+
+void trace_writer::flush()
+{
+	size_t count{};
+
+	uint64_t const dropped = dropped_.exchange(0);
+	if (dropped) {
+		auto & r = batch_[count++];
+		r = trace_record();
+		r.time = static_cast<uint64_t>((fz::monotonic_clock::now() - start_).get_microseconds());
+		r.event = static_cast<uint16_t>(trace_event::dropped);
+		r.args[0] = static_cast<int64_t>(dropped);
+	}
+
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	while (true) {
+		auto & s = slots_[tail & mask_];
+		if (s.seq.load(std::memory_order_acquire) != tail + 1) {
+			break;
+		}
+		batch_[count++] = s.record;
+		s.seq.store(tail + mask_ + 1, std::memory_order_release);
+		tail_.store(++tail, std::memory_order_relaxed);
+
+		if (count == batch_size) {
+			write(batch_.get(), count * sizeof(trace_record));
+			count = 0;
+		}
+	}
+
+	if (count) {
+		write(batch_.get(), count * sizeof(trace_record));
+	}
+}
+
+bool trace_writer::open()
+{
+	if (!file_.open(file_name_, fz::file::writing, fz::file::empty)) {
+		return false;
+	}
+
+	trace_file_header header{};
+	memcpy(header.magic, trace_magic, sizeof(header.magic));
+	header.version = trace_version;
+	header.record_size = sizeof(trace_record);
+	header.start_time = (start_time_ - fz::datetime(0, fz::datetime::milliseconds)).get_milliseconds();
+
+	size_ = 0;
+	write(&header, sizeof(header));
+	return file_.opened();
+}
+
+void trace_writer::write(void const* data, size_t len)
+{
+	if (!file_.opened()) {
+		return;
+	}
+
+	if (max_size_ && size_ > max_size_) {
+		file_.close();
+		rename_file(file_name_, file_name_ + fzT(".1"));
+		if (!open()) {
+			return;
+		}
+	}
+
+	auto p = static_cast<unsigned char const*>(data);
+	while (len) {
+		int64_t written = file_.write(p, static_cast<int64_t>(len));
+		if (written <= 0) {
+			// Tracing stops, there is nowhere to report this to
+			file_.close();
+			return;
+		}
+		p += written;
+		len -= static_cast<size_t>(written);
+		size_ += written;
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef FILEZILLA_ENGINE_TRACE_HEADER
+#define FILEZILLA_ENGINE_TRACE_HEADER
+
+#include "trace_format.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <memory>
+
+class COptionsBase;
+
+// Writes the binary trace file, see trace_format.h.
+//
+// Records are put into a bounded lock-free ring from any thread and written
+// out in batches by a background thread. If the ring is full, records get
+// dropped and the number of lost records is written instead.
+class trace_writer final
+{
+public:
+	trace_writer(COptionsBase & options, fz::thread_pool & pool);
+	~trace_writer();
+
+	trace_writer(trace_writer const&) = delete;
+	trace_writer& operator=(trace_writer const&) = delete;
+
+	void add(unsigned int engine_id, trace_event event, int64_t arg0, int64_t arg1);
+
+private:
+	void entry();
+	void flush();
+	bool open();
+	void write(void const* data, size_t len);
+
+	struct slot final
+	{
+		std::atomic<size_t> seq{};
+		trace_record record{};
+	};
+
+	std::unique_ptr<slot[]> slots_;
+	size_t const mask_;
+	alignas(64) std::atomic<size_t> head_{};
+	alignas(64) std::atomic<size_t> tail_{};
+	std::atomic<uint64_t> dropped_{};
+
+	fz::monotonic_clock const start_{fz::monotonic_clock::now()};
+	fz::datetime const start_time_{fz::datetime::now()};
+
+	fz::thread_pool & pool_;
+	fz::async_task thread_;
+
+	fz::mutex mutex_{false};
+	fz::condition cond_;
+	bool quit_{};
+	std::atomic<bool> wakeup_pending_{};
+
+	// Only accessed by the background thread
+	fz::native_string file_name_;
+	fz::file file_;
+	int64_t size_{};
+	int64_t max_size_{};
+	std::unique_ptr<trace_record[]> batch_;
+};
+
+namespace trace_detail {
+extern std::atomic<trace_writer*> writer;
+
+// Number of threads that may be using the writer. Its destructor waits for
+// this to drop to zero after clearing the writer pointer.
+extern std::atomic<int> users;
+}
+
+// Records an event if tracing is enabled. Cheap if it is not.
+inline void record_trace(unsigned int engine_id, trace_event event, int64_t arg0 = 0, int64_t arg1 = 0)
+{
+	if (!trace_detail::writer.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	++trace_detail::users;
+	auto * writer = trace_detail::writer.load();
+	if (writer) {
+		writer->add(engine_id, event, arg0, arg1);
+	}
+	--trace_detail::users;
+}
+
+// Microseconds since t, for events carrying a duration
+inline int64_t trace_duration(fz::monotonic_clock const& t)
+{
+	return (fz::monotonic_clock::now() - t).get_microseconds();
+}
+
+inline int64_t trace_duration(fz::duration const& d)
+{
+	return d.get_microseconds();
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef FILEZILLA_ENGINE_TRACE_FORMAT_HEADER
+#define FILEZILLA_ENGINE_TRACE_FORMAT_HEADER
+
+#include <stdint.h>
+
+// Layout of binary trace files, shared between the engine and fztrace.
+//
+// A trace file starts with a trace_file_header, followed by any number of
+// trace_records. Everything is in host byte order, fztrace refuses files
+// written on a host with different byte order.
+
+char const trace_magic[8] = { 'F', 'Z', 'T', 'R', 'A', 'C', 'E', 0 };
+uint32_t const trace_version = 1;
+
+struct trace_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+
+	// Wall clock time at which the trace was started, in milliseconds since
+	// the epoch. Record times are relative to this.
+	int64_t start_time;
+};
+
+enum class trace_event : uint16_t
+{
+	// Records lost because the writer could not keep up. arg0: Count.
+	dropped = 1,
+
+	// A message got logged. arg0: logmsg::type, arg1: Length of the message
+	log,
+
+	// arg0: 1 for downloads, 0 for uploads
+	transfer_start,
+
+	// arg0: Reply code
+	transfer_end,
+
+	// Data connection of an FTP transfer
+	socket_connected,
+	// arg0: Bytes received in one go, each go reads until EAGAIN or a limit is hit
+	socket_receive,
+	// arg0: Bytes sent in one go
+	socket_send,
+	// Sending would block
+	socket_send_blocked,
+	// arg0: TransferEndReason
+	socket_transfer_end,
+
+	// arg0: Bytes read from disk, arg1: Microseconds spent reading
+	reader_read,
+	// The consumer has to wait for the reader
+	reader_wait,
+	// The reader wakes up a waiting consumer
+	reader_ready,
+
+	// arg0: Bytes written to disk, arg1: Microseconds spent writing
+	writer_write,
+	// The producer has to wait for the writer
+	writer_wait,
+	// The writer wakes up a waiting producer
+	writer_ready,
+
+	// arg0: locking_reason, arg1: 1 if the lock has to wait
+	oplock_lock,
+	// A waiting lock got obtained. arg0: locking_reason
+	oplock_obtained,
+	// arg0: locking_reason
+	oplock_unlock,
+
+	count
+};
+
+struct trace_record
+{
+	// Monotonic time in microseconds since the start of the trace
+	uint64_t time;
+	uint32_t engine_id;
+	uint16_t event;
+	uint16_t reserved;
+	int64_t args[2];
+};
+
+static_assert(sizeof(trace_file_header) == 24, "Unexpected size of trace_file_header");
+static_assert(sizeof(trace_record) == 32, "Unexpected size of trace_record");
+
+#endif
@@ -1,5 +1,6 @@
 #include "../include/writer.h"
 #include "engineprivate.h"
+#include "trace.h"
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 
@@ -68,6 +69,15 @@ file_writer_factory::file_writer_factory(std::wstring const& file, bool fsync)
 {
 }
 
+file_writer_factory::file_writer_factory(std::wstring const& file, uint64_t start, uint64_t end, bool fsync)
+	: writer_factory(file)
+	, fsync_(fsync)
+	, range_start_(start)
+	, range_end_(end)
+	, range_position_(std::make_shared<std::atomic<uint64_t>>(start))
+{
+}
+
 std::unique_ptr<writer_factory> file_writer_factory::clone() const
 {
 	return std::make_unique<file_writer_factory>(*this);
@@ -75,6 +85,10 @@ std::unique_ptr<writer_factory> file_writer_factory::clone() const
 
 uint64_t file_writer_factory::size() const
 {
+	if (range_position_) {
+		return *range_position_;
+	}
+
 	auto s = fz::local_filesys::get_size(fz::to_native(name()));
 	if (s < 0) {
 		return npos;
@@ -89,14 +103,35 @@ fz::datetime file_writer_factory::mtime() const
 	return fz::local_filesys::get_modification_time(fz::to_native(name()));
 }
 
+bool file_writer_factory::extend_range()
+{
+	if (!range_position_) {
+		return false;
+	}
+	range_end_ = npos;
+	return true;
+}
+
 bool file_writer_factory::set_mtime(fz::datetime const& t)
 {
+	if (range_position_) {
+		// Other ranges of the file may still be written to.
+		return false;
+	}
 	return fz::local_filesys::set_modification_time(fz::to_native(name()), t);
 }
 
 std::unique_ptr<writer_base> file_writer_factory::open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status)
 {
 	auto ret = std::make_unique<file_writer>(name(), engine, handler, update_transfer_status);
+	if (range_position_) {
+		if (offset > range_end_) {
+			engine.GetLogger().log(logmsg::debug_warning, L"Offset %d lies past the end %d of the range to write", offset, range_end_);
+			return nullptr;
+		}
+		ret->range_end_ = range_end_;
+		ret->range_position_ = range_position_;
+	}
 
 	if (ret->open(offset, fsync_, shm) != aio_result::ok) {
 		ret.reset();
@@ -169,7 +204,10 @@ get_write_buffer_result writer_base::get_write_buffer(fz::nonowning_buffer & las
 		}
 	}
 	last_written.reset();
+	engine_.transfer_telemetry_.SampleOccupancy(ready_count_);
 	if (ready_count_ >= buffers_.size()) {
+		record_trace(engine_.GetEngineId(), trace_event::writer_wait);
+		wait_start_ = fz::monotonic_clock::now();
 		handler_waiting_ = true;
 		processing_ = false;
 		return {aio_result::wait, fz::nonowning_buffer()};
@@ -225,6 +263,7 @@ aio_result writer_base::finalize(fz::nonowning_buffer & last_written)
 		}
 	}
 	if (ready_count_) {
+		wait_start_ = fz::monotonic_clock::now();
 		handler_waiting_ = true;
 		return aio_result::wait;
 	}
@@ -278,7 +317,10 @@ void file_writer::close()
 
 	if (file_.opened()) {
 		bool remove{};
-		if (from_beginning_ && !file_.position() && !finalized_) {
+		if (range_position_) {
+			// Other ranges of the file might still be in progress
+		}
+		else if (from_beginning_ && !file_.position() && !finalized_) {
 			// Freshly created file to which nothing has been written.
 			remove = true;
 		}
@@ -319,12 +361,21 @@ aio_result file_writer::open(uint64_t offset, bool fsync, shm_flag shm)
 		}
 	}
 
-	if (!file_.open(fz::to_native(name()), fz::file::writing, offset ? fz::file::existing : fz::file::empty)) {
+	if (!file_.open(fz::to_native(name()), fz::file::writing, (offset || range_position_) ? fz::file::existing : fz::file::empty)) {
 		engine_.GetLogger().log(logmsg::error, fztranslate("Could not open '%s' for writing."), name_);
 		return aio_result::error;
 	}
 
-	if (offset) {
+	if (range_position_) {
+		auto const ofs = static_cast<int64_t>(offset);
+		if (file_.seek(ofs, fz::file::begin) != ofs) {
+			engine_.GetLogger().log(logmsg::error, fztranslate("Could not seek to offset %d in '%s'."), ofs, name_);
+			return aio_result::error;
+		}
+		range_offset_ = offset;
+		*range_position_ = offset;
+	}
+	else if (offset) {
 		auto const ofs = static_cast<int64_t>(offset);
 		if (file_.seek(ofs, fz::file::begin) != ofs) {
 			engine_.GetLogger().log(logmsg::error, fztranslate("Could not seek to offset %d in '%s'."), ofs, name_);
@@ -355,27 +406,43 @@ void file_writer::entry()
 		if (!ready_count_) {
 			if (handler_waiting_) {
 				handler_waiting_ = false;
+				engine_.transfer_telemetry_.AddWait(CTransferTelemetry::disk, fz::monotonic_clock::now() - wait_start_);
 				if (handler_) {
 					handler_->send_event<write_ready_event>(this);
 				}
 				break;
 			}
 
+			fz::monotonic_clock const start = fz::monotonic_clock::now();
 			cond_.wait(l);
+			engine_.transfer_telemetry_.AddWait(CTransferTelemetry::peer, fz::monotonic_clock::now() - start);
 			continue;
 		}
 
 		fz::nonowning_buffer & b = buffers_[ready_pos_];
 
+		if (range_position_ && b.size() > range_end_ - range_offset_) {
+			engine_.GetLogger().log(logmsg::debug_verbose, L"Discarding %d bytes past the end of the range", b.size() - (range_end_ - range_offset_));
+			b.resize(static_cast<size_t>(range_end_ - range_offset_));
+		}
+
 		while (!b.empty()) {
 			l.unlock();
+			fz::monotonic_clock const start = fz::monotonic_clock::now();
 			auto written = file_.write(b.get(), b.size());
+			fz::duration const d = fz::monotonic_clock::now() - start;
+			engine_.transfer_telemetry_.AddDiskIO(d, written);
+			record_trace(engine_.GetEngineId(), trace_event::writer_write, written, trace_duration(d));
 			l.lock();
 			if (quit_) {
 				return;
 			}
 			if (written > 0) {
 				b.consume(static_cast<size_t>(written));
+				if (range_position_) {
+					range_offset_ += static_cast<uint64_t>(written);
+					*range_position_ = range_offset_;
+				}
 				if (update_transfer_status_) {
 					engine_.transfer_status_.SetMadeProgress();
 					engine_.transfer_status_.Update(written);
@@ -393,6 +460,8 @@ void file_writer::entry()
 
 		if (handler_waiting_) {
 			handler_waiting_ = false;
+			record_trace(engine_.GetEngineId(), trace_event::writer_ready);
+			engine_.transfer_telemetry_.AddWait(CTransferTelemetry::disk, fz::monotonic_clock::now() - wait_start_);
 			if (handler_) {
 				handler_->send_event<write_ready_event>(this);
 			}
@@ -435,6 +504,11 @@ aio_result file_writer::preallocate(uint64_t size)
 		return aio_result::error;
 	}
 
+	if (range_position_) {
+		// Whoever split the file into ranges has already allocated it in full.
+		return aio_result::ok;
+	}
+
 	engine_.GetLogger().log(logmsg::debug_info, L"Preallocating %d bytes for the file \"%s\"", size, name_);
 
 	fz::scoped_lock l(mtx_);
@@ -25,10 +25,14 @@ public:
 
 	std::pair<uint64_t, uint64_t> extract_amounts();
 
+	// Everything recorded so far, not affected by extract_amounts
+	uint64_t total(_direction direction) const { return totals_[direction].load(std::memory_order_relaxed); }
+
 	void set_notifier(std::function<void()> && notification_cb);
 
 private:
 	std::atomic_uint64_t amounts_[2];
+	std::atomic_uint64_t totals_[2]{};
 
 	fz::mutex mtx_;
 	std::function<void()> notification_cb_;
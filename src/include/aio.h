@@ -5,6 +5,7 @@
 
 #include <libfilezilla/nonowning_buffer.hpp>
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
 
 #include <array>
 #include <tuple>
@@ -78,6 +79,9 @@ protected:
 	bool error_{};
 	bool handler_waiting_{};
 
+	// Since when the handler is waiting, for the transfer telemetry
+	fz::monotonic_clock wait_start_;
+
 private:
 	shm_handle mapping_{shm_handle_default};
 	size_t memory_size_{};
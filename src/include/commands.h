@@ -220,6 +220,13 @@ namespace ftp_transfer_flags
 	auto constexpr ascii = transfer_flags::protocol_reserved_max;
 }
 
+namespace sftp_transfer_flags
+{
+	// Transfers the directory remoteFile in remotePath with all its contents
+	// as a single tar stream. The factory names the local directory.
+	auto constexpr archive = static_cast<transfer_flags>(0x4000);
+}
+
 class FZC_PUBLIC_SYMBOL CFileTransferCommand final : public CCommandHelper<CFileTransferCommand, Command::transfer>
 {
 public:
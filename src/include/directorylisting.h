@@ -97,6 +97,11 @@ public:
 
 	void ClearFindMap();
 
+	// Completes the maps used by the FindFile functions. Until the listing
+	// gets modified again, these then no longer change it and the same
+	// listing can be searched from multiple threads.
+	void BuildFindMaps() const;
+
 	explicit operator bool() const { return !path.empty(); }
 
 	CServerPath path;
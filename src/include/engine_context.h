@@ -7,9 +7,13 @@
 
 class activity_logger;
 class CDirectoryCache;
+class engine_metrics;
+class local_hash_cache;
+class CLogFileWriter;
 class COptionsBase;
 class CPathCache;
 class OpLockManager;
+class tls_session_cache;
 
 namespace fz {
 class event_loop;
@@ -41,10 +45,14 @@ public:
 	fz::rate_limiter& GetRateLimiter();
 	CDirectoryCache& GetDirectoryCache();
 	CPathCache& GetPathCache();
+	local_hash_cache& GetLocalHashCache();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
+	tls_session_cache& GetTlsSessionCache();
 	activity_logger& GetActivityLogger();
+	CLogFileWriter& GetLogFileWriter();
+	engine_metrics& GetMetrics();
 
 protected:
 	COptionsBase& options_;
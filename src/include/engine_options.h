@@ -60,6 +60,7 @@ enum engineOptions : unsigned int
 
 	OPTION_SFTP_KEYFILES,
 	OPTION_SFTP_COMPRESSION,
+	OPTION_SFTP_ARCHIVE_TRANSFERS,
 
 	OPTION_PROXY_TYPE,
 	OPTION_PROXY_HOST,
@@ -70,6 +71,8 @@ enum engineOptions : unsigned int
 	OPTION_LOGGING_FILE,
 	OPTION_LOGGING_FILE_SIZELIMIT,
 	OPTION_LOGGING_SHOW_DETAILED_LOGS,
+	OPTION_TRACE_FILE,
+	OPTION_METRICS_SOCKET,
 
 	OPTION_SIZE_FORMAT,
 	OPTION_SIZE_USETHOUSANDSEP,
@@ -79,6 +82,9 @@ enum engineOptions : unsigned int
 
 	OPTION_CACHE_TTL,
 
+	OPTION_HTTP_PIPELINING,
+	OPTION_HTTP_IDLE_CONNECTIONS,
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -0,0 +1,141 @@
+#ifndef FILEZILLA_ENGINE_FILE_HASH_HEADER
+#define FILEZILLA_ENGINE_FILE_HASH_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include "visibility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Hash algorithms servers can report through the various checksum commands
+enum class file_hash_algorithm
+{
+	none,
+	crc32,
+	md5,
+	sha1,
+	sha256,
+	sha512
+};
+
+// Name as used in the FTP HASH command, e.g. SHA-256
+std::wstring FZC_PUBLIC_SYMBOL file_hash_algorithm_name(file_hash_algorithm alg);
+file_hash_algorithm FZC_PUBLIC_SYMBOL file_hash_algorithm_from_name(std::wstring_view const& name);
+
+// Length of the hex-encoded digest
+size_t FZC_PUBLIC_SYMBOL file_hash_length(file_hash_algorithm alg);
+
+// Computes the hash of a local file in lowercase hex.
+// Returns an empty string on error or if aborted.
+std::string FZC_PUBLIC_SYMBOL hash_local_file(std::wstring const& file, file_hash_algorithm alg, std::atomic<bool> const* abort = nullptr);
+
+// Hashes the first total bytes of a local file in chunks of chunk_size bytes,
+// on_chunk gets called with the hash of each chunk and can return false to
+// stop early. Returns false on error, if aborted or if the file is too short.
+bool FZC_PUBLIC_SYMBOL hash_local_file_chunks(std::wstring const& file, file_hash_algorithm alg, int64_t chunk_size, int64_t total
+	, std::function<bool(std::string && hash)> const& on_chunk, std::atomic<bool> const* abort = nullptr);
+
+// Splits the first size bytes of a file into the chunks that get compared
+// when uploading only the changed remainder of a file. Chunks are at least
+// 1 MiB large, their number is limited to keep the number of round trips low.
+class FZC_PUBLIC_SYMBOL file_hash_chunks final
+{
+public:
+	explicit file_hash_chunks(int64_t size);
+
+	int64_t size() const { return size_; }
+	int64_t chunk_size() const { return chunk_size_; }
+	int64_t count() const { return count_; }
+
+	// Offsets of the first and last byte of a chunk, as expected by RANG
+	int64_t first(int64_t chunk) const { return chunk * chunk_size_; }
+	int64_t last(int64_t chunk) const { return std::min(first(chunk) + chunk_size_, size_) - 1; }
+
+	// Number of bytes covered by the given number of leading chunks
+	int64_t covered(int64_t chunks) const { return std::min(chunks * chunk_size_, size_); }
+
+private:
+	int64_t size_{};
+	int64_t chunk_size_{};
+	int64_t count_{};
+};
+
+// Offset from which a local file needs to be uploaded if its first common
+// bytes are identical to the remote file. Without REST STREAM, the remote
+// file can only be appended to. Returns -1 if the entire file needs to be
+// uploaded.
+int64_t FZC_PUBLIC_SYMBOL delta_upload_offset(int64_t common, int64_t remote_size, bool rest_stream);
+
+// Number of leading bytes covered by the chunks whose local and remote hashes
+// are identical. remote_hash gets called for one chunk after the other until
+// the first mismatch, it returns an empty string if the hash of a chunk is
+// not known yet.
+int64_t FZC_PUBLIC_SYMBOL common_prefix(file_hash_chunks const& chunks, std::vector<std::string> const& local_hashes
+	, std::function<std::string(int64_t chunk)> const& remote_hash);
+
+// Persistent storage behind local_hash_cache. Gets called from any thread.
+class FZC_PUBLIC_SYMBOL local_hash_store
+{
+public:
+	virtual ~local_hash_store() = default;
+
+	virtual std::string lookup(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime) = 0;
+	virtual void store(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash) = 0;
+};
+
+// Remembers the hashes of local files. Entries are only returned as long as
+// size and modification time of the file are unchanged.
+class FZC_PUBLIC_SYMBOL local_hash_cache final
+{
+public:
+	explicit local_hash_cache(size_t max_entries = 100000);
+
+	// The store, if any, is consulted on misses and receives all new entries.
+	// It needs to be reset before it gets destroyed.
+	void set_store(local_hash_store* store);
+
+	std::string lookup(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime);
+	void store(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash);
+
+	void clear();
+
+private:
+	void insert(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash);
+
+	typedef std::tuple<std::wstring, file_hash_algorithm> key_type;
+
+	struct key_hash final
+	{
+		size_t operator()(key_type const& k) const noexcept {
+			return std::hash<std::wstring>()(std::get<0>(k)) ^ static_cast<size_t>(std::get<1>(k));
+		}
+	};
+
+	struct entry final
+	{
+		int64_t size{-1};
+		fz::datetime mtime;
+		std::string hash;
+		std::list<key_type>::iterator lru;
+	};
+
+	fz::mutex mtx_;
+	size_t const max_entries_;
+	std::unordered_map<key_type, entry, key_hash> entries_;
+
+	// Most recently used first
+	std::list<key_type> lru_;
+
+	fz::mutex store_mtx_;
+	local_hash_store* store_{};
+};
+
+#endif
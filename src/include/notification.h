@@ -36,7 +36,8 @@ enum NotificationId
 	nId_sftp_encryption,	// information about key exchange, encryption algorithms and so on for SFTP
 	nId_local_dir_created,	// local directory has been created
 	nId_serverchange,		// With some protocols, actual server identity isn't known until after logon
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_transfer_telemetry	// where a finished transfer spent its time
 };
 
 // Async request IDs
@@ -178,6 +179,7 @@ public:
 		resume, // Overwrites if cannot be resumed
 		rename,
 		skip,
+		overwriteIfDifferent, // Overwrite unless size and checksum match. Falls back to overwriteSizeOrNewer if server doesn't do checksums
 
 		ACTION_COUNT
 	};
@@ -268,6 +270,57 @@ protected:
 	CTransferStatus const status_;
 };
 
+// Where a transfer spent its time. Waits overlap, e.g. while the transfer
+// waits for the disk, the socket might be waiting as well.
+class FZC_PUBLIC_SYMBOL CTransferTelemetry final
+{
+public:
+	enum stage
+	{
+		// The transfer waited for the local file reader or writer
+		disk,
+
+		// The data connection would block. Includes the speed limit and TLS.
+		network,
+
+		// The local file reader or writer waited for the transfer, i.e.
+		// the data connection on FTP or fzsftp on SFTP.
+		peer,
+
+		stage_count
+	};
+
+	static constexpr size_t occupancy_buckets = 9;
+
+	fz::duration duration;
+
+	// Time spent in each stage
+	fz::duration wait[stage_count];
+
+	// Time spent in the reads or writes of the local file
+	fz::duration disk_io;
+
+	// Calls reading or writing the local file and the data connection
+	uint64_t disk_calls{};
+	uint64_t network_calls{};
+
+	int64_t bytes{};
+
+	// Number of buffers filled and waiting each time the transfer took or
+	// handed over a buffer, from empty to full.
+	uint64_t occupancy[occupancy_buckets]{};
+};
+
+class FZC_PUBLIC_SYMBOL CTransferTelemetryNotification final : public CNotificationHelper<nId_transfer_telemetry>
+{
+public:
+	explicit CTransferTelemetryNotification(CTransferTelemetry const& telemetry)
+		: telemetry_(telemetry)
+	{}
+
+	CTransferTelemetry const telemetry_;
+};
+
 class FZC_PUBLIC_SYMBOL CSftpEncryptionDetails
 {
 public:
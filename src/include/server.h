@@ -107,7 +107,8 @@ enum class ProtocolFeature
 	ServerAssignedHome,
 	TemporaryUrl,
 	Security, // Encryption, integrity protection and authentication
-	UnixChmod
+	UnixChmod,
+	SegmentedDownload // Large files can be downloaded in ranges over multiple connections in parallel
 };
 
 enum class CaseSensitivity
@@ -4,17 +4,31 @@
 #include "server.h"
 
 #include <libfilezilla/optional.hpp>
-#include <libfilezilla/shared.hpp>
 
+#include <functional>
+#include <memory>
 #include <vector>
 
+// Paths are interned in a global trie: equal paths share the same node.
+// Nodes are keyed by their parent node and their last segment, the roots
+// of the trie carry the prefix.
 class FZC_PUBLIC_SYMBOL CServerPathData final
 {
 public:
-	std::vector<std::wstring> m_segments;
+	// Empty on roots
+	std::shared_ptr<CServerPathData const> m_parent;
+	CServerPathData const* m_root{};
+
+	// Last segment, empty on roots
+	std::wstring m_segment;
+
+	// Only set on roots
 	fz::sparse_optional<std::wstring> m_prefix;
 
-	bool operator==(const CServerPathData& cmp) const;
+	// Number of segments
+	size_t m_depth{};
+
+	size_t m_hash{};
 };
 
 class FZC_PUBLIC_SYMBOL CServerPath final
@@ -76,6 +90,9 @@ public:
 
 	size_t SegmentCount() const;
 
+	// Equal paths share their data, this does not look at the segments.
+	size_t hash() const;
+
 	static CServerPath GetChanged(CServerPath const& oldPath, CServerPath const& newPath, std::wstring const& newSubdir);
 private:
 	bool FZC_PRIVATE_SYMBOL IsSeparator(wchar_t c) const;
@@ -91,8 +108,23 @@ private:
 	bool FZC_PRIVATE_SYMBOL SegmentizeAddSegment(std::wstring & segment, tSegmentList& segments, bool& append);
 	bool FZC_PRIVATE_SYMBOL ExtractFile(std::wstring& dir, std::wstring& file);
 
-	fz::shared_optional<CServerPathData> m_data;
+	tSegmentList FZC_PRIVATE_SYMBOL GetSegments() const;
+	fz::sparse_optional<std::wstring> const& FZC_PRIVATE_SYMBOL GetPrefix() const;
+	void FZC_PRIVATE_SYMBOL Assign(fz::sparse_optional<std::wstring> const& prefix, tSegmentList const& segments);
+
+	std::shared_ptr<CServerPathData const> m_data;
 	ServerType m_type;
 };
 
+namespace std {
+template<>
+struct hash<CServerPath>
+{
+	size_t operator()(CServerPath const& path) const noexcept
+	{
+		return path.hash();
+	}
+};
+}
+
 #endif
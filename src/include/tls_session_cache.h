@@ -0,0 +1,70 @@
+#ifndef FILEZILLA_ENGINE_TLS_SESSION_CACHE_HEADER
+#define FILEZILLA_ENGINE_TLS_SESSION_CACHE_HEADER
+
+#include "visibility.h"
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Persistent storage behind tls_session_cache. Gets called from any thread.
+class FZC_PUBLIC_SYMBOL tls_session_store
+{
+public:
+	virtual ~tls_session_store() = default;
+
+	virtual std::vector<uint8_t> lookup(std::string const& host, unsigned short port) = 0;
+	virtual void store(std::string const& host, unsigned short port, std::vector<uint8_t> const& session) = 0;
+	virtual void remove(std::string const& host, unsigned short port) = 0;
+};
+
+// Remembers the TLS session parameters of connections so that later
+// connections to the same server, by any engine, can resume the session
+// instead of doing a full handshake.
+class FZC_PUBLIC_SYMBOL tls_session_cache final
+{
+public:
+	explicit tls_session_cache(size_t max_entries = 1000);
+
+	// The store, if any, is consulted on misses and receives all new entries.
+	// It needs to be reset before it gets destroyed.
+	void set_store(tls_session_store* store);
+
+	// Returns an empty vector if there is no usable session
+	std::vector<uint8_t> lookup(std::string const& host, unsigned short port);
+	void store(std::string const& host, unsigned short port, std::vector<uint8_t> const& session);
+	void remove(std::string const& host, unsigned short port);
+
+	// Servers limit the lifetime of their tickets, older sessions are not
+	// worth trying.
+	static fz::duration max_age() { return fz::duration::from_hours(24); }
+
+private:
+	void insert(std::string const& host, unsigned short port, std::vector<uint8_t> const& session);
+
+	typedef std::tuple<std::string, unsigned short> key_type;
+
+	struct entry final
+	{
+		fz::monotonic_clock time;
+		std::vector<uint8_t> session;
+		std::list<key_type>::iterator lru;
+	};
+
+	fz::mutex mtx_;
+	size_t const max_entries_;
+	std::map<key_type, entry> entries_;
+
+	// Most recently used first
+	std::list<key_type> lru_;
+
+	fz::mutex store_mtx_;
+	tls_session_store* store_{};
+};
+
+#endif
@@ -8,6 +8,8 @@
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/thread_pool.hpp>
 
+#include <atomic>
+
 class writer_base;
 
 struct write_ready_event_type{};
@@ -36,6 +38,17 @@ public:
 	virtual fz::datetime mtime() const { return fz::datetime(); }
 	virtual bool set_mtime(fz::datetime const&) { return false; }
 
+	// For writers only covering a range of the target, e.g. a segment
+	// of a segmented download, the offset past the end of the range.
+	virtual uint64_t range_end() const { return npos; }
+
+	// The offset at which the range starts.
+	virtual uint64_t range_start() const { return npos; }
+
+	// Lets a writer covering a range write on past the end of its range,
+	// up to the end of the target. Returns false if there is no range.
+	virtual bool extend_range() { return false; }
+
 protected:
 	writer_factory() = default;
 	writer_factory(writer_factory const&) = default;
@@ -71,6 +84,9 @@ public:
 	uint64_t size() const {	return impl_ ? impl_->size() : aio_base::nosize; }
 	fz::datetime mtime() const { return impl_ ? impl_->mtime() : fz::datetime(); }
 	bool set_mtime(fz::datetime const& t) { return impl_ ? impl_->set_mtime(t) : false; }
+	uint64_t range_end() const { return impl_ ? impl_->range_end() : npos; }
+	uint64_t range_start() const { return impl_ ? impl_->range_start() : npos; }
+	bool extend_range() { return impl_ ? impl_->extend_range() : false; }
 
 	explicit operator bool() const { return impl_.operator bool(); }
 
@@ -83,6 +99,13 @@ class FZC_PUBLIC_SYMBOL file_writer_factory final : public writer_factory
 public:
 	file_writer_factory(std::wstring const& file, bool fsync = false);
 
+	// Writes only the range [start, end) of an existing, preallocated file.
+	// Data past the end of the range is discarded, the file is neither
+	// truncated nor deleted.
+	// size() returns the position up to which the range has been written,
+	// it is shared among all clones of the factory and the writers they open.
+	file_writer_factory(std::wstring const& file, uint64_t start, uint64_t end, bool fsync = false);
+
 	virtual std::unique_ptr<writer_base> open(uint64_t offset, CFileZillaEnginePrivate & engine, fz::event_handler * handler, aio_base::shm_flag shm, bool update_transfer_status = true) override;
 	virtual std::unique_ptr<writer_factory> clone() const override;
 
@@ -91,7 +114,16 @@ public:
 
 	virtual bool set_mtime(fz::datetime const&) override;
 
+	virtual uint64_t range_end() const override { return range_end_; }
+	virtual uint64_t range_start() const override { return range_start_; }
+	virtual bool extend_range() override;
+
 	bool fsync_{};
+
+private:
+	uint64_t range_start_{npos};
+	uint64_t range_end_{npos};
+	std::shared_ptr<std::atomic<uint64_t>> range_position_;
 };
 
 
@@ -158,6 +190,11 @@ private:
 	bool from_beginning_{};
 	bool fsync_{};
 	bool preallocated_{};
+
+	// Only set if writing a range
+	uint64_t range_end_{nosize};
+	uint64_t range_offset_{};
+	std::shared_ptr<std::atomic<uint64_t>> range_position_;
 };
 
 namespace fz {
@@ -278,6 +278,7 @@ CLocalListView::CLocalListView(CView* pParent, CState& state, CQueueView *pQueue
 	m_parentView(pParent)
 {
 	wxGetApp().AddStartupProfileRecord("CLocalListView::CLocalListView");
+	m_sortPool = &state.pool_;
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_DIR);
 	m_state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_REFRESH_FILE);
@@ -930,6 +931,10 @@ void CLocalListView::OnMenuUpload(wxCommandEvent& event)
 		}
 
 		if (data->dir) {
+			if (m_pQueue->QueueArchive(queue_only, false, data->name, m_dir, remotePath, site)) {
+				added = true;
+				continue;
+			}
 			CLocalPath localPath = m_dir;
 			if (!localPath.ChangePath(data->name)) {
 				continue;
@@ -1173,6 +1178,7 @@ bool CLocalListView::OnAcceptRename(const wxListEvent& event)
 	}
 
 	data->name = newname;
+	data->sortKey.clear();
 #ifdef __WXMSW__
 	data->label.clear();
 #endif
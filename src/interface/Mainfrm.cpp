@@ -21,6 +21,7 @@
 #include "import.h"
 #include "inputdialog.h"
 #include "list_search_panel.h"
+#include "local_hash_index.h"
 #include "local_recursive_operation.h"
 #include "LocalListView.h"
 #include "LocalTreeView.h"
@@ -43,6 +44,7 @@
 #include "StatusView.h"
 #include "state.h"
 #include "themeprovider.h"
+#include "tls_session_store.h"
 #include "toolbar.h"
 #include "update_dialog.h"
 #include "updater.h"
@@ -363,6 +365,17 @@ CMainFrame::CMainFrame()
 	, m_comparisonToggleAcceleratorId(wxNewId())
 {
 	wxGetApp().AddStartupProfileRecord("CMainFrame::CMainFrame");
+
+	m_localHashIndex = std::make_unique<CLocalHashIndex>(m_engineContext.GetThreadPool());
+	m_engineContext.GetLocalHashCache().set_store(m_localHashIndex.get());
+
+	// Kiosk mode does not keep secrets across sessions
+	if (!COptions::Get()->get_int(OPTION_DEFAULT_KIOSKMODE)) {
+		m_tlsSessionStore = std::make_unique<CTlsSessionStore>();
+		m_engineContext.GetTlsSessionCache().set_store(m_tlsSessionStore.get());
+		CLoginManager::SetTlsSessionStore(m_tlsSessionStore.get());
+	}
+
 	wxRect screen_size = CWindowStateManager::GetScreenDimensions();
 
 	wxSize initial_size;
@@ -571,6 +584,13 @@ CMainFrame::~CMainFrame()
 #ifndef __WXMAC__
 	delete m_taskBarIcon;
 #endif
+
+	m_engineContext.GetLocalHashCache().set_store(nullptr);
+	m_localHashIndex.reset();
+
+	CLoginManager::SetTlsSessionStore(nullptr);
+	m_engineContext.GetTlsSessionCache().set_store(nullptr);
+	m_tlsSessionStore.reset();
 }
 
 void CMainFrame::HandleResize()
@@ -21,6 +21,7 @@
 class CAsyncRequestQueue;
 class CContextControl;
 class CertStore;
+class CLocalHashIndex;
 class CMainFrameStateEventHandler;
 class CMenuBar;
 class CQueue;
@@ -30,6 +31,7 @@ class Site;
 class CSplitterWindowEx;
 class CStatusView;
 class CState;
+class CTlsSessionStore;
 class CToolBar;
 class CWindowStateManager;
 
@@ -82,6 +84,8 @@ private:
 	void FocusNextEnabled(std::list<wxWindow*>& windowOrder, std::list<wxWindow*>::iterator iter, bool skipFirst, bool forward);
 
 	CFileZillaEngineContext m_engineContext;
+	std::unique_ptr<CLocalHashIndex> m_localHashIndex;
+	std::unique_ptr<CTlsSessionStore> m_tlsSessionStore;
 
 	CStatusBar* m_pStatusBar{};
 	CMenuBar* m_pMenuBar{};
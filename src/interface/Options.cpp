@@ -76,8 +76,8 @@ unsigned int register_interface_options()
 		{ "Update Check New Version", L"", option_flags::platform },
 		{ "Update Check Check Beta", 0, option_flags::normal, 0, 2 },
 		{ "Show debug menu", false, option_flags::normal },
-		{ "File exists action download", 0, option_flags::normal, 0, 7 },
-		{ "File exists action upload", 0, option_flags::normal, 0, 7 },
+		{ "File exists action download", 0, option_flags::normal, 0, 8 },
+		{ "File exists action upload", 0, option_flags::normal, 0, 8 },
 		{ "Allow ascii resume", false, option_flags::normal },
 		{ "Greeting version", L"", option_flags::normal },
 		{ "Greeting resources", L"", option_flags::normal },
@@ -148,7 +148,10 @@ unsigned int register_interface_options()
 		{ "Disable update footer", false, option_flags::normal },
 		{ "Master password encryptor", L"", option_flags::normal },
 		{ "Tab data", L"", option_flags::normal | option_flags::sensitive_data, option_type::xml },
-		{ "Highest shown overlay id", 0, option_flags::normal }
+		{ "Highest shown overlay id", 0, option_flags::normal },
+		{ "Segmented download parts", 1, option_flags::numeric_clamp, 1, 10 },
+		{ "Segmented download threshold", 256, option_flags::numeric_clamp, 1, 1024 * 1024 }, // In MiB
+		{ "Recursive listing connections", 1, option_flags::numeric_clamp, 1, 10 }
 	});
 	return value;
 }
@@ -102,6 +102,9 @@ enum interfaceOptions
 	OPTION_MASTERPASSWORDENCRYPTOR,
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
+	OPTION_SEGMENTED_DOWNLOAD_PARTS,
+	OPTION_SEGMENTED_DOWNLOAD_THRESHOLD,
+	OPTION_RECURSIVE_LIST_CONNECTIONS,
 
 	// Has to be last element
 	OPTIONS_NUM
@@ -7,6 +7,7 @@
 #include "xmlfunctions.h"
 #include "filezillaapp.h"
 #include "file_utils.h"
+#include "filter_manager.h"
 #include "local_recursive_operation.h"
 #include "state.h"
 #include "asyncrequestqueue.h"
@@ -26,7 +27,9 @@
 #include "../commonui/cert_store.h"
 #include "../commonui/ipcmutex.h"
 
+#include <libfilezilla/file.hpp>
 #include <libfilezilla/glue/wxinvoker.hpp>
+#include <libfilezilla/local_filesys.hpp>
 
 #if WITH_LIBDBUS
 #include "../dbus/desktop_notification.h"
@@ -314,6 +317,36 @@ bool CQueueView::QueueFile(bool const queueOnly, bool const download,
 	return true;
 }
 
+bool CQueueView::QueueArchive(bool const queueOnly, bool const download, std::wstring const& name,
+	CLocalPath const& localParent, CServerPath const& remoteParent, Site const& site)
+{
+	if (site.server.GetProtocol() != SFTP || !COptions::Get()->get_int(OPTION_SFTP_ARCHIVE_TRANSFERS)) {
+		return false;
+	}
+
+	// The archive is produced and unpacked as a whole, filters cannot be applied
+	if (CFilterManager::HasActiveFilters()) {
+		return false;
+	}
+
+	transfer_flags flags = sftp_transfer_flags::archive;
+	if (download) {
+		flags |= transfer_flags::download;
+	}
+	if (queueOnly) {
+		flags |= queue_flags::queued;
+	}
+
+	std::wstring localName = download ? ReplaceInvalidCharacters(name) : name;
+	std::wstring targetName = (localName == name) ? std::wstring() : localName;
+
+	CServerItem* pServerItem = CreateServerItem(site);
+	CFileItem* fileItem = new CFileItem(pServerItem, flags, name, targetName, localParent, remoteParent, -1);
+	InsertItem(pServerItem, fileItem);
+
+	return true;
+}
+
 void CQueueView::QueueFile_Finish(const bool start)
 {
 	bool need_refresh = false;
@@ -605,6 +638,71 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 	return true;
 }
 
+void CQueueView::SplitIntoSegments(CServerItem* pServerItem, CFileItem* fileItem)
+{
+	if (!fileItem->Download() || fileItem->segment() || fileItem->m_edit != CEditHandler::none) {
+		return;
+	}
+
+	Site const& site = pServerItem->GetSite();
+	if (!site.server.HasFeature(ProtocolFeature::SegmentedDownload)) {
+		return;
+	}
+	if (site.server.HasFeature(ProtocolFeature::DataTypeConcept) && (fileItem->flags() & ftp_transfer_flags::ascii)) {
+		return;
+	}
+
+	int const parts = COptions::Get()->get_int(OPTION_SEGMENTED_DOWNLOAD_PARTS);
+	if (parts < 2) {
+		return;
+	}
+
+	int64_t const size = fileItem->GetSize();
+	int64_t const threshold = static_cast<int64_t>(COptions::Get()->get_int(OPTION_SEGMENTED_DOWNLOAD_THRESHOLD)) * 1024 * 1024;
+	if (size <= 0 || size < threshold) {
+		return;
+	}
+
+	// Only new files get split. Existing files go through the regular
+	// file exists handling.
+	std::wstring const localFile = fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile();
+	if (fz::local_filesys::get_file_type(fz::to_native(localFile)) != fz::local_filesys::unknown) {
+		return;
+	}
+
+	// Allocate the target once, the segments then only write into their range of it.
+	wxFileName::Mkdir(fileItem->GetLocalPath().GetPath(), 0777, wxPATH_MKDIR_FULL);
+	{
+		fz::file f(fz::to_native(localFile), fz::file::writing, fz::file::empty);
+		if (!f.opened() || f.seek(size, fz::file::begin) != size || !f.truncate()) {
+			f.close();
+			fz::remove_file(fz::to_native(localFile));
+			return;
+		}
+	}
+
+	uint64_t const segmentSize = (static_cast<uint64_t>(size) + parts - 1) / parts;
+
+	fileItem->SetSegment(0, segmentSize);
+	UpdateItemSize(fileItem, static_cast<int64_t>(segmentSize));
+
+	transfer_flags flags = fileItem->flags() - queue_flags::mask;
+	if (fileItem->queued()) {
+		flags |= queue_flags::queued;
+	}
+	auto const& targetFile = fileItem->GetTargetFile();
+	for (uint64_t start = segmentSize; start < static_cast<uint64_t>(size); start += segmentSize) {
+		uint64_t const end = std::min(start + segmentSize, static_cast<uint64_t>(size));
+		CFileItem* segmentItem = new CFileItem(pServerItem, flags, fileItem->GetSourceFile(), targetFile ? *targetFile : std::wstring(),
+			fileItem->GetLocalPath(), fileItem->GetRemotePath(), static_cast<int64_t>(end - start));
+		segmentItem->SetSegment(start, end);
+		segmentItem->SetPriorityRaw(fileItem->GetPriority());
+		segmentItem->m_defaultFileExistsAction = fileItem->m_defaultFileExistsAction;
+		InsertItem(pServerItem, segmentItem);
+	}
+	CommitChanges();
+}
+
 bool CQueueView::TryStartNextTransfer()
 {
 	if (m_quit || !m_activeMode) {
@@ -706,6 +804,10 @@ bool CQueueView::TryStartNextTransfer()
 		}
 	}
 
+	if (bestMatch.fileItem->GetType() == QueueItemType::File) {
+		SplitIntoSegments(bestMatch.serverItem, bestMatch.fileItem);
+	}
+
 	// Now we have both inactive engine and file.
 	// Assign the file to the engine.
 
@@ -1008,6 +1110,7 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 			SaveSetItemCount(m_itemCount);
 
 			CFileItem* const pFileItem = (CFileItem*)data.pItem;
+			pFileItem->UpdateSegmentProgress();
 			if (pFileItem->Download()) {
 				const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
 				for (auto *pState : *pStates) {
@@ -1269,6 +1372,11 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags());
 				res = engineData.pEngine->Execute(cmd);
 			}
+			else if (fileItem->segment()) {
+				auto cmd = CFileTransferCommand(fileItem->GetSegmentWriter(),
+					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags());
+				res = engineData.pEngine->Execute(cmd);
+			}
 			else {
 				auto cmd = CFileTransferCommand(file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile()),
 					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags());
@@ -1703,6 +1811,12 @@ void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 						previousLocalPath, previousRemotePath, size);
 					fileItem->SetPriorityRaw(QueuePriority(priority));
 					fileItem->m_errorCount = errorCount;
+
+					int64_t const segmentStart = GetTextElementInt(file, "SegmentStart", -1);
+					int64_t const segmentEnd = GetTextElementInt(file, "SegmentEnd", -1);
+					if ((flags & transfer_flags::download) && segmentStart >= 0 && segmentEnd >= segmentStart) {
+						fileItem->SetSegment(static_cast<uint64_t>(segmentStart), static_cast<uint64_t>(segmentEnd));
+					}
 					InsertItem(pServerItem, fileItem);
 
 					if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT) {
@@ -124,6 +124,12 @@ public:
 		QueuePriority priority = QueuePriority::normal);
 
 	void QueueFile_Finish(const bool start); // Need to be called after QueueFile
+
+	// Queues the directory name as a single archive transfer if the site and
+	// settings allow it. Returns false otherwise, the caller then has to fall
+	// back to a recursive transfer. Needs QueueFile_Finish as well.
+	bool QueueArchive(bool const queueOnly, bool const download, std::wstring const& name,
+		CLocalPath const& localParent, CServerPath const& remoteParent, Site const& site);
 	bool QueueFiles(const bool queueOnly, CLocalPath const& localPath, const CRemoteDataObject& dataObject);
 	bool QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing);
 
@@ -169,6 +175,10 @@ protected:
 	// whether it is allowed to start another transfer on that server item
 	bool CanStartTransfer(const CServerItem& server_item, t_EngineData *&pEngineData);
 
+	// Splits large downloads into segments which can be
+	// transferred in parallel over multiple connections.
+	void SplitIntoSegments(CServerItem* pServerItem, CFileItem* fileItem);
+
 	void ProcessReply(t_EngineData* pEngineData, COperationNotification const& notification);
 	void SendNextCommand(t_EngineData& engineData);
 
@@ -25,6 +25,8 @@
 #include <wx/menu.h>
 
 #include <algorithm>
+#include <iterator>
+#include <numeric>
 
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
@@ -326,6 +328,7 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
 	state.RegisterHandler(this, STATECHANGE_SERVER);
 
+	m_sortPool = &state.pool_;
 	m_dropTarget = -1;
 
 	m_pInfoText = new CInfoText(*this);
@@ -676,6 +679,192 @@ bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing>
 	return true;
 }
 
+bool CRemoteListView::UpdateDirectoryListing_Diff(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+{
+	assert(!IsComparing());
+
+	CDirectoryListing const& oldListing = *m_pDirectoryListing;
+	CDirectoryListing const& newListing = *pDirectoryListing;
+
+	if (m_fileData.size() != oldListing.size() + 1 || m_indexMapping.empty()) {
+		return false;
+	}
+
+	auto const orderByName = [](CDirectoryListing const& listing) {
+		std::vector<unsigned int> order(listing.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&listing](unsigned int a, unsigned int b) {
+			return listing[a].name < listing[b].name;
+		});
+		return order;
+	};
+	std::vector<unsigned int> const oldOrder = orderByName(oldListing);
+	std::vector<unsigned int> const newOrder = orderByName(newListing);
+
+	// Merge both, pairing up unchanged entries. Changed entries count as removed and added.
+	unsigned int const none = static_cast<unsigned int>(-1);
+	std::vector<unsigned int> oldToNew(oldListing.size(), none);
+	std::vector<unsigned int> newToOld(newListing.size(), none);
+	size_t unchanged{};
+	size_t i = 0;
+	size_t j = 0;
+	while (i < oldOrder.size() && j < newOrder.size()) {
+		CDirentry const& oldEntry = oldListing[oldOrder[i]];
+		CDirentry const& newEntry = newListing[newOrder[j]];
+		int const cmp = oldEntry.name.compare(newEntry.name);
+		if (cmp < 0) {
+			++i;
+		}
+		else if (cmp > 0) {
+			++j;
+		}
+		else {
+			if ((i + 1 < oldOrder.size() && oldListing[oldOrder[i + 1]].name == oldEntry.name) ||
+				(j + 1 < newOrder.size() && newListing[newOrder[j + 1]].name == newEntry.name))
+			{
+				// Ambiguous names
+				return false;
+			}
+			if (oldEntry == newEntry) {
+				oldToNew[oldOrder[i]] = newOrder[j];
+				newToOld[newOrder[j]] = oldOrder[i];
+				++unchanged;
+			}
+			++i;
+			++j;
+		}
+	}
+
+	// Rebuilding is cheaper if most of the listing changed
+	size_t const added = newListing.size() - unchanged;
+	size_t const removed = oldListing.size() - unchanged;
+	if ((added + removed) * 2 > newListing.size()) {
+		return false;
+	}
+
+	std::wstring prevFocused;
+	int focusedItem = -1;
+	std::vector<std::wstring> selectedNames = RememberSelectedItems(prevFocused, focusedItem);
+
+	// Keep whichever entry is at the top of the view at the top
+	unsigned int topIndex = none;
+	int const topItem = GetTopItem();
+	if (topItem > 0 && static_cast<size_t>(topItem) < m_indexMapping.size()) {
+		topIndex = oldToNew[m_indexMapping[topItem]];
+	}
+
+	if (m_dropTarget != -1) {
+		if (m_dropTarget < GetItemCount()) {
+			SetItemState(m_dropTarget, 0, wxLIST_STATE_DROPHILITED);
+		}
+		m_dropTarget = -1;
+	}
+
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->UnselectAll();
+	}
+
+	// Move cached data of unchanged entries over
+	std::vector<CGenericFileData> fileData;
+	fileData.reserve(newListing.size() + 1);
+	for (size_t n = 0; n < newListing.size(); ++n) {
+		if (newToOld[n] != none) {
+			fileData.emplace_back(std::move(m_fileData[newToOld[n]]));
+		}
+		else {
+			CGenericFileData data;
+			CDirentry const& entry = newListing[n];
+			if (entry.is_dir()) {
+				data.icon = m_dirIcon;
+#ifndef __WXMSW__
+				if (entry.is_link()) {
+					data.icon += 3;
+				}
+#endif
+			}
+			fileData.emplace_back(std::move(data));
+		}
+	}
+	fileData.emplace_back(std::move(m_fileData.back()));
+
+	// Unchanged items keep both their visibility and relative order
+	std::vector<unsigned int> kept;
+	kept.reserve(m_indexMapping.size());
+	kept.push_back(newListing.size());
+	for (size_t item = 1; item < m_indexMapping.size(); ++item) {
+		unsigned int const index = oldToNew[m_indexMapping[item]];
+		if (index != none) {
+			kept.push_back(index);
+		}
+	}
+
+	m_pDirectoryListing = pDirectoryListing;
+	m_fileData.swap(fileData);
+
+	CFilterManager const& filter = m_state.GetStateFilterManager();
+	std::wstring const path = newListing.path.GetPath();
+	std::vector<unsigned int> addedIndexes;
+	for (size_t n = 0; n < newListing.size(); ++n) {
+		if (newToOld[n] != none) {
+			continue;
+		}
+		CDirentry const& entry = newListing[n];
+		if (!filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time)) {
+			addedIndexes.push_back(n);
+		}
+	}
+
+	std::unique_ptr<CFileListCtrlSortBase> compare = GetSortComparisonObject();
+	std::sort(addedIndexes.begin(), addedIndexes.end(), SortPredicate(compare));
+
+	m_indexMapping.clear();
+	m_indexMapping.reserve(kept.size() + addedIndexes.size());
+	m_indexMapping.push_back(kept.front());
+	std::merge(kept.cbegin() + 1, kept.cend(), addedIndexes.cbegin(), addedIndexes.cend(), std::back_inserter(m_indexMapping), SortPredicate(compare));
+
+	int64_t totalSize{};
+	int unknown_sizes = 0;
+	int totalFileCount = 0;
+	int totalDirCount = 0;
+	for (size_t item = 1; item < m_indexMapping.size(); ++item) {
+		CDirentry const& entry = newListing[m_indexMapping[item]];
+		if (entry.is_dir()) {
+			++totalDirCount;
+		}
+		else {
+			if (entry.size == -1) {
+				++unknown_sizes;
+			}
+			else {
+				totalSize += entry.size;
+			}
+			++totalFileCount;
+		}
+	}
+	if (m_pFilelistStatusBar) {
+		m_pFilelistStatusBar->SetDirectoryContents(totalFileCount, totalDirCount, totalSize, unknown_sizes, newListing.size() + 1 - m_indexMapping.size());
+	}
+
+	bool const eraseBackground = static_cast<size_t>(GetItemCount()) > m_indexMapping.size();
+	if (static_cast<size_t>(GetItemCount()) != m_indexMapping.size()) {
+		SetItemCount(m_indexMapping.size());
+	}
+
+	SetInfoText();
+
+	if (topIndex != none) {
+		auto const it = std::find(m_indexMapping.cbegin() + 1, m_indexMapping.cend(), topIndex);
+		if (it != m_indexMapping.cend()) {
+			ScrollTopItem(it - m_indexMapping.cbegin());
+		}
+	}
+
+	ReselectItems(selectedNames, prevFocused, focusedItem, false);
+	RefreshListOnly(eraseBackground);
+
+	return true;
+}
+
 void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
 	CancelLabelEdit();
@@ -687,13 +876,11 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	else if (m_pDirectoryListing->path != pDirectoryListing->path) {
 		reset = true;
 	}
-	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
-		&& m_pDirectoryListing->size() > 200)
-	{
+	else if (!IsComparing() && m_pDirectoryListing->size() > 200) {
 		// Updated directory listing. Check if we can use process it in a different,
 		// more efficient way.
 		// Makes only sense for big listings though.
-		if (UpdateDirectoryListing(pDirectoryListing)) {
+		if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && UpdateDirectoryListing(pDirectoryListing)) {
 			wxASSERT(GetItemCount() == (int)m_indexMapping.size());
 			wxASSERT(GetItemCount() <= (int)m_fileData.size());
 			wxASSERT(GetItemCount() == (int)m_fileData.size() || CFilterManager::HasActiveFilters());
@@ -704,6 +891,11 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 
 			return;
 		}
+
+		// Refreshed listing, only apply the differences
+		if (UpdateDirectoryListing_Diff(pDirectoryListing)) {
+			return;
+		}
 	}
 
 	int focusedItem = -1;
@@ -1281,6 +1473,10 @@ void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool
 			if (!idle) {
 				continue;
 			}
+			if (!entry.is_link() && m_pQueue->QueueArchive(queue_only, true, name, local_parent, m_pDirectoryListing->path, site)) {
+				added = true;
+				continue;
+			}
 			CLocalPath local_path(local_parent);
 			local_path.AddSegment(CQueueView::ReplaceInvalidCharacters(name));
 			CServerPath remotePath = m_pDirectoryListing->path;
@@ -2566,7 +2762,7 @@ wxString CRemoteListView::GetItemText(int item, unsigned int column)
 
 std::unique_ptr<CFileListCtrlSortBase> CRemoteListView::GetSortComparisonObject()
 {
-	CFileListCtrlSort<CDirectoryListing>::DirSortMode dirSortMode = GetDirSortMode();
+	CFileListCtrlSortBase::DirSortMode dirSortMode = GetDirSortMode();
 	NameSortMode nameSortMode = GetNameSortMode();
 
 	CDirectoryListing const& directoryListing = *m_pDirectoryListing;
@@ -73,6 +73,7 @@ protected:
 	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	void UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+	bool UpdateDirectoryListing_Diff(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
 
 #ifdef __WXDEBUG__
 	void ValidateIndexMapping();
@@ -50,6 +50,7 @@ bool CDefaultFileExistsDlg::Load(wxWindow *parent, bool fromQueue, bool local, b
 			c->AppendString(_("Resume file transfer"));
 			c->AppendString(_("Rename file"));
 			c->AppendString(_("Skip file"));
+			c->AppendString(_("Overwrite file if size or checksum differs"));
 		};
 		if (local) {
 			inner->Add(new wxStaticText(box, nullID, _("&Downloads:")), lay.valign);
@@ -85,6 +85,7 @@ bool CFileExistsDlg::Create(wxWindow* parent)
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION2"), _("Overwrite &if source newer")));
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION7"), _("Overwrite if &different size")));
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION6"), _("Overwrite if different si&ze or source newer")));
+	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION8"), _("Overwrite if different size or chec&ksum")));
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION3"), _("&Resume")));
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION4"), _("Re&name")));
 	actions->Add(new wxRadioButton(box, XRCID("ID_ACTION5"), _("&Skip")));
@@ -259,6 +260,9 @@ void CFileExistsDlg::OnOK(wxCommandEvent&)
 	else if (xrc_call(*this, "ID_ACTION7", &wxRadioButton::GetValue)) {
 		m_action = CFileExistsNotification::overwriteSize;
 	}
+	else if (xrc_call(*this, "ID_ACTION8", &wxRadioButton::GetValue)) {
+		m_action = CFileExistsNotification::overwriteIfDifferent;
+	}
 	else {
 		m_action = CFileExistsNotification::overwrite;
 	}
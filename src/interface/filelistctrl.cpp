@@ -10,6 +10,10 @@
 #include "filelist_statusbar.h"
 #include "themeprovider.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <thread>
+
 #ifndef __WXMSW__
 #include <wx/mimetype.h>
 #endif
@@ -293,6 +297,54 @@ template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pPar
 #endif
 }
 
+namespace {
+// Smaller listings are sorted on the calling thread only
+size_t const parallel_sort_threshold = 20000;
+
+// Sorts chunks of the range in parallel, then merges them pairwise
+template<typename Iterator, typename Compare>
+void parallel_sort(fz::thread_pool& pool, Iterator const begin, Iterator const end, Compare const& cmp)
+{
+	size_t const chunks = std::clamp(static_cast<size_t>(std::thread::hardware_concurrency()), size_t(1), size_t(8));
+	size_t const size = end - begin;
+
+	std::vector<Iterator> bounds;
+	for (size_t i = 0; i <= chunks; ++i) {
+		bounds.push_back(begin + size * i / chunks);
+	}
+
+	std::vector<fz::async_task> tasks;
+	auto const run = [&](auto && f) {
+		tasks.emplace_back(pool.spawn(f));
+		if (!tasks.back()) {
+			tasks.pop_back();
+			f();
+		}
+	};
+	auto const join = [&]() {
+		for (auto & task : tasks) {
+			task.join();
+		}
+		tasks.clear();
+	};
+
+	for (size_t i = 0; i < chunks; ++i) {
+		run([&bounds, &cmp, i]() { std::sort(bounds[i], bounds[i + 1], cmp); });
+	}
+	join();
+
+	for (size_t width = 1; width < chunks; width *= 2) {
+		for (size_t i = 0; i + width < chunks; i += 2 * width) {
+			Iterator const first = bounds[i];
+			Iterator const middle = bounds[i + width];
+			Iterator const last = bounds[std::min(i + 2 * width, chunks)];
+			run([first, middle, last, &cmp]() { std::inplace_merge(first, middle, last, cmp); });
+		}
+		join();
+	}
+}
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=-1*/, int direction /*=-1*/, bool updateSelections /*=true*/)
 {
 	CancelLabelEdit();
@@ -392,7 +444,16 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 		++start;
 	}
 	std::unique_ptr<CFileListCtrlSortBase> object = GetSortComparisonObject();
-	std::sort(start, m_indexMapping.end(), SortPredicate(object));
+	if (m_sortPool && m_indexMapping.size() >= parallel_sort_threshold) {
+		// Fill in all cached sort data first so that comparisons do not modify anything
+		for (auto it = start; it != m_indexMapping.end(); ++it) {
+			object->Prepare(*it);
+		}
+		parallel_sort(*m_sortPool, start, m_indexMapping.end(), SortPredicate(object));
+	}
+	else {
+		std::sort(start, m_indexMapping.end(), SortPredicate(object));
+	}
 
 	if (updateSelections) {
 		SortList_UpdateSelections(selected, focused_item, focused_index);
@@ -688,17 +749,25 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 	RefreshListOnly();
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags)
+template<class CFileData> void CFileListCtrl<CFileData>::ApplyComparison(std::vector<unsigned char> const& flags)
 {
-	if (flags == fill) {
-		m_indexMapping.push_back(m_fileData.size() - 1);
-		return;
-	}
+	unsigned int const fillIndex = m_fileData.size() - 1;
 
-	int index = m_originalIndexMapping[m_comparisonIndex];
-	m_fileData[index].comparison_flags = flags;
+	m_indexMapping.reserve(flags.size());
 
-	m_indexMapping.push_back(index);
+	size_t pos = 0;
+	for (auto const flag : flags) {
+		if (flag == fill) {
+			m_indexMapping.push_back(fillIndex);
+			continue;
+		}
+
+		unsigned int const index = m_originalIndexMapping[pos++];
+		if (flag) {
+			m_fileData[index].comparison_flags = static_cast<t_fileEntryFlags>(flag);
+			m_indexMapping.push_back(index);
+		}
+	}
 }
 
 template<class CFileData> void CFileListCtrl<CFileData>::ComparisonRememberSelections()
@@ -9,6 +9,10 @@
 #include <deque>
 #include <memory>
 
+namespace fz {
+class thread_pool;
+}
+
 class CQueueView;
 class CFileListCtrl_SortComparisonObject;
 class CFilelistStatusBar;
@@ -25,6 +29,10 @@ public:
 	// t_fileEntryFlags is defined in listingcomparison.h as it will be used for
 	// both local and remote listings
 	CComparableListing::t_fileEntryFlags comparison_flags{CComparableListing::normal};
+
+	// Cached name sort key, see make_sort_key
+	std::wstring sortKey;
+	NameSortMode sortKeyMode{NameSortMode::case_sensitive};
 };
 
 class CFileListCtrlSortBase
@@ -44,6 +52,10 @@ public:
 	virtual bool operator()(int a, int b) const = 0;
 	virtual ~CFileListCtrlSortBase() {} // Without this empty destructor GCC complains
 
+	// Fills in cached data needed to compare the given item. Once all items
+	// to be sorted are prepared, the object can be used by multiple threads.
+	virtual void Prepare(unsigned int) const {}
+
 	#define CMP(f, data1, data2) \
 		{\
 			int res = this->f(data1, data2);\
@@ -175,16 +187,23 @@ inline int DoCmpName(value_type const& data1, value_type const& data2, NameSortM
 	}
 }
 
-template<typename Listing>
+template<typename Listing, typename DataEntry>
 class CFileListCtrlSort : public CFileListCtrlSortBase
 {
 public:
 	typedef Listing List;
 	typedef typename Listing::value_type value_type;
 
-	CFileListCtrlSort(Listing const& listing, DirSortMode dirSortMode, NameSortMode nameSortMode)
-		: m_listing(listing), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	CFileListCtrlSort(Listing const& listing, std::vector<DataEntry>& fileData, DirSortMode dirSortMode, NameSortMode nameSortMode)
+		: m_listing(listing), m_fileData(fileData), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	{
+	}
+
+	virtual void Prepare(unsigned int index) const override
 	{
+		if (m_nameSortMode != NameSortMode::case_sensitive) {
+			SortKey(index);
+		}
 	}
 
 	inline int CmpDir(value_type const& data1, value_type const& data2) const
@@ -231,10 +250,25 @@ public:
 		}
 	}
 
-	template<typename value_type>
-	inline int CmpName(value_type const& data1, value_type const& data2) const
+	inline int CmpName(int a, int b) const
+	{
+		if (m_nameSortMode != NameSortMode::case_sensitive) {
+			int const res = SortKey(a).compare(SortKey(b));
+			if (res) {
+				return res;
+			}
+		}
+		return DoCmpName(m_listing[a], m_listing[b], m_nameSortMode);
+	}
+
+	std::wstring const& SortKey(int index) const
 	{
-		return DoCmpName(data1, data2, m_nameSortMode);
+		DataEntry & data = m_fileData[index];
+		if (data.sortKeyMode != m_nameSortMode || data.sortKey.empty()) {
+			data.sortKey = make_sort_key(m_listing[index].name, m_nameSortMode);
+			data.sortKeyMode = m_nameSortMode;
+		}
+		return data.sortKey;
 	}
 
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
@@ -271,6 +305,7 @@ public:
 
 protected:
 	Listing const& m_listing;
+	std::vector<DataEntry>& m_fileData;
 
 	DirSortMode const m_dirSortMode;
 	NameSortMode const m_nameSortMode;
@@ -293,11 +328,11 @@ public:
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortName : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortName : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -308,16 +343,16 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortSize : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortSize : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -330,16 +365,16 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortType : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortType : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortType(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode), m_pListView(pListView), m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode), m_pListView(pListView)
 	{
 	}
 
@@ -350,31 +385,37 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
-		if (type1.fileType.empty()) {
-			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
-		}
-		if (type2.fileType.empty()) {
-			type2.fileType = m_pListView->GetType(data2.name, data2.is_dir());
-		}
+		CMP(CmpStringNoCase, Type(a), Type(b));
 
-		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
+		CMP_LESS(CmpName, a, b);
+	}
+
+	virtual void Prepare(unsigned int index) const override
+	{
+		CFileListCtrlSort<Listing, DataEntry>::Prepare(index);
+		Type(index);
+	}
 
-		CMP_LESS(CmpName, data1, data2);
+	std::wstring const& Type(int index) const
+	{
+		DataEntry & data = this->m_fileData[index];
+		if (data.fileType.empty()) {
+			typename Listing::value_type const& entry = this->m_listing[index];
+			data.fileType = m_pListView->GetType(entry.name, entry.is_dir());
+		}
+		return data.fileType;
 	}
 
 protected:
 	CFileListCtrl<DataEntry>* const m_pListView;
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortTime : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortTime : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -387,16 +428,16 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -409,16 +450,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
-	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -431,17 +472,16 @@ public:
 
 		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortPath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortPath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -457,18 +497,16 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
-class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing>
+class CFileListCtrlSortNamePath : public CFileListCtrlSort<Listing, DataEntry>
 {
 public:
 	CFileListCtrlSortNamePath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
-		, m_fileData(fileData)
+		: CFileListCtrlSort<Listing, DataEntry>(listing, fileData, dirSortMode, nameSortMode)
 	{
 	}
 
@@ -478,7 +516,7 @@ public:
 		typename Listing::value_type const& data2 = this->m_listing[b];
 
 		CMP(CmpDir, data1, data2);
-		CMP(CmpName, data1, data2);
+		CMP(CmpName, a, b);
 
 		if (data1.path < data2.path) {
 			return true;
@@ -487,9 +525,8 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
-	std::vector<DataEntry>& m_fileData;
 };
 
 namespace genericTypes {
@@ -533,6 +570,9 @@ protected:
 	int m_sortColumn{-1};
 	int m_sortDirection{};
 
+	// If set, large listings get sorted using multiple threads
+	fz::thread_pool* m_sortPool{};
+
 	void InitSort(interfaceOptions optionID); // Has to be called after initializing columns
 	void SortList(int column = -1, int direction = -1, bool updateSelections = true);
 	CFileListCtrlSortBase::DirSortMode GetDirSortMode();
@@ -546,7 +586,7 @@ protected:
 	virtual void ScrollTopItem(int item);
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
-	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual void ApplyComparison(std::vector<unsigned char> const& flags);
 
 	int m_comparisonIndex{-1};
 
@@ -17,6 +17,9 @@
 
 bool CFilterManager::m_loaded = false;
 filter_data CFilterManager::global_filters_;
+compiled_filters CFilterManager::compiled_local_filters_;
+compiled_filters CFilterManager::compiled_remote_filters_;
+bool CFilterManager::compiled_filters_valid_ = false;
 bool CFilterManager::m_filters_disabled = false;
 
 BEGIN_EVENT_TABLE(CFilterDialog, wxDialogEx)
@@ -141,6 +144,7 @@ void CFilterDialog::OnOkOrApply(wxCommandEvent& event)
 	global_filters_.filters = m_filters;
 	global_filters_.filter_sets = m_filterSets;
 	global_filters_.current_filter_set = m_currentFilterSet;
+	InvalidateCompiledFilters();
 
 	SaveFilters();
 	m_filters_disabled = false;
@@ -488,19 +492,39 @@ bool CFilterManager::FilenameFiltered(std::wstring const& name, std::wstring con
 		return false;
 	}
 
-	CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
-	auto const& active = local ? set.local : set.remote;
+	return GetCompiledFilters(local).FilenameFiltered(name, path, dir, size, attributes, date);
+}
 
-	// Check active filters
-	for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
-		if (active[i]) {
-			if (FilenameFilteredByFilter(global_filters_.filters[i], name, path, dir, size, attributes, date)) {
-				return true;
+compiled_filters const& CFilterManager::GetCompiledFilters(bool local)
+{
+	if (!compiled_filters_valid_) {
+		compiled_filters_valid_ = true;
+
+		std::vector<CFilter> local_filters;
+		std::vector<CFilter> remote_filters;
+		if (global_filters_.current_filter_set < global_filters_.filter_sets.size()) {
+			CFilterSet const& set = global_filters_.filter_sets[global_filters_.current_filter_set];
+			for (unsigned int i = 0; i < global_filters_.filters.size(); ++i) {
+				if (i < set.local.size() && set.local[i]) {
+					local_filters.push_back(global_filters_.filters[i]);
+				}
+				if (i < set.remote.size() && set.remote[i]) {
+					remote_filters.push_back(global_filters_.filters[i]);
+				}
 			}
 		}
+		compiled_local_filters_ = compiled_filters(local_filters);
+		compiled_remote_filters_ = compiled_filters(remote_filters);
 	}
 
-	return false;
+	return local ? compiled_local_filters_ : compiled_remote_filters_;
+}
+
+void CFilterManager::InvalidateCompiledFilters()
+{
+	compiled_filters_valid_ = false;
+	compiled_local_filters_ = compiled_filters();
+	compiled_remote_filters_ = compiled_filters();
 }
 
 void CFilterManager::LoadFilters()
@@ -521,6 +545,7 @@ void CFilterManager::LoadFilters()
 	CXmlFile xml(file);
 	auto element = xml.Load();
 	load_filters(element, global_filters_);
+	InvalidateCompiledFilters();
 
 	if (!element) {
 		wxString msg = xml.GetError() + _T("\n\n") + _("Any changes made to the filters will not be saved.");
@@ -557,6 +582,7 @@ void CFilterManager::LoadFilters(pugi::xml_node& element)
 
 		global_filters_.filter_sets.push_back(set);
 	}
+	InvalidateCompiledFilters();
 }
 
 void CFilterManager::SaveFilters()
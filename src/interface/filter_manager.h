@@ -35,6 +35,13 @@ protected:
 
 	static filter_data global_filters_;
 
+	// Active local and remote filters of the current set, built on demand
+	static compiled_filters const& GetCompiledFilters(bool local);
+	static void InvalidateCompiledFilters();
+	static compiled_filters compiled_local_filters_;
+	static compiled_filters compiled_remote_filters_;
+	static bool compiled_filters_valid_;
+
 	static bool m_filters_disabled;
 };
 
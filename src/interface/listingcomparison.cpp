@@ -58,6 +58,9 @@ void CComparableListing::RefreshComparison()
 		return;
 	}
 
+	// The listing changed, a pending result no longer matches it
+	m_pComparisonManager->CancelComparison();
+
 	if (!CanStartComparison() || !GetOther() || !GetOther()->CanStartComparison()) {
 		return;
 	}
@@ -89,129 +92,66 @@ bool CComparisonManager::CompareListings()
 	}
 
 	fz::duration const threshold = fz::duration::from_minutes( COptions::Get()->get_int(OPTION_COMPARISON_THRESHOLD) );
+	int const dirSortMode = COptions::Get()->get_int(OPTION_FILELIST_DIRSORT);
+	auto const nameSortMode = static_cast<NameSortMode>(COptions::Get()->get_int(OPTION_FILELIST_NAMESORT));
 
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	std::wstring localPath, remotePath;
-	std::wstring_view localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	int64_t localSize, remoteSize;
-	fz::datetime localDate, remoteDate;
-
-	int const dirSortMode = COptions::Get()->get_int(OPTION_FILELIST_DIRSORT);
-	auto const nameSortMode = static_cast<NameSortMode>(COptions::Get()->get_int(OPTION_FILELIST_NAMESORT));
+	auto const collect = [](CComparableListing & listing) {
+		std::vector<listing_comparison::entry> entries;
 
-	bool gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
-
-	while (gotLocal && gotRemote) {
-		int cmp = CompareFiles(dirSortMode, nameSortMode, localPath, localFile, remotePath, remoteFile, localDir, remoteDir);
-		if (!cmp) {
-			if (!m_comparisonMode) {
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
-
-				if (!m_hideIdentical || flag != CComparableListing::normal || localFile == L"..") {
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
-				}
-			}
-			else {
-				if (localDate.empty() || remoteDate.empty()) {
-					if (!m_hideIdentical || !localDate.empty() || !remoteDate.empty() || localFile == L"..") {
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
-					}
-				}
-				else {
-					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
-
-					int dateCmp = localDate.compare(remoteDate);
-					if (dateCmp < 0) {
-						localDate += threshold;
-					}
-					else if (dateCmp > 0 ) {
-						remoteDate += threshold;
-					}
-					int adjustedDateCmp = localDate.compare(remoteDate);
-					if (dateCmp && dateCmp == -adjustedDateCmp) {
-						dateCmp = 0;
-					}
-
-					localFlag = CComparableListing::normal;
-					remoteFlag = CComparableListing::normal;
-					if (dateCmp < 0 ) {
-						remoteFlag = CComparableListing::newer;
-					}
-					else if (dateCmp > 0) {
-						localFlag = CComparableListing::newer;
-					}
-					if (!m_hideIdentical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == L"..") {
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
-					}
-				}
-			}
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
-			continue;
+		std::wstring_view name;
+		listing_comparison::entry e;
+		while (listing.get_next_file(name, e.path_key, e.dir, e.size, e.date)) {
+			e.key = name;
+			e.parent = name == L"..";
+			entries.push_back(std::move(e));
+			e = listing_comparison::entry();
 		}
+		return entries;
+	};
 
-		if (cmp < 0) {
-			m_pLeft->CompareAddFile(CComparableListing::lonely);
-			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
+	// Only collecting the entries needs the views, everything else runs on the pool.
+	struct job final
+	{
+		listing_comparison comparison;
+		std::vector<listing_comparison::entry> left;
+		std::vector<listing_comparison::entry> right;
+	};
+	auto j = std::make_shared<job>(job{listing_comparison(dirSortMode, nameSortMode, m_comparisonMode, m_hideIdentical, threshold), collect(*m_pLeft), collect(*m_pRight)});
+
+	if (m_task) {
+		m_task.join();
+	}
+	uint64_t const generation = ++m_generation;
+
+	auto const run = [this, j, generation]() {
+		// Computing the sort keys is the expensive part, do one side in another task.
+		fz::async_task task = m_state.pool_.spawn([j]() { j->comparison.prepare(j->left); });
+		if (!task) {
+			j->comparison.prepare(j->left);
 		}
-		else {
-			m_pLeft->CompareAddFile(CComparableListing::fill);
-			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
+		j->comparison.prepare(j->right);
+		if (task) {
+			task.join();
 		}
-	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->get_next_file(localFile, localPath, localDir, localSize, localDate);
-	}
-	while (gotRemote) {
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->get_next_file(remoteFile, remotePath, remoteDir, remoteSize, remoteDate);
-	}
 
-	m_pRight->FinishComparison();
-	m_pLeft->FinishComparison();
-
-	return true;
-}
+		std::vector<unsigned char> leftFlags, rightFlags;
+		j->comparison.add(true, std::move(j->left));
+		j->comparison.add(false, std::move(j->right));
+		j->comparison.compare(true, leftFlags, rightFlags);
 
-int CComparisonManager::CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir)
-{
-	switch (dirSortMode)
-	{
-	default:
-		if (localDir) {
-			if (!remoteDir) {
-				return -1;
-			}
-		}
-		else if (remoteDir) {
-			return 1;
-		}
-		break;
-	case 2:
-		// Inline
-		break;
+		m_handler.CallAfter([this, generation, leftFlags = std::move(leftFlags), rightFlags = std::move(rightFlags)]() {
+			OnComparisonDone(generation, leftFlags, rightFlags);
+		});
+	};
+	m_task = m_state.pool_.spawn(run);
+	if (!m_task) {
+		run();
 	}
 
-	auto const f = CFileListCtrlSortBase::GetCmpFunction(nameSortMode);
-	auto cmp = f(local, remote);
-	if (!cmp) {
-		return f(local_path, remote_path);
-	}
-	return cmp;
+	return true;
 }
 
 CComparisonManager::CComparisonManager(CState& state)
@@ -247,6 +187,19 @@ void CComparisonManager::SetListings(CComparableListing* pLeft, CComparableListi
 	}
 }
 
+void CComparisonManager::OnComparisonDone(uint64_t generation, std::vector<unsigned char> const& leftFlags, std::vector<unsigned char> const& rightFlags)
+{
+	if (generation != m_generation || !m_isComparing || !m_pLeft || !m_pRight) {
+		return;
+	}
+
+	m_pLeft->ApplyComparison(leftFlags);
+	m_pRight->ApplyComparison(rightFlags);
+
+	m_pRight->FinishComparison();
+	m_pLeft->FinishComparison();
+}
+
 void CComparisonManager::ExitComparisonMode()
 {
 	if (!IsComparing()) {
@@ -254,6 +207,7 @@ void CComparisonManager::ExitComparisonMode()
 	}
 
 	m_isComparing = false;
+	CancelComparison();
 	if (m_pLeft) {
 		m_pLeft->OnExitComparisonMode();
 	}
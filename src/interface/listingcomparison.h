@@ -1,14 +1,14 @@
 #ifndef FILEZILLA_INTERFACE_LISTINGCOMPARISON_HEADER
 #define FILEZILLA_INTERFACE_LISTINGCOMPARISON_HEADER
 
+#include "../commonui/listing_comparison.h"
+
+#include <libfilezilla/thread_pool.hpp>
+
 #include <wx/listctrl.h>
 
-enum class NameSortMode
-{
-	case_insensitive,
-	case_sensitive,
-	natural
-};
+#include <string>
+#include <vector>
 
 class CComparisonManager;
 class CComparableListing
@@ -20,17 +20,20 @@ public:
 
 	enum t_fileEntryFlags
 	{
-		normal = 1,
-		fill = 2,
-		different = 4,
-		newer = 8,
-		lonely = 16
+		normal = listing_comparison::normal,
+		fill = listing_comparison::fill,
+		different = listing_comparison::different,
+		newer = listing_comparison::newer,
+		lonely = listing_comparison::lonely
 	};
 
 	virtual bool CanStartComparison() = 0;
 	virtual void StartComparison() = 0;
 	virtual bool get_next_file(std::wstring_view & name, std::wstring & path, bool &dir, int64_t &size, fz::datetime& date) = 0;
-	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+	// Applies the flags produced by listing_comparison, one per row. A zero
+	// flag consumes the next entry without showing it, fill inserts a blank
+	// row without consuming an entry.
+	virtual void ApplyComparison(std::vector<unsigned char> const& flags) = 0;
 	virtual void FinishComparison() = 0;
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
@@ -74,8 +77,11 @@ public:
 	void SetComparisonMode(int mode) { m_comparisonMode = mode; }
 	void SetHideIdentical(bool hideIdentical) { m_hideIdentical = hideIdentical; }
 
+	// Drops the result of a comparison still running, e.g. because a listing changed
+	void CancelComparison() { ++m_generation; }
+
 protected:
-	int CompareFiles(int const dirSortMode, NameSortMode const nameSortMode, std::wstring_view const& local_path, std::wstring_view const& local, std::wstring_view const& remote_path, std::wstring_view const& remote, bool localDir, bool remoteDir);
+	void OnComparisonDone(uint64_t generation, std::vector<unsigned char> const& leftFlags, std::vector<unsigned char> const& rightFlags);
 
 	CState& m_state;
 
@@ -86,6 +92,12 @@ protected:
 	bool m_isComparing{};
 	int m_comparisonMode{};
 	bool m_hideIdentical{};
+
+	// The comparison runs on the thread pool, the flags get posted back
+	// through the handler. Results of older generations are dropped.
+	wxEvtHandler m_handler;
+	uint64_t m_generation{};
+	fz::async_task m_task;
 };
 
 #endif
@@ -0,0 +1,260 @@
+#include "filezilla.h"
+#include "local_hash_index.h"
+#include "Options.h"
+
+#include <libfilezilla/thread_pool.hpp>
+
+#include <sqlite3.h>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#endif
+
+#include <vector>
+
+namespace {
+int64_t GetInode(std::wstring const& file)
+{
+#ifdef FZ_WINDOWS
+	(void)file;
+	return 0;
+#else
+	struct stat buf;
+	if (stat(fz::to_native(file).c_str(), &buf) != 0) {
+		return -1;
+	}
+	return static_cast<int64_t>(buf.st_ino);
+#endif
+}
+
+int64_t ToMilliseconds(fz::datetime const& t)
+{
+	return (t - fz::datetime(0, fz::datetime::milliseconds)).get_milliseconds();
+}
+
+// Entries not refreshed for this long get removed on startup
+fz::duration const max_age = fz::duration::from_days(180);
+}
+
+class CLocalHashIndex::Impl final
+{
+public:
+	explicit Impl(fz::thread_pool & pool)
+		: pool_(pool)
+	{}
+
+	bool Open(std::wstring const& file);
+	void Close();
+
+	// Writes out pending entries until there are none left
+	void Write();
+
+	struct pending_entry final
+	{
+		std::string file;
+		file_hash_algorithm alg;
+		int64_t size;
+		int64_t mtime;
+		int accuracy;
+		int64_t inode;
+		std::string hash;
+	};
+
+	fz::thread_pool & pool_;
+
+	// Guards the database and the prepared statements
+	fz::mutex mtx_;
+	sqlite3* db_{};
+	sqlite3_stmt* selectQuery_{};
+	sqlite3_stmt* insertQuery_{};
+
+	fz::mutex pendingMtx_;
+	std::vector<pending_entry> pending_;
+	fz::async_task task_;
+	bool writing_{};
+};
+
+bool CLocalHashIndex::Impl::Open(std::wstring const& file)
+{
+	fz::scoped_lock l(mtx_);
+
+	if (sqlite3_open(fz::to_utf8(file).c_str(), &db_) != SQLITE_OK) {
+		Close();
+		return false;
+	}
+
+	char const* const create =
+		"CREATE TABLE IF NOT EXISTS files ("
+		"path TEXT NOT NULL, "
+		"algorithm INTEGER NOT NULL, "
+		"size INTEGER NOT NULL, "
+		"mtime INTEGER NOT NULL, "
+		"accuracy INTEGER NOT NULL, "
+		"inode INTEGER NOT NULL, "
+		"hash TEXT NOT NULL, "
+		"stored INTEGER NOT NULL, "
+		"PRIMARY KEY (path, algorithm))";
+	if (sqlite3_exec(db_, create, 0, 0, 0) != SQLITE_OK) {
+		Close();
+		return false;
+	}
+
+	std::string const prune = fz::sprintf("DELETE FROM files WHERE stored < %d", (fz::datetime::now() - max_age).get_time_t());
+	sqlite3_exec(db_, prune.c_str(), 0, 0, 0);
+
+	if (sqlite3_prepare_v2(db_, "SELECT size, mtime, accuracy, inode, hash FROM files WHERE path=?1 AND algorithm=?2", -1, &selectQuery_, 0) != SQLITE_OK ||
+		sqlite3_prepare_v2(db_, "INSERT OR REPLACE INTO files (path, algorithm, size, mtime, accuracy, inode, hash, stored) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)", -1, &insertQuery_, 0) != SQLITE_OK)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void CLocalHashIndex::Impl::Close()
+{
+	sqlite3_finalize(selectQuery_);
+	sqlite3_finalize(insertQuery_);
+	selectQuery_ = 0;
+	insertQuery_ = 0;
+	sqlite3_close(db_);
+	db_ = 0;
+}
+
+void CLocalHashIndex::Impl::Write()
+{
+	std::vector<pending_entry> entries;
+	while (true) {
+		{
+			fz::scoped_lock l(pendingMtx_);
+			entries.clear();
+			entries.swap(pending_);
+			if (entries.empty()) {
+				writing_ = false;
+				return;
+			}
+		}
+
+		fz::scoped_lock l(mtx_);
+		if (!db_) {
+			continue;
+		}
+
+		int64_t const now = fz::datetime::now().get_time_t();
+
+		sqlite3_exec(db_, "BEGIN TRANSACTION", 0, 0, 0);
+		for (auto const& e : entries) {
+			sqlite3_bind_text(insertQuery_, 1, e.file.c_str(), e.file.size(), SQLITE_STATIC);
+			sqlite3_bind_int(insertQuery_, 2, static_cast<int>(e.alg));
+			sqlite3_bind_int64(insertQuery_, 3, e.size);
+			sqlite3_bind_int64(insertQuery_, 4, e.mtime);
+			sqlite3_bind_int(insertQuery_, 5, e.accuracy);
+			sqlite3_bind_int64(insertQuery_, 6, e.inode);
+			sqlite3_bind_text(insertQuery_, 7, e.hash.c_str(), e.hash.size(), SQLITE_STATIC);
+			sqlite3_bind_int64(insertQuery_, 8, now);
+			sqlite3_step(insertQuery_);
+			sqlite3_reset(insertQuery_);
+		}
+		sqlite3_exec(db_, "END TRANSACTION", 0, 0, 0);
+	}
+}
+
+CLocalHashIndex::CLocalHashIndex(fz::thread_pool & pool)
+	: impl_(std::make_unique<Impl>(pool))
+{
+	std::wstring const file = GetDatabaseFilename();
+
+	// Entries stored in the meantime get written once the database is open
+	fz::scoped_lock l(impl_->pendingMtx_);
+	impl_->task_ = impl_->pool_.spawn([this, file]() {
+		impl_->Open(file);
+		impl_->Write();
+	});
+	impl_->writing_ = static_cast<bool>(impl_->task_);
+	if (!impl_->task_) {
+		impl_->Open(file);
+	}
+}
+
+CLocalHashIndex::~CLocalHashIndex()
+{
+	fz::async_task task;
+	{
+		fz::scoped_lock l(impl_->pendingMtx_);
+		task = std::move(impl_->task_);
+	}
+	if (task) {
+		task.join();
+	}
+
+	// In case spawning the task failed
+	impl_->Write();
+
+	impl_->Close();
+}
+
+std::string CLocalHashIndex::lookup(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime)
+{
+	std::string hash;
+	int64_t inode{-1};
+
+	// Not waiting for the database to be opened or written to, the
+	// caller falls back to computing the checksum.
+	if (!impl_->mtx_.try_lock()) {
+		return hash;
+	}
+
+	if (impl_->db_) {
+		std::string const path = fz::to_utf8(file);
+		auto * q = impl_->selectQuery_;
+		sqlite3_bind_text(q, 1, path.c_str(), path.size(), SQLITE_STATIC);
+		sqlite3_bind_int(q, 2, static_cast<int>(alg));
+		if (sqlite3_step(q) == SQLITE_ROW) {
+			if (sqlite3_column_int64(q, 0) == size &&
+				sqlite3_column_int64(q, 1) == ToMilliseconds(mtime) &&
+				sqlite3_column_int(q, 2) == static_cast<int>(mtime.get_accuracy()))
+			{
+				inode = sqlite3_column_int64(q, 3);
+				char const* text = reinterpret_cast<char const*>(sqlite3_column_text(q, 4));
+				if (text) {
+					hash.assign(text, sqlite3_column_bytes(q, 4));
+				}
+			}
+		}
+		sqlite3_reset(q);
+	}
+	impl_->mtx_.unlock();
+
+	if (!hash.empty() && inode != GetInode(file)) {
+		// Same metadata, yet a different file
+		hash.clear();
+	}
+
+	return hash;
+}
+
+void CLocalHashIndex::store(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash)
+{
+	int64_t const inode = GetInode(file);
+	if (inode < 0) {
+		return;
+	}
+
+	fz::scoped_lock l(impl_->pendingMtx_);
+	impl_->pending_.push_back({fz::to_utf8(file), alg, size, ToMilliseconds(mtime), static_cast<int>(mtime.get_accuracy()), inode, hash});
+
+	if (!impl_->writing_) {
+		if (impl_->task_) {
+			// Has finished already, writing_ gets cleared last
+			impl_->task_.join();
+		}
+		impl_->task_ = impl_->pool_.spawn([this]() { impl_->Write(); });
+		impl_->writing_ = static_cast<bool>(impl_->task_);
+	}
+}
+
+std::wstring CLocalHashIndex::GetDatabaseFilename()
+{
+	return COptions::Get()->get_string(OPTION_DEFAULT_SETTINGSDIR) + L"hashindex.sqlite3";
+}
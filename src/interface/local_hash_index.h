@@ -0,0 +1,38 @@
+#ifndef FILEZILLA_INTERFACE_LOCAL_HASH_INDEX_HEADER
+#define FILEZILLA_INTERFACE_LOCAL_HASH_INDEX_HEADER
+
+#include "../include/file_hash.h"
+
+#include <memory>
+
+namespace fz {
+class thread_pool;
+}
+
+// On-disk index of local file checksums, keyed by path and algorithm.
+// Besides size and modification time, entries also record the inode so
+// that files replaced by a different file with the same metadata are
+// detected. Opening and pruning the database as well as writing new
+// entries in batches happens on the thread pool. Lookups never wait for
+// that, while the database is busy they report a miss.
+class CLocalHashIndex final : public local_hash_store
+{
+	class Impl;
+
+public:
+	explicit CLocalHashIndex(fz::thread_pool & pool);
+	virtual ~CLocalHashIndex();
+
+	CLocalHashIndex(CLocalHashIndex const&) = delete;
+	CLocalHashIndex& operator=(CLocalHashIndex const&) = delete;
+
+	virtual std::string lookup(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime) override;
+	virtual void store(std::wstring const& file, file_hash_algorithm alg, int64_t size, fz::datetime const& mtime, std::string const& hash) override;
+
+	static std::wstring GetDatabaseFilename();
+
+private:
+	std::unique_ptr<Impl> impl_;
+};
+
+#endif
@@ -17,7 +17,7 @@ CLocalRecursiveOperation::CLocalRecursiveOperation(CState& state)
 
 CLocalRecursiveOperation::~CLocalRecursiveOperation()
 {
-	thread_.join();
+	join_threads();
 }
 
 void CLocalRecursiveOperation::StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate, bool ignore_links)
@@ -82,14 +82,8 @@ void CLocalRecursiveOperation::OnListedDirectory()
 	bool stop = false;
 	int64_t processed = 0;
 	while (processed < 5000) {
-		{
-			fz::scoped_lock l(mutex_);
-			if (m_listedDirectories.empty()) {
-				break;
-			}
-
-			d = std::move(m_listedDirectories.front());
-			m_listedDirectories.pop_front();
+		if (!DequeueEnumeratedListing(d)) {
+			break;
 		}
 
 		if (d.localPath.empty()) {
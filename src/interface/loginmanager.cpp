@@ -4,9 +4,11 @@
 #include "filezillaapp.h"
 #include "Options.h"
 #include "textctrlex.h"
+#include "tls_session_store.h"
 
 
 CLoginManager CLoginManager::m_theLoginManager;
+CTlsSessionStore* CLoginManager::m_tlsSessionStore{};
 
 
 bool CLoginManager::query_unprotect_site(Site & site)
@@ -355,3 +357,10 @@ bool CLoginManager::AskDecryptor(fz::public_key const& pub, bool allowForgotten,
 
 	return true;
 }
+
+void CLoginManager::on_decryptor_added(fz::private_key const& key)
+{
+	if (m_tlsSessionStore) {
+		m_tlsSessionStore->Unlock(key);
+	}
+}
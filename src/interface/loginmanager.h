@@ -6,6 +6,8 @@
 
 #include <list>
 
+class CTlsSessionStore;
+
 // The purpose of this class is to manage some aspects of the login
 // behaviour. These are:
 // - Password dialog for servers with ASK or INTERACTIVE logontype
@@ -18,11 +20,16 @@ public:
 
 	bool AskDecryptor(fz::public_key const& pub, bool allowForgotten, bool allowCancel);
 
+	// Encrypted TLS sessions become usable once the master password is known
+	static void SetTlsSessionStore(CTlsSessionStore* store) { m_tlsSessionStore = store; }
+
 protected:
 	bool query_unprotect_site(Site & site);
 	bool query_credentials(Site & site, std::wstring const& challenge, bool canRemember);
+	virtual void on_decryptor_added(fz::private_key const& key) override;
 
 	static CLoginManager m_theLoginManager;
+	static CTlsSessionStore* m_tlsSessionStore;
 };
 
 #endif
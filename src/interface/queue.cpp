@@ -311,6 +311,10 @@ void CFileItem::SaveItem(pugi::xml_node& element) const
 	if (m_defaultFileExistsAction != CFileExistsNotification::unknown) {
 		AddTextElement(file, "OverwriteAction", m_defaultFileExistsAction);
 	}
+	if (m_segment) {
+		AddTextElement(file, "SegmentStart", static_cast<int64_t>(m_segment->start_));
+		AddTextElement(file, "SegmentEnd", static_cast<int64_t>(m_segment->end_));
+	}
 }
 
 bool CFileItem::TryRemoveAll()
@@ -323,6 +327,34 @@ bool CFileItem::TryRemoveAll()
 	return false;
 }
 
+void CFileItem::SetSegment(uint64_t start, uint64_t end)
+{
+	file_segment segment;
+	segment.start_ = start;
+	segment.end_ = end;
+	m_segment = fz::sparse_optional<file_segment>(std::move(segment));
+}
+
+writer_factory_holder const& CFileItem::GetSegmentWriter()
+{
+	wxASSERT(m_segment);
+	m_segment->writer_ = file_writer_factory(m_localPath.GetPath() + GetLocalFile(), m_segment->start_, m_segment->end_);
+	return m_segment->writer_;
+}
+
+void CFileItem::UpdateSegmentProgress()
+{
+	if (!m_segment || !m_segment->writer_) {
+		return;
+	}
+
+	uint64_t const position = m_segment->writer_.size();
+	if (position != aio_base::nosize && position > m_segment->start_ && position <= m_segment->end_) {
+		m_segment->start_ = position;
+	}
+	m_segment->writer_ = writer_factory_holder();
+}
+
 void CFileItem::SetTargetFile(std::wstring const& file)
 {
 	if (!file.empty() && file != m_sourceFile) {
@@ -437,7 +469,14 @@ void CServerItem::AddFileItemToList(CFileItem* pItem)
 		return;
 	}
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	auto & fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
+	if (pItem->segment()) {
+		// Finish partially downloaded files first
+		fileList.push_front(pItem);
+	}
+	else {
+		fileList.push_back(pItem);
+	}
 }
 
 void CServerItem::RemoveFileItemFromList(CFileItem* pItem, bool forward)
@@ -948,6 +987,10 @@ wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 			switch (column)
 			{
 			case colLocalName:
+				if (pFileItem->segment()) {
+					auto const& segment = *pFileItem->segment();
+					return _T("  ") + pFileItem->GetLocalPath().GetPath() + pFileItem->GetLocalFile() + fz::sprintf(L" [%d-%d]", segment.start_, segment.end_);
+				}
 				return _T("  ") + pFileItem->GetLocalPath().GetPath() + pFileItem->GetLocalFile();
 			case colDirection:
 				if (pFileItem->Download()) {
@@ -154,6 +154,19 @@ namespace queue_flags
 	auto constexpr mask = static_cast<transfer_flags>(0x0f);
 }
 
+// A download of only the range [start_, end_) of a remote file into a
+// preallocated local file. Large downloads are split into several of these
+// which are then transferred in parallel.
+struct file_segment final
+{
+	uint64_t start_{};
+	uint64_t end_{};
+
+	// Factory used by the transfer in progress, shares the written position
+	// with the engine's writer.
+	writer_factory_holder writer_;
+};
+
 class CFileItem : public CQueueItem
 {
 public:
@@ -214,6 +227,15 @@ public:
 
 	void SetTargetFile(std::wstring const& file);
 
+	fz::sparse_optional<file_segment> const& segment() const { return m_segment; }
+	void SetSegment(uint64_t start, uint64_t end);
+
+	// Creates the writer factory for the next transfer of the segment
+	writer_factory_holder const& GetSegmentWriter();
+
+	// Advances the start of the segment past the data written by the last transfer
+	void UpdateSegmentProgress();
+
 	enum class Status : unsigned char {
 		none,
 		incorrect_password,
@@ -266,6 +288,7 @@ protected:
 	CLocalPath const m_localPath;
 	CServerPath const m_remotePath;
 	int64_t m_size{};
+	fz::sparse_optional<file_segment> m_segment;
 };
 
 class CFolderItem final : public CFileItem
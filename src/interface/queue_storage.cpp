@@ -93,7 +93,9 @@ namespace file_table_column_names
 		error_count,
 		priority,
 		flags,
-		default_exists_action
+		default_exists_action,
+		segment_start,
+		segment_end
 	};
 }
 
@@ -108,7 +110,9 @@ _column file_table_columns[] = {
 	{ "error_count", Column_type::integer, 0 },
 	{ "priority", Column_type::integer, 0 },
 	{ "flags", Column_type::integer, 0 },
-	{ "default_exists_action", Column_type::integer, 0 }
+	{ "default_exists_action", Column_type::integer, 0 },
+	{ "segment_start", Column_type::integer, default_null },
+	{ "segment_end", Column_type::integer, default_null }
 };
 
 namespace path_table_column_names
@@ -293,7 +297,7 @@ bool CQueueStorage::Impl::MigrateSchema()
 	bool ret = sqlite3_exec(db_, "PRAGMA user_version", int_callback, &version, 0) == SQLITE_OK;
 
 	if (ret) {
-		if (version > 6) {
+		if (version > 7) {
 			ret = false;
 		}
 		else if (version > 0) {
@@ -320,9 +324,14 @@ bool CQueueStorage::Impl::MigrateSchema()
 				ret &= sqlite3_exec(db_, "DROP TABLE files", 0, 0, 0) == SQLITE_OK;
 				ret &= sqlite3_exec(db_, "ALTER TABLE files2 RENAME TO files", 0, 0, 0) == SQLITE_OK;
 			}
+			else if (ret && version < 7) {
+				// Tables recreated above already have the segment columns
+				ret = sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN segment_start INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+				ret &= sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN segment_end INTEGER DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
+			}
 		}
-		if (ret && version != 6) {
-			ret = sqlite3_exec(db_, "PRAGMA user_version = 6", 0, 0, 0) == SQLITE_OK;
+		if (ret && version != 7) {
+			ret = sqlite3_exec(db_, "PRAGMA user_version = 7", 0, 0, 0) == SQLITE_OK;
 		}
 	}
 
@@ -840,6 +849,16 @@ bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
 		BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
 	}
 
+	auto const& segment = file.segment();
+	if (segment) {
+		Bind(insertFileQuery_, file_table_column_names::segment_start, static_cast<int64_t>(segment->start_));
+		Bind(insertFileQuery_, file_table_column_names::segment_end, static_cast<int64_t>(segment->end_));
+	}
+	else {
+		BindNull(insertFileQuery_, file_table_column_names::segment_start);
+		BindNull(insertFileQuery_, file_table_column_names::segment_end);
+	}
+
 	int res;
 	do {
 		res = sqlite3_step(insertFileQuery_);
@@ -881,6 +900,8 @@ bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
 	Bind(insertFileQuery_, file_table_column_names::flags, static_cast<int>(directory.flags() - queue_flags::mask));
 
 	BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
+	BindNull(insertFileQuery_, file_table_column_names::segment_start);
+	BindNull(insertFileQuery_, file_table_column_names::segment_end);
 
 	int res;
 	do {
@@ -1124,6 +1145,12 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		fileItem->SetPriorityRaw(QueuePriority(priority));
 		fileItem->m_errorCount = errorCount;
 
+		int64_t const segmentStart = GetColumnInt64(selectFilesQuery_, file_table_column_names::segment_start, -1);
+		int64_t const segmentEnd = GetColumnInt64(selectFilesQuery_, file_table_column_names::segment_end, -1);
+		if (download && segmentStart >= 0 && segmentEnd >= segmentStart) {
+			fileItem->SetSegment(static_cast<uint64_t>(segmentStart), static_cast<uint64_t>(segmentEnd));
+		}
+
 		if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT) {
 			fileItem->m_defaultFileExistsAction = (CFileExistsNotification::OverwriteAction)overwrite_action;
 		}
@@ -6,12 +6,18 @@
 #include "Options.h"
 #include "queue.h"
 
+#include "../include/FileZillaEngine.h"
+
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
+#include <libfilezilla/glue/wxinvoker.hpp>
+
+#include <algorithm>
 
-CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
+CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state, CFileZillaEngineContext& engine_context)
 : CStateEventHandler(state)
 , m_state(state)
+, engine_context_(engine_context)
 {
 	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR_OTHER);
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
@@ -19,6 +25,7 @@ CRemoteRecursiveOperation::CRemoteRecursiveOperation(CState &state)
 
 CRemoteRecursiveOperation::~CRemoteRecursiveOperation()
 {
+	StopPrefetching();
 }
 
 void CRemoteRecursiveOperation::OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data)
@@ -62,6 +69,12 @@ void CRemoteRecursiveOperation::do_start_recursive_operation(OperationMode mode,
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 	m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
 
+	max_prefetch_engines_ = COptions::Get()->get_int(OPTION_RECURSIVE_LIST_CONNECTIONS) - 1;
+	int const max_connections = m_state.GetSite().server.MaximumMultipleConnections();
+	if (max_connections > 0 && max_prefetch_engines_ >= max_connections) {
+		max_prefetch_engines_ = max_connections - 1;
+	}
+
 	remote_recursive_operation::do_start_recursive_operation(mode, filters);
 }
 
@@ -118,10 +131,105 @@ void CRemoteRecursiveOperation::handle_invalid_dir_link(std::wstring const& sour
 	added_to_queue_ = false;
 }
 
+void CRemoteRecursiveOperation::prefetch_listings()
+{
+	Site const& site = m_state.GetSite();
+	if (!site || max_prefetch_engines_ <= 0) {
+		return;
+	}
+
+	for (auto & e : prefetch_engines_) {
+		if (e->busy_) {
+			continue;
+		}
+
+		if (!e->connected_) {
+			if (e->engine_->Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false)) == FZ_REPLY_WOULDBLOCK) {
+				e->busy_ = true;
+			}
+			continue;
+		}
+
+		CServerPath parent;
+		std::wstring subdir;
+		if (!next_prefetch(parent, subdir)) {
+			return;
+		}
+		if (e->engine_->Execute(CListCommand(parent, subdir)) == FZ_REPLY_WOULDBLOCK) {
+			e->busy_ = true;
+		}
+	}
+
+	// Only open further connections while there is work for them
+	while (static_cast<int>(prefetch_engines_.size()) < max_prefetch_engines_) {
+		CServerPath parent;
+		std::wstring subdir;
+		if (!next_prefetch(parent, subdir)) {
+			return;
+		}
+		// The new connection isn't ready yet, so the directory is left to the main connection.
+
+		auto e = std::make_unique<prefetch_engine>();
+		e->engine_ = std::make_unique<CFileZillaEngine>(engine_context_, fz::make_invoker(*this, [this](CFileZillaEngine* engine) { OnPrefetchEngineEvent(engine); }));
+		if (e->engine_->Execute(CConnectCommand(site.server, site.Handle(), site.credentials, false)) == FZ_REPLY_WOULDBLOCK) {
+			e->busy_ = true;
+		}
+		prefetch_engines_.push_back(std::move(e));
+	}
+}
+
+void CRemoteRecursiveOperation::OnPrefetchEngineEvent(CFileZillaEngine* engine)
+{
+	auto it = std::find_if(prefetch_engines_.begin(), prefetch_engines_.end(), [engine](auto const& e) { return e->engine_.get() == engine; });
+	if (it == prefetch_engines_.end()) {
+		return;
+	}
+	auto & e = **it;
+
+	std::unique_ptr<CNotification> notification = engine->GetNextNotification();
+	while (notification) {
+		if (notification->GetID() == nId_operation) {
+			auto const& op = static_cast<COperationNotification const&>(*notification);
+			e.busy_ = false;
+			if (op.commandId_ == Command::connect) {
+				if (op.replyCode_ != FZ_REPLY_OK) {
+					// Server might not allow more connections, make do with fewer.
+					prefetch_engines_.erase(it);
+					--max_prefetch_engines_;
+					return;
+				}
+				e.connected_ = true;
+			}
+			else if ((op.replyCode_ & FZ_REPLY_DISCONNECTED) == FZ_REPLY_DISCONNECTED) {
+				e.connected_ = false;
+			}
+		}
+		else if (notification->GetID() == nId_asyncrequest) {
+			// Unattended connection, anything needing a decision is left to the main connection.
+			prefetch_engines_.erase(it);
+			--max_prefetch_engines_;
+			return;
+		}
+
+		notification = engine->GetNextNotification();
+	}
+
+	if (m_operationMode != recursive_none) {
+		prefetch_listings();
+	}
+}
+
+void CRemoteRecursiveOperation::StopPrefetching()
+{
+	prefetch_engines_.clear();
+	max_prefetch_engines_ = 0;
+}
+
 void CRemoteRecursiveOperation::StopRecursiveOperation()
 {
 	bool notify = m_operationMode != recursive_none;
 	remote_recursive_operation::StopRecursiveOperation();
+	StopPrefetching();
 	if (notify) {
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_IDLE);
 		m_state.NotifyHandlers(STATECHANGE_REMOTE_RECURSION_STATUS);
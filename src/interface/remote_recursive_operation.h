@@ -6,11 +6,13 @@
 
 class CQueueView;
 class CActionAfterBlocker;
+class CFileZillaEngine;
+class CFileZillaEngineContext;
 
-class CRemoteRecursiveOperation final : public remote_recursive_operation, public CStateEventHandler
+class CRemoteRecursiveOperation final : public wxEvtHandler, public remote_recursive_operation, public CStateEventHandler
 {
 public:
-	CRemoteRecursiveOperation(CState& state);
+	CRemoteRecursiveOperation(CState& state, CFileZillaEngineContext& engine_context);
 	virtual ~CRemoteRecursiveOperation();
 
 	void StartRecursiveOperation(OperationMode mode, ActiveFilters const& filters, bool immediate = true);
@@ -30,6 +32,7 @@ protected:
 	void handle_empty_directory(CLocalPath const& localPath) override;
 	void handle_invalid_dir_link(std::wstring const& sourceFile, CLocalPath const& localPath, CServerPath const& remotePath) override;
 	void handle_dir_listing_end() override;
+	void prefetch_listings() override;
 
 	void OnStateChange(t_statechange_notifications notification, std::wstring const&, const void* data) override;
 
@@ -39,6 +42,20 @@ protected:
 	CQueueView* m_pQueue{};
 	std::shared_ptr<CActionAfterBlocker> m_actionAfterBlocker;
 
+	// Additional connections listing upcoming directories into the directory cache
+	struct prefetch_engine final
+	{
+		std::unique_ptr<CFileZillaEngine> engine_;
+		bool connected_{};
+		bool busy_{};
+	};
+	void OnPrefetchEngineEvent(CFileZillaEngine* engine);
+	void StopPrefetching();
+
+	CFileZillaEngineContext& engine_context_;
+	std::vector<std::unique_ptr<prefetch_engine>> prefetch_engines_;
+	int max_prefetch_engines_{};
+
 	friend class CCommandQueue;
 };
 
@@ -23,6 +23,7 @@ struct COptionsPageConnectionSFTP::impl
 	wxButton* remove_{};
 
 	wxCheckBox* compression_{};
+	wxCheckBox* archive_{};
 };
 
 COptionsPageConnectionSFTP::COptionsPageConnectionSFTP()
@@ -76,6 +77,10 @@ bool COptionsPageConnectionSFTP::CreateControls(wxWindow* parent)
 
 		impl_->compression_ = new wxCheckBox(box, nullID, _("&Enable compression"));
 		inner->Add(impl_->compression_);
+
+		impl_->archive_ = new wxCheckBox(box, nullID, _("&Transfer directories as a single archive stream"));
+		inner->Add(impl_->archive_);
+		inner->Add(new wxStaticText(box, nullID, _("Requires tar and a shell on the server. Existing files get overwritten and filters are not applied.")));
 	}
 	return true;
 }
@@ -102,6 +107,7 @@ bool COptionsPageConnectionSFTP::LoadPage()
 	SetCtrlState();
 
 	impl_->compression_->SetValue(m_pOptions->get_int(OPTION_SFTP_COMPRESSION) != 0);
+	impl_->archive_->SetValue(m_pOptions->get_int(OPTION_SFTP_ARCHIVE_TRANSFERS) != 0);
 
 	return !failure;
 }
@@ -121,6 +127,7 @@ bool COptionsPageConnectionSFTP::SavePage()
 	}
 
 	m_pOptions->set(OPTION_SFTP_COMPRESSION, impl_->compression_->GetValue() ? 1 : 0);
+	m_pOptions->set(OPTION_SFTP_ARCHIVE_TRANSFERS, impl_->archive_->GetValue() ? 1 : 0);
 
 	return true;
 }
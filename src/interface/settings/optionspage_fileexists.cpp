@@ -51,6 +51,7 @@ bool COptionsPageFileExists::CreateControls(wxWindow* parent)
 			c->AppendString(_("Resume file transfer"));
 			c->AppendString(_("Rename file"));
 			c->AppendString(_("Skip file"));
+			c->AppendString(_("Overwrite file if size or checksum differs"));
 		};
 		actions(impl_->download_);
 		actions(impl_->upload_);
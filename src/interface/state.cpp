@@ -227,7 +227,7 @@ CState::CState(CMainFrame &mainFrame)
 	m_pComparisonManager = new CComparisonManager(*this);
 
 	m_pLocalRecursiveOperation = new CLocalRecursiveOperation(*this);
-	m_pRemoteRecursiveOperation = new CRemoteRecursiveOperation(*this);
+	m_pRemoteRecursiveOperation = new CRemoteRecursiveOperation(*this, mainFrame.GetEngineContext());
 
 	m_localDir.SetPath(std::wstring(1, CLocalPath::path_separator));
 }
@@ -0,0 +1,171 @@
+#include "filezilla.h"
+#include "tls_session_store.h"
+#include "filezillaapp.h"
+#include "Options.h"
+#include "xmlfunctions.h"
+
+#include <libfilezilla/encode.hpp>
+
+CTlsSessionStore::CTlsSessionStore()
+{
+	Load();
+}
+
+CTlsSessionStore::~CTlsSessionStore()
+{
+	if (modified_) {
+		Save();
+	}
+}
+
+std::vector<uint8_t> CTlsSessionStore::lookup(std::string const& host, unsigned short port)
+{
+	fz::scoped_lock l(mtx_);
+
+	auto it = entries_.find(std::make_tuple(host, port));
+	if (it == entries_.end()) {
+		return std::vector<uint8_t>();
+	}
+
+	if (fz::datetime::now() - it->second.time >= tls_session_cache::max_age()) {
+		entries_.erase(it);
+		modified_ = true;
+		return std::vector<uint8_t>();
+	}
+
+	return it->second.session;
+}
+
+void CTlsSessionStore::store(std::string const& host, unsigned short port, std::vector<uint8_t> const& session)
+{
+	fz::scoped_lock l(mtx_);
+
+	auto & e = entries_[std::make_tuple(host, port)];
+	e.time = fz::datetime::now();
+	e.session = session;
+	e.cipher.clear();
+	e.key = fz::public_key();
+	modified_ = true;
+}
+
+void CTlsSessionStore::remove(std::string const& host, unsigned short port)
+{
+	fz::scoped_lock l(mtx_);
+	if (entries_.erase(std::make_tuple(host, port))) {
+		modified_ = true;
+	}
+}
+
+void CTlsSessionStore::Unlock(fz::private_key const& key)
+{
+	if (!key) {
+		return;
+	}
+	auto const pub = key.pubkey();
+
+	fz::scoped_lock l(mtx_);
+	for (auto & it : entries_) {
+		auto & e = it.second;
+		if (e.session.empty() && !e.cipher.empty() && e.key == pub) {
+			auto const plain = fz::decrypt(e.cipher, key);
+			e.session.assign(plain.begin(), plain.end());
+		}
+	}
+}
+
+void CTlsSessionStore::Load()
+{
+	CXmlFile file(wxGetApp().GetSettingsFile(L"tlssessions"));
+	auto root = file.Load();
+	if (!root) {
+		return;
+	}
+
+	auto const now = fz::datetime::now();
+
+	auto sessions = root.child("TlsSessions");
+	for (auto node = sessions.child("Session"); node; node = node.next_sibling("Session")) {
+		std::string const host = node.attribute("Host").value();
+		unsigned int const port = node.attribute("Port").as_uint();
+		if (host.empty() || port < 1 || port > 65535) {
+			continue;
+		}
+
+		entry e;
+		e.time = fz::datetime(static_cast<time_t>(node.attribute("Time").as_llong()), fz::datetime::seconds);
+		if (e.time.empty() || now - e.time >= tls_session_cache::max_age()) {
+			continue;
+		}
+
+		auto const data = fz::base64_decode(std::string(node.child_value()));
+		if (data.empty()) {
+			continue;
+		}
+
+		std::string const key = node.attribute("Key").value();
+		if (key.empty()) {
+			e.session.assign(data.begin(), data.end());
+		}
+		else {
+			e.key = fz::public_key::from_base64(key);
+			if (!e.key) {
+				continue;
+			}
+			e.cipher.assign(data.begin(), data.end());
+		}
+
+		entries_[std::make_tuple(host, static_cast<unsigned short>(port))] = std::move(e);
+	}
+}
+
+void CTlsSessionStore::Save()
+{
+	auto const pub = fz::public_key::from_base64(fz::to_utf8(COptions::Get()->get_string(OPTION_MASTERPASSWORDENCRYPTOR)));
+	std::string const key = pub ? pub.to_base64() : std::string();
+
+	CXmlFile file(wxGetApp().GetSettingsFile(L"tlssessions"));
+	auto root = file.CreateEmpty();
+	if (!root) {
+		return;
+	}
+	auto sessions = root.append_child("TlsSessions");
+
+	auto const now = fz::datetime::now();
+
+	fz::scoped_lock l(mtx_);
+	for (auto const& it : entries_) {
+		auto const& e = it.second;
+		if (now - e.time >= tls_session_cache::max_age()) {
+			continue;
+		}
+
+		std::vector<uint8_t> data;
+		if (pub) {
+			if (!e.session.empty()) {
+				data = fz::encrypt(e.session, pub);
+			}
+			else if (e.key == pub) {
+				data = e.cipher;
+			}
+		}
+		else {
+			// Without the master password, encrypted sessions that never
+			// got unlocked are lost.
+			data = e.session;
+		}
+		if (data.empty()) {
+			continue;
+		}
+
+		auto node = sessions.append_child("Session");
+		node.append_attribute("Host").set_value(std::get<0>(it.first).c_str());
+		node.append_attribute("Port").set_value(std::get<1>(it.first));
+		node.append_attribute("Time").set_value(static_cast<long long>(e.time.get_time_t()));
+		if (pub) {
+			node.append_attribute("Key").set_value(key.c_str());
+		}
+		node.text().set(fz::base64_encode(std::string(data.begin(), data.end()), fz::base64_type::standard, false).c_str());
+	}
+
+	file.Save();
+}
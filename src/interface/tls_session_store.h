@@ -0,0 +1,50 @@
+#ifndef FILEZILLA_INTERFACE_TLS_SESSION_STORE_HEADER
+#define FILEZILLA_INTERFACE_TLS_SESSION_STORE_HEADER
+
+#include "../include/tls_session_cache.h"
+
+#include <libfilezilla/encryption.hpp>
+#include <libfilezilla/time.hpp>
+
+// Keeps the TLS sessions of the engine across restarts in tlssessions.xml.
+//
+// If a master password is set, the sessions are written encrypted with it.
+// Such sessions can only be resumed once the master password has been
+// entered, until then lookups miss.
+class CTlsSessionStore final : public tls_session_store
+{
+public:
+	CTlsSessionStore();
+	virtual ~CTlsSessionStore();
+
+	CTlsSessionStore(CTlsSessionStore const&) = delete;
+	CTlsSessionStore& operator=(CTlsSessionStore const&) = delete;
+
+	virtual std::vector<uint8_t> lookup(std::string const& host, unsigned short port) override;
+	virtual void store(std::string const& host, unsigned short port, std::vector<uint8_t> const& session) override;
+	virtual void remove(std::string const& host, unsigned short port) override;
+
+	// Decrypts the sessions encrypted with the given key
+	void Unlock(fz::private_key const& key);
+
+private:
+	void Load();
+	void Save();
+
+	struct entry final
+	{
+		fz::datetime time;
+
+		// Empty while still encrypted
+		std::vector<uint8_t> session;
+
+		std::vector<uint8_t> cipher;
+		fz::public_key key;
+	};
+
+	fz::mutex mtx_;
+	std::map<std::tuple<std::string, unsigned short>, entry> entries_;
+	bool modified_{};
+};
+
+#endif
@@ -0,0 +1,1002 @@
+/*
+ * fzarchive.c: transfers of whole directory trees as a single tar
+ * stream. tar runs on the server in a separate session channel, the
+ * members are split off or added on the fly and go through the
+ * engine's readers and writers one file at a time.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "putty.h"
+#include "psftp.h"
+#include "ssh.h"
+#include "sshchan.h"
+#include "fzarchive.h"
+
+#define TAR_BLOCK 512
+
+/* Upper bound for GNU long names and pax headers we are willing to buffer */
+#define TAR_MAX_EXTENDED (1024 * 1024)
+
+/* Stop feeding the channel once this much is waiting to be sent */
+#define ARCHIVE_MAX_BACKLOG (1024 * 1024)
+
+/* Keep at most this much of what tar writes to stderr */
+#define ARCHIVE_MAX_ERRORS 4096
+
+/* ----------------------------------------------------------------------
+ * The channel running tar on the server.
+ */
+
+typedef struct ArchiveChannel {
+    SshChannel *sc;
+    char *command;
+
+    bufchain data;
+    strbuf *errors;
+
+    bool discard_output;
+    bool started, failed, remote_eof, closed, input_wanted;
+
+    /* Set if archive_channel_close is done with the structure while the
+     * connection layer still holds the channel. archivechan_free then
+     * frees what is left. */
+    bool orphaned;
+
+    int exit_status;
+    char *exit_signal;
+
+    Channel chan;
+} ArchiveChannel;
+
+static void archivechan_free(Channel *chan);
+static void archivechan_open_confirmation(Channel *chan);
+static void archivechan_open_failed(Channel *chan, const char *errtext);
+static size_t archivechan_send(
+    Channel *chan, bool is_stderr, const void *, size_t);
+static void archivechan_send_eof(Channel *chan);
+static void archivechan_set_input_wanted(Channel *chan, bool wanted);
+static char *archivechan_log_close_msg(Channel *chan);
+static bool archivechan_rcvd_exit_status(Channel *chan, int status);
+static bool archivechan_rcvd_exit_signal(
+    Channel *chan, ptrlen signame, bool core_dumped, ptrlen msg);
+static bool archivechan_rcvd_exit_signal_numeric(
+    Channel *chan, int signum, bool core_dumped, ptrlen msg);
+static void archivechan_request_response(Channel *chan, bool success);
+
+static const struct ChannelVtable archivechan_channelvt = {
+    archivechan_free,
+    archivechan_open_confirmation,
+    archivechan_open_failed,
+    archivechan_send,
+    archivechan_send_eof,
+    archivechan_set_input_wanted,
+    archivechan_log_close_msg,
+    chan_default_want_close,
+    archivechan_rcvd_exit_status,
+    archivechan_rcvd_exit_signal,
+    archivechan_rcvd_exit_signal_numeric,
+    chan_no_run_shell,
+    chan_no_run_command,
+    chan_no_run_subsystem,
+    chan_no_enable_x11_forwarding,
+    chan_no_enable_agent_forwarding,
+    chan_no_allocate_pty,
+    chan_no_set_env,
+    chan_no_send_break,
+    chan_no_send_signal,
+    chan_no_change_window_size,
+    archivechan_request_response,
+};
+
+static void archivechan_free(Channel *chan)
+{
+    /* The structure itself is owned by archive_channel_close, unless
+     * that has already given up on it */
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    if (ac->orphaned) {
+        sfree(ac->exit_signal);
+        sfree(ac);
+        return;
+    }
+    ac->closed = true;
+
+    /* Data still waiting to be processed must not keep the connection
+     * throttled once the channel is gone. */
+    if (bufchain_size(&ac->data)) {
+        sshfwd_unthrottle(ac->sc, 0);
+    }
+}
+
+static void archivechan_open_confirmation(Channel *chan)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    sshfwd_start_command(ac->sc, true, ac->command);
+}
+
+static void archivechan_open_failed(Channel *chan, const char *errtext)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    fzprintf(sftpError, "Could not open a channel for tar: %s",
+             errtext ? errtext : "unknown error");
+    ac->failed = true;
+}
+
+static size_t archivechan_send(
+    Channel *chan, bool is_stderr, const void *data, size_t len)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+
+    if (ac->orphaned) {
+        return 0;
+    }
+
+    if (is_stderr) {
+        if (ac->errors->len < ARCHIVE_MAX_ERRORS) {
+            size_t room = ARCHIVE_MAX_ERRORS - ac->errors->len;
+            put_data(ac->errors, data, len < room ? len : room);
+        }
+        return 0;
+    }
+
+    if (ac->discard_output) {
+        return 0;
+    }
+
+    /*
+     * Returning a non-zero backlog throttles the connection until
+     * the data has been processed and sshfwd_unthrottle gets called.
+     */
+    bufchain_add(&ac->data, data, len);
+    return bufchain_size(&ac->data);
+}
+
+static void archivechan_send_eof(Channel *chan)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    ac->remote_eof = true;
+}
+
+static void archivechan_set_input_wanted(Channel *chan, bool wanted)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    ac->input_wanted = wanted;
+}
+
+static char *archivechan_log_close_msg(Channel *chan)
+{
+    return dupstr("Archive channel closed");
+}
+
+static bool archivechan_rcvd_exit_status(Channel *chan, int status)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    ac->exit_status = status;
+    return true;
+}
+
+static bool archivechan_rcvd_exit_signal(
+    Channel *chan, ptrlen signame, bool core_dumped, ptrlen msg)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    sfree(ac->exit_signal);
+    ac->exit_signal = dupprintf("%.*s", PTRLEN_PRINTF(signame));
+    return true;
+}
+
+static bool archivechan_rcvd_exit_signal_numeric(
+    Channel *chan, int signum, bool core_dumped, ptrlen msg)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    sfree(ac->exit_signal);
+    ac->exit_signal = dupprintf("%d", signum);
+    return true;
+}
+
+static void archivechan_request_response(Channel *chan, bool success)
+{
+    ArchiveChannel *ac = container_of(chan, ArchiveChannel, chan);
+    if (success) {
+        ac->started = true;
+    } else {
+        fzprintf(sftpError, "The server refused to run tar");
+        ac->failed = true;
+    }
+}
+
+/* Runs one iteration of the event loop, returns false if the
+ * connection is gone. */
+static bool archive_loop(Backend *backend)
+{
+    if (backend_exitcode(backend) >= 0 || ssh_sftp_loop_iteration() < 0) {
+        fzprintf(sftpError, "Connection lost during archive transfer");
+        return false;
+    }
+    return true;
+}
+
+static ArchiveChannel *archive_channel_open(Backend *backend, char *command)
+{
+    ConnectionLayer *cl = ssh_get_connection_layer(backend);
+    if (!cl) {
+        sfree(command);
+        return NULL;
+    }
+
+    ArchiveChannel *ac = snew(ArchiveChannel);
+    memset(ac, 0, sizeof(ArchiveChannel));
+    ac->command = command;
+    bufchain_init(&ac->data);
+    ac->errors = strbuf_new();
+    ac->exit_status = -1;
+    ac->input_wanted = true;
+    ac->chan.vt = &archivechan_channelvt;
+    ac->chan.initial_fixed_window_size = 0;
+
+    fzprintf(sftpVerbose, "Running %s", command);
+    ac->sc = ssh_session_open(cl, &ac->chan);
+
+    while (!ac->started && !ac->failed && !ac->closed) {
+        if (!archive_loop(backend)) {
+            archive_channel_close(backend, ac, 0);
+            return NULL;
+        }
+    }
+
+    return ac;
+}
+
+/* Closes the channel if still open, reports what tar had to say and
+ * frees everything. Returns ret, or 0 if tar did not succeed. */
+static int archive_channel_close(Backend *backend, ArchiveChannel *ac, int ret)
+{
+    if (!ac->closed && backend_exitcode(backend) >= 0) {
+        /* The connection is gone, the channel may not be touched anymore.
+         * The connection layer still references the structure and frees
+         * it through archivechan_free once it gets cleaned up. */
+        bufchain_clear(&ac->data);
+        strbuf_free(ac->errors);
+        ac->errors = NULL;
+        sfree(ac->exit_signal);
+        ac->exit_signal = NULL;
+        sfree(ac->command);
+        ac->command = NULL;
+        ac->orphaned = true;
+        return 0;
+    }
+
+    if (!ac->closed) {
+        /* Lift any throttling of the connection before the channel
+         * turns into a zombie. */
+        bufchain_clear(&ac->data);
+        sshfwd_unthrottle(ac->sc, 0);
+        sshfwd_initiate_close(ac->sc, NULL);
+    }
+
+    /* Not all servers report the exit status */
+    if (ret && (ac->failed || ac->exit_signal || ac->exit_status > 0)) {
+        ret = 0;
+    }
+
+    /* Warnings only if tar succeeded */
+    if (ac->errors->len) {
+        fzprintf(ret ? sftpStatus : sftpError, "%.*s", (int)ac->errors->len, ac->errors->s);
+    }
+    if (ac->started && ac->exit_signal) {
+        fzprintf(sftpError, "tar terminated by signal %s", ac->exit_signal);
+    } else if (ac->started && ac->exit_status > 0) {
+        fzprintf(sftpError, "tar failed with exit status %d", ac->exit_status);
+    }
+
+    bufchain_clear(&ac->data);
+    strbuf_free(ac->errors);
+    sfree(ac->exit_signal);
+    sfree(ac->command);
+    sfree(ac);
+
+    return ret;
+}
+
+/* Quotes s for a POSIX shell */
+static char *shell_quote(const char *s)
+{
+    strbuf *buf = strbuf_new();
+    put_byte(buf, '\'');
+    for (; *s; ++s) {
+        if (*s == '\'') {
+            put_data(buf, "'\\''", 4);
+        } else {
+            put_byte(buf, *s);
+        }
+    }
+    put_byte(buf, '\'');
+    return strbuf_to_str(buf);
+}
+
+static uint64_t next_uint64(char **s)
+{
+    uint64_t ret = 0;
+    while (**s >= '0' && **s <= '9') {
+        ret = ret * 10 + (uint64_t)(**s - '0');
+        ++(*s);
+    }
+    while (**s == ' ') {
+        ++(*s);
+    }
+    return ret;
+}
+
+/* ----------------------------------------------------------------------
+ * Reading tar streams.
+ */
+
+typedef enum {
+    TAR_HEADER,
+    TAR_FILE,       /* Member data written to a local file */
+    TAR_SKIP,       /* Member data we are not interested in */
+    TAR_LONGNAME,   /* GNU long name for the next member */
+    TAR_PAX,        /* pax extended header for the next member */
+    TAR_PADDING,
+    TAR_END
+} TarState;
+
+typedef struct TarReader {
+    TarState state;
+
+    unsigned char header[TAR_BLOCK];
+    size_t header_len;
+    bool zero_block;
+
+    /* Data bytes of the current entry still to come, and the padding
+     * up to the next block boundary after them */
+    uint64_t remaining;
+    size_t padding;
+
+    strbuf *extended;
+
+    /* Overrides for the next member from long names or pax headers */
+    char *next_name;
+    bool has_next_size, has_next_mtime;
+    uint64_t next_size, next_mtime;
+
+    WFile *file;
+    bool error;
+
+    uint64_t transferred;
+} TarReader;
+
+static bool tar_is_zero_block(const unsigned char *block)
+{
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        if (block[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Parses an octal or GNU base-256 number field */
+static uint64_t tar_number(const unsigned char *field, size_t len, bool *ok)
+{
+    uint64_t ret = 0;
+    size_t i = 0;
+
+    if (field[0] & 0x80) {
+        if (field[0] != 0x80) {
+            /* Negative or too large */
+            *ok = false;
+            return 0;
+        }
+        for (i = 1; i < len; ++i) {
+            if (ret >> 56) {
+                *ok = false;
+                return 0;
+            }
+            ret = (ret << 8) | field[i];
+        }
+        return ret;
+    }
+
+    while (i < len && field[i] == ' ') {
+        ++i;
+    }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; ++i) {
+        if (ret >> 61) {
+            *ok = false;
+            return 0;
+        }
+        ret = (ret << 3) | (uint64_t)(field[i] - '0');
+    }
+    if (i < len && field[i] != ' ' && field[i] != 0) {
+        *ok = false;
+    }
+    return ret;
+}
+
+static bool tar_checksum_ok(const unsigned char *h)
+{
+    bool ok = true;
+    uint64_t expected = tar_number(h + 148, 8, &ok);
+    if (!ok) {
+        return false;
+    }
+
+    /* Some old implementations used signed chars */
+    uint64_t sum = 0;
+    int64_t signed_sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        unsigned char c = (i >= 148 && i < 156) ? ' ' : h[i];
+        sum += c;
+        signed_sum += (signed char)c;
+    }
+    return sum == expected || (uint64_t)signed_sum == expected;
+}
+
+static char *tar_field(const unsigned char *field, size_t len)
+{
+    const unsigned char *end = memchr(field, 0, len);
+    size_t n = end ? (size_t)(end - field) : len;
+    return dupprintf("%.*s", (int)n, (const char *)field);
+}
+
+static char *tar_header_name(const unsigned char *h)
+{
+    char *name = tar_field(h, 100);
+
+    /* The prefix field only exists in POSIX ustar headers, GNU tar
+     * stores other data there. */
+    if (!memcmp(h + 257, "ustar", 6) && h[345]) {
+        char *prefix = tar_field(h + 345, 155);
+        char *full = dupcat(prefix, "/", name);
+        sfree(prefix);
+        sfree(name);
+        name = full;
+    }
+    return name;
+}
+
+static void tar_parse_pax(TarReader *tr)
+{
+    const char *data = tr->extended->s;
+    size_t len = tr->extended->len;
+    size_t pos = 0;
+
+    /* Records are of the form "<length> <key>=<value>\n" */
+    while (pos < len) {
+        size_t reclen = 0, p = pos;
+        while (p < len && data[p] >= '0' && data[p] <= '9' && reclen < len) {
+            reclen = reclen * 10 + (size_t)(data[p] - '0');
+            ++p;
+        }
+        if (p >= len || data[p] != ' ' || reclen <= p - pos + 1 ||
+            reclen > len - pos || data[pos + reclen - 1] != '\n') {
+            break;
+        }
+
+        const char *key = data + p + 1;
+        const char *end = data + pos + reclen - 1;
+        const char *eq = memchr(key, '=', end - key);
+        if (eq) {
+            ptrlen k = make_ptrlen(key, eq - key);
+            const char *value = eq + 1;
+            if (ptrlen_eq_string(k, "path")) {
+                sfree(tr->next_name);
+                tr->next_name = dupprintf("%.*s", (int)(end - value), value);
+            } else if (ptrlen_eq_string(k, "size") ||
+                       ptrlen_eq_string(k, "mtime")) {
+                /* Fractional seconds get cut off by the parser */
+                char *s = dupprintf("%.*s", (int)(end - value), value);
+                char *q = s;
+                uint64_t n = next_uint64(&q);
+                if (ptrlen_eq_string(k, "size")) {
+                    tr->has_next_size = true;
+                    tr->next_size = n;
+                } else {
+                    tr->has_next_mtime = true;
+                    tr->next_mtime = n;
+                }
+                sfree(s);
+            }
+        }
+        pos += reclen;
+    }
+}
+
+static void tar_reader_begin(TarReader *tr, TarState state, uint64_t size)
+{
+    tr->state = state;
+    tr->remaining = size;
+    tr->padding = (size_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+}
+
+/* Tells the engine about a member. Returns 1 if it should be
+ * extracted, 0 if it should be skipped and -1 on fatal errors. */
+static int archive_announce(char type, uint64_t mtime, const char *name)
+{
+    fzprintf_raw(sftp_io_member, "%c %"PRIu64" %s\n", type, mtime, name);
+    char *reply = priority_read();
+    int ret = -1;
+    if (reply[1] == '1') {
+        ret = 1;
+    } else if (reply[1] == '0') {
+        ret = 0;
+    }
+    sfree(reply);
+    return ret;
+}
+
+static bool tar_reader_finish_file(TarReader *tr)
+{
+    bool ok = finalize_wfile(tr->file) != 0;
+    if (!ok) {
+        fzprintf(sftpError, "error while writing local file");
+    }
+    close_wfile(tr->file);
+    tr->file = NULL;
+    return ok;
+}
+
+static void tar_reader_header(TarReader *tr)
+{
+    const unsigned char *h = tr->header;
+
+    if (tar_is_zero_block(h)) {
+        /* Two consecutive zero blocks mark the end */
+        if (tr->zero_block) {
+            tr->state = TAR_END;
+        }
+        tr->zero_block = true;
+        return;
+    }
+    tr->zero_block = false;
+
+    if (!tar_checksum_ok(h)) {
+        fzprintf(sftpError, "Invalid tar header checksum");
+        tr->error = true;
+        return;
+    }
+
+    bool ok = true;
+    uint64_t size = tar_number(h + 124, 12, &ok);
+    uint64_t mtime = tar_number(h + 136, 12, &ok);
+    if (!ok) {
+        fzprintf(sftpError, "Invalid number in tar header");
+        tr->error = true;
+        return;
+    }
+
+    char type = (char)h[156];
+    if (type == 'L' || type == 'x') {
+        if (size > TAR_MAX_EXTENDED) {
+            fzprintf(sftpError, "Extended tar header too large");
+            tr->error = true;
+            return;
+        }
+        strbuf_clear(tr->extended);
+        tar_reader_begin(tr, type == 'L' ? TAR_LONGNAME : TAR_PAX, size);
+        return;
+    }
+    if (type == 'g' || type == 'K') {
+        /* Global pax headers and link targets are of no interest */
+        tar_reader_begin(tr, TAR_SKIP, size);
+        return;
+    }
+
+    if (tr->has_next_size) {
+        size = tr->next_size;
+    }
+    if (tr->has_next_mtime) {
+        mtime = tr->next_mtime;
+    }
+    char *name = tr->next_name ? tr->next_name : tar_header_name(h);
+    tr->next_name = NULL;
+    tr->has_next_size = tr->has_next_mtime = false;
+
+    char *p = name;
+    while (*p == '/' || (p[0] == '.' && p[1] == '/')) {
+        p += (*p == '/') ? 1 : 2;
+    }
+    size_t len = strlen(p);
+    while (len && p[len - 1] == '/') {
+        p[--len] = 0;
+    }
+
+    TarState state = TAR_SKIP;
+    if (!*p || !strcmp(p, ".")) {
+        /* The root directory itself */
+    } else if (strpbrk(p, "\r\n")) {
+        fzprintf(sftpStatus, "Skipping member with line break in its name");
+    } else if (type == '5') {
+        if (archive_announce('d', mtime, p) < 0) {
+            tr->error = true;
+        }
+    } else if (type == '0' || type == '\0' || type == '7') {
+        int r = archive_announce('f', mtime, p);
+        if (r < 0) {
+            tr->error = true;
+        } else if (r > 0) {
+            tr->file = open_new_file(p, -1);
+            if (!tr->file) {
+                fzprintf(sftpError, "local: unable to open %s", p);
+                tr->error = true;
+            } else {
+                state = TAR_FILE;
+                if (!size && !tar_reader_finish_file(tr)) {
+                    tr->error = true;
+                }
+            }
+        }
+    } else {
+        fzprintf(sftpStatus, "Skipping %s, it is neither a regular file nor a directory", p);
+    }
+    sfree(name);
+
+    if (!tr->error) {
+        tar_reader_begin(tr, state, size);
+    }
+}
+
+/* Consumes up to len bytes of the stream, returns how many */
+static size_t tar_reader_feed(TarReader *tr, const unsigned char *data, size_t len)
+{
+    size_t consumed = 0;
+
+    while (!tr->error && tr->state != TAR_END) {
+        if (tr->state == TAR_HEADER) {
+            size_t n = TAR_BLOCK - tr->header_len;
+            if (n > len - consumed) {
+                n = len - consumed;
+            }
+            memcpy(tr->header + tr->header_len, data + consumed, n);
+            tr->header_len += n;
+            consumed += n;
+            if (tr->header_len < TAR_BLOCK) {
+                break;
+            }
+            tr->header_len = 0;
+            tar_reader_header(tr);
+            continue;
+        }
+
+        if (tr->state == TAR_PADDING) {
+            size_t n = tr->padding;
+            if (n > len - consumed) {
+                n = len - consumed;
+            }
+            tr->padding -= n;
+            consumed += n;
+            if (tr->padding) {
+                break;
+            }
+            tr->state = TAR_HEADER;
+            continue;
+        }
+
+        if (!tr->remaining) {
+            if (tr->state == TAR_FILE && tr->file && !tar_reader_finish_file(tr)) {
+                tr->error = true;
+                break;
+            } else if (tr->state == TAR_LONGNAME) {
+                sfree(tr->next_name);
+                tr->next_name = tar_field((const unsigned char *)tr->extended->s, tr->extended->len);
+            } else if (tr->state == TAR_PAX) {
+                tar_parse_pax(tr);
+            }
+            tr->state = TAR_PADDING;
+            continue;
+        }
+
+        if (consumed == len) {
+            break;
+        }
+
+        size_t n = len - consumed;
+        if (n > tr->remaining) {
+            n = (size_t)tr->remaining;
+        }
+
+        if (tr->state == TAR_FILE) {
+            if (n > INT_MAX) {
+                n = INT_MAX;
+            }
+            size_t written = 0;
+            while (written < n) {
+                int w = write_to_file(tr->file, (void *)(data + consumed + written), (int)(n - written));
+                if (w <= 0) {
+                    fzprintf(sftpError, "error while writing local file");
+                    tr->error = true;
+                    break;
+                }
+                written += w;
+            }
+            tr->transferred += written;
+            n = written;
+        } else if (tr->state == TAR_LONGNAME || tr->state == TAR_PAX) {
+            put_data(tr->extended, data + consumed, n);
+        }
+
+        tr->remaining -= n;
+        consumed += n;
+    }
+
+    return consumed;
+}
+
+int archive_download(Backend *backend, const char *dir)
+{
+    char *quoted = shell_quote(dir);
+    ArchiveChannel *ac = archive_channel_open(
+        backend, dupprintf("tar -cf - -C %s .", quoted));
+    sfree(quoted);
+    if (!ac) {
+        return 0;
+    }
+
+    TarReader tr;
+    memset(&tr, 0, sizeof(TarReader));
+    tr.state = TAR_HEADER;
+    tr.extended = strbuf_new();
+
+    _fztimer timer;
+    fz_timer_init(&timer);
+    uint64_t reported = 0;
+
+    /* tar does not read anything */
+    int ret = ac->started;
+    if (ret) {
+        sshfwd_write_eof(ac->sc);
+    }
+
+    while (ret) {
+        if (bufchain_size(&ac->data)) {
+            while (bufchain_size(&ac->data) && !tr.error) {
+                ptrlen chunk = bufchain_prefix(&ac->data);
+                size_t n = tar_reader_feed(&tr, chunk.ptr, chunk.len);
+                bufchain_consume(&ac->data, n);
+                if (tr.state == TAR_END) {
+                    /* Trailing padding of the last record */
+                    bufchain_clear(&ac->data);
+                }
+            }
+            if (tr.error) {
+                ret = 0;
+                break;
+            }
+            if (!ac->closed) {
+                sshfwd_unthrottle(ac->sc, 0);
+            }
+        }
+
+        if (fz_timer_check(&timer)) {
+            fzprintf(sftpTransfer, "%d", (int)(tr.transferred - reported));
+            reported = tr.transferred;
+        }
+
+        if (ac->closed) {
+            break;
+        }
+        if (!archive_loop(backend)) {
+            ret = 0;
+            break;
+        }
+    }
+
+    if (ret && !tr.error && tr.state != TAR_END && (tr.file || tr.remaining || tr.header_len)) {
+        fzprintf(sftpError, "Unexpected end of archive");
+        ret = 0;
+    }
+
+    if (tr.file) {
+        close_wfile(tr.file);
+    }
+    strbuf_free(tr.extended);
+    sfree(tr.next_name);
+
+    return archive_channel_close(backend, ac, ret);
+}
+
+/* ----------------------------------------------------------------------
+ * Writing tar streams.
+ */
+
+static bool archive_write(Backend *backend, ArchiveChannel *ac, const void *data, size_t len)
+{
+    while (!ac->input_wanted && !ac->closed) {
+        if (!archive_loop(backend)) {
+            return false;
+        }
+    }
+    if (ac->closed) {
+        fzprintf(sftpError, "tar exited prematurely");
+        return false;
+    }
+
+    if (sshfwd_write(ac->sc, data, len) > ARCHIVE_MAX_BACKLOG) {
+        /* Gets set again once the backlog has been sent */
+        ac->input_wanted = false;
+    }
+    return true;
+}
+
+static void tar_octal(unsigned char *field, size_t len, uint64_t value)
+{
+    /* Fits in len - 1 octal digits plus terminator? */
+    if ((len - 1) * 3 >= 64 || !(value >> ((len - 1) * 3))) {
+        for (size_t i = len - 1; i-- > 0; ) {
+            field[i] = (unsigned char)('0' + (value & 7));
+            value >>= 3;
+        }
+        field[len - 1] = 0;
+    } else {
+        /* GNU base-256 */
+        memset(field, 0, len);
+        field[0] = 0x80;
+        for (size_t i = len - 1; i > 0 && value; --i) {
+            field[i] = (unsigned char)(value & 0xff);
+            value >>= 8;
+        }
+    }
+}
+
+static void tar_make_header(unsigned char *h, const char *name, size_t namelen,
+                            char type, uint64_t size, uint64_t mtime)
+{
+    memset(h, 0, TAR_BLOCK);
+    memcpy(h, name, namelen < 100 ? namelen : 100);
+    tar_octal(h + 100, 8, type == '5' ? 0755 : 0644);
+    tar_octal(h + 108, 8, 0);
+    tar_octal(h + 116, 8, 0);
+    tar_octal(h + 124, 12, size);
+    tar_octal(h + 136, 12, mtime);
+    h[156] = (unsigned char)type;
+
+    /* GNU format, so that long names can use 'L' entries */
+    memcpy(h + 257, "ustar  ", 8);
+
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        sum += h[i];
+    }
+    tar_octal(h + 148, 7, sum);
+    h[155] = ' ';
+}
+
+static bool archive_write_padding(Backend *backend, ArchiveChannel *ac, uint64_t size)
+{
+    static const unsigned char zeros[TAR_BLOCK];
+    size_t padding = (size_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+    return !padding || archive_write(backend, ac, zeros, padding);
+}
+
+static bool archive_write_header(Backend *backend, ArchiveChannel *ac, const char *name,
+                                 char type, uint64_t size, uint64_t mtime)
+{
+    unsigned char h[TAR_BLOCK];
+    char *full = dupcat(name, type == '5' ? "/" : "");
+    size_t len = strlen(full);
+    bool ok = true;
+
+    if (len > 100) {
+        tar_make_header(h, "././@LongLink", 13, 'L', len + 1, 0);
+        ok = archive_write(backend, ac, h, TAR_BLOCK) &&
+            archive_write(backend, ac, full, len + 1) &&
+            archive_write_padding(backend, ac, len + 1);
+    }
+    if (ok) {
+        tar_make_header(h, full, len, type, size, mtime);
+        ok = archive_write(backend, ac, h, TAR_BLOCK);
+    }
+
+    sfree(full);
+    return ok;
+}
+
+static bool archive_add_file(Backend *backend, ArchiveChannel *ac, const char *name,
+                             uint64_t size, uint64_t mtime,
+                             _fztimer *timer, uint64_t *interval)
+{
+    RFile *file = open_existing_file(name, 0, NULL, NULL, NULL);
+    if (!file) {
+        fzprintf(sftpError, "local: unable to open %s", name);
+        return false;
+    }
+
+    bool ok = archive_write_header(backend, ac, name, '0', size, mtime);
+
+    char buffer[4096*4];
+    uint64_t remaining = size;
+    while (ok && remaining) {
+        int len = read_from_file(file, buffer, remaining < sizeof(buffer) ? (int)remaining : (int)sizeof(buffer));
+        if (len <= 0) {
+            /* The header has been sent already, there is no way to recover */
+            fzprintf(sftpError, "error while reading local file %s", name);
+            ok = false;
+            break;
+        }
+        ok = archive_write(backend, ac, buffer, len);
+        remaining -= len;
+        *interval += len;
+
+        if (fz_timer_check(timer)) {
+            fzprintf(sftpTransfer, "%d", (int)*interval);
+            *interval = 0;
+        }
+    }
+
+    close_rfile(file);
+
+    return ok && archive_write_padding(backend, ac, size);
+}
+
+int archive_upload(Backend *backend, const char *dir)
+{
+    char *quoted = shell_quote(dir);
+    ArchiveChannel *ac = archive_channel_open(
+        backend, dupprintf("mkdir -p %s && tar -xf - -C %s", quoted, quoted));
+    sfree(quoted);
+    if (!ac) {
+        return 0;
+    }
+    ac->discard_output = true;
+
+    _fztimer timer;
+    fz_timer_init(&timer);
+    uint64_t interval = 0;
+
+    int ret = ac->started;
+    while (ret) {
+        /* Reply is one of -0 at the end, -1 <size> <mtime> <name> for
+         * directories or -2 <size> <mtime> <name> for files. */
+        fzprintf_raw(sftp_io_member, "n\n");
+        char *reply = priority_read();
+        if (reply[1] == '-') {
+            sfree(reply);
+            ret = 0;
+            break;
+        }
+
+        char *p = reply + 1;
+        uint64_t type = next_uint64(&p);
+        uint64_t size = next_uint64(&p);
+        uint64_t mtime = next_uint64(&p);
+        if (!type) {
+            sfree(reply);
+            break;
+        }
+
+        if (!*p) {
+            fzprintf(sftpError, "Archive member without name");
+            ret = 0;
+        } else if (type == 1) {
+            ret = archive_write_header(backend, ac, p, '5', 0, mtime);
+        } else {
+            ret = archive_add_file(backend, ac, p, size, mtime, &timer, &interval);
+        }
+        sfree(reply);
+    }
+
+    if (ret) {
+        static const unsigned char end[2 * TAR_BLOCK];
+        ret = archive_write(backend, ac, end, sizeof(end));
+    }
+    if (interval) {
+        fzprintf(sftpTransfer, "%d", (int)interval);
+    }
+
+    if (ret) {
+        sshfwd_write_eof(ac->sc);
+        while (!ac->closed) {
+            if (!archive_loop(backend)) {
+                ret = 0;
+                break;
+            }
+        }
+    }
+
+    return archive_channel_close(backend, ac, ret);
+}
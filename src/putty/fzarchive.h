@@ -0,0 +1,18 @@
+#ifndef FILEZILLA_PUTTY_FZARCHIVE_HEADER
+#define FILEZILLA_PUTTY_FZARCHIVE_HEADER
+
+/*
+ * Transfers of whole directory trees as a single tar stream, produced
+ * or consumed by tar running on the server in an additional session
+ * channel. Both return 1 on success and 0 on failure.
+ */
+
+/* Receives the contents of the remote directory dir. Each member is
+ * announced to the engine, which decides where to write it. */
+int archive_download(Backend *backend, const char *dir);
+
+/* Creates the remote directory dir if needed and fills it with the
+ * members the engine hands out one after another. */
+int archive_upload(Backend *backend, const char *dir);
+
+#endif
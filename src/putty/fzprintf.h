@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 10
+#define FZSFTP_PROTOCOL_VERSION 11
 
 typedef enum
 {
@@ -33,6 +33,7 @@ typedef enum
     sftp_io_open,
     sftp_io_nextbuf,
     sftp_io_finalize,
+    sftp_io_member, /* archive transfers: announces or requests the next member */
 } sftpEventTypes;
 
 extern bool pending_reply;
@@ -37,28 +37,36 @@ char* priority_read()
     while (!ret) {
         DWORD read;
         BOOL r;
+        strbuf *sb = strbuf_new();
+
+        /* Replies can be longer than a single read, e.g. those naming
+         * archive members, so read up to the end of the line. */
+        do {
+            r = ReadFile(hin, buffer, 255, &read, 0);
+            if (!r || read == 0) {
+                    fzprintf(sftpError, "ReadFile failed in priority_read");
+                    cleanup_exit(1);
+            }
+            put_data(sb, buffer, read);
+        } while (buffer[read - 1] != '\n');
 
-        r = ReadFile(hin, buffer, 255, &read, 0);
-        if (!r || read == 0) {
-                fzprintf(sftpError, "ReadFile failed in priority_read");
-                cleanup_exit(1);
-        }
-        while (read && (buffer[read - 1] == '\r' || buffer[read - 1] == '\n')) {
-            --read;
+        while (sb->len && (sb->s[sb->len - 1] == '\r' || sb->s[sb->len - 1] == '\n')) {
+            strbuf_shrink_to(sb, sb->len - 1);
         }
-        buffer[read] = 0;
+        char *line = strbuf_to_str(sb);
 
-        if (buffer[0] != '-') {
+        if (line[0] != '-') {
             if (input_pushback != 0) {
+                sfree(line);
                 fzprintf(sftpError, "input_pushback not null!");
                 cleanup_exit(1);
             }
             else {
-                input_pushback = dupstr(buffer);
+                input_pushback = line;
             }
         }
         else {
-            ret = dupstr(buffer);
+            ret = line;
         }
     }
 
@@ -18,6 +18,7 @@
 #include "storage.h"
 #include "ssh.h"
 #include "sftp.h"
+#include "fzarchive.h"
 
 const char *const appname = "FZSFTP";
 
@@ -274,7 +275,7 @@ static void not_connected(void)
 /* ----------------------------------------------------------------------
  * The meat of the `get' and `put' commands.
  */
-int sftp_get_file(char *fname, char *outfname, bool restart)
+int sftp_get_file(char *fname, char *outfname, bool restart, uint64_t end)
 {
     struct fxp_handle *fh;
     struct sftp_packet *pktin;
@@ -328,7 +329,7 @@ int sftp_get_file(char *fname, char *outfname, bool restart)
      * thus put up a progress bar.
      */
     ret = 1;
-    xfer = xfer_download_init(fh, offset);
+    xfer = xfer_download_init_range(fh, offset, end);
     while (!xfer_done(xfer)) {
         void *vbuf;
         int retd, len;
@@ -809,17 +810,40 @@ int sftp_general_get(struct sftp_command *cmd, int restart)
 {
     char *fname, *origfname, *outfname;
     int ret;
+    uint64_t end = UINT64_MAX;
 
     if (!backend) {
         not_connected();
         return 0;
     }
 
-    if (cmd->nwords != 3) {
+    /*
+     * reget optionally takes the offset at which to stop reading,
+     * used for the segments of segmented downloads.
+     */
+    if (cmd->nwords != 3 && (!restart || cmd->nwords != 4)) {
         fzprintf(sftpError, "%s: expects a filename", cmd->words[0]);
         return 0;
     }
 
+    if (cmd->nwords == 4) {
+        char *p = cmd->words[3];
+        end = 0;
+        if (!*p) {
+            fzprintf(sftpError, "%s: not a valid offset", cmd->words[0]);
+            return 0;
+        }
+        while (*p) {
+            char c = *p++;
+            if (c < '0' || c > '9') {
+                fzprintf(sftpError, "%s: not a valid offset", cmd->words[0]);
+                return 0;
+            }
+            end *= 10;
+            end += c - '0';
+        }
+    }
+
     ret = 1;
     origfname = cmd->words[1];
     outfname = cmd->words[2];
@@ -830,7 +854,7 @@ int sftp_general_get(struct sftp_command *cmd, int restart)
         return 0;
     }
 
-    ret = sftp_get_file(fname, outfname, restart);
+    ret = sftp_get_file(fname, outfname, restart, end);
     sfree(fname);
     return ret;
 }
@@ -889,6 +913,63 @@ int sftp_cmd_reput(struct sftp_command *cmd)
     return sftp_general_put(cmd, true);
 }
 
+/*
+ * Transfer a whole directory tree as one tar stream, see fzarchive.c.
+ * The engine takes care of the local side, one member at a time.
+ */
+int sftp_cmd_gettar(struct sftp_command *cmd)
+{
+    char *dir;
+    int ret;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 2) {
+        fzprintf(sftpError, "%s: expects a directory", cmd->words[0]);
+        return 0;
+    }
+
+    dir = canonify(cmd->words[1], false);
+    if (!dir) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+
+    ret = archive_download(backend, dir);
+    sfree(dir);
+    return ret;
+}
+
+int sftp_cmd_puttar(struct sftp_command *cmd)
+{
+    char *dir;
+    int ret;
+
+    if (!backend) {
+        not_connected();
+        return 0;
+    }
+
+    if (cmd->nwords != 2) {
+        fzprintf(sftpError, "%s: expects a directory", cmd->words[0]);
+        return 0;
+    }
+
+    /* The target directory may not exist yet */
+    dir = canonify(cmd->words[1], true);
+    if (!dir) {
+        fzprintf(sftpError, "%s: canonify: %s", cmd->words[1], fxp_error());
+        return 0;
+    }
+
+    ret = archive_upload(backend, dir);
+    sfree(dir);
+    return ret;
+}
+
 int sftp_cmd_mkdir(struct sftp_command *cmd)
 {
     char *dir;
@@ -1461,6 +1542,9 @@ static struct sftp_cmd_lookup {
     {
         "get", sftp_cmd_get
     },
+    {
+        "gettar", sftp_cmd_gettar
+    },
     {
         "keyfile", sftp_cmd_keyfile
     },
@@ -1486,6 +1570,9 @@ static struct sftp_cmd_lookup {
     {
         "put", sftp_cmd_put
     },
+    {
+        "puttar", sftp_cmd_puttar
+    },
     {
         "pwd", sftp_cmd_pwd
     },
@@ -1749,6 +1836,15 @@ void agent_schedule_callback(void (*callback)(void *, void *, int),
  */
 static bufchain received_data;
 static BinarySink *stderr_bs;
+
+/*
+ * While sftp_recvdata is blocked waiting for more data and nothing is
+ * left in received_data, incoming channel data is copied straight
+ * into the caller's buffer instead of being staged in the bufchain
+ * first. On bulk downloads this saves one copy of every byte.
+ */
+static char *recv_target;
+static size_t recv_target_len;
 static size_t psftp_output(
     Seat *seat, bool is_stderr, const void *data, size_t len)
 {
@@ -1761,7 +1857,18 @@ static size_t psftp_output(
         return 0;
     }
 
-    bufchain_add(&received_data, data, len);
+    if (recv_target_len) {
+        size_t n = len < recv_target_len ? len : recv_target_len;
+        memcpy(recv_target, data, n);
+        recv_target += n;
+        recv_target_len -= n;
+        data = (const char *)data + n;
+        len -= n;
+    }
+
+    if (len) {
+        bufchain_add(&received_data, data, len);
+    }
     return 0;
 }
 
@@ -1781,18 +1888,26 @@ static bool psftp_eof(Seat *seat)
 
 bool sftp_recvdata(char *buf, size_t len)
 {
-    while (len > 0) {
-        while (bufchain_size(&received_data) == 0) {
-            if (backend_exitcode(backend) >= 0 ||
-                ssh_sftp_loop_iteration() < 0)
-                return false;          /* doom */
-        }
-
+    if (bufchain_size(&received_data)) {
         size_t got = bufchain_fetch_consume_up_to(&received_data, buf, len);
         buf += got;
         len -= got;
     }
 
+    /*
+     * Anything still missing gets delivered directly into buf by
+     * psftp_output.
+     */
+    recv_target = buf;
+    recv_target_len = len;
+    while (recv_target_len > 0) {
+        if (backend_exitcode(backend) >= 0 ||
+            ssh_sftp_loop_iteration() < 0) {
+            recv_target_len = 0;
+            return false;          /* doom */
+        }
+    }
+
     return true;
 }
 bool sftp_senddata(const char *buf, size_t len)
@@ -901,7 +901,7 @@ struct req {
 };
 
 struct fxp_xfer {
-    uint64_t offset, furthestdata, filesize;
+    uint64_t offset, furthestdata, filesize, end;
     int req_totalsize, req_maxsize;
     bool eof, err;
     struct fxp_handle *fh;
@@ -921,6 +921,7 @@ static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
     xfer->req_maxsize = 1048576*4;
     xfer->err = false;
     xfer->filesize = UINT64_MAX;
+    xfer->end = UINT64_MAX;
     xfer->furthestdata = 0;
     fz_timer_init(&xfer->send_timer);
     xfer->sent_interval = 0;
@@ -947,6 +948,15 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         struct req *rr;
         struct sftp_request *req;
 
+        if (xfer->offset >= xfer->end) {
+            /*
+             * Everything up to the end of the requested range has
+             * been asked for, pretend we've reached EOF.
+             */
+            xfer->eof = true;
+            break;
+        }
+
         rr = snew(struct req);
         rr->offset = xfer->offset;
         rr->complete = 0;
@@ -961,6 +971,8 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         rr->next = NULL;
 
         rr->len = 32768;
+        if (xfer->end - xfer->offset < (uint64_t)rr->len)
+            rr->len = (int)(xfer->end - xfer->offset);
         rr->buffer = snewn(rr->len, char);
         sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
         fxp_set_userdata(req, rr);
@@ -975,10 +987,21 @@ void xfer_download_queue(struct fxp_xfer *xfer)
 }
 
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
+{
+    return xfer_download_init_range(fh, offset, UINT64_MAX);
+}
+
+/*
+ * Like xfer_download_init, but stops reading once the given end
+ * offset is reached.
+ */
+struct fxp_xfer *xfer_download_init_range(struct fxp_handle *fh, uint64_t offset,
+                                          uint64_t end)
 {
     struct fxp_xfer *xfer = xfer_init(fh, offset);
 
     xfer->eof = false;
+    xfer->end = end;
     xfer_download_queue(xfer);
 
     return xfer;
@@ -1212,3 +1212,9 @@ size_t ssh_pending_receive(Backend *be)
     int r = recv_peek(ssh->s, tmp, 64);
     return r > 0 ? r : 0;
 }
+
+ConnectionLayer *ssh_get_connection_layer(Backend *be)
+{
+    Ssh *ssh = container_of(be, Ssh, backend);
+    return ssh ? ssh->cl : NULL;
+}
@@ -35,7 +35,8 @@ struct ssh_channel;
  *    to the remote side. This actually has nothing to do with the
  *    size of the _packet_, but is instead a limit on the amount
  *    of data we're willing to receive in a single SSH2 channel
- *    data message.
+ *    data message. Together with the packet overhead it has to fit
+ *    into OUR_V2_PACKETLIMIT.
  *
  *  - OUR_V2_PACKETLIMIT is actually the maximum size of SSH
  *    _packet_ we're prepared to cope with.  It must be a multiple
@@ -46,7 +47,7 @@ struct ssh_channel;
 #define SSH_MAX_BACKLOG 32768
 #define OUR_V2_WINSIZE 16384
 #define OUR_V2_BIGWIN 0x7fffffff
-#define OUR_V2_MAXPKT 0x4000UL
+#define OUR_V2_MAXPKT 0x8000UL
 #define OUR_V2_PACKETLIMIT 0x9000UL
 
 typedef struct PacketQueueNode PacketQueueNode;
@@ -1573,3 +1574,4 @@ bool ssh_transient_hostkey_cache_has(
 bool ssh_transient_hostkey_cache_non_empty(ssh_transient_hostkey_cache *thc);
 
 size_t ssh_pending_receive(Backend *be);
+ConnectionLayer *ssh_get_connection_layer(Backend *be);
@@ -559,12 +559,15 @@ static bool ssh2_connection_filter_queue(struct ssh2_connection_state *s)
                     /*
                      * If it looks like the remote end hit the end of
                      * its window, and we didn't want it to do that,
-                     * think about using a larger window.
+                     * think about using a larger window. Double it,
+                     * so that bulk transfers on long fat links reach
+                     * a window covering the bandwidth-delay product
+                     * after a few round trips.
                      */
                     if (c->remlocwin <= 0 &&
                         c->throttle_state == UNTHROTTLED &&
                         c->locmaxwin < 0x40000000)
-                        c->locmaxwin += OUR_V2_WINSIZE;
+                        c->locmaxwin *= 2;
 
                     /*
                      * If we are not buffering too much data, enlarge
@@ -0,0 +1,337 @@
+// Decoder for the binary trace files written by the engine if the
+// "Trace file" option is set.
+//
+// Usage: fztrace [--timeline] [--engine <id>] <file>...
+//
+// Without --timeline, a latency breakdown of each transfer is printed.
+// Pass rotated files oldest first.
+
+#include "../engine/trace_format.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+char const* event_name(uint16_t event)
+{
+	switch (static_cast<trace_event>(event)) {
+	case trace_event::dropped: return "dropped";
+	case trace_event::log: return "log";
+	case trace_event::transfer_start: return "transfer_start";
+	case trace_event::transfer_end: return "transfer_end";
+	case trace_event::socket_connected: return "socket_connected";
+	case trace_event::socket_receive: return "socket_receive";
+	case trace_event::socket_send: return "socket_send";
+	case trace_event::socket_send_blocked: return "socket_send_blocked";
+	case trace_event::socket_transfer_end: return "socket_transfer_end";
+	case trace_event::reader_read: return "reader_read";
+	case trace_event::reader_wait: return "reader_wait";
+	case trace_event::reader_ready: return "reader_ready";
+	case trace_event::writer_write: return "writer_write";
+	case trace_event::writer_wait: return "writer_wait";
+	case trace_event::writer_ready: return "writer_ready";
+	case trace_event::oplock_lock: return "oplock_lock";
+	case trace_event::oplock_obtained: return "oplock_obtained";
+	case trace_event::oplock_unlock: return "oplock_unlock";
+	default: return nullptr;
+	}
+}
+
+struct trace_file
+{
+	int64_t start_time{};
+	std::vector<trace_record> records;
+};
+
+bool load(char const* name, trace_file & out)
+{
+	FILE* f = fopen(name, "rb");
+	if (!f) {
+		fprintf(stderr, "%s: Could not open file\n", name);
+		return false;
+	}
+
+	trace_file_header header{};
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, trace_magic, sizeof(trace_magic))) {
+		fprintf(stderr, "%s: Not a trace file\n", name);
+		fclose(f);
+		return false;
+	}
+	if (header.record_size != sizeof(trace_record)) {
+		fprintf(stderr, "%s: Unexpected record size, the file might be from a host with different byte order\n", name);
+		fclose(f);
+		return false;
+	}
+	if (header.version != trace_version) {
+		fprintf(stderr, "%s: Unsupported version %" PRIu32 "\n", name, header.version);
+		fclose(f);
+		return false;
+	}
+
+	out.start_time = header.start_time;
+
+	trace_record r;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		out.records.push_back(r);
+	}
+	// A partially written record at the end is ignored
+
+	fclose(f);
+	return true;
+}
+
+std::string format_time(int64_t start_time, uint64_t t)
+{
+	int64_t const ms = start_time + static_cast<int64_t>(t / 1000);
+	time_t const s = static_cast<time_t>(ms / 1000);
+
+	char buf[64];
+	struct tm tm{};
+#ifdef _WIN32
+	localtime_s(&tm, &s);
+#else
+	localtime_r(&s, &tm);
+#endif
+	size_t len = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(buf + len, sizeof(buf) - len, ".%06u", static_cast<unsigned int>((ms % 1000) * 1000 + t % 1000));
+	return buf;
+}
+
+void print_timeline(trace_file const& file, int64_t engine)
+{
+	for (auto const& r : file.records) {
+		if (engine >= 0 && r.engine_id != engine && r.event != static_cast<uint16_t>(trace_event::dropped)) {
+			continue;
+		}
+		char const* name = event_name(r.event);
+		if (name) {
+			printf("%s %4" PRIu32 " %-20s %" PRId64 " %" PRId64 "\n", format_time(file.start_time, r.time).c_str(), r.engine_id, name, r.args[0], r.args[1]);
+		}
+		else {
+			printf("%s %4" PRIu32 " event_%-14u %" PRId64 " %" PRId64 "\n", format_time(file.start_time, r.time).c_str(), r.engine_id, static_cast<unsigned int>(r.event), r.args[0], r.args[1]);
+		}
+	}
+}
+
+// Time is attributed to whatever the transfer was waiting for
+struct transfer
+{
+	uint64_t start{};
+	bool download{};
+
+	int64_t socket_bytes{};
+	int64_t disk_bytes{};
+	uint64_t disk_time{};
+
+	// Waiting for the disk
+	uint64_t disk_wait{};
+	uint64_t disk_wait_since{};
+
+	// Sending would block
+	uint64_t network_wait{};
+	uint64_t network_wait_since{};
+
+	// Waiting for another engine to finish working on the same directory
+	uint64_t lock_wait{};
+	uint64_t lock_wait_since{};
+
+	uint64_t first_data{};
+	uint64_t log_messages{};
+};
+
+double seconds(uint64_t us)
+{
+	return static_cast<double>(us) / 1000000.0;
+}
+
+double percent(uint64_t part, uint64_t total)
+{
+	return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+}
+
+void print_transfer(trace_file const& file, uint32_t engine_id, transfer const& t, trace_record const& end)
+{
+	uint64_t const duration = end.time - t.start;
+	int64_t const bytes = t.socket_bytes ? t.socket_bytes : t.disk_bytes;
+
+	printf("%s engine %" PRIu32 " %s, result %" PRId64 "\n", format_time(file.start_time, t.start).c_str(), engine_id, t.download ? "download" : "upload", end.args[0]);
+	printf("  duration       %10.3f s, %" PRId64 " bytes", seconds(duration), bytes);
+	if (duration) {
+		printf(", %.1f KiB/s", static_cast<double>(bytes) / 1024.0 / seconds(duration));
+	}
+	printf("\n");
+	if (t.first_data) {
+		printf("  setup          %10.3f s  (%5.1f%%) until the first data\n", seconds(t.first_data - t.start), percent(t.first_data - t.start, duration));
+	}
+	printf("  lock wait      %10.3f s  (%5.1f%%)\n", seconds(t.lock_wait), percent(t.lock_wait, duration));
+	printf("  disk wait      %10.3f s  (%5.1f%%) %s\n", seconds(t.disk_wait), percent(t.disk_wait, duration), t.download ? "writer full" : "reader empty");
+	printf("  network wait   %10.3f s  (%5.1f%%) send blocked\n", seconds(t.network_wait), percent(t.network_wait, duration));
+	printf("  disk I/O       %10.3f s  in %" PRId64 " bytes\n", seconds(t.disk_time), t.disk_bytes);
+	printf("  log messages   %10" PRIu64 "\n", t.log_messages);
+}
+
+void print_transfers(trace_file const& file, int64_t engine)
+{
+	std::map<uint32_t, transfer> active;
+
+	for (auto const& r : file.records) {
+		auto const event = static_cast<trace_event>(r.event);
+		if (event == trace_event::dropped) {
+			printf("%s %" PRId64 " records got dropped, the following numbers may be incomplete\n", format_time(file.start_time, r.time).c_str(), r.args[0]);
+			continue;
+		}
+		if (engine >= 0 && r.engine_id != engine) {
+			continue;
+		}
+
+		if (event == trace_event::transfer_start) {
+			auto & t = active[r.engine_id];
+			t = transfer();
+			t.start = r.time;
+			t.download = r.args[0] != 0;
+			continue;
+		}
+
+		auto it = active.find(r.engine_id);
+		if (it == active.end()) {
+			continue;
+		}
+		auto & t = it->second;
+
+		switch (event) {
+		case trace_event::transfer_end:
+			print_transfer(file, r.engine_id, t, r);
+			active.erase(it);
+			break;
+		case trace_event::log:
+			++t.log_messages;
+			break;
+		case trace_event::socket_receive:
+		case trace_event::socket_send:
+			if (!t.first_data) {
+				t.first_data = r.time;
+			}
+			t.socket_bytes += r.args[0];
+			if (t.network_wait_since) {
+				t.network_wait += r.time - t.network_wait_since;
+				t.network_wait_since = 0;
+			}
+			break;
+		case trace_event::socket_send_blocked:
+			if (!t.network_wait_since) {
+				t.network_wait_since = r.time;
+			}
+			break;
+		case trace_event::reader_read:
+		case trace_event::writer_write:
+			if (r.args[0] > 0) {
+				t.disk_bytes += r.args[0];
+			}
+			if (r.args[1] > 0) {
+				t.disk_time += static_cast<uint64_t>(r.args[1]);
+			}
+			break;
+		case trace_event::reader_wait:
+		case trace_event::writer_wait:
+			if (!t.disk_wait_since) {
+				t.disk_wait_since = r.time;
+			}
+			break;
+		case trace_event::reader_ready:
+		case trace_event::writer_ready:
+			if (t.disk_wait_since) {
+				t.disk_wait += r.time - t.disk_wait_since;
+				t.disk_wait_since = 0;
+			}
+			break;
+		case trace_event::oplock_lock:
+			if (r.args[1] && !t.lock_wait_since) {
+				t.lock_wait_since = r.time;
+			}
+			break;
+		case trace_event::oplock_obtained:
+		case trace_event::oplock_unlock:
+			if (t.lock_wait_since) {
+				t.lock_wait += r.time - t.lock_wait_since;
+				t.lock_wait_since = 0;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (auto const& a : active) {
+		printf("%s engine %" PRIu32 " %s did not finish within the trace\n", format_time(file.start_time, a.second.start).c_str(), a.first, a.second.download ? "download" : "upload");
+	}
+}
+
+int usage(char const* self)
+{
+	fprintf(stderr, "Usage: %s [--timeline] [--engine <id>] <file>...\n", self);
+	fprintf(stderr, "Prints a latency breakdown of each transfer, or with --timeline all records.\n");
+	fprintf(stderr, "Pass rotated trace files oldest first.\n");
+	return 1;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	bool timeline{};
+	int64_t engine = -1;
+	std::vector<char const*> files;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--timeline")) {
+			timeline = true;
+		}
+		else if (!strcmp(argv[i], "--engine")) {
+			if (++i >= argc) {
+				return usage(argv[0]);
+			}
+			engine = strtoll(argv[i], nullptr, 10);
+		}
+		else if (argv[i][0] == '-') {
+			return usage(argv[0]);
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.empty()) {
+		return usage(argv[0]);
+	}
+
+	// Files are combined into one. Each file has its own start time, rebase
+	// the records onto the first one.
+	trace_file all;
+	for (size_t i = 0; i < files.size(); ++i) {
+		trace_file file;
+		if (!load(files[i], file)) {
+			return 1;
+		}
+		if (!i) {
+			all.start_time = file.start_time;
+		}
+		int64_t const offset = (file.start_time - all.start_time) * 1000;
+		for (auto r : file.records) {
+			int64_t const t = static_cast<int64_t>(r.time) + offset;
+			r.time = t > 0 ? static_cast<uint64_t>(t) : 0;
+			all.records.push_back(r);
+		}
+	}
+
+	if (timeline) {
+		print_timeline(all, engine);
+	}
+	else {
+		print_transfers(all, engine);
+	}
+
+	return 0;
+}
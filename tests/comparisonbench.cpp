@@ -0,0 +1,188 @@
+#include "../src/commonui/listing_comparison.h"
+
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+/*
+ * Compares two synthetic directory trees of one million files each the way
+ * a recursive comparison would, streaming one directory after the other
+ * through listing_comparison in chunks.
+ *
+ * Not part of the test suite, build with `make comparisonbench`.
+ */
+
+namespace {
+size_t const directories = 1000;
+size_t const files_per_directory = 1000;
+size_t const subdirectories_per_directory = 10;
+size_t const chunk_size = 256;
+
+typedef std::vector<listing_comparison::entry> listing;
+
+struct tree final
+{
+	std::vector<listing> left;
+	std::vector<listing> right;
+
+	size_t removed{};
+	size_t added{};
+	size_t changed{};
+};
+
+tree make_trees()
+{
+	std::mt19937 rng(1);
+	std::vector<std::wstring> const stems = {L"IMG_", L"report", L"Thumbs", L"index", L"Main", L"log", L"data", L"README", L"backup", L"track"};
+	std::vector<std::wstring> const suffixes = {L".txt", L".jpg", L".TMP", L".bak", L".o", L".cpp", L".ini", L".db", L"", L".html"};
+
+	tree t;
+	t.left.resize(directories);
+	t.right.resize(directories);
+	for (size_t d = 0; d < directories; ++d) {
+		auto & left = t.left[d];
+		auto & right = t.right[d];
+		left.reserve(files_per_directory + subdirectories_per_directory);
+		right.reserve(files_per_directory + subdirectories_per_directory + files_per_directory / 50);
+
+		for (size_t i = 0; i < subdirectories_per_directory; ++i) {
+			listing_comparison::entry e;
+			e.key = L"Dir" + fz::to_wstring(i);
+			e.dir = true;
+			left.push_back(e);
+			right.push_back(e);
+		}
+
+		for (size_t i = 0; i < files_per_directory; ++i) {
+			listing_comparison::entry e;
+			e.key = stems[rng() % stems.size()] + fz::to_wstring(i) + suffixes[rng() % suffixes.size()];
+			e.size = static_cast<int64_t>(rng() % 100000);
+
+			if (rng() % 50 == 0) {
+				++t.removed;
+			}
+			else {
+				auto r = e;
+				if (rng() % 10 == 0) {
+					++r.size;
+					++t.changed;
+				}
+				right.push_back(std::move(r));
+			}
+			left.push_back(std::move(e));
+
+			if (rng() % 50 == 0) {
+				listing_comparison::entry n;
+				n.key = L"new" + fz::to_wstring(i) + L".txt";
+				n.size = 1;
+				right.push_back(std::move(n));
+				++t.added;
+			}
+		}
+	}
+
+	return t;
+}
+
+// The order in which the file lists hand out their entries
+void sort(listing & entries)
+{
+	std::sort(entries.begin(), entries.end(), [](auto const& lhs, auto const& rhs) {
+		if (lhs.dir != rhs.dir) {
+			return lhs.dir;
+		}
+		return lhs.key < rhs.key;
+	});
+}
+
+std::vector<listing> split(listing && entries)
+{
+	std::vector<listing> chunks;
+	for (size_t pos = 0; pos < entries.size(); pos += chunk_size) {
+		auto const first = entries.begin() + pos;
+		auto const last = entries.begin() + std::min(pos + chunk_size, entries.size());
+		chunks.emplace_back(std::make_move_iterator(first), std::make_move_iterator(last));
+	}
+	return chunks;
+}
+}
+
+int main()
+{
+	tree t = make_trees();
+
+	size_t files{};
+	for (auto const& l : t.left) {
+		files += l.size();
+	}
+
+	int ret = 0;
+	for (auto const mode : {NameSortMode::case_insensitive, NameSortMode::natural}) {
+		tree trees = t;
+		listing_comparison comparison(0, mode, 0, false, fz::duration());
+
+		fz::monotonic_clock start = fz::monotonic_clock::now();
+		for (size_t d = 0; d < directories; ++d) {
+			comparison.prepare(trees.left[d]);
+			comparison.prepare(trees.right[d]);
+		}
+		auto const prepare_time = fz::monotonic_clock::now() - start;
+
+		// Split each directory into the chunks a recursive listing would deliver
+		std::vector<std::vector<listing>> left_chunks(directories);
+		std::vector<std::vector<listing>> right_chunks(directories);
+		for (size_t d = 0; d < directories; ++d) {
+			sort(trees.left[d]);
+			sort(trees.right[d]);
+			left_chunks[d] = split(std::move(trees.left[d]));
+			right_chunks[d] = split(std::move(trees.right[d]));
+		}
+
+		size_t rows{};
+		size_t different{};
+		size_t lonely_left{};
+		size_t lonely_right{};
+		std::vector<unsigned char> leftFlags, rightFlags;
+
+		start = fz::monotonic_clock::now();
+		for (size_t d = 0; d < directories; ++d) {
+			auto & left = left_chunks[d];
+			auto & right = right_chunks[d];
+			for (size_t i = 0; i < left.size() || i < right.size(); ++i) {
+				if (i < left.size()) {
+					comparison.add(true, std::move(left[i]));
+				}
+				if (i < right.size()) {
+					comparison.add(false, std::move(right[i]));
+				}
+				comparison.compare(false, leftFlags, rightFlags);
+			}
+			comparison.compare(true, leftFlags, rightFlags);
+
+			rows += leftFlags.size();
+			for (size_t i = 0; i < leftFlags.size(); ++i) {
+				different += (leftFlags[i] == listing_comparison::different) ? 1 : 0;
+				lonely_left += (leftFlags[i] == listing_comparison::lonely) ? 1 : 0;
+				lonely_right += (rightFlags[i] == listing_comparison::lonely) ? 1 : 0;
+			}
+			leftFlags.clear();
+			rightFlags.clear();
+		}
+		auto const compare_time = fz::monotonic_clock::now() - start;
+
+		printf("%s: %zu files per side, %zu rows\n", mode == NameSortMode::natural ? "Natural" : "Case-insensitive", files, rows);
+		printf("  Sort keys: %lld ms\n", static_cast<long long>(prepare_time.get_milliseconds()));
+		printf("  Merge:     %lld ms\n", static_cast<long long>(compare_time.get_milliseconds()));
+		printf("  Total:     %lld ms\n", static_cast<long long>((prepare_time + compare_time).get_milliseconds()));
+
+		if (different != t.changed || lonely_left != t.removed || lonely_right != t.added) {
+			printf("Unexpected result: %zu different, %zu only left, %zu only right\n", different, lonely_left, lonely_right);
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
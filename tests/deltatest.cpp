@@ -0,0 +1,244 @@
+#include "../src/include/file_hash.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <vector>
+
+/*
+ * This testsuite asserts the correctness of the chunk arithmetic and local
+ * chunk hashing used when uploading only the changed part of a file.
+ */
+
+class CDeltaTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDeltaTest);
+	CPPUNIT_TEST(testChunks);
+	CPPUNIT_TEST(testUploadOffset);
+	CPPUNIT_TEST(testLocalChunks);
+	CPPUNIT_TEST(testCommonPrefix);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown();
+
+	void testChunks();
+	void testUploadOffset();
+	void testLocalChunks();
+	void testCommonPrefix();
+
+protected:
+	std::wstring write_file(std::wstring const& name, std::string const& data);
+
+	// What a server answers to HASH after RANG first last
+	std::string remote_hash(std::string const& remote, int64_t first, int64_t last);
+
+	// Hashes both sides the way CFtpDeltaOpData does, returns the common prefix
+	int64_t compare(std::string const& local, std::string const& remote);
+
+	std::vector<std::wstring> files_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDeltaTest);
+
+namespace {
+int64_t const mib = 1024 * 1024;
+
+std::string make_data(size_t size, unsigned int seed)
+{
+	std::string ret;
+	ret.reserve(size);
+	for (size_t i = 0; i < size; ++i) {
+		seed = seed * 1103515245 + 12345;
+		ret += static_cast<char>(seed >> 16);
+	}
+	return ret;
+}
+}
+
+void CDeltaTest::tearDown()
+{
+	for (auto const& file : files_) {
+		fz::remove_file(fz::to_native(file));
+	}
+	files_.clear();
+}
+
+std::wstring CDeltaTest::write_file(std::wstring const& name, std::string const& data)
+{
+	fz::file f(fz::to_native(name), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(data.size()), f.write(data.c_str(), static_cast<int64_t>(data.size())));
+	files_.push_back(name);
+	return name;
+}
+
+std::string CDeltaTest::remote_hash(std::string const& remote, int64_t first, int64_t last)
+{
+	auto const file = write_file(L"deltatest_range.tmp", remote.substr(static_cast<size_t>(first), static_cast<size_t>(last - first + 1)));
+	return hash_local_file(file, file_hash_algorithm::sha256);
+}
+
+int64_t CDeltaTest::compare(std::string const& local, std::string const& remote)
+{
+	file_hash_chunks const chunks(static_cast<int64_t>(remote.size()));
+
+	std::vector<std::string> localHashes;
+	auto const file = write_file(L"deltatest_local.tmp", local);
+	hash_local_file_chunks(file, file_hash_algorithm::sha256, chunks.chunk_size(), chunks.size(), [&](std::string && hash) {
+		localHashes.emplace_back(std::move(hash));
+		return true;
+	});
+
+	return common_prefix(chunks, localHashes, [&](int64_t chunk) {
+		return remote_hash(remote, chunks.first(chunk), chunks.last(chunk));
+	});
+}
+
+void CDeltaTest::testChunks()
+{
+	file_hash_chunks const empty(0);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), empty.count());
+
+	// Small files are a single chunk
+	file_hash_chunks const small(1000);
+	CPPUNIT_ASSERT_EQUAL(int64_t(1), small.count());
+	CPPUNIT_ASSERT_EQUAL(mib, small.chunk_size());
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), small.first(0));
+	CPPUNIT_ASSERT_EQUAL(int64_t(999), small.last(0));
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), small.covered(1));
+
+	// Exact multiple of the minimum chunk size
+	file_hash_chunks const exact(3 * mib);
+	CPPUNIT_ASSERT_EQUAL(int64_t(3), exact.count());
+	CPPUNIT_ASSERT_EQUAL(2 * mib, exact.first(2));
+	CPPUNIT_ASSERT_EQUAL(3 * mib - 1, exact.last(2));
+	CPPUNIT_ASSERT_EQUAL(2 * mib, exact.covered(2));
+	CPPUNIT_ASSERT_EQUAL(3 * mib, exact.covered(3));
+
+	// Partial last chunk
+	file_hash_chunks const partial(3 * mib + 1);
+	CPPUNIT_ASSERT_EQUAL(int64_t(4), partial.count());
+	CPPUNIT_ASSERT_EQUAL(3 * mib, partial.first(3));
+	CPPUNIT_ASSERT_EQUAL(3 * mib, partial.last(3));
+	CPPUNIT_ASSERT_EQUAL(3 * mib + 1, partial.covered(4));
+
+	// Large files get no more than 64 chunks
+	for (int64_t const size : {64 * mib, 64 * mib + 1, 1000 * mib + 7, int64_t(5000000000)}) {
+		file_hash_chunks const chunks(size);
+		CPPUNIT_ASSERT(chunks.count() <= 64);
+		CPPUNIT_ASSERT(chunks.chunk_size() >= mib);
+		CPPUNIT_ASSERT_EQUAL(size - 1, chunks.last(chunks.count() - 1));
+		CPPUNIT_ASSERT(chunks.first(chunks.count() - 1) < size);
+		CPPUNIT_ASSERT_EQUAL(size, chunks.covered(chunks.count()));
+
+		// Chunks are adjacent
+		for (int64_t i = 1; i < chunks.count(); ++i) {
+			CPPUNIT_ASSERT_EQUAL(chunks.last(i - 1) + 1, chunks.first(i));
+		}
+	}
+}
+
+void CDeltaTest::testUploadOffset()
+{
+	// Nothing in common
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), delta_upload_offset(0, 100, true));
+
+	// Whole remote file matches, append
+	CPPUNIT_ASSERT_EQUAL(int64_t(100), delta_upload_offset(100, 100, true));
+	CPPUNIT_ASSERT_EQUAL(int64_t(100), delta_upload_offset(100, 100, false));
+
+	// Change in the middle needs REST STREAM
+	CPPUNIT_ASSERT_EQUAL(int64_t(50), delta_upload_offset(50, 100, true));
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), delta_upload_offset(50, 100, false));
+
+	// Bogus prefix
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), delta_upload_offset(101, 100, true));
+}
+
+void CDeltaTest::testLocalChunks()
+{
+	std::string const data = make_data(static_cast<size_t>(2 * mib + 12345), 1);
+	auto const file = write_file(L"deltatest_chunks.tmp", data);
+
+	file_hash_chunks const chunks(static_cast<int64_t>(data.size()));
+	CPPUNIT_ASSERT_EQUAL(int64_t(3), chunks.count());
+
+	std::vector<std::string> hashes;
+	auto const collect = [&](std::string && hash) {
+		hashes.emplace_back(std::move(hash));
+		return true;
+	};
+	CPPUNIT_ASSERT(hash_local_file_chunks(file, file_hash_algorithm::sha256, chunks.chunk_size(), chunks.size(), collect));
+	CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(chunks.count()), hashes.size());
+	for (int64_t i = 0; i < chunks.count(); ++i) {
+		CPPUNIT_ASSERT_EQUAL(remote_hash(data, chunks.first(i), chunks.last(i)), hashes[i]);
+	}
+
+	// Hashing only a prefix of the local file
+	hashes.clear();
+	file_hash_chunks const prefix(mib + 10);
+	CPPUNIT_ASSERT(hash_local_file_chunks(file, file_hash_algorithm::sha256, prefix.chunk_size(), prefix.size(), collect));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), hashes.size());
+	CPPUNIT_ASSERT_EQUAL(remote_hash(data, mib, mib + 9), hashes[1]);
+
+	// Stopping early
+	hashes.clear();
+	auto const first_only = [&](std::string && hash) {
+		hashes.emplace_back(std::move(hash));
+		return false;
+	};
+	CPPUNIT_ASSERT(hash_local_file_chunks(file, file_hash_algorithm::sha256, chunks.chunk_size(), chunks.size(), first_only));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), hashes.size());
+
+	// Local file shorter than the remote one
+	CPPUNIT_ASSERT(!hash_local_file_chunks(file, file_hash_algorithm::sha256, chunks.chunk_size(), chunks.size() + 1, [](std::string &&) { return true; }));
+}
+
+void CDeltaTest::testCommonPrefix()
+{
+	std::string const remote = make_data(static_cast<size_t>(3 * mib + 500), 2);
+
+	// Identical
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(remote.size()), compare(remote, remote));
+
+	// Appended to
+	std::string local = remote + make_data(1000, 3);
+	int64_t common = compare(local, remote);
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(remote.size()), common);
+	CPPUNIT_ASSERT_EQUAL(common, delta_upload_offset(common, static_cast<int64_t>(remote.size()), false));
+
+	// Modified in the third chunk
+	local = remote;
+	local[static_cast<size_t>(2 * mib + 17)] ^= 1;
+	common = compare(local, remote);
+	CPPUNIT_ASSERT_EQUAL(2 * mib, common);
+	CPPUNIT_ASSERT_EQUAL(2 * mib, delta_upload_offset(common, static_cast<int64_t>(remote.size()), true));
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), delta_upload_offset(common, static_cast<int64_t>(remote.size()), false));
+
+	// Modified in the partial last chunk
+	local = remote;
+	local.back() ^= 1;
+	CPPUNIT_ASSERT_EQUAL(3 * mib, compare(local, remote));
+
+	// Modified at the start
+	local = remote;
+	local[0] ^= 1;
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), compare(local, remote));
+
+	// Hashes not known yet end the prefix
+	file_hash_chunks const chunks(3 * mib);
+	auto const letters = [](int64_t chunk) {
+		return std::string(1, static_cast<char>('a' + chunk));
+	};
+	auto const first_two = [&](int64_t chunk) {
+		return chunk < 2 ? letters(chunk) : std::string();
+	};
+	CPPUNIT_ASSERT_EQUAL(3 * mib, common_prefix(chunks, {"a", "b", "c"}, letters));
+	CPPUNIT_ASSERT_EQUAL(2 * mib, common_prefix(chunks, {"a", "b", "c"}, first_two));
+	CPPUNIT_ASSERT_EQUAL(mib, common_prefix(chunks, {"a", "", "c"}, letters));
+	CPPUNIT_ASSERT_EQUAL(mib, common_prefix(chunks, {"a"}, letters));
+}
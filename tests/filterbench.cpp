@@ -0,0 +1,102 @@
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <cstdio>
+#include <random>
+
+/*
+ * Compares evaluating filters one condition at a time against
+ * compiled_filters on a synthetic corpus of one million names.
+ *
+ * Not part of the test suite, build with `make filterbench`.
+ */
+
+namespace {
+std::vector<CFilter> make_filters()
+{
+	std::vector<CFilter> filters;
+
+	auto add = [&filters](std::wstring const& name, bool matchCase, CFilter::t_matchType matchType, std::vector<std::pair<int, std::wstring>> const& conditions, t_filterType type = filter_name) {
+		CFilter filter;
+		filter.name = name;
+		filter.matchCase = matchCase;
+		filter.matchType = matchType;
+		for (auto const& c : conditions) {
+			CFilterCondition condition;
+			if (condition.set(type, c.second, c.first, matchCase)) {
+				filter.filters.push_back(condition);
+			}
+		}
+		filters.push_back(filter);
+	};
+
+	// Similar to the default filters
+	add(L"Temporary and backup files", false, CFilter::any, {{3, L".bak"}, {3, L".tmp"}, {3, L"~"}, {2, L".#"}, {1, L"thumbs.db"}, {1, L"desktop.ini"}});
+	add(L"VCS directories", true, CFilter::any, {{1, L"CVS"}, {1, L".svn"}, {1, L".git"}, {1, L".hg"}, {1, L"_darcs"}});
+	add(L"Build output", false, CFilter::any, {{0, L"/build/"}, {0, L"/node_modules/"}}, filter_path);
+	add(L"Object files", false, CFilter::any, {{3, L".o"}, {3, L".obj"}, {3, L".pyc"}, {5, L"."}});
+	add(L"Numbered logs", true, CFilter::any, {{4, L"^log[0-9]+\\.txt$"}});
+
+	return filters;
+}
+
+std::vector<std::pair<std::wstring, std::wstring>> make_corpus(size_t count)
+{
+	std::mt19937 rng(1);
+	std::vector<std::wstring> const stems = {L"report", L"IMG_", L"Thumbs", L"index", L"main", L"log", L"Desktop", L"data", L"README", L"backup"};
+	std::vector<std::wstring> const suffixes = {L".txt", L".jpg", L".TMP", L".bak", L".o", L".cpp", L".ini", L".db", L"", L"~", L".pyc", L".html"};
+	std::vector<std::wstring> const paths = {L"/home/user/src/project", L"/home/user/src/project/build/obj", L"/var/www/html", L"/srv/app/node_modules/lib", L"/home/user/Pictures/2021"};
+
+	std::vector<std::pair<std::wstring, std::wstring>> corpus;
+	corpus.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		std::wstring name = stems[rng() % stems.size()] + fz::to_wstring(rng() % 1000) + suffixes[rng() % suffixes.size()];
+		corpus.emplace_back(std::move(name), paths[rng() % paths.size()]);
+	}
+
+	return corpus;
+}
+}
+
+int main()
+{
+	auto const filters = make_filters();
+	auto const corpus = make_corpus(1000000);
+
+	fz::monotonic_clock start = fz::monotonic_clock::now();
+	size_t plain{};
+	std::vector<bool> results;
+	results.reserve(corpus.size());
+	for (auto const& entry : corpus) {
+		bool const filtered = filter_manager::FilenameFiltered(filters, entry.first, entry.second, false, 100, 0644, fz::datetime());
+		results.push_back(filtered);
+		plain += filtered ? 1 : 0;
+	}
+	auto const plain_time = fz::monotonic_clock::now() - start;
+
+	start = fz::monotonic_clock::now();
+	compiled_filters const compiled(filters);
+	size_t fast{};
+	size_t mismatches{};
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		bool const filtered = compiled.FilenameFiltered(corpus[i].first, corpus[i].second, false, 100, 0644, fz::datetime());
+		fast += filtered ? 1 : 0;
+		if (filtered != results[i]) {
+			++mismatches;
+		}
+	}
+	auto const compiled_time = fz::monotonic_clock::now() - start;
+
+	printf("%zu names, %zu filtered\n", corpus.size(), plain);
+	printf("Per condition: %lld ms\n", static_cast<long long>(plain_time.get_milliseconds()));
+	printf("Compiled:      %lld ms (including compilation)\n", static_cast<long long>(compiled_time.get_milliseconds()));
+
+	if (mismatches || fast != plain) {
+		printf("Mismatching results: %zu\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
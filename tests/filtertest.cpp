@@ -0,0 +1,272 @@
+#include "../src/commonui/filter.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <random>
+
+/*
+ * This testsuite asserts that compiled_filters evaluates filters exactly
+ * like filter_manager::FilenameFiltered does one condition at a time.
+ */
+
+class CFilterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFilterTest);
+	CPPUNIT_TEST(testMatcher);
+	CPPUNIT_TEST(testEmpty);
+	CPPUNIT_TEST(testStringConditions);
+	CPPUNIT_TEST(testMatchTypes);
+	CPPUNIT_TEST(testRandom);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testMatcher();
+	void testEmpty();
+	void testStringConditions();
+	void testMatchTypes();
+	void testRandom();
+
+protected:
+	struct file final
+	{
+		std::wstring name;
+		std::wstring path;
+		bool dir{};
+		int64_t size{-1};
+		int attributes{-1};
+		fz::datetime date;
+	};
+
+	// Asserts both evaluators agree on every file
+	void check(std::vector<CFilter> const& filters, std::vector<file> const& files);
+
+	static CFilter make_filter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::tuple<t_filterType, int, std::wstring>> const& conditions);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFilterTest);
+
+namespace {
+std::vector<std::wstring> const pieces = {L"a", L"b", L"ab", L"A", L"B", L".", L"txt", L"TXT", L"~", L"#", L"\u00e9", L"\u00c9", L"log", L"1", L"22"};
+std::vector<std::wstring> const paths = {L"/", L"/home/user", L"/home/user/ab", L"/srv/AB/txt", L"/srv/\u00c9t\u00e9", L"C:\\Data\\Log"};
+
+std::wstring make_string(std::mt19937 & rng, size_t max_pieces)
+{
+	std::wstring ret;
+	size_t const n = 1 + rng() % max_pieces;
+	for (size_t i = 0; i < n; ++i) {
+		ret += pieces[rng() % pieces.size()];
+	}
+	return ret;
+}
+}
+
+CFilter CFilterTest::make_filter(CFilter::t_matchType matchType, bool matchCase, std::vector<std::tuple<t_filterType, int, std::wstring>> const& conditions)
+{
+	CFilter filter;
+	filter.matchType = matchType;
+	filter.matchCase = matchCase;
+	for (auto const& c : conditions) {
+		CFilterCondition condition;
+		CPPUNIT_ASSERT(condition.set(std::get<0>(c), std::get<2>(c), std::get<1>(c), matchCase));
+		filter.filters.push_back(condition);
+	}
+	return filter;
+}
+
+void CFilterTest::check(std::vector<CFilter> const& filters, std::vector<file> const& files)
+{
+	compiled_filters const compiled(filters);
+	for (auto const& f : files) {
+		bool const expected = filter_manager::FilenameFiltered(filters, f.name, f.path, f.dir, f.size, f.attributes, f.date);
+		bool const actual = compiled.FilenameFiltered(f.name, f.path, f.dir, f.size, f.attributes, f.date);
+		if (expected != actual) {
+			std::string const msg = fz::sprintf("Mismatch for name '%s' in '%s', dir %d: expected %d", fz::to_utf8(f.name), fz::to_utf8(f.path), f.dir, expected);
+			CPPUNIT_FAIL(msg);
+		}
+	}
+}
+
+void CFilterTest::testMatcher()
+{
+	compiled_filters::matcher m;
+	int const he = m.add(L"he");
+	int const she = m.add(L"she");
+	int const his = m.add(L"his");
+	int const hers = m.add(L"hers");
+	m.build();
+
+	CPPUNIT_ASSERT_EQUAL(size_t(4), m.length(hers));
+
+	auto r = m.match(L"ushers");
+	CPPUNIT_ASSERT(r.found & (uint64_t(1) << he));
+	CPPUNIT_ASSERT(r.found & (uint64_t(1) << she));
+	CPPUNIT_ASSERT(r.found & (uint64_t(1) << hers));
+	CPPUNIT_ASSERT(!(r.found & (uint64_t(1) << his)));
+	CPPUNIT_ASSERT(r.at_end & (uint64_t(1) << hers));
+	CPPUNIT_ASSERT(!(r.at_end & (uint64_t(1) << he)));
+	CPPUNIT_ASSERT(!r.at_start);
+
+	r = m.match(L"hishe");
+	CPPUNIT_ASSERT(r.at_start & (uint64_t(1) << his));
+	CPPUNIT_ASSERT(r.at_end & (uint64_t(1) << she));
+	CPPUNIT_ASSERT(r.at_end & (uint64_t(1) << he));
+
+	r = m.match(L"");
+	CPPUNIT_ASSERT(!r.found);
+
+	compiled_filters::matcher full;
+	for (size_t i = 0; i < compiled_filters::matcher::max_patterns; ++i) {
+		CPPUNIT_ASSERT_EQUAL(static_cast<int>(i), full.add(fz::to_wstring(i)));
+	}
+	CPPUNIT_ASSERT_EQUAL(-1, full.add(L"x"));
+}
+
+void CFilterTest::testEmpty()
+{
+	compiled_filters const compiled{std::vector<CFilter>()};
+	CPPUNIT_ASSERT(compiled.empty());
+	CPPUNIT_ASSERT(!compiled.FilenameFiltered(L"foo", L"/", false, 1, 0644, fz::datetime()));
+
+	// A filter without conditions never matches
+	std::vector<CFilter> filters(1);
+	check(filters, {{L"foo", L"/", false, 1, 0644, fz::datetime()}, {L"bar", L"/", true, -1, -1, fz::datetime()}});
+}
+
+void CFilterTest::testStringConditions()
+{
+	std::vector<file> files;
+	for (auto const& name : {L"report.TXT", L"report.txt", L"TXT", L"txt", L".txt", L"Thumbs.db", L"thumbs.db", L"~lock", L"backup~", L"\u00c9t\u00e9.txt", L"\u00e9t\u00e9.TXT", L"a", L""}) {
+		for (auto const& path : {L"/home/user", L"/home/User/TXT", L"/srv/\u00e9t\u00e9"}) {
+			files.push_back({name, path, false, 10, 0644, fz::datetime()});
+			files.push_back({name, path, true, -1, 0755, fz::datetime()});
+		}
+	}
+
+	for (bool const matchCase : {false, true}) {
+		for (int condition = 0; condition <= 5; ++condition) {
+			for (auto const& value : {L"txt", L"TXT", L".txt", L"thumbs.db", L"~", L"\u00e9t\u00e9", L"^[a-z]+\\.txt$"}) {
+				if (condition == 4 && value[0] != '^') {
+					continue;
+				}
+				check({make_filter(CFilter::any, matchCase, {{filter_name, condition, value}})}, files);
+				check({make_filter(CFilter::any, matchCase, {{filter_path, condition, value}})}, files);
+			}
+		}
+	}
+
+	// Many string conditions sharing a matcher
+	CFilter filter = make_filter(CFilter::any, false, {{filter_name, 3, L".bak"}, {filter_name, 3, L".tmp"}, {filter_name, 3, L"~"}, {filter_name, 2, L".#"}, {filter_name, 1, L"thumbs.db"}, {filter_name, 0, L"txt"}});
+	filter.filterDirs = false;
+	check({filter}, files);
+}
+
+void CFilterTest::testMatchTypes()
+{
+	fz::datetime const date(fz::datetime::utc, 2020, 6, 15, 12, 0, 0);
+
+	std::vector<file> files;
+	for (auto const& name : {L"a.txt", L"b.TXT", L"ab", L"log1.txt"}) {
+		for (int64_t const size : {int64_t(-1), int64_t(0), int64_t(100), int64_t(5000)}) {
+			for (int const attributes : {-1, 0, 0644, 0755}) {
+				files.push_back({name, L"/home", false, size, attributes, date});
+				files.push_back({name, L"/home", false, size, attributes, fz::datetime()});
+			}
+		}
+		files.push_back({name, L"/home", true, -1, 0755, date});
+	}
+
+	for (auto const matchType : {CFilter::all, CFilter::any, CFilter::none, CFilter::not_all}) {
+		for (bool const matchCase : {false, true}) {
+			CFilter filter = make_filter(matchType, matchCase, {
+				{filter_name, 3, L".txt"},
+				{filter_size, 0, L"50"},
+				{filter_permissions, 2, L"1"},
+				{filter_date, 0, L"2021-01-01"},
+				{filter_name, 4, L"^[a-z]+[0-9]"}
+			});
+			check({filter}, files);
+
+			filter.filterFiles = false;
+			check({filter}, files);
+
+			filter.filterFiles = true;
+			filter.filterDirs = false;
+			check({filter}, files);
+		}
+	}
+}
+
+void CFilterTest::testRandom()
+{
+	std::mt19937 rng(42);
+
+	std::vector<std::wstring> const regexes = {L"^a", L"b$", L"[0-9]{2}", L"^(log|txt)", L"\\.txt$"};
+	std::vector<std::wstring> const dates = {L"2019-03-01", L"2020-06-15", L"2020-06-15 12:00"};
+
+	std::vector<fz::datetime> const file_dates = {fz::datetime(), fz::datetime(fz::datetime::utc, 2019, 3, 1), fz::datetime(fz::datetime::utc, 2020, 6, 15, 12, 0), fz::datetime(fz::datetime::utc, 2022, 1, 1, 0, 0, 0)};
+
+	std::vector<file> files;
+	for (size_t i = 0; i < 500; ++i) {
+		file f;
+		f.name = make_string(rng, 4);
+		f.path = paths[rng() % paths.size()];
+		f.dir = rng() % 4 == 0;
+		f.size = f.dir ? -1 : static_cast<int64_t>(rng() % 200);
+		f.attributes = (rng() % 10) ? static_cast<int>(rng() % 01000) : -1;
+		f.date = file_dates[rng() % file_dates.size()];
+		files.push_back(f);
+	}
+
+	for (size_t round = 0; round < 200; ++round) {
+		std::vector<CFilter> filters;
+		size_t const filter_count = 1 + rng() % 4;
+		for (size_t i = 0; i < filter_count; ++i) {
+			CFilter filter;
+			filter.matchType = static_cast<CFilter::t_matchType>(rng() % 4);
+			filter.matchCase = rng() % 2;
+			filter.filterFiles = rng() % 5 != 0;
+			filter.filterDirs = rng() % 5 != 0;
+
+			size_t const condition_count = 1 + rng() % 5;
+			for (size_t j = 0; j < condition_count; ++j) {
+				CFilterCondition condition;
+				bool ok{};
+				switch (rng() % 6) {
+				case 0:
+				case 1:
+				{
+					auto const type = (rng() % 3) ? filter_name : filter_path;
+					int const c = static_cast<int>(rng() % 6);
+					std::wstring const value = (c == 4) ? regexes[rng() % regexes.size()] : make_string(rng, 2);
+					ok = condition.set(type, value, c, filter.matchCase);
+					break;
+				}
+				case 2:
+					ok = condition.set(filter_size, fz::to_wstring(rng() % 200), static_cast<int>(rng() % 4), filter.matchCase);
+					break;
+				case 3:
+					ok = condition.set(filter_permissions, fz::to_wstring(rng() % 2), static_cast<int>(rng() % 9), filter.matchCase);
+					break;
+				case 4:
+					ok = condition.set(filter_attributes, fz::to_wstring(rng() % 2), static_cast<int>(rng() % 6), filter.matchCase);
+					break;
+				default:
+					ok = condition.set(filter_date, dates[rng() % dates.size()], static_cast<int>(rng() % 4), filter.matchCase);
+					break;
+				}
+				if (ok) {
+					filter.filters.push_back(condition);
+				}
+			}
+			filters.push_back(filter);
+		}
+
+		check(filters, files);
+	}
+}
@@ -0,0 +1,168 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/engine_context.h"
+#include "../src/include/engine_options.h"
+#include "../src/engine/metrics.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#ifndef __WXMSW__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string.h>
+
+/*
+ * This testsuite reads the engine metrics through the local socket.
+ */
+
+class CMetricsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CMetricsTest);
+	CPPUNIT_TEST(testPermissions);
+	CPPUNIT_TEST(testPlain);
+	CPPUNIT_TEST(testHttp);
+	CPPUNIT_TEST(testRemoved);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testPermissions();
+	void testPlain();
+	void testHttp();
+	void testRemoved();
+
+protected:
+	// Connects to the socket, sends the request and returns everything
+	// read until the server closes the connection.
+	std::string query(std::string const& request);
+
+	class options final : public COptionsBase
+	{
+	public:
+		options()
+		{
+			set(OPTION_METRICS_SOCKET, std::wstring_view(socket_path));
+		}
+
+		virtual void notify_changed() override {}
+	};
+
+	class converter final : public CustomEncodingConverterBase
+	{
+	public:
+		virtual std::wstring toLocal(std::wstring const&, char const* buffer, size_t len) const override
+		{
+			return fz::to_wstring(std::string(buffer, len));
+		}
+
+		virtual std::string toServer(std::wstring const&, wchar_t const* buffer, size_t len) const override
+		{
+			return fz::to_string(std::wstring(buffer, len));
+		}
+	};
+
+	static wchar_t const* const socket_path;
+
+	std::unique_ptr<options> options_;
+	converter converter_;
+	std::unique_ptr<CFileZillaEngineContext> context_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CMetricsTest);
+
+wchar_t const* const CMetricsTest::socket_path = L"metricstest.sock";
+
+void CMetricsTest::setUp()
+{
+	options_ = std::make_unique<options>();
+	context_ = std::make_unique<CFileZillaEngineContext>(*options_, converter_);
+}
+
+void CMetricsTest::tearDown()
+{
+	context_.reset();
+	options_.reset();
+}
+
+std::string CMetricsTest::query(std::string const& request)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	CPPUNIT_ASSERT(fd != -1);
+
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	std::string const path = fz::to_string(socket_path);
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+	if (connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr))) {
+		close(fd);
+		CPPUNIT_FAIL("Could not connect to metrics socket");
+	}
+
+	if (!request.empty()) {
+		CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(request.size()), write(fd, request.c_str(), request.size()));
+	}
+	shutdown(fd, SHUT_WR);
+
+	std::string ret;
+	char buf[1024];
+	ssize_t r;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		ret.append(buf, static_cast<size_t>(r));
+	}
+	close(fd);
+
+	return ret;
+}
+
+void CMetricsTest::testPermissions()
+{
+	struct stat buf;
+	CPPUNIT_ASSERT(!lstat(fz::to_string(socket_path).c_str(), &buf));
+	CPPUNIT_ASSERT(S_ISSOCK(buf.st_mode));
+	CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(buf.st_mode & (S_IRWXG | S_IRWXO)));
+}
+
+void CMetricsTest::testPlain()
+{
+	context_->GetMetrics().reconnect();
+	context_->GetMetrics().reconnect();
+
+	std::string const out = query(std::string());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), out.find("# HELP "));
+	CPPUNIT_ASSERT(out.find("# TYPE filezilla_reconnects_total counter\nfilezilla_reconnects_total 2\n") != std::string::npos);
+	CPPUNIT_ASSERT(out.find("\nfilezilla_engines 0\n") != std::string::npos);
+	CPPUNIT_ASSERT(out.find("\nfilezilla_errors_total{protocol=\"ftp\"} 0\n") != std::string::npos);
+	CPPUNIT_ASSERT(out.back() == '\n');
+}
+
+void CMetricsTest::testHttp()
+{
+	context_->GetMetrics().tls_handshake();
+
+	std::string const out = query("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+	size_t const pos = out.find("\r\n\r\n");
+	CPPUNIT_ASSERT(pos != std::string::npos);
+	std::string const headers = out.substr(0, pos + 2);
+	std::string const body = out.substr(pos + 4);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), headers.find("HTTP/1.0 200 OK\r\n"));
+	CPPUNIT_ASSERT(headers.find("\r\nContent-Length: " + fz::to_string(body.size()) + "\r\n") != std::string::npos);
+	CPPUNIT_ASSERT(body.find("\nfilezilla_tls_handshakes_total 1\n") != std::string::npos);
+
+	std::string const rejected = query("POST /metrics HTTP/1.1\r\n\r\n");
+	CPPUNIT_ASSERT_EQUAL(size_t(0), rejected.find("HTTP/1.0 405 "));
+}
+
+void CMetricsTest::testRemoved()
+{
+	context_.reset();
+
+	struct stat buf;
+	CPPUNIT_ASSERT(lstat(fz::to_string(socket_path).c_str(), &buf) == -1);
+}
+#endif
@@ -0,0 +1,117 @@
+#include "../src/include/serverpath.h"
+
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <unordered_set>
+
+/*
+ * Exercises CServerPath the way the directory cache, the path cache and
+ * recursive operations use it, on a synthetic tree of several million
+ * directories.
+ *
+ * Not part of the test suite, build with `make pathbench`.
+ */
+
+namespace {
+std::vector<CServerPath> make_tree(size_t count)
+{
+	std::mt19937 rng(1);
+	std::vector<std::wstring> const names = {L"src", L"include", L"build", L"data", L"2021", L"Photos", L"backup", L"lib", L"node_modules", L"docs"};
+
+	std::vector<CServerPath> paths;
+	paths.reserve(count);
+	paths.emplace_back(L"/home/user");
+	while (paths.size() < count) {
+		// Mostly descend into recently added directories, like a recursive
+		// listing does.
+		size_t const window = std::min<size_t>(paths.size(), 1000);
+		CServerPath path = paths[paths.size() - 1 - rng() % window];
+		if (path.SegmentCount() > 12) {
+			path = paths[rng() % paths.size()];
+		}
+		path.AddSegment(names[rng() % names.size()] + fz::to_wstring(rng() % 100));
+		paths.push_back(std::move(path));
+	}
+
+	return paths;
+}
+
+void report(char const* name, fz::duration const& d, size_t result)
+{
+	printf("%-36s %6lld ms  (%zu)\n", name, static_cast<long long>(d.get_milliseconds()), result);
+}
+}
+
+int main()
+{
+	fz::monotonic_clock start = fz::monotonic_clock::now();
+	auto const paths = make_tree(2000000);
+	report("Building paths", fz::monotonic_clock::now() - start, paths.size());
+
+	start = fz::monotonic_clock::now();
+	std::set<CServerPath> ordered;
+	for (auto const& path : paths) {
+		ordered.insert(path);
+	}
+	size_t found{};
+	for (auto const& path : paths) {
+		found += ordered.count(path.GetParent());
+	}
+	report("std::set insert and parent lookup", fz::monotonic_clock::now() - start, found);
+
+	start = fz::monotonic_clock::now();
+	std::unordered_set<CServerPath> visited;
+	for (auto const& path : paths) {
+		visited.insert(path);
+	}
+	found = 0;
+	for (auto const& path : paths) {
+		found += visited.count(path.GetParent());
+	}
+	report("Visited set insert and parent lookup", fz::monotonic_clock::now() - start, found);
+
+	start = fz::monotonic_clock::now();
+	std::map<CServerPath, CServerPath> cache;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		cache.emplace(paths[i], paths[paths.size() - 1 - i]);
+	}
+	found = 0;
+	for (auto const& path : paths) {
+		auto it = cache.find(path);
+		if (it != cache.end() && it->second.HasParent()) {
+			++found;
+		}
+	}
+	report("Path map insert and lookup", fz::monotonic_clock::now() - start, found);
+
+	start = fz::monotonic_clock::now();
+	found = 0;
+	CServerPath const root(L"/home/user/src1");
+	for (auto const& path : paths) {
+		if (path.IsSubdirOf(root, false)) {
+			++found;
+		}
+	}
+	report("IsSubdirOf", fz::monotonic_clock::now() - start, found);
+
+	start = fz::monotonic_clock::now();
+	found = 0;
+	for (size_t i = 1; i < paths.size(); ++i) {
+		if (paths[i] == paths[i - 1] || paths[i].GetParent() == paths[i - 1]) {
+			++found;
+		}
+	}
+	report("Comparing with neighbours", fz::monotonic_clock::now() - start, found);
+
+	if (visited.size() != ordered.size()) {
+		printf("Mismatching set sizes: %zu %zu\n", ordered.size(), visited.size());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include "../src/engine/pathcache.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that CPathCache keeps its reverse index in sync with
+ * the cached entries, so that invalidating a path removes exactly the entries
+ * at or below it and leaves no stale index nodes behind.
+ */
+
+class CPathCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CPathCacheTest);
+	CPPUNIT_TEST(testOverwrite);
+	CPPUNIT_TEST(testSourceIsTarget);
+	CPPUNIT_TEST(testInvalidateSubtree);
+	CPPUNIT_TEST(testMVS);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testOverwrite();
+	void testSourceIsTarget();
+	void testInvalidateSubtree();
+	void testMVS();
+
+protected:
+	CServer const server_{FTP, DEFAULT, L"localhost", 21};
+	CServer const mvsServer_{FTP, MVS, L"localhost", 21};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CPathCacheTest);
+
+void CPathCacheTest::testOverwrite()
+{
+	CPathCache cache;
+
+	CServerPath const source(L"/x");
+	cache.Store(server_, CServerPath(L"/a/b"), source);
+	CPPUNIT_ASSERT(cache.Lookup(server_, source) == CServerPath(L"/a/b"));
+
+	// /, /x, /a and /a/b
+	CPPUNIT_ASSERT_EQUAL(size_t(4), cache.GetIndexSize(server_));
+
+	// Overwriting drops the old target and its ancestors that lead nowhere else
+	cache.Store(server_, CServerPath(L"/c"), source);
+	CPPUNIT_ASSERT(cache.Lookup(server_, source) == CServerPath(L"/c"));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), cache.GetIndexSize(server_));
+
+	// The old target no longer leads to the entry
+	cache.InvalidatePath(server_, CServerPath(L"/a"), L"b");
+	CPPUNIT_ASSERT(cache.Lookup(server_, source) == CServerPath(L"/c"));
+
+	// Storing the same target again changes nothing
+	cache.Store(server_, CServerPath(L"/c"), source);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), cache.GetIndexSize(server_));
+
+	// But the new one does
+	cache.InvalidatePath(server_, CServerPath(L"/"), L"c");
+	CPPUNIT_ASSERT(cache.Lookup(server_, source).empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), cache.GetIndexSize(server_));
+}
+
+void CPathCacheTest::testSourceIsTarget()
+{
+	CPathCache cache;
+
+	CServerPath const path(L"/a");
+	cache.Store(server_, path, path);
+	CPPUNIT_ASSERT(cache.Lookup(server_, path) == path);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.GetIndexSize(server_));
+
+	// The node of the source has to survive the target moving away
+	cache.Store(server_, CServerPath(L"/a/b"), path);
+	CPPUNIT_ASSERT(cache.Lookup(server_, path) == CServerPath(L"/a/b"));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), cache.GetIndexSize(server_));
+
+	cache.Store(server_, path, path);
+	CPPUNIT_ASSERT(cache.Lookup(server_, path) == path);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.GetIndexSize(server_));
+
+	// Both references get removed
+	cache.InvalidatePath(server_, path);
+	CPPUNIT_ASSERT(cache.Lookup(server_, path).empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), cache.GetIndexSize(server_));
+}
+
+void CPathCacheTest::testInvalidateSubtree()
+{
+	CPathCache cache;
+
+	CServerPath const srv(L"/srv");
+	CServerPath const a(L"/srv/a");
+	CServerPath const y(L"/srv/a/y");
+	CServerPath const link(L"/srv/a/link");
+	CServerPath const root(L"/");
+
+	// Below /srv/a
+	cache.Store(server_, CServerPath(L"/srv/a/x"), a, L"x");
+	cache.Store(server_, CServerPath(L"/srv/a/y/z"), y, L"z");
+
+	// Source below /srv/a, target outside
+	cache.Store(server_, CServerPath(L"/home/user"), link);
+
+	// Siblings, one of them sharing the name as prefix
+	cache.Store(server_, CServerPath(L"/srv/b"), srv, L"b");
+	cache.Store(server_, CServerPath(L"/srv/ab"), srv, L"ab");
+	cache.Store(server_, CServerPath(L"/home"), root, L"home");
+
+	// /, /srv, /srv/a, /srv/a/x, /srv/a/y, /srv/a/y/z, /srv/a/link, /home, /home/user, /srv/b and /srv/ab
+	CPPUNIT_ASSERT_EQUAL(size_t(11), cache.GetIndexSize(server_));
+
+	cache.InvalidatePath(server_, srv, L"a");
+
+	CPPUNIT_ASSERT(cache.Lookup(server_, a, L"x").empty());
+	CPPUNIT_ASSERT(cache.Lookup(server_, y, L"z").empty());
+	CPPUNIT_ASSERT(cache.Lookup(server_, link).empty());
+
+	CPPUNIT_ASSERT(cache.Lookup(server_, srv, L"b") == CServerPath(L"/srv/b"));
+	CPPUNIT_ASSERT(cache.Lookup(server_, srv, L"ab") == CServerPath(L"/srv/ab"));
+	CPPUNIT_ASSERT(cache.Lookup(server_, root, L"home") == CServerPath(L"/home"));
+
+	// /, /srv, /srv/b, /srv/ab and /home
+	CPPUNIT_ASSERT_EQUAL(size_t(5), cache.GetIndexSize(server_));
+
+	cache.InvalidatePath(server_, srv, L"b");
+	cache.InvalidatePath(server_, srv, L"ab");
+	CPPUNIT_ASSERT(cache.Lookup(server_, root, L"home") == CServerPath(L"/home"));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.GetIndexSize(server_));
+
+	cache.InvalidatePath(server_, root, L"home");
+	CPPUNIT_ASSERT_EQUAL(size_t(0), cache.GetIndexSize(server_));
+}
+
+void CPathCacheTest::testMVS()
+{
+	CPathCache cache;
+
+	// 'FOO.BAR.' is a prefix, 'FOO.BAR' is not. Both have 'FOO.' as parent.
+	CServerPath const prefix(L"'FOO.BAR.'", MVS);
+	CServerPath const dataset(L"'FOO.BAR'", MVS);
+	CServerPath const member(L"'FOO.BAR.BAZ'", MVS);
+	CPPUNIT_ASSERT(prefix != dataset);
+
+	cache.Store(mvsServer_, prefix, prefix);
+	cache.Store(mvsServer_, dataset, dataset);
+	cache.Store(mvsServer_, member, member);
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, prefix) == prefix);
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, dataset) == dataset);
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, member) == member);
+
+	// 'FOO.', 'FOO.BAR.', 'FOO.BAR' and 'FOO.BAR.BAZ'
+	CPPUNIT_ASSERT_EQUAL(size_t(4), cache.GetIndexSize(mvsServer_));
+
+	// The dataset is not below the prefix
+	cache.InvalidatePath(mvsServer_, prefix);
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, prefix).empty());
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, member).empty());
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, dataset) == dataset);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.GetIndexSize(mvsServer_));
+
+	// Nor is the prefix below the dataset
+	cache.Store(mvsServer_, prefix, prefix);
+	cache.InvalidatePath(mvsServer_, dataset);
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, dataset).empty());
+	CPPUNIT_ASSERT(cache.Lookup(mvsServer_, prefix) == prefix);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), cache.GetIndexSize(mvsServer_));
+
+	cache.InvalidatePath(mvsServer_, prefix);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), cache.GetIndexSize(mvsServer_));
+
+	// Servers are independent
+	CPPUNIT_ASSERT_EQUAL(size_t(0), cache.GetIndexSize(server_));
+}
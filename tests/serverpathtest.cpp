@@ -16,6 +16,7 @@ class CServerPathTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testGetCommonParent);
 	CPPUNIT_TEST(testFormatFilename);
 	CPPUNIT_TEST(testChangePath);
+	CPPUNIT_TEST(testInterning);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -29,6 +30,7 @@ public:
 	void testGetCommonParent();
 	void testFormatFilename();
 	void testChangePath();
+	void testInterning();
 
 protected:
 };
@@ -686,3 +688,30 @@ void CServerPathTest::testChangePath()
 	}
 
 }
+
+void CServerPathTest::testInterning()
+{
+	CServerPath unix1(L"/foo/bar/baz");
+	CServerPath unix2(L"/foo");
+	CPPUNIT_ASSERT(unix2.AddSegment(L"bar") && unix2.AddSegment(L"baz"));
+	CPPUNIT_ASSERT(unix1 == unix2 && std::hash<CServerPath>()(unix1) == std::hash<CServerPath>()(unix2));
+
+	CServerPath unix3;
+	CPPUNIT_ASSERT(unix3.SetSafePath(unix1.GetSafePath()) && unix3 == unix1);
+	CPPUNIT_ASSERT(unix1.GetParent() == CServerPath(L"/foo/bar") && unix1.GetParent().GetParent().GetParent() == CServerPath(L"/"));
+
+	// Same segments, different drive or type
+	CServerPath const dos1(L"c:\\foo\\bar");
+	CServerPath const dos2(L"d:\\foo\\bar");
+	CServerPath const unix4(L"/foo/bar");
+	CServerPath const cygwin1(L"/foo/bar", CYGWIN);
+	CPPUNIT_ASSERT(dos1 != dos2 && unix4 != cygwin1);
+	CPPUNIT_ASSERT(dos1 < dos2 || dos2 < dos1);
+	CPPUNIT_ASSERT(unix4 < cygwin1 || cygwin1 < unix4);
+
+	// The prefix is part of the identity
+	CServerPath const vms1(L"FOO:[BAR.BAZ]");
+	CServerPath const vms2(L"QUX:[BAR.BAZ]");
+	CPPUNIT_ASSERT(vms1 != vms2 && vms1.GetParent() != vms2.GetParent());
+	CPPUNIT_ASSERT(vms1.GetParent() == CServerPath(L"FOO:[BAR]"));
+}